@@ -5,6 +5,7 @@
 #pragma once
 
 #include <filesystem>
+#include <string_view>
 #include <unordered_map>
 
 #include <metalchat/dtype.h>
@@ -27,7 +28,12 @@ namespace metalchat {
 static const std::string framework_identifier = __lib_metalchat_framework_identifier;
 
 
+/// A hash function for strings, this hash is transparent, therefore it could be used
+/// to lookup elements of associative containers using string views without a copy of the
+/// key (when container is also specified with a transparent equality operator).
 struct _StringHash {
+    using is_transparent = void;
+
     std::size_t
     operator()(const void* s, std::size_t len) const noexcept;
 
@@ -39,6 +45,13 @@ struct _StringHash {
 
         return operator()(s.data(), sizeof(typename String::value_type) * s.size());
     }
+
+    template <typename CharT>
+    std::size_t
+    operator()(const std::basic_string_view<CharT>& s) const noexcept
+    {
+        return operator()(s.data(), sizeof(CharT) * s.size());
+    }
 };
 
 
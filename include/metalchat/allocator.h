@@ -5,9 +5,12 @@
 #pragma once
 
 #include <algorithm>
+#include <bit>
 #include <concepts>
 #include <mutex>
 #include <new>
+#include <unordered_map>
+#include <vector>
 // TODO: Move implementation to .cc file
 #include <unistd.h>
 
@@ -772,6 +775,162 @@ template <> struct random_memory_allocator<void> {
 };
 
 
+/// Statistics of live allocations of the \ref mapped_memory_allocator.
+///
+/// Allocations are accounted in the mode accepted by the kernel (see \ref memory_map_mode),
+/// which is not necessarily the achieved state of the memory.
+struct mapped_memory_stats {
+    /// A number of bytes mapped with pages of the default size.
+    std::size_t normal_bytes = 0;
+    /// A number of bytes mapped from the reserved pool of huge pages (`MAP_HUGETLB`).
+    std::size_t hugetlb_bytes = 0;
+    /// A number of bytes advised to be backed by transparent huge pages (`MADV_HUGEPAGE`).
+    std::size_t transparent_hugepage_bytes = 0;
+    /// A number of bytes, which page tables were requested to be populated in advance.
+    std::size_t populate_requested_bytes = 0;
+    /// A number of bytes bound to NUMA nodes with the policy of the allocator.
+    std::size_t numa_bound_bytes = 0;
+    /// A number of resident bytes of live allocations on every NUMA node (see
+    /// \ref memory_numa_nodes), empty when the placement could not be queried.
+    std::vector<std::size_t> node_bytes;
+};
+
+
+/// This class creates host containers from anonymous memory mappings.
+///
+/// Unlike \ref random_memory_allocator, the memory of every container is mapped directly from
+/// the kernel with the specified \ref memory_map_options, so that large host buffers could be
+/// backed by huge pages and populated in advance. When the requested mode is not supported,
+/// the allocator falls back to the default pages, modes accepted by the kernel for live
+/// allocations are reported by \ref stats.
+///
+/// The allocator places memory across NUMA nodes according to the \ref numa_policy of the
+/// options, e.g. weights shared by all threads could be interleaved across nodes, while a
+/// shard of weights could be bound to the node of threads processing it.
+///
+/// Every allocation is a separate memory mapping, therefore the allocator is intended for large
+/// buffers, e.g. as an underlying allocator of \ref arena_allocator_adapter or
+/// \ref caching_allocator_adapter. Copies of the allocator share statistics.
+///
+/// Example:
+/// ```cpp
+/// auto options = memory_map_options{.hugepage = true, .populate = true};
+/// auto alloc = arena_allocator_adapter(mapped_memory_allocator(options), 64 << 20);
+///
+/// auto shard_options = memory_map_options{.numa = numa_policy::bind(1)};
+/// auto shard_alloc = mapped_memory_allocator(shard_options);
+/// ```
+class mapped_memory_allocator {
+public:
+    using value_type = void;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+    using size_type = std::size_t;
+    using container_type = random_memory_container<void>;
+    using container_pointer = std::shared_ptr<container_type>;
+
+    /// Constructs a new mapped memory allocator.
+    ///
+    /// \param options Options of the memory mappings.
+    mapped_memory_allocator(const memory_map_options& options = {})
+    : _M_options(options),
+      _M_state(std::make_shared<_State>())
+    {}
+
+    container_pointer
+    allocate(size_type size)
+    {
+        auto [memory_ptr, mode] = memory_map(size, _M_options);
+        const std::scoped_lock lock(_M_state->mutex);
+
+        // Expired allocations are removed only before the list grows, so that the cost of
+        // removal is amortized over allocations.
+        auto& allocations = _M_state->allocations;
+        if (allocations.size() == allocations.capacity()) {
+            std::erase_if(allocations, [](const auto& a) { return a.memory.expired(); });
+        }
+
+        allocations.push_back({memory_ptr, size, mode});
+        return std::make_shared<container_type>(memory_ptr, size);
+    }
+
+    container_pointer
+    allocate(const_pointer ptr, size_type size)
+    {
+        auto container_ptr = allocate(size);
+        std::memcpy(container_ptr->data(), ptr, size);
+        return container_ptr;
+    }
+
+    /// Returns options of the memory mappings.
+    const memory_map_options&
+    options() const
+    {
+        return _M_options;
+    }
+
+    /// Returns the number of bytes of live allocations in every mode of the memory mapping.
+    ///
+    /// Placement of live allocations across NUMA nodes is queried from the kernel on every
+    /// call, so the method is intended for reports rather than for the hot path.
+    mapped_memory_stats
+    stats() const
+    {
+        const std::scoped_lock lock(_M_state->mutex);
+        auto& allocations = _M_state->allocations;
+
+        std::erase_if(allocations, [](const auto& a) { return a.memory.expired(); });
+
+        mapped_memory_stats stats;
+        stats.node_bytes.assign(numa_node_count(), 0);
+
+        bool node_placement = true;
+        for (const auto& [memory_weak_ptr, size, mode] : allocations) {
+            switch (mode.pages) {
+            case memory_page_kind::normal:
+                stats.normal_bytes += size;
+                break;
+            case memory_page_kind::hugetlb:
+                stats.hugetlb_bytes += size;
+                break;
+            case memory_page_kind::transparent_hugepage:
+                stats.transparent_hugepage_bytes += size;
+                break;
+            }
+            stats.populate_requested_bytes += mode.populate_requested ? size : 0;
+            stats.numa_bound_bytes += mode.numa_bound ? size : 0;
+
+            auto memory_ptr = memory_weak_ptr.lock();
+            auto node_bytes = memory_numa_nodes(memory_ptr.get(), size);
+            node_placement = node_placement && node_bytes.size() == stats.node_bytes.size();
+            for (std::size_t node = 0; node_placement && node < node_bytes.size(); node++) {
+                stats.node_bytes[node] += node_bytes[node];
+            }
+        }
+
+        if (!node_placement) {
+            stats.node_bytes.clear();
+        }
+        return stats;
+    }
+
+private:
+    struct _Allocation {
+        std::weak_ptr<void> memory;
+        size_type size;
+        memory_map_mode mode;
+    };
+
+    struct _State {
+        std::mutex mutex;
+        std::vector<_Allocation> allocations;
+    };
+
+    memory_map_options _M_options;
+    std::shared_ptr<_State> _M_state;
+};
+
+
 template <typename T> class nocopy_allocator<T, random_memory_allocator<T>> {
 private:
     using allocator_type = random_memory_allocator<T>;
@@ -1136,4 +1295,412 @@ private:
 };
 
 
+/// Statistics of the \ref arena_allocator_adapter.
+struct arena_stats {
+    /// A size of the arena region in bytes.
+    std::size_t capacity = 0;
+    /// A number of bytes allocated since the last reset, including the alignment padding.
+    std::size_t size = 0;
+    /// The maximum number of bytes allocated between two resets.
+    std::size_t peak_size = 0;
+    /// A number of times the arena region was exhausted, and an additional region was allocated.
+    std::size_t overflows = 0;
+    /// A number of resets of the arena.
+    std::size_t resets = 0;
+};
+
+
+/// This class creates containers by bumping an offset within a large reusable region.
+///
+/// The adapter is designed for transient tensors, that live within a single step of the
+/// computation (e.g. intermediate results of a decoding step). Allocation is a single increment
+/// of the offset, and all allocations are released at once with \ref reset in constant time,
+/// so that the region is reused by the next step without returning the memory to the
+/// underlying allocator.
+///
+/// When the region is exhausted, the adapter allocates an additional region from the underlying
+/// allocator instead of failing, containers allocated before remain valid. On the next reset,
+/// the arena grows to accommodate all allocations of the step within a single region.
+///
+/// Copies of the adapter share the same arena, the adapter is a \ref hardware_allocator, when
+/// the underlying allocator is a hardware allocator, and could be used with host allocators
+/// like \ref random_memory_allocator.
+///
+/// \warning Containers allocated by the arena must not be used after the reset of the arena,
+/// since their memory is handed out to the subsequent allocations.
+///
+/// Example:
+/// ```cpp
+/// auto alloc = arena_allocator_adapter(random_memory_allocator<void>(), 64 << 20);
+///
+/// for (std::size_t step = 0; step < 100; step++) {
+///     auto container_ptr = alloc.allocate(4096);
+///     // Use the container within a step.
+///     alloc.reset();
+/// }
+///
+/// std::cout << alloc.stats().peak_size << std::endl;
+/// ```
+template <allocator_t<void> Allocator> class arena_allocator_adapter {
+public:
+    using value_type = Allocator::value_type;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+    using size_type = Allocator::size_type;
+    using container_type = Allocator::container_type;
+    using container_pointer = Allocator::container_pointer;
+
+    /// The default alignment of allocations in bytes.
+    static constexpr size_type default_alignment = 256;
+
+    /// Constructs a new arena allocator, the region of the arena is allocated on the first
+    /// allocation.
+    ///
+    /// \param alloc An allocator used to allocate regions of the arena.
+    /// \param capacity An initial size of the arena region in bytes.
+    /// \param alignment An alignment of allocations in bytes (must be a power of two).
+    arena_allocator_adapter(
+        const Allocator& alloc, size_type capacity, size_type alignment = default_alignment
+    )
+    : _M_state(std::make_shared<_State>(alloc, capacity, alignment))
+    {}
+
+    /// Constructs a new arena allocator, the region of the arena is allocated on the first
+    /// allocation.
+    ///
+    /// \param alloc An allocator used to allocate regions of the arena.
+    /// \param capacity An initial size of the arena region in bytes.
+    /// \param alignment An alignment of allocations in bytes (must be a power of two).
+    arena_allocator_adapter(
+        Allocator&& alloc, size_type capacity, size_type alignment = default_alignment
+    )
+    : _M_state(std::make_shared<_State>(std::move(alloc), capacity, alignment))
+    {}
+
+    container_pointer
+    allocate(size_type size)
+    {
+        const std::scoped_lock lock(_M_state->mutex);
+        auto& state = *_M_state;
+
+        auto offset = align(state.offset, state.alignment);
+        auto padding = offset - state.offset;
+
+        if (state.region == nullptr || offset + size > state.region_size) {
+            // The region is exhausted, containers that were allocated from the region keep
+            // it alive, so the new region is allocated for the rest of the step.
+            if (state.region != nullptr) {
+                state.overflowed = true;
+                state.stats.overflows++;
+            }
+
+            state.region_size = std::max(state.stats.capacity, align(size, state.alignment));
+            state.region = state.alloc.allocate(state.region_size);
+            offset = 0;
+            padding = 0;
+        }
+
+        state.stats.size += padding + size;
+        state.stats.peak_size = std::max(state.stats.peak_size, state.stats.size);
+        state.offset = offset + size;
+
+        return _Container_traits::offset(state.region, offset);
+    }
+
+    container_pointer
+    allocate(const_pointer ptr, size_type size)
+    {
+        auto container_ptr = allocate(size);
+        std::memcpy(container_ptr->data(), ptr, size);
+        return container_ptr;
+    }
+
+    /// Release all allocations of the arena in constant time.
+    ///
+    /// When the arena overflowed since the last reset, the capacity of the arena is increased
+    /// to fit all allocations, and the region is allocated again on the next allocation.
+    void
+    reset()
+    {
+        const std::scoped_lock lock(_M_state->mutex);
+        auto& state = *_M_state;
+
+        if (state.overflowed) {
+            auto capacity = std::max(state.stats.capacity * 2, state.stats.size);
+            state.stats.capacity = align(capacity, state.alignment);
+            state.region = nullptr;
+            state.overflowed = false;
+        }
+
+        state.offset = 0;
+        state.stats.size = 0;
+        state.stats.resets++;
+    }
+
+    /// Returns statistics of the arena.
+    arena_stats
+    stats() const
+    {
+        const std::scoped_lock lock(_M_state->mutex);
+        return _M_state->stats;
+    }
+
+private:
+    using _Container_traits = container_traits<container_type>;
+
+    struct _State {
+        Allocator alloc;
+        std::mutex mutex;
+        container_pointer region;
+        size_type region_size;
+        size_type offset;
+        size_type alignment;
+        bool overflowed;
+        arena_stats stats;
+
+        _State(const Allocator& a, size_type capacity, size_type alignment)
+        : alloc(a),
+          mutex(),
+          region(nullptr),
+          region_size(0),
+          offset(0),
+          alignment(alignment),
+          overflowed(false),
+          stats({.capacity = capacity})
+        {
+            if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+                throw std::invalid_argument(std::format(
+                    "arena_allocator_adapter: alignment {} is not a power of two", alignment
+                ));
+            }
+        }
+    };
+
+    static size_type
+    align(size_type size, size_type alignment)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    std::shared_ptr<_State> _M_state;
+};
+
+
+/// Statistics of the \ref caching_allocator_adapter.
+struct caching_stats {
+    /// A number of allocations served from cached blocks.
+    std::size_t hits = 0;
+    /// A number of allocations served by the underlying allocator.
+    std::size_t misses = 0;
+    /// A number of released blocks returned to the underlying allocator, since the cache
+    /// reached its limit.
+    std::size_t evictions = 0;
+    /// A number of bytes of blocks, that are currently in use.
+    std::size_t bytes_in_use = 0;
+    /// A number of bytes requested by the allocations, that are currently in use.
+    std::size_t requested_bytes = 0;
+    /// A number of bytes of blocks, that are cached for reuse.
+    std::size_t cached_bytes = 0;
+
+    /// Returns a fraction of allocations served from cached blocks.
+    double
+    hit_rate() const
+    {
+        auto total = hits + misses;
+        return total == 0 ? 0.0 : double(hits) / double(total);
+    }
+
+    /// Returns a fraction of bytes in use, that are wasted due to rounding of allocations
+    /// to size classes.
+    double
+    fragmentation() const
+    {
+        return bytes_in_use == 0 ? 0.0 : 1.0 - double(requested_bytes) / double(bytes_in_use);
+    }
+};
+
+
+/// This class recycles containers of the underlying allocator.
+///
+/// Sizes of allocations are rounded up to size classes: there are four classes between two
+/// consecutive powers of two (e.g. 640, 768, 896, and 1024 bytes), so the rounding wastes at
+/// most a quarter of the allocation. Every class keeps a free list of released blocks, when a
+/// container is destroyed, its block is returned to the free list of the class instead of the
+/// underlying allocator, and the next allocation of the same class reuses the block.
+///
+/// The number of cached bytes is limited, blocks released above the limit are returned to the
+/// underlying allocator. Copies of the adapter share the same cache, and the adapter is a
+/// \ref hardware_allocator, when the underlying allocator is a hardware allocator.
+///
+/// \note The size of containers is the size of the class, which might be larger than the
+/// requested size.
+///
+/// Example:
+/// ```cpp
+/// auto alloc = caching_allocator_adapter(random_memory_allocator<void>(), 1 << 30);
+/// {
+///     auto container_ptr = alloc.allocate(1000);
+/// }
+/// // The block of the released container is reused.
+/// auto container_ptr = alloc.allocate(1000);
+/// std::cout << alloc.stats().hit_rate() << std::endl;
+/// ```
+template <allocator_t<void> Allocator> class caching_allocator_adapter {
+public:
+    using value_type = Allocator::value_type;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+    using size_type = Allocator::size_type;
+    using container_type = Allocator::container_type;
+    using container_pointer = Allocator::container_pointer;
+
+    /// The size of the smallest size class in bytes.
+    static constexpr size_type min_class_size = 256;
+
+    /// Constructs a new caching allocator.
+    ///
+    /// \param alloc An allocator used to allocate blocks.
+    /// \param max_cached_size The maximum number of bytes of cached blocks.
+    caching_allocator_adapter(const Allocator& alloc, size_type max_cached_size)
+    : _M_state(std::make_shared<_State>(alloc, max_cached_size))
+    {}
+
+    /// Constructs a new caching allocator.
+    ///
+    /// \param alloc An allocator used to allocate blocks.
+    /// \param max_cached_size The maximum number of bytes of cached blocks.
+    caching_allocator_adapter(Allocator&& alloc, size_type max_cached_size)
+    : _M_state(std::make_shared<_State>(std::move(alloc), max_cached_size))
+    {}
+
+    container_pointer
+    allocate(size_type size)
+    {
+        auto class_size = size_class(size);
+        container_pointer block = nullptr;
+
+        {
+            const std::scoped_lock lock(_M_state->mutex);
+            auto& state = *_M_state;
+            auto& blocks = state.free_lists[class_size];
+
+            if (!blocks.empty()) {
+                block = std::move(blocks.back());
+                blocks.pop_back();
+                state.stats.cached_bytes -= class_size;
+                state.stats.hits++;
+            } else {
+                state.stats.misses++;
+            }
+
+            state.stats.bytes_in_use += class_size;
+            state.stats.requested_bytes += size;
+        }
+
+        if (block == nullptr) {
+            try {
+                block = _M_state->alloc.allocate(class_size);
+            } catch (...) {
+                _M_state->release(class_size, size);
+                throw;
+            }
+        }
+
+        // The returned container shares the block, the deleter returns the block to the
+        // free list, once the last reference to the container is destroyed.
+        auto container_ptr = block.get();
+        auto deleter = [state = _M_state, block = std::move(block), class_size,
+                        size](container_type*) mutable {
+            state->release(std::move(block), class_size, size);
+        };
+
+        return container_pointer(container_ptr, std::move(deleter));
+    }
+
+    container_pointer
+    allocate(const_pointer ptr, size_type size)
+    {
+        auto container_ptr = allocate(size);
+        std::memcpy(container_ptr->data(), ptr, size);
+        return container_ptr;
+    }
+
+    /// Return all cached blocks to the underlying allocator.
+    void
+    trim()
+    {
+        const std::scoped_lock lock(_M_state->mutex);
+        _M_state->free_lists.clear();
+        _M_state->stats.cached_bytes = 0;
+    }
+
+    /// Returns statistics of the cache.
+    caching_stats
+    stats() const
+    {
+        const std::scoped_lock lock(_M_state->mutex);
+        return _M_state->stats;
+    }
+
+    /// Returns the size class of the allocation.
+    ///
+    /// \param size A size of the allocation in bytes.
+    static size_type
+    size_class(size_type size)
+    {
+        if (size <= min_class_size) {
+            return min_class_size;
+        }
+
+        // Classes between 2^(k-1) and 2^k are spaced by 2^(k-3).
+        auto width = std::bit_width(size - 1);
+        auto spacing = size_type(1) << (width - 3);
+        return (size + spacing - 1) & ~(spacing - 1);
+    }
+
+private:
+    struct _State {
+        Allocator alloc;
+        std::mutex mutex;
+        std::unordered_map<size_type, std::vector<container_pointer>> free_lists;
+        size_type max_cached_size;
+        caching_stats stats;
+
+        _State(const Allocator& a, size_type max_cached)
+        : alloc(a),
+          mutex(),
+          free_lists(),
+          max_cached_size(max_cached),
+          stats()
+        {}
+
+        void
+        release(size_type class_size, size_type size)
+        {
+            const std::scoped_lock lock(mutex);
+            stats.bytes_in_use -= class_size;
+            stats.requested_bytes -= size;
+        }
+
+        void
+        release(container_pointer&& block, size_type class_size, size_type size)
+        {
+            const std::scoped_lock lock(mutex);
+            stats.bytes_in_use -= class_size;
+            stats.requested_bytes -= size;
+
+            if (stats.cached_bytes + class_size > max_cached_size) {
+                stats.evictions++;
+                return;
+            }
+
+            free_lists[class_size].push_back(std::move(block));
+            stats.cached_bytes += class_size;
+        }
+    };
+
+    std::shared_ptr<_State> _M_state;
+};
+
+
 }; // namespace metalchat
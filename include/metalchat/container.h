@@ -8,7 +8,10 @@
 #include <filesystem>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <streambuf>
+#include <string>
 #include <vector>
 
 #include <metalchat/metal.h>
@@ -17,6 +20,226 @@
 namespace metalchat {
 
 
+/// A hint about the expected access pattern of the memory, see \ref memory_advise.
+enum class memory_advice {
+    /// No special treatment, the default access pattern.
+    normal,
+    /// Pages are accessed in the sequential order, so the read-ahead is performed aggressively.
+    sequential,
+    /// Pages are accessed in the random order, so the read-ahead is disabled.
+    random,
+    /// Pages are accessed in the near future, so the kernel starts reading them in background.
+    willneed,
+    /// Pages are backed by huge pages, the hint is supported only on Linux.
+    hugepage,
+};
+
+
+/// Returns the size of the virtual memory page in bytes.
+std::size_t
+memory_page_size() noexcept;
+
+
+/// Give a hint to the kernel about the expected access pattern of the memory range.
+///
+/// The range is extended to the page boundaries. Hints never change the semantics of the
+/// memory access, therefore errors are not reported as exceptions.
+///
+/// \param ptr A pointer to the beginning of the memory range.
+/// \param size A size of the memory range in bytes.
+/// \param advice An expected access pattern.
+/// \return `true` when the hint is supported by the platform and accepted by the kernel.
+bool
+memory_advise(const void* ptr, std::size_t size, memory_advice advice) noexcept;
+
+
+/// Returns the number of bytes of the memory range that are resident in the physical memory.
+///
+/// The range is extended to the page boundaries, so the result is a multiple of the page size.
+/// When the residency could not be queried, the method returns zero.
+///
+/// \param ptr A pointer to the beginning of the memory range.
+/// \param size A size of the memory range in bytes.
+std::size_t
+memory_resident_size(const void* ptr, std::size_t size) noexcept;
+
+
+/// Returns the size of the default huge page in bytes.
+///
+/// On Linux the size is read from `/proc/meminfo`, on other platforms (or when the size could
+/// not be queried) the method returns 2 MiB.
+std::size_t
+memory_huge_page_size() noexcept;
+
+
+/// A kind of pages backing the memory mapping, see \ref memory_map_mode.
+enum class memory_page_kind {
+    /// The mapping is backed by pages of the default size.
+    normal,
+    /// The mapping is backed by pages from the reserved pool of huge pages (`MAP_HUGETLB`).
+    hugetlb,
+    /// The mapping is advised to be backed by transparent huge pages (`MADV_HUGEPAGE`).
+    transparent_hugepage,
+};
+
+
+/// A placement of the memory across NUMA nodes, see \ref numa_policy.
+enum class numa_placement {
+    /// Pages are placed on the node of the thread, that touches them first (the default).
+    first_touch,
+    /// Pages are placed on the node of the thread, that touches them first, regardless of the
+    /// memory policy of the thread (`MPOL_LOCAL`).
+    local,
+    /// Pages are placed only on the specified nodes (`MPOL_BIND`).
+    bind,
+    /// Pages are interleaved page by page across the specified nodes (`MPOL_INTERLEAVE`).
+    interleave,
+};
+
+
+/// A policy of the memory placement across NUMA nodes.
+///
+/// Policies are applied with `mbind` and `set_mempolicy` system calls, which are available
+/// only on Linux. On other platforms (or when the kernel is built without NUMA support)
+/// policies are not applied, and the memory is placed by the first touch.
+///
+/// ```cpp
+/// auto options = memory_map_options{.numa = numa_policy::interleave()};
+/// auto [memory_ptr, mode] = memory_map(1 << 30, options);
+/// ```
+struct numa_policy {
+    /// A placement of the memory.
+    numa_placement placement = numa_placement::first_touch;
+    /// Nodes of the placement. When the list is empty, the interleave placement uses all
+    /// nodes of the system.
+    std::vector<std::size_t> nodes;
+
+    /// Returns a policy, that places pages on the node of the touching thread.
+    static numa_policy
+    local();
+
+    /// Returns a policy, that places pages on the specified node.
+    ///
+    /// \param node A NUMA node to place pages on.
+    static numa_policy
+    bind(std::size_t node);
+
+    /// Returns a policy, that interleaves pages across the specified nodes.
+    ///
+    /// \param nodes NUMA nodes to interleave pages across, all nodes when empty.
+    static numa_policy
+    interleave(std::vector<std::size_t> nodes = {});
+};
+
+
+/// Returns the number of NUMA nodes in the system.
+///
+/// The number includes nodes without memory, so that node identifiers are always less than
+/// the returned value. When the topology could not be queried, the method returns one.
+std::size_t
+numa_node_count() noexcept;
+
+
+/// Apply the NUMA policy to the memory range.
+///
+/// The range is extended to the page boundaries. Pages, which are already allocated, are
+/// moved to follow the policy when possible.
+///
+/// \param ptr A pointer to the beginning of the memory range.
+/// \param size A size of the memory range in bytes.
+/// \param policy A policy of the memory placement.
+/// \return `true` when the policy is supported by the platform and accepted by the kernel.
+bool
+memory_bind(const void* ptr, std::size_t size, const numa_policy& policy) noexcept;
+
+
+/// Returns the number of resident bytes of the memory range on every NUMA node.
+///
+/// The range is extended to the page boundaries. Pages that were not touched yet are not
+/// counted. When the placement could not be queried, the method returns an empty vector.
+///
+/// \param ptr A pointer to the beginning of the memory range.
+/// \param size A size of the memory range in bytes.
+/// \return A vector of \ref numa_node_count elements, an element per node.
+std::vector<std::size_t>
+memory_numa_nodes(const void* ptr, std::size_t size);
+
+
+/// Set the default NUMA policy of the calling thread (`set_mempolicy`).
+///
+/// The policy is applied to all subsequent allocations of the thread, which are not bound
+/// with \ref memory_bind.
+///
+/// \param policy A policy of the memory placement.
+/// \return `true` when the policy is supported by the platform and accepted by the kernel.
+bool
+numa_set_thread_policy(const numa_policy& policy) noexcept;
+
+
+/// Pin the calling thread to the NUMA node.
+///
+/// The thread is scheduled only on CPUs of the node, and memory allocated by the thread is
+/// preferably placed on the node. Use this method in worker threads processing a shard of
+/// weights, that is bound to the node with \ref numa_policy::bind.
+///
+/// \param node A NUMA node to pin the thread to.
+/// \return `true` when the thread was pinned to the node.
+bool
+numa_pin_thread(std::size_t node) noexcept;
+
+
+/// Options of the memory mapping.
+///
+/// Options are hints: when the platform or the kernel does not support the requested mode,
+/// the memory is mapped with the default options, the mode accepted by the kernel is reported
+/// by \ref memory_map_mode.
+struct memory_map_options {
+    /// Back the mapping with huge pages. The mapping is first attempted with `MAP_HUGETLB`,
+    /// which requires reserved huge pages (and a file on `hugetlbfs` for file mappings), then
+    /// the mapping falls back to default pages advised with `MADV_HUGEPAGE`.
+    bool hugepage = false;
+
+    /// Populate page tables of the mapping in advance (`MAP_POPULATE`), so that the first
+    /// access to the memory does not trigger page faults.
+    bool populate = false;
+
+    /// A policy of the memory placement across NUMA nodes. The policy is applied before the
+    /// mapping is populated, so that pages are allocated on the right nodes.
+    numa_policy numa = {};
+};
+
+
+/// A mode of the memory mapping, that was accepted by the kernel.
+///
+/// The mode reports requests and advices, which the kernel did not reject, rather than the
+/// achieved state of the mapping: transparent huge pages are allocated lazily and could be
+/// split at any time, and `MAP_POPULATE` does not report pages, which were not populated.
+struct memory_map_mode {
+    /// A kind of pages requested for the mapping. Only \ref memory_page_kind::hugetlb
+    /// guarantees huge pages, transparent huge pages are only advised.
+    memory_page_kind pages = memory_page_kind::normal;
+    /// Equals to `true` when the population of page tables in advance was requested, and the
+    /// kernel accepted the request.
+    bool populate_requested = false;
+    /// Equals to `true` when the NUMA policy was applied to the mapping.
+    bool numa_bound = false;
+};
+
+
+/// Map anonymous read-write memory with the specified options.
+///
+/// The returned pointer unmaps the memory on destruction. The size of the mapping is rounded
+/// up to the page size (or the huge page size, when the mapping is backed by `MAP_HUGETLB`).
+/// The method throws `std::runtime_error`, when the memory could not be mapped even with the
+/// default options.
+///
+/// \param size A size of the memory in bytes.
+/// \param options Options of the memory mapping.
+/// \return A pointer to the mapped memory and the mode of the mapping accepted by the kernel.
+std::pair<std::shared_ptr<void>, memory_map_mode>
+memory_map(std::size_t size, const memory_map_options& options = {});
+
+
 /// A memory-mapped file abstraction for efficient file I/O operations.
 ///
 /// This class provides a low-level interface for reading and writing to files with optional
@@ -66,6 +289,21 @@ public:
     /// Constructs an anonymous read-only memory file.
     basic_memfile();
 
+    /// Constructs a read-only window of the specified file.
+    ///
+    /// The window shares the file handle with the specified file, but it is mapped into the
+    /// memory independently: \ref declare_mapped maps only pages of the window. This allows
+    /// to map and evict regions of a file, that does not fit into the memory.
+    ///
+    /// \note The window is read only through the memory mapping (see \ref data).
+    ///
+    /// \param file A file to create a window of.
+    /// \param offset An offset of the window from the beginning of the file.
+    /// \param size A size of the window in bytes.
+    basic_memfile(const basic_memfile& file, std::size_t offset, std::size_t size);
+
+    basic_memfile(const basic_memfile&) = delete;
+
     /// Checks if the file is currently memory-mapped.
     bool
     is_mapped() const noexcept;
@@ -76,12 +314,37 @@ public:
     basic_memfile&
     declare_mapped();
 
+    /// Declares the file as memory-mapped with the specified options.
+    ///
+    /// When the file is already memory-mapped, options are ignored. The actually used mode
+    /// of the mapping is returned by \ref map_mode.
+    ///
+    /// \param options Options of the memory mapping.
+    basic_memfile&
+    declare_mapped(const memory_map_options& options);
+
     /// Undeclares the file as memory-mapped.
     ///
     /// It's safe to execute method multiple times, even when the file is already unmapped.
     basic_memfile&
     undeclare_mapped();
 
+    /// Give a hint to the kernel about the expected access pattern of the mapped file.
+    ///
+    /// See \ref memory_advise for more details. The method returns `false`, when the file
+    /// is not memory-mapped.
+    ///
+    /// \param advice An expected access pattern.
+    /// \param offset An offset of the memory range from the beginning of the file.
+    /// \param size A size of the memory range, the range is clipped to the size of the file.
+    bool
+    advise(memory_advice advice, std::size_t offset = 0, std::size_t size = -1) const noexcept;
+
+    /// Returns the mode of the memory mapping, that was accepted by the kernel. When the file
+    /// is not memory-mapped, the method returns the default mode.
+    memory_map_mode
+    map_mode() const noexcept;
+
     /// Returns the size of the file in bytes.
     std::size_t
     size() const noexcept;
@@ -138,16 +401,23 @@ public:
     ~basic_memfile();
 
 private:
-    std::FILE* _M_file = nullptr;
+    std::shared_ptr<std::FILE> _M_file;
+    std::size_t _M_file_offset = 0;
     std::size_t _M_file_size = 0;
     pos_type _M_file_p = 0;
     pos_type _M_file_g = 0;
     char_type* _M_map = nullptr;
+    std::size_t _M_map_size = 0;
+    memory_map_mode _M_map_mode;
     std::ios::openmode _M_mode = std::ios::in;
 
     /// Checks if the file is opened in writable mode.
     bool
     writable() const;
+
+    /// Returns the page-aligned offset and the size of the memory-mapped range of the file.
+    std::pair<std::size_t, std::size_t>
+    mapped_range() const noexcept;
 };
 
 
@@ -183,6 +453,102 @@ make_pointer_alias(const std::shared_ptr<T>& ptr1, const std::shared_ptr<U>& ptr
 }
 
 
+/// Statistics of the \ref residency_manager.
+struct residency_stats {
+    /// A number of accesses to groups that were already mapped.
+    std::size_t hits = 0;
+    /// A number of accesses to groups that had to be mapped.
+    std::size_t misses = 0;
+    /// A number of groups unmapped to keep the resident size within the budget.
+    std::size_t evictions = 0;
+    /// A total size of currently mapped groups in bytes.
+    std::size_t resident_size = 0;
+    /// A maximum resident size observed by the manager in bytes.
+    std::size_t peak_size = 0;
+};
+
+
+/// A residency manager keeps the total size of memory-mapped files within the budget.
+///
+/// Files (usually windows of a single large file, see \ref basic_memfile) are registered in
+/// groups, e.g. all tensors of a single transformer layer. A group is mapped as a whole on the
+/// first access and remains mapped after the access. When the total size of mapped groups
+/// exceeds the budget, the least recently used groups are unmapped on \ref acquire and
+/// \ref release. Acquired groups are never unmapped, therefore the budget could be exceeded,
+/// when all mapped groups are in use. A plain access (\ref touch) never unmaps groups, so
+/// pointers to the data of groups remain valid until the next acquire, release or park.
+///
+/// The manager is a handle to the shared state, copies of the manager share groups and
+/// statistics. All methods of the manager are thread-safe.
+///
+/// Example usage:
+/// ```cpp
+/// auto file = basic_memfile("model.safetensors");
+/// auto window = std::make_shared<basic_memfile>(file, 4096, 1024);
+///
+/// residency_manager residency(1 << 30);
+/// auto group = residency.insert("layers.0", window);
+///
+/// residency.acquire(group);
+/// auto data = window->data();
+/// residency.release(group);
+/// ```
+class residency_manager {
+public:
+    /// Constructs a new residency manager.
+    ///
+    /// \param budget A maximum total size of mapped groups in bytes.
+    residency_manager(std::size_t budget);
+
+    /// Registers a file in the group with the specified name, and returns an index of the
+    /// group. The manager does not extend the lifetime of the file.
+    ///
+    /// \param group A name of the group.
+    /// \param file A file to register in the group.
+    std::size_t
+    insert(const std::string& group, const std::shared_ptr<basic_memfile>& file);
+
+    /// Maps all files of the group (when they are not mapped yet), and prevents them from
+    /// being unmapped until the group is released.
+    ///
+    /// \param group An index of the group.
+    void
+    acquire(std::size_t group);
+
+    /// Releases the group acquired by \ref acquire, and evicts the least recently used groups
+    /// that are not acquired, until the resident size is within the budget.
+    ///
+    /// \param group An index of the group.
+    void
+    release(std::size_t group);
+
+    /// Maps all files of the group (when they are not mapped yet), and marks the group as
+    /// the most recently used. Unlike \ref acquire, the group could be evicted by the next
+    /// acquire or release of other groups. The method never evicts other groups, even when
+    /// the budget is exceeded.
+    ///
+    /// \param group An index of the group.
+    void
+    touch(std::size_t group);
+
+    /// Unmaps all groups that are not acquired.
+    void
+    park();
+
+    /// Returns the budget of the manager in bytes.
+    std::size_t
+    budget() const;
+
+    /// Returns statistics of the manager.
+    residency_stats
+    stats() const;
+
+private:
+    struct _State;
+    std::shared_ptr<_State> _M_state;
+};
+
+
 /// Abstract base interface for all memory containers.
 ///
 /// Provides type-erased access to contiguous memory regions. All concrete container types must
@@ -200,6 +566,21 @@ struct basic_container {
     virtual const void*
     data_ptr() const = 0;
 
+    /// Keeps the container data mapped into the memory, until the container is released.
+    ///
+    /// Containers, which memory could be unmapped implicitly (e.g. file-buffered containers
+    /// managed by the \ref residency_manager), override this method, for all other
+    /// containers the method does nothing. Every call must be paired with \ref release.
+    virtual void
+    acquire() const
+    {}
+
+    /// Releases the container data acquired by \ref acquire, the data pointers retrieved
+    /// after the acquire could become invalid after this call.
+    virtual void
+    release() const
+    {}
+
     /// The \ref basic_container virtual destructor.
     virtual ~basic_container() = default;
 };
@@ -867,19 +1248,94 @@ public:
       _M_offset(offset)
     {}
 
+    /// Constructs a container from existing file storage, which is mapped and evicted by the
+    /// residency manager.
+    ///
+    /// The storage must be registered in the specified group of the residency manager. For
+    /// such containers \ref unpark acquires the group and \ref park releases it, so that
+    /// the storage remains mapped until the manager evicts the group.
+    ///
+    /// \param storage Shared pointer to the underlying file.
+    /// \param size Size of the accessible region in bytes.
+    /// \param offset Byte offset from the file start.
+    /// \param residency A residency manager of the storage.
+    /// \param group An index of the storage group in the residency manager.
+    filebuf_memory_container(
+        const storage_type& storage,
+        std::size_t size,
+        std::size_t offset,
+        const residency_manager& residency,
+        std::size_t group
+    )
+    : _M_storage(storage),
+      _M_size(size),
+      _M_offset(offset),
+      _M_residency(residency),
+      _M_residency_group(group)
+    {}
+
+    /// Constructs a view of the specified container, the view shares the storage and the
+    /// residency manager with the container.
+    ///
+    /// \param container A container to create a view of.
+    /// \param size Size of the accessible region in bytes.
+    /// \param offset Byte offset from the file start.
+    template <typename U>
+    filebuf_memory_container(
+        const filebuf_memory_container<U>& container, std::size_t size, std::size_t offset
+    )
+    : _M_storage(container._M_storage),
+      _M_size(size),
+      _M_offset(offset),
+      _M_residency(container._M_residency),
+      _M_residency_group(container._M_residency_group)
+    {}
+
     /// Method evicts memory-mapped file from the memory. When the file is not memory-mapped
     /// method does absolutely nothing, so calling method multiple time is safe.
+    ///
+    /// When the container is managed by the residency manager, method releases the storage
+    /// group, and the manager decides when to evict it.
     void
     park() const
     {
-        _M_storage->undeclare_mapped();
+        if (_M_residency) {
+            _M_residency->release(_M_residency_group);
+        } else {
+            _M_storage->undeclare_mapped();
+        }
     }
 
     /// Maps the file into memory if not already mapped.
+    ///
+    /// When the container is managed by the residency manager, method acquires the storage
+    /// group, so it is not evicted until the container is parked.
     void
     unpark() const
     {
-        _M_storage->declare_mapped();
+        if (_M_residency) {
+            _M_residency->acquire(_M_residency_group);
+        } else {
+            _M_storage->declare_mapped();
+        }
+    }
+
+    /// Acquires the storage group, when the container is managed by the residency manager.
+    void
+    acquire() const override
+    {
+        if (_M_residency) {
+            _M_residency->acquire(_M_residency_group);
+        }
+    }
+
+    /// Releases the storage group, when the container is managed by the residency manager.
+    void
+    release() const override
+    {
+        if (_M_residency) {
+            _M_residency->release(_M_residency_group);
+        }
     }
 
     std::size_t
@@ -915,10 +1371,18 @@ public:
 
     /// Returns a void pointer to the data at the current offset.
     /// Automatically maps the file into memory if needed.
+    ///
+    /// \note For containers managed by the residency manager, the pointer remains valid while
+    /// the container is unparked or acquired. Otherwise the pointer remains valid until the
+    /// next acquire, release or park of the manager, which could evict the storage group.
     void*
     storage_ptr() const
     {
-        _M_storage->declare_mapped();
+        if (_M_residency) {
+            _M_residency->touch(_M_residency_group);
+        } else {
+            _M_storage->declare_mapped();
+        }
         return _M_storage->data() + storage_offset();
     }
 
@@ -926,6 +1390,11 @@ private:
     storage_type _M_storage;
     std::size_t _M_size;
     std::size_t _M_offset;
+
+    mutable std::optional<residency_manager> _M_residency;
+    std::size_t _M_residency_group = 0;
+
+    template <typename U> friend struct filebuf_memory_container;
 };
 
 
@@ -948,7 +1417,7 @@ template <typename T> struct container_rebind<T, filebuf_memory_container<void>>
     {
         auto size = ptr->size();
         auto offset = ptr->storage_offset();
-        auto container_ptr = std::make_shared<type>(ptr->storage(), size, offset);
+        auto container_ptr = std::make_shared<type>(*ptr, size, offset);
 
         return make_pointer_alias(container_ptr, ptr);
     }
@@ -960,7 +1429,8 @@ template <typename T> struct container_offset<filebuf_memory_container<T>> {
     using type = filebuf_memory_container<T>;
     using pointer = std::shared_ptr<type>;
 
-    /// Creates an offset view of the container.
+    /// Creates an offset view of the container, the view shares the residency manager with
+    /// the container.
     ///
     /// \param ptr Pointer to the original container.
     /// \param off Byte offset from the current position.
@@ -969,7 +1439,7 @@ template <typename T> struct container_offset<filebuf_memory_container<T>> {
     {
         auto size = ptr->size() - off;
         auto offset = ptr->storage_offset() + off;
-        auto container_ptr = std::make_shared<type>(ptr->storage(), size, offset);
+        auto container_ptr = std::make_shared<type>(*ptr, size, offset);
 
         return make_pointer_alias(container_ptr, ptr);
     }
@@ -1031,6 +1501,18 @@ public:
         return static_cast<const_pointer>(ptr);
     }
 
+    void
+    acquire() const override
+    {
+        _M_storage->acquire();
+    }
+
+    void
+    release() const override
+    {
+        _M_storage->release();
+    }
+
     std::size_t
     size() const
     {
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <metalchat/accelerator.h>
+#include <metalchat/allocator.h>
+#include <metalchat/container.h>
+#include <metalchat/safetensor.h>
+
+
+namespace metalchat {
+
+
+/// A description of the tensor data type in the GGUF format.
+///
+/// Quantized types store elements in blocks: every `block_size` consecutive elements of the
+/// innermost dimension are packed into `type_size` bytes. Plain types have blocks of a single
+/// element.
+struct gguf_type {
+    /// A name of the type as in the GGML library (e.g. `F32`, `Q4_0`, `Q4_K`).
+    std::string_view name;
+    /// An identifier of the type in the GGUF file.
+    std::uint32_t id;
+    /// A number of elements in a single block.
+    std::size_t block_size;
+    /// A size of a single block in bytes.
+    std::size_t type_size;
+    /// A safetensor data type of the container elements, quantized blocks are stored
+    /// as raw bytes (`U8`).
+    std::string_view container_dtype;
+
+    /// Returns true, when elements of the type are packed into blocks.
+    bool
+    quantized() const
+    {
+        return block_size > 1;
+    }
+};
+
+
+/// A descriptor of the tensor in the GGUF header.
+struct gguf_descriptor {
+    /// A name of the tensor.
+    std::string name;
+    /// A data type of the tensor.
+    const gguf_type* type;
+    /// Sizes of the tensor ordered from the outermost to the innermost dimension (GGUF stores
+    /// them in the reversed order). The innermost dimension of quantized tensors is replaced
+    /// by two dimensions: the number of blocks and the size of the block in bytes.
+    std::vector<std::size_t> shape;
+    /// An offset of the tensor relative to the beginning of the data section.
+    std::size_t offset;
+    /// A size of the tensor in bytes.
+    std::size_t size;
+};
+
+
+/// A header of the file in the GGUF format (versions 2 and 3).
+///
+/// The header is parsed from the specified buffer (usually a memory-mapped file). Key-value
+/// pairs of scalars and strings are converted to strings, so that they could be stored in the
+/// metadata of the \ref safetensor_document, arrays (e.g. vocabulary of the tokenizer) are
+/// skipped. When the header is corrupted, the parser throws `std::runtime_error`.
+///
+/// ```cpp
+/// auto file = std::make_shared<basic_memfile>("model.gguf");
+/// file->declare_mapped();
+///
+/// auto header = gguf_header(file->data(), file->size());
+/// for (const auto& tensor : header.tensors()) {
+///     std::cout << tensor.name << " " << tensor.type->name << std::endl;
+/// }
+/// ```
+class gguf_header {
+public:
+    using metadata_type = std::vector<std::pair<std::string, std::string>>;
+
+    /// A magic number at the beginning of the GGUF file.
+    static constexpr std::string_view magic = "GGUF";
+
+    /// The default alignment of the data section and tensors in bytes.
+    static constexpr std::size_t default_alignment = 32;
+
+    /// The maximum number of tensor dimensions.
+    static constexpr std::size_t max_dimensions = 4;
+
+    /// Parse the header of the GGUF file.
+    ///
+    /// \param data A pointer to the beginning of the file.
+    /// \param size A size of the file.
+    gguf_header(const char* data, std::size_t size);
+
+    /// Returns descriptors of tensors ordered by the data offset.
+    const std::vector<gguf_descriptor>&
+    tensors() const
+    {
+        return _M_tensors;
+    }
+
+    /// Returns key-value pairs of scalars and strings of the header.
+    const metadata_type&
+    metadata() const
+    {
+        return _M_metadata;
+    }
+
+    /// Returns a version of the GGUF format.
+    std::uint32_t
+    version() const
+    {
+        return _M_version;
+    }
+
+    /// Returns an alignment of the data section (the `general.alignment` key).
+    std::size_t
+    alignment() const
+    {
+        return _M_alignment;
+    }
+
+    /// Returns an offset of the data section from the beginning of the file.
+    std::size_t
+    data_offset() const
+    {
+        return _M_data_offset;
+    }
+
+    /// Returns a size of the data section.
+    std::size_t
+    data_size() const
+    {
+        return _M_data_size;
+    }
+
+    /// Returns all data types supported by the reader.
+    static std::span<const gguf_type>
+    types();
+
+    /// Find a GGUF data type by its name.
+    ///
+    /// \param name A name of the type (e.g. `Q4_K`).
+    /// \return A reference to the type description, or `std::invalid_argument` is thrown,
+    ///     when the type is not supported.
+    static const gguf_type&
+    find_type(std::string_view name);
+
+private:
+    struct _Parser;
+
+    std::vector<gguf_descriptor> _M_tensors;
+    metadata_type _M_metadata;
+    std::uint32_t _M_version;
+    std::size_t _M_alignment;
+    std::size_t _M_data_offset;
+    std::size_t _M_data_size;
+};
+
+
+/// A reader of files in the GGUF format.
+///
+/// The reader produces a \ref safetensor_document, so that tensors are iterated and loaded into
+/// layers in the same way as tensors of safetensor files. Tensors are never dequantized: blocks
+/// of quantized tensors are surfaced as raw containers of bytes, the data type of the tensor is
+/// the name of the GGUF type (see \ref gguf_header::find_type), and the innermost dimension of
+/// the tensor is split into the number of blocks and the size of the block. So the weight of a
+/// linear layer of type `Q4_0` with shape `[4096, 4096]` is loaded into `tensor<uint8_t, 3>`
+/// of shape `[4096, 128, 18]`.
+///
+/// Types `F16` and `BF16` are surfaced as containers of `uint16_t` and \ref bf16 respectively.
+///
+/// Key-value pairs of the header are stored in the metadata of the document.
+class gguf_document {
+public:
+    /// Open a GGUF document.
+    ///
+    /// The file is memory-mapped and all tensors are allocated into \ref random_memory_container
+    /// without copying memory.
+    ///
+    /// \param p A path in the filesystem to a file in a GGUF format.
+    static safetensor_document
+    open(const std::filesystem::path& p);
+
+    /// Open a GGUF document.
+    ///
+    /// The file is memory-mapped and tensors are allocated using \ref hardware_memory_container,
+    /// like \ref safetensor_document::open(const std::filesystem::path&, hardware_accelerator&).
+    ///
+    /// \param p A path in the filesystem to a file in a GGUF format.
+    /// \param accelerator A hardware accelerator.
+    static safetensor_document
+    open(const std::filesystem::path& p, hardware_accelerator& accelerator);
+
+    /// Open a GGUF document.
+    ///
+    /// This implementation reads tensors from the specified memory-mapped file and then uses a
+    /// paginated allocator to create large buffers to allocate tensors from with
+    /// \ref pooling_allocator_adapter. All containers hold a pointer to the opened file.
+    ///
+    /// \tparam Allocator A type of the allocator used to allocate tensor containers.
+    /// \param p A path in the filesystem to a file in a GGUF format.
+    /// \param alloc An instance of the Allocator type.
+    /// \param max_size A maximum size of the buffer to allocate.
+    template <allocator_t<void> Allocator>
+    static safetensor_document
+    open(const std::filesystem::path& p, Allocator& alloc, std::size_t max_size = -1)
+    {
+        auto file = std::make_shared<basic_memfile>(p);
+        file->declare_mapped();
+
+        auto header = gguf_header(file->data(), file->size());
+
+        // Tensors are aligned within the data section, so the padding between tensors is
+        // attributed to the preceding tensor to split the data section into contiguous pages.
+        const auto& tensors = header.tensors();
+        std::vector<std::size_t> sizes;
+        sizes.reserve(tensors.size());
+
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            auto last = i + 1 < tensors.size() ? tensors[i + 1].offset : header.data_size();
+            sizes.push_back(last - tensors[i].offset);
+        }
+
+        auto data_ptr = file->data() + header.data_offset();
+        if (!tensors.empty()) {
+            data_ptr += tensors.front().offset;
+        }
+
+        auto aliasing_alloc = aliasing_allocator(std::forward<Allocator>(alloc), file);
+        using aliasing_type = decltype(aliasing_alloc);
+
+        auto page_alloc =
+            paginated_allocator_adapter(std::forward<aliasing_type>(aliasing_alloc), max_size);
+        auto containers = page_alloc.allocate(data_ptr, sizes);
+
+        char* container_data_ptr = nullptr;
+        if (!containers.empty()) {
+            container_data_ptr = static_cast<char*>(containers.front()->data());
+        }
+
+        using allocator_type = pooling_allocator_adapter<null_allocator<Allocator>>;
+        auto container_alloc = allocator_type(null_allocator<Allocator>{}, containers);
+
+        safetensor_document document;
+        safetensor_allocator<allocator_type> allocator;
+
+        for (const auto& tensor : tensors) {
+            auto data = container_data_ptr + (tensor.offset - tensors.front().offset);
+            auto dtype = tensor.type->container_dtype;
+
+            auto container_ptr = allocator.allocate(dtype, data, tensor.size, container_alloc);
+            auto type_name = std::string(tensor.type->name);
+
+            document.insert(safetensor(tensor.name, type_name, tensor.shape, container_ptr));
+        }
+
+        auto& metadata = document.get_metadata();
+        for (const auto& [key, value] : header.metadata()) {
+            metadata.insert_or_assign(key, value);
+        }
+
+        return document;
+    }
+
+    /// Open a GGUF document.
+    ///
+    /// This implementation is similar to
+    /// \ref gguf_document::open(const std::filesystem::path&, Allocator&, std::size_t),
+    /// except that allocator must be an r-value.
+    template <allocator_t<void> Allocator>
+    static safetensor_document
+    open(const std::filesystem::path& p, Allocator&& alloc, std::size_t max_size = -1)
+    {
+        return open(p, alloc, max_size);
+    }
+};
+
+
+} // namespace metalchat
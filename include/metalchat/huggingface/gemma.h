@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <optional>
+
+#include <metalchat/name_mapping.h>
 #include <metalchat/nn/gemma.h>
 #include <metalchat/safetensor.h>
 #include <metalchat/text.h>
@@ -25,24 +28,33 @@ struct gemma3_options_serializer {
 };
 
 
-template <typename T, nn::mutable_layer Layer> class gemma3_safetensor_serializer {
+template <typename T, nn::mutable_layer Layer>
+class gemma3_safetensor_serializer
+: public basic_safetensor_serializer<gemma3_safetensor_serializer<T, Layer>> {
 public:
     using value_type = nn::indirect_layer<Layer>;
+    using base_type = basic_safetensor_serializer<gemma3_safetensor_serializer>;
+
+    /// An identifier of the adaptation of weights, it must be changed whenever the adaptation
+    /// changes, so that models compiled by earlier versions are compiled again.
+    static constexpr std::string_view compiled_layout = "huggingface.gemma3.1";
 
     /// Creates a new instance of a layer serializer with Gemma3 options.
     gemma3_safetensor_serializer(
         const nn::gemma3_options& options, hardware_accelerator& accelerator
     )
-    : _M_options(options),
+    : base_type({"tok_embeddings", "layers.", "norm", "output"}),
+      _M_options(options),
       _M_accelerator(accelerator)
     {}
 
     value_type
     load(safetensor_document& document)
     {
-        value_type layer(_M_options, _M_accelerator);
-
         auto doc = adapt(document);
+        this->start_warmup(doc);
+
+        auto layer = make_layer();
         doc.load(layer);
 
         return layer;
@@ -57,39 +69,46 @@ public:
     safetensor_document
     adapt(const safetensor_document& document) const
     {
-        const std::vector<std::pair<std::regex, std::string>> mapping = {
-            {std::regex(R"(model\.(layers\.\d+)\.input_layernorm)"), "$1.attention_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.post_attention_layernorm)"),
-             "$1.attention_post_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.pre_feedforward_layernorm)"), "$1.ffn_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.post_feedforward_layernorm)"), "$1.ffn_post_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.mlp\.gate_proj)"), "$1.feed_forward.w1"},
-            {std::regex(R"(model\.(layers\.\d+)\.mlp\.down_proj)"), "$1.feed_forward.w2"},
-            {std::regex(R"(model\.(layers\.\d+)\.mlp\.up_proj)"), "$1.feed_forward.w3"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.q_proj)"), "$1.attention.wq"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.q_norm)"), "$1.attention.q_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.k_proj)"), "$1.attention.wk"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.k_norm)"), "$1.attention.k_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.v_proj)"), "$1.attention.wv"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.o_proj)"), "$1.attention.wo"},
-            {std::regex(R"(model.norm)"), "norm"},
-            {std::regex(R"(model.embed_tokens)"), "tok_embeddings"},
+        static const name_mapping mapping = {
+            {"model.layers.{n}.input_layernorm", "layers.$1.attention_norm"},
+            {"model.layers.{n}.post_attention_layernorm", "layers.$1.attention_post_norm"},
+            {"model.layers.{n}.pre_feedforward_layernorm", "layers.$1.ffn_norm"},
+            {"model.layers.{n}.post_feedforward_layernorm", "layers.$1.ffn_post_norm"},
+            {"model.layers.{n}.mlp.gate_proj", "layers.$1.feed_forward.w1"},
+            {"model.layers.{n}.mlp.down_proj", "layers.$1.feed_forward.w2"},
+            {"model.layers.{n}.mlp.up_proj", "layers.$1.feed_forward.w3"},
+            {"model.layers.{n}.self_attn.q_proj", "layers.$1.attention.wq"},
+            {"model.layers.{n}.self_attn.q_norm", "layers.$1.attention.q_norm"},
+            {"model.layers.{n}.self_attn.k_proj", "layers.$1.attention.wk"},
+            {"model.layers.{n}.self_attn.k_norm", "layers.$1.attention.k_norm"},
+            {"model.layers.{n}.self_attn.v_proj", "layers.$1.attention.wv"},
+            {"model.layers.{n}.self_attn.o_proj", "layers.$1.attention.wo"},
+            {"model.norm", "norm"},
+            {"model.embed_tokens", "tok_embeddings"},
         };
 
-        auto doc = document.rename(mapping.begin(), mapping.end());
+        auto doc = document.rename(mapping);
         doc.insert("output.weight", "tok_embeddings.weight");
 
         return doc;
     }
 
 private:
+    friend base_type;
+
     nn::gemma3_options _M_options;
     hardware_accelerator _M_accelerator;
+
+    value_type
+    make_layer()
+    {
+        return value_type(_M_options, _M_accelerator);
+    }
 };
 
 
 struct gemma3_tokenizer_loader {
-    using type = text::unicode_tokenizer_adaptor<text::sentence_piece>;
+    using type = text::sentence_piece;
 
     type
     load(std::istream& is) const;
@@ -109,7 +128,7 @@ template <contiguous_container Container> struct gemma3_traits {
     using options_type = nn::gemma3_options;
     using options_serializer = gemma3_options_serializer;
 
-    using tokenizer_type = text::unicode_tokenizer_adaptor<text::sentence_piece>;
+    using tokenizer_type = text::sentence_piece;
     using tokenizer_loader = gemma3_tokenizer_loader;
 };
 
@@ -5,11 +5,12 @@
 #pragma once
 
 #include <istream>
-#include <regex>
+#include <optional>
 #include <vector>
 
 #include <metalchat/container.h>
 #include <metalchat/dtype.h>
+#include <metalchat/name_mapping.h>
 #include <metalchat/nn/llama.h>
 #include <metalchat/quantization.h>
 #include <metalchat/reference.h>
@@ -42,24 +43,33 @@ struct llama3_options_serializer {
 ///
 /// \tparam T a type of the attention weights (Wq, Wk).
 /// \tparam Layer a Llama3 implementation layer.
-template <typename T, nn::mutable_layer Layer> class llama3_safetensor_serializer {
+template <typename T, nn::mutable_layer Layer>
+class llama3_safetensor_serializer
+: public basic_safetensor_serializer<llama3_safetensor_serializer<T, Layer>> {
 public:
     using value_type = nn::indirect_layer<Layer>;
+    using base_type = basic_safetensor_serializer<llama3_safetensor_serializer>;
+
+    /// An identifier of the adaptation of weights, it must be changed whenever the adaptation
+    /// changes, so that models compiled by earlier versions are compiled again.
+    static constexpr std::string_view compiled_layout = "huggingface.llama3.1";
 
     /// Creates a new instance of a layer serializer with Llama3 options.
     llama3_safetensor_serializer(
         const nn::llama3_options& options, hardware_accelerator& accelerator
     )
-    : _M_options(options),
+    : base_type({"tok_embeddings", "layers.", "norm", "output"}),
+      _M_options(options),
       _M_accelerator(accelerator)
     {}
 
     value_type
     load(safetensor_document& document)
     {
-        value_type layer(_M_options, _M_accelerator);
-
         auto doc = adapt(document);
+        this->start_warmup(doc);
+
+        auto layer = make_layer();
         doc.load(layer);
 
         return layer;
@@ -85,29 +95,37 @@ public:
     safetensor_document
     adapt(const safetensor_document& document) const
     {
-        const std::vector<std::pair<std::regex, std::string>> mapping = {
-            {std::regex(R"(model\.(layers\.\d+)\.input_layernorm)"), "$1.attention_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.post_attention_layernorm)"), "$1.ffn_norm"},
-            {std::regex(R"(model\.(layers\.\d+)\.mlp\.gate_proj)"), "$1.feed_forward.w1"},
-            {std::regex(R"(model\.(layers\.\d+)\.mlp\.down_proj)"), "$1.feed_forward.w2"},
-            {std::regex(R"(model\.(layers\.\d+)\.mlp\.up_proj)"), "$1.feed_forward.w3"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.q_proj)"), "$1.attention.wq"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.k_proj)"), "$1.attention.wk"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.v_proj)"), "$1.attention.wv"},
-            {std::regex(R"(model\.(layers\.\d+)\.self_attn\.o_proj)"), "$1.attention.wo"},
-            {std::regex(R"(model.norm)"), "norm"},
-            {std::regex(R"(model.embed_tokens)"), "tok_embeddings"},
+        static const name_mapping mapping = {
+            {"model.layers.{n}.input_layernorm", "layers.$1.attention_norm"},
+            {"model.layers.{n}.post_attention_layernorm", "layers.$1.ffn_norm"},
+            {"model.layers.{n}.mlp.gate_proj", "layers.$1.feed_forward.w1"},
+            {"model.layers.{n}.mlp.down_proj", "layers.$1.feed_forward.w2"},
+            {"model.layers.{n}.mlp.up_proj", "layers.$1.feed_forward.w3"},
+            {"model.layers.{n}.self_attn.q_proj", "layers.$1.attention.wq"},
+            {"model.layers.{n}.self_attn.k_proj", "layers.$1.attention.wk"},
+            {"model.layers.{n}.self_attn.v_proj", "layers.$1.attention.wv"},
+            {"model.layers.{n}.self_attn.o_proj", "layers.$1.attention.wo"},
+            {"model.norm", "norm"},
+            {"model.embed_tokens", "tok_embeddings"},
         };
 
-        auto doc = document.rename(mapping.begin(), mapping.end());
+        auto doc = document.rename(mapping);
         doc.insert("output.weight", "tok_embeddings.weight");
 
         return doc;
     }
 
 private:
+    friend base_type;
+
     nn::llama3_options _M_options;
     hardware_accelerator _M_accelerator;
+
+    value_type
+    make_layer()
+    {
+        return value_type(_M_options, _M_accelerator);
+    }
 };
 
 
@@ -188,6 +206,10 @@ private:
 struct llama3_tokenizer_loader {
     using type = text::byte_pair_encoder<char>;
 
+    /// A memory budget (in bytes) of the pre-token encoding cache of loaded tokenizers. When
+    /// the value is zero, tokenizers are loaded without the encoding cache.
+    std::size_t cache_size = reference::llama3_tokenizer_loader::default_cache_size;
+
     /// Load the tokenizer from the specified input stream.
     ///
     /// \param is An input stream containing a JSON-encoded tokenizer model (HuggingFace format).
@@ -196,9 +218,23 @@ struct llama3_tokenizer_loader {
 
     /// Load the tokenizer from the specified local file.
     ///
+    /// When the compiled vocabulary of the tokenizer model exists next to the model (see
+    /// \ref compile), and it was compiled from the current version of the model, the tokenizer
+    /// is loaded from the compiled vocabulary without parsing the JSON file. Otherwise, the
+    /// tokenizer is loaded from the JSON file.
+    ///
     /// \param p A path to the JSON-encoded tokenizer model (HuggingFace format).
     type
     load(const std::filesystem::path& p) const;
+
+    /// Compile the tokenizer model into a memory-mappable vocabulary.
+    ///
+    /// The compiled vocabulary is written next to the tokenizer model, with the file
+    /// extension \ref text::mapped_vocabulary::default_extension.
+    ///
+    /// \param p A path to the JSON-encoded tokenizer model (HuggingFace format).
+    void
+    compile(const std::filesystem::path& p) const;
 };
 
 
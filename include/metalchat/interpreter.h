@@ -4,9 +4,12 @@
 
 #pragma once
 
+#include <format>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <optional>
+#include <stdexcept>
 
 #include <metalchat/command.h>
 #include <metalchat/dtype.h>
@@ -174,6 +177,15 @@ private:
 };
 
 
+/// Specifies how the \ref interpreter handles a message that does not fit into the context.
+enum class context_overflow {
+    /// The message is rejected with an exception, the context is left unchanged.
+    reject,
+    /// The message is trimmed to the longest prefix that fits into the context.
+    truncate,
+};
+
+
 /// Each message submitted to the interpreter is being passed through the mustache render engine,
 /// so all valid mustache sequences are expanded with appropriate variable values.
 class interpreter {
@@ -228,6 +240,26 @@ public:
         set_token_scanner(scanner_ptr);
     }
 
+    /// Set the maximum number of tokens in the context of the interpreter.
+    ///
+    /// The limit is usually equal to the maximum sequence length of the transformer. Messages
+    /// are checked against the limit while they are encoded, so an oversized message is
+    /// rejected (or trimmed) before it reaches the transformer. Generation of the response
+    /// stops, when the context is full. By default the context is unlimited.
+    ///
+    /// \param max_tokens The maximum number of tokens in the context.
+    /// \param overflow A policy of handling messages that exceed the limit.
+    void
+    set_context_limit(std::size_t max_tokens, context_overflow overflow = context_overflow::reject);
+
+    /// Returns the number of tokens in the context, including tokens of written messages
+    /// that were not yet processed by the transformer.
+    std::size_t
+    context_size() const
+    {
+        return _M_start_pos + _M_buf.size();
+    }
+
     /// Declare the command available for execution.
     ///
     /// The declaration format depends on the underlying command scanner. By default command
@@ -334,12 +366,36 @@ private:
     std::size_t _M_start_pos;
     std::vector<index_type> _M_buf;
 
+    std::size_t _M_max_tokens;
+    context_overflow _M_overflow;
+
+    text::utf8_stream_decoder _M_decoder;
+    std::string _M_chunk;
+
     void
     write_header(const std::string& role);
 
+    /// Encode the header of the message with the specified role.
+    template <std::output_iterator<index_type> OutputIt>
+    void
+    encode_header(const std::string& role, OutputIt& output) const
+    {
+        tokenizer_traits::encode(*_M_tokenizer, text::token::begin_header, output);
+        tokenizer_traits::encode(*_M_tokenizer, role, output);
+        tokenizer_traits::encode(*_M_tokenizer, text::token::end_header, output);
+        tokenizer_traits::encode(*_M_tokenizer, "\n\n", output);
+    }
+
     tensor_type
     flush()
     {
+        if (context_size() > _M_max_tokens) {
+            throw std::runtime_error(std::format(
+                "interpreter: context of {} tokens exceeds the limit of {} tokens",
+                context_size(), _M_max_tokens
+            ));
+        }
+
         std::vector<index_type> encoding;
         _M_buf.swap(encoding);
 
@@ -355,21 +411,44 @@ private:
         return stream;
     }
 
+    /// Write the chunk of the decoded text to the output iterator. The chunk is copied into
+    /// the string that is reused across calls, so that streaming does not allocate memory.
+    template <std::output_iterator<std::string> OutputIt>
+    void
+    write_chunk(std::string_view chunk, OutputIt& it)
+    {
+        if (!chunk.empty()) {
+            _M_chunk.assign(chunk);
+            *it = _M_chunk;
+            ++it;
+        }
+    }
+
+    /// Generate tokens until the token scanner stops the generation, or the context is full.
+    ///
+    /// Generated tokens are decoded through the \ref text::utf8_stream_decoder, so that the
+    /// output iterator receives only complete UTF-8 characters, even when a character is
+    /// split between multiple byte-level tokens.
     template <std::output_iterator<std::string> OutputIt>
     tensor_type
     read_until(OutputIt& it)
     {
         _M_token_scanner->reset();
+        _M_decoder.clear();
 
         auto stream = flush();
         auto token = stream.get()[0, 0];
+        auto decoder_it = _M_decoder.begin();
+
+        while (_M_token_scanner->scan(token) && _M_start_pos < _M_max_tokens) {
+            tokenizer_traits::decode(*_M_tokenizer, token, decoder_it);
+            write_chunk(_M_decoder.take(), it);
 
-        while (_M_token_scanner->scan(token)) {
-            tokenizer_traits::decode(*_M_tokenizer, token, it);
             stream = _M_transformer->transform(stream, _M_start_pos++);
             token = stream.get()[0, 0];
         }
 
+        write_chunk(_M_decoder.flush(), it);
         return stream;
     }
 };
@@ -9,13 +9,17 @@
 #include <metalchat/container.h>
 #include <metalchat/dtype.h>
 #include <metalchat/functional.h>
+#include <metalchat/gguf.h>
 #include <metalchat/interpreter.h>
 #include <metalchat/kernel.h>
 #include <metalchat/kernel_thread.h>
+#include <metalchat/name_mapping.h>
 #include <metalchat/nn.h>
 #include <metalchat/reference.h>
 #include <metalchat/repository.h>
 #include <metalchat/safetensor.h>
 #include <metalchat/tensor.h>
 #include <metalchat/text.h>
+#include <metalchat/thread_pool.h>
+#include <metalchat/tracing.h>
 #include <metalchat/transformer.h>
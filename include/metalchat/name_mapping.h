@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace metalchat {
+
+
+/// A compiled mapping of tensor names.
+///
+/// The mapping is used to adapt names of tensors between checkpoint formats (e.g. from the
+/// HuggingFace naming to the naming of the reference implementation). Patterns of the mapping
+/// are compiled into a trie once, so that every name is matched against all patterns within a
+/// single walk over the name, instead of evaluating a regular expression per pattern.
+///
+/// A pattern is a literal string with the following placeholders:
+/// - `{n}` matches a non-empty sequence of decimal digits (e.g. a number of the layer);
+/// - `{*}` matches a non-empty sequence of characters other than `.` (a name component).
+///
+/// Placeholders are greedy and captured in the order of appearance. A replacement refers to
+/// captures as `$1`, `$2`, etc., and `$$` is replaced with `$`.
+///
+/// A pattern matches a prefix of the name, that ends at a component boundary (i.e. before `.`
+/// or at the end of the name), and the longest matching prefix wins. The matched prefix is
+/// substituted with the replacement, the rest of the name is kept, names that don't match any
+/// pattern are kept unchanged.
+///
+/// ```cpp
+/// name_mapping mapping = {
+///     {"model.layers.{n}.mlp.gate_proj", "layers.$1.feed_forward.w1"},
+///     {"model.embed_tokens", "tok_embeddings"},
+/// };
+///
+/// auto name = mapping.apply("model.layers.3.mlp.gate_proj.weight");
+/// // name == "layers.3.feed_forward.w1.weight"
+/// ```
+class name_mapping {
+public:
+    /// A result of matching the name against patterns of the mapping.
+    struct match_result {
+        /// An index of the matched pattern in the order of insertion.
+        std::size_t index;
+        /// A size of the matched prefix of the name.
+        std::size_t size;
+        /// Values of the pattern placeholders, views into the matched name.
+        std::vector<std::string_view> captures;
+    };
+
+    /// Create an empty mapping.
+    name_mapping();
+
+    /// Create a mapping from the list of pattern and replacement pairs.
+    ///
+    /// \param rules Pairs of patterns and replacements in the order of insertion.
+    name_mapping(std::initializer_list<std::pair<std::string_view, std::string_view>> rules);
+
+    /// Insert a pattern with a replacement into the mapping.
+    ///
+    /// Method throws `std::invalid_argument`, when the pattern is malformed, when it's already
+    /// present in the mapping, or when the replacement refers to a non-existing capture.
+    ///
+    /// \param pattern A pattern of the name.
+    /// \param replacement A replacement of the matched prefix.
+    /// \return An index of the inserted pattern.
+    std::size_t
+    insert(std::string_view pattern, std::string_view replacement);
+
+    /// Insert a pattern without a replacement into the mapping, names matching the pattern are
+    /// kept unchanged by \ref apply. Such patterns are used only to classify names with
+    /// \ref match.
+    ///
+    /// \param pattern A pattern of the name.
+    /// \return An index of the inserted pattern.
+    std::size_t
+    insert(std::string_view pattern);
+
+    /// Match the name against all patterns of the mapping.
+    ///
+    /// \param name A name to match.
+    /// \return The longest match, or an empty optional, when no pattern matches the name.
+    std::optional<match_result>
+    match(std::string_view name) const;
+
+    /// Apply the mapping to the name.
+    ///
+    /// \param name A name to map.
+    /// \return A mapped name, or a copy of the name, when no pattern matches it.
+    std::string
+    apply(std::string_view name) const;
+
+    /// Returns the number of patterns in the mapping.
+    std::size_t
+    size() const;
+
+private:
+    static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max();
+
+    struct _Node {
+        std::vector<std::pair<char, std::uint32_t>> children;
+        std::uint32_t digits = npos;
+        std::uint32_t component = npos;
+        std::uint32_t rule = npos;
+    };
+
+    struct _Segment {
+        std::string literal;
+        std::size_t capture;
+    };
+
+    struct _Rule {
+        std::vector<_Segment> replacement;
+        bool identity;
+    };
+
+    std::vector<_Node> _M_nodes;
+    std::vector<_Rule> _M_rules;
+
+    std::uint32_t
+    insert_child(std::uint32_t node, char c);
+
+    std::size_t
+    insert_rule(std::string_view pattern, std::optional<std::string_view> replacement);
+
+    void
+    match(
+        std::uint32_t node,
+        std::string_view name,
+        std::size_t pos,
+        std::vector<std::string_view>& captures,
+        std::optional<match_result>& result
+    ) const;
+};
+
+
+} // namespace metalchat
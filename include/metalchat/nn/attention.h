@@ -4,8 +4,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <format>
 #include <optional>
 #include <ranges>
+#include <stdexcept>
 
 #include <metalchat/functional.h>
 #include <metalchat/kernel/copy.h>
@@ -16,6 +20,7 @@
 #include <metalchat/nn/linear.h>
 #include <metalchat/nn/rmsnorm.h>
 #include <metalchat/tensor/future.h>
+#include <metalchat/thread_pool.h>
 
 
 namespace metalchat {
@@ -255,28 +260,123 @@ permute_attention_heads(const Input& input, std::size_t n_heads, hardware_accele
 }
 
 
+/// Permute rows of the attention weight matrix with a single strided copy on the host.
+///
+/// Rows of the matrix are viewed as a tensor of shape `[n_heads, attention_heads, 2]`, which
+/// is transposed to the shape `[n_heads, 2, attention_heads]`. Since every row is contiguous,
+/// the permutation copies whole rows: the matrix is split into blocks of rows of the same head,
+/// and blocks are copied from the threads of the pool. Each block reads input rows sequentially
+/// and writes two sequential streams of output rows, the size of the block is chosen to fit
+/// into the cache of a core.
+///
+/// The input could point to the memory-mapped file, in this case pages of the file are read
+/// only once.
+///
+/// \param input a pointer to the input matrix.
+/// \param output a pointer to the output matrix, it must not overlap with the input matrix.
+/// \param rows a number of rows in the matrix.
+/// \param row_size a size of the row in bytes.
+/// \param n_heads a number of the attention heads in the matrix.
+/// \param pool a thread pool used to copy blocks of rows.
+inline void
+permute_attention_rows(
+    const void* input,
+    void* output,
+    std::size_t rows,
+    std::size_t row_size,
+    std::size_t n_heads,
+    thread_pool& pool
+)
+{
+    if (n_heads == 0 || rows % (n_heads * 2) != 0) {
+        throw std::invalid_argument(std::format(
+            "permute_attention_rows: {} rows could not be split into {} heads", rows, n_heads
+        ));
+    }
+
+    constexpr std::size_t block_size = 256 * 1024;
+
+    const auto attention_heads = rows / n_heads / 2;
+    const auto block_rows = std::max<std::size_t>(1, block_size / (2 * row_size));
+    const auto head_blocks = (attention_heads + block_rows - 1) / block_rows;
+
+    const auto source = static_cast<const char*>(input);
+    const auto target = static_cast<char*>(output);
+
+    pool.parallel_for(n_heads * head_blocks, [&](std::size_t block) {
+        const auto head = block / head_blocks;
+        const auto first = (block % head_blocks) * block_rows;
+        const auto last = std::min(first + block_rows, attention_heads);
+
+        const auto head_source = source + head * 2 * attention_heads * row_size;
+        const auto head_target = target + head * 2 * attention_heads * row_size;
+
+        for (std::size_t j = first; j < last; j++) {
+            const auto row_source = head_source + j * 2 * row_size;
+            const auto row_target = head_target + j * row_size;
+
+            std::memcpy(row_target, row_source, row_size);
+            std::memcpy(row_target + attention_heads * row_size, row_source + row_size, row_size);
+        }
+    });
+}
+
+
 /// This method performs adaptation of HuggingFace-style attention weight matrices (K, Q) to
 /// Meta-style shape.
 ///
+/// The permutation is performed on the host with \ref permute_attention_rows, the result is
+/// written into a new container allocated by the accelerator allocator.
+///
 /// \tparam T a data type of the input tensor.
 /// \param ptr a pointer to the input tensor.
 /// \param n_heads a number of the attention heads in the input tensor.
 /// \param accelerator a hardware accelerator instance.
+/// \param pool a thread pool used to copy rows of the tensor.
 template <typename T>
 void
 permute_attention_heads(
-    std::shared_ptr<basic_tensor>& ptr, std::size_t n_heads, hardware_accelerator& accelerator
+    std::shared_ptr<basic_tensor>& ptr,
+    std::size_t n_heads,
+    hardware_accelerator& accelerator,
+    thread_pool& pool
 )
 {
-    using container_type = hardware_memory_container<T>;
-    using tensor_type = tensor<T, 2, container_type>;
+    auto& input = *ptr;
+    if (input.dimensions() != 2 || input.stride(1) != 1 || input.stride(0) != input.size(1) ||
+        input.offset(0) != 0 || input.offset(1) != 0) {
+        throw std::invalid_argument("permute_attention_heads: weight must be a contiguous matrix");
+    }
 
-    auto weight = shared_tensor(tensor_type());
-    tensor_accessor::resize(*ptr, weight.accessor(), ptr->dimensions());
-    weight.set_container(ptr->container_ptr());
+    const auto rows = input.size(0);
+    const auto row_size = input.size(1) * sizeof(T);
 
-    weight = permute_attention_heads(weight, n_heads, accelerator);
-    ptr->set_container(weight.container_ptr());
+    auto alloc = accelerator.get_allocator();
+    auto container_ptr = alloc.allocate(rows * row_size);
+
+    using container_traits_type = container_traits<hardware_memory_container<void>>;
+    auto output = container_traits_type::template rebind<T>(container_ptr);
+
+    permute_attention_rows(input.data(), output->data_ptr(), rows, row_size, n_heads, pool);
+    ptr->set_container(output);
+}
+
+
+/// This method performs adaptation of HuggingFace-style attention weight matrices (K, Q) to
+/// Meta-style shape.
+///
+/// \tparam T a data type of the input tensor.
+/// \param ptr a pointer to the input tensor.
+/// \param n_heads a number of the attention heads in the input tensor.
+/// \param accelerator a hardware accelerator instance.
+template <typename T>
+void
+permute_attention_heads(
+    std::shared_ptr<basic_tensor>& ptr, std::size_t n_heads, hardware_accelerator& accelerator
+)
+{
+    thread_pool pool;
+    permute_attention_heads<T>(ptr, n_heads, accelerator, pool);
 }
 
 
@@ -123,9 +123,8 @@ public:
         );
 
         for (std::size_t i = 0; i < _M_transforms->size(); i++) {
-            auto& transform = _M_transforms->at(i);
             auto& mask = uses_sliding_attention(i) ? sliding_mask : rolling_mask;
-            x = transform(x, mask, start_pos);
+            x = _M_transforms(i, x, mask, start_pos);
         }
 
         auto output = _M_norm(x);
@@ -14,6 +14,7 @@
 #include <metalchat/accelerator.h>
 #include <metalchat/kernel.h>
 #include <metalchat/tensor.h>
+#include <metalchat/tracing.h>
 
 
 namespace metalchat {
@@ -156,10 +157,12 @@ public:
     /// Invoke the stored layer target with the parameters `args`.
     ///
     /// Effectively does `f(std::forward<Args>(args)...);`, where `f` is the target layer.
+    /// The invocation opens an \ref allocation_scope with the name of the layer.
     template <typename... Args>
     auto
     operator()(Args&&... args)
     {
+        const allocation_scope scope(_M_value->name(), _M_value->delimiter());
         return (*_M_value)(std::forward<Args>(args)...);
     }
 
@@ -292,6 +295,13 @@ public:
     char
     delimiter() const;
 
+    /// Return a name, under which the layer was registered in the upstream layer.
+    ///
+    /// The name is empty for layers, that are not registered (e.g. the root layer of the
+    /// model). When the layer is registered multiple times, the last name is returned.
+    const std::string&
+    name() const;
+
     /// Get a constant reference to the hardware accelerator.
     const hardware_accelerator&
     accelerator() const;
@@ -502,6 +512,7 @@ public:
         if (auto it = _M_polymorphic_pointers.find(name); it != _M_polymorphic_pointers.end()) {
             *(it->second) = layer.get();
         }
+        layer.get()->_M_name = name;
         _M_layers.insert_or_assign(name, layer.get());
         return layer;
     }
@@ -605,6 +616,7 @@ private:
 
     hardware_accelerator _M_accelerator;
     char _M_delimiter;
+    std::string _M_name;
 };
 
 
@@ -738,6 +750,7 @@ public:
     operator()(Args&&... args)
     {
         auto& layer = *get();
+        const allocation_scope scope(layer.name(), layer.delimiter());
         return layer(std::forward<Args>(args)...);
     }
 
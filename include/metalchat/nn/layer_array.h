@@ -50,7 +50,10 @@ namespace nn {
 ///             // Step 4. Use layers as a regular random-access array.
 ///             input = linears[i / 2](input) + linears[i](input);
 ///         }
-///         return input;
+///
+///         // Step 5. Invoke layers through the array to attribute allocations to the path
+///         // of the layer (i.e. `linears.0`), see \ref allocation_scope.
+///         return linears(0, input);
 ///     }
 /// };
 /// ```
@@ -121,6 +124,22 @@ public:
         return *_M_pointers[pos];
     }
 
+    /// Invoke the `pos`-element of the layer array with the parameters `args`.
+    ///
+    /// Unlike the invocation of the reference returned by \ref at, the invocation opens an
+    /// \ref allocation_scope with the index of the layer, so when the array itself is invoked
+    /// through \ref indirect_layer, allocations are tagged with the full path of the element
+    /// (e.g. `layers.0.attention`).
+    ///
+    /// \param pos the position of a layer in the array.
+    /// \param args arguments to forward to the layer.
+    template <typename... Args>
+    auto
+    operator()(size_type pos, Args&&... args)
+    {
+        return _M_pointers.at(pos)(std::forward<Args>(args)...);
+    }
+
     /// Appends an existing layer to the end of the container.
     ///
     /// \param layer the layer to append.
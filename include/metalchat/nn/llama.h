@@ -121,8 +121,7 @@ public:
         auto mask = make_causal_mask<T>(len, end_pos, accelerator());
 
         for (std::size_t i = 0; i < _M_transforms->size(); i++) {
-            auto& transform = _M_transforms->at(i);
-            x = transform(x, mask, start_pos);
+            x = _M_transforms(i, x, mask, start_pos);
         }
 
         auto output = _M_norm(x);
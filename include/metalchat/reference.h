@@ -5,9 +5,11 @@
 #pragma once
 
 #include <istream>
+#include <optional>
 #include <string_view>
 
 #include <metalchat/allocator.h>
+#include <metalchat/name_mapping.h>
 #include <metalchat/nn/llama.h>
 #include <metalchat/safetensor.h>
 #include <metalchat/tensor/concept.h>
@@ -19,23 +21,33 @@ namespace metalchat {
 namespace reference {
 
 
-template <typename T, nn::mutable_layer Layer> class llama3_safetensor_serializer {
+template <typename T, nn::mutable_layer Layer>
+class llama3_safetensor_serializer
+: public basic_safetensor_serializer<llama3_safetensor_serializer<T, Layer>> {
 public:
     using value_type = nn::indirect_layer<Layer>;
+    using base_type = basic_safetensor_serializer<llama3_safetensor_serializer>;
+
+    /// An identifier of the adaptation of weights, it must be changed whenever the adaptation
+    /// changes, so that models compiled by earlier versions are compiled again.
+    static constexpr std::string_view compiled_layout = "reference.llama3.1";
 
     /// The safetensor serializer for a Llama3 model.
     llama3_safetensor_serializer(
         const nn::llama3_options& options, hardware_accelerator& accelerator
     )
-    : _M_options(options),
+    : base_type({"tok_embeddings", "layers.", "norm", "output"}),
+      _M_options(options),
       _M_accelerator(accelerator)
     {}
 
     value_type
     load(const safetensor_document& document)
     {
-        value_type layer(_M_options, _M_accelerator);
         auto doc = adapt(document);
+        this->start_warmup(doc);
+
+        auto layer = make_layer();
         doc.load(layer);
         adapt(layer);
         return layer;
@@ -73,20 +85,25 @@ public:
     void
     adapt(value_type& layer)
     {
-        const std::vector<std::pair<std::regex, std::size_t>> permutations = {
-            {std::regex(R"(layers\.(\d+)\.attention\.wk\.weight)"), _M_options.n_kv_heads},
-            {std::regex(R"(layers\.(\d+)\.attention\.wq\.weight)"), _M_options.n_heads},
-        };
+        // Patterns are compiled once, the index of the matched pattern selects the number
+        // of heads of the weight.
+        static const name_mapping permutations = [] {
+            name_mapping mapping;
+            mapping.insert("layers.{n}.attention.wk.weight");
+            mapping.insert("layers.{n}.attention.wq.weight");
+            return mapping;
+        }();
+        const std::size_t permutation_heads[] = {_M_options.n_kv_heads, _M_options.n_heads};
+
+        // Rows of weights are permuted on the host into new containers, the pool is shared
+        // by all permutations, so that threads are not created for every weight.
+        thread_pool pool;
 
-        // Create a typed container, duplicate accessor attributes (strides, sizes, and offsets);
-        // and use the same container. After permutations, override the original container with
-        // the resulting container.
         auto permute_attention = [&](nn::named_parameter param) {
-            for (auto& [re, n_heads] : permutations) {
-                if (std::regex_match(param.path, re)) {
-                    nn::permute_attention_heads<T>(param.ptr, n_heads, _M_accelerator);
-                    break;
-                }
+            auto match = permutations.match(param.path);
+            if (match.has_value() && match->size == param.path.size()) {
+                auto n_heads = permutation_heads[match->index];
+                nn::permute_attention_heads<T>(param.ptr, n_heads, _M_accelerator, pool);
             }
         };
 
@@ -94,8 +111,16 @@ public:
     }
 
 private:
+    friend base_type;
+
     nn::llama3_options _M_options;
     hardware_accelerator _M_accelerator;
+
+    value_type
+    make_layer()
+    {
+        return value_type(_M_options, _M_accelerator);
+    }
 };
 
 
@@ -120,16 +145,17 @@ struct llama3_tokenizer_loader {
     using type = text::byte_pair_encoder<char>;
 
     /// A regular expression string that is used to split the input text into tokens.
-    // clang-format off
-    static constexpr std::string_view default_regex =
-        (R"((?i:'s|'t|'re|'ve|'m|'ll|'d)|)"
-         R"([^\r\n\p{L}\p{N}]?\p{L}+|)"
-         R"(\p{N}{1,3}|)"
-         R"( ?[^\s\p{L}\p{N}]+[\r\n]*|)"
-         R"(\s*[\r\n]+|)"
-         R"(\s+(?!\S)|)"
-         R"(\s+)");
-    // clang-format on
+    ///
+    /// Tokenizers created with this expression use \ref text::llama3_pretokenizer to
+    /// split the input instead of a regular expression engine.
+    static constexpr std::string_view default_regex = text::llama3_pretokenizer::pattern;
+
+    /// A default memory budget of the pre-token encoding cache, 16MiB.
+    static constexpr std::size_t default_cache_size = 16 * 1024 * 1024;
+
+    /// A memory budget (in bytes) of the pre-token encoding cache of loaded tokenizers. When
+    /// the value is zero, tokenizers are loaded without the encoding cache.
+    std::size_t cache_size = default_cache_size;
 
     /// Load a tokenizer from the input stream.
     ///
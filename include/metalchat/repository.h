@@ -83,8 +83,15 @@ struct filesystem_repository {
             ));
         }
 
+        // Loaders that accept a path could use artifacts stored next to the tokenizer
+        // model, like a compiled vocabulary, therefore they are preferred over streams.
         tokenizer_loader loader;
-        return loader.load(tokenizer_stream);
+        if constexpr (requires { loader.load(tokenizer_path); }) {
+            tokenizer_stream.close();
+            return loader.load(tokenizer_path);
+        } else {
+            return loader.load(tokenizer_stream);
+        }
     }
 
     tokenizer_type
@@ -94,18 +101,47 @@ struct filesystem_repository {
         return retrieve_tokenizer(p);
     }
 
+    /// Retrieve the transformer from the safetensor document at the specified location.
+    ///
+    /// When the compiled document of the model exists next to the safetensor document (see
+    /// \ref compile_transformer), and it was compiled from the current version of the model,
+    /// the transformer is loaded from the compiled document without adaptation of weights.
     transformer_type
     retrieve_transformer(const std::filesystem::path& p, const options_type& options)
     {
         layer_serializer serializer(options, _M_accelerator);
-
         auto document_path = _M_repo_path / p;
-        auto document = document_type::open(document_path, _M_accelerator);
+
+        if constexpr (requires(safetensor_document& d) { serializer.load_compiled(d); }) {
+            auto compiled_path = compiled_safetensor::compiled_path(document_path);
+            if (serializer.is_compiled(compiled_path, document_path)) {
+                auto document = safetensor_document::open(compiled_path, _M_accelerator);
+                return transformer_type(serializer.load_compiled(document));
+            }
+        }
+
+        auto document = _M_open_document(document_path);
         auto layer = serializer.load(document);
 
         return transformer_type(layer);
     }
 
+    /// Compile the transformer into a document with weights in the layout of the layer.
+    ///
+    /// The compiled document is written next to the safetensor document, with the file
+    /// extension \ref compiled_safetensor::default_extension.
+    void
+    compile_transformer(const std::filesystem::path& p, const options_type& options)
+    {
+        layer_serializer serializer(options, _M_accelerator);
+
+        auto document_path = _M_repo_path / p;
+        auto compiled_path = compiled_safetensor::compiled_path(document_path);
+
+        auto document = _M_open_document(document_path);
+        serializer.compile(document, compiled_path, document_path);
+    }
+
     transformer_type
     retrieve_transformer(const options_type& options) requires has_transformer_location<Transformer>
     {
@@ -160,6 +196,21 @@ struct filesystem_repository {
 private:
     std::filesystem::path _M_repo_path;
     hardware_accelerator _M_accelerator;
+
+    /// Open the document of the model. Documents split into shards (see
+    /// \ref sharded_safetensor_document) are opened concurrently, one shard per thread.
+    document_type
+    _M_open_document(const std::filesystem::path& p)
+    {
+        if constexpr (requires(hardware_accelerator& accelerator, thread_pool& pool) {
+                          document_type::open(p, accelerator, pool);
+                      }) {
+            thread_pool pool;
+            return document_type::open(p, _M_accelerator, pool);
+        } else {
+            return document_type::open(p, _M_accelerator);
+        }
+    }
 };
 
 
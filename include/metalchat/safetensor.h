@@ -5,13 +5,21 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <functional>
 #include <istream>
 #include <numeric>
+#include <optional>
 #include <regex>
+#include <span>
 #include <streambuf>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -20,8 +28,10 @@
 #include <metalchat/allocator.h>
 #include <metalchat/container.h>
 #include <metalchat/dtype.h>
+#include <metalchat/name_mapping.h>
 #include <metalchat/nn/layer.h>
 #include <metalchat/tensor/basic.h>
+#include <metalchat/thread_pool.h>
 
 
 namespace metalchat {
@@ -140,6 +150,123 @@ struct safetensor_header {
 };
 
 
+/// A descriptor of the tensor in the safetensor header.
+///
+/// Strings and the shape of the descriptor are views into the memory owned by the
+/// \ref safetensor_header_view and the parsed buffer, so the descriptor is valid only as
+/// long as both of them are alive.
+struct safetensor_descriptor {
+    /// A name of the tensor.
+    std::string_view name;
+    /// A data type string representation as in the safetensor specification.
+    std::string_view dtype;
+    /// Sizes of the tensor.
+    std::span<const std::size_t> shape;
+    /// Offsets of the first and past the last byte of the tensor, relative to the beginning
+    /// of the data section (right after the header).
+    std::array<std::size_t, 2> data_offsets;
+    /// True, when the tensor data is aligned on the size of the tensor element.
+    bool aligned;
+
+    /// Returns the size of the tensor in bytes.
+    std::size_t
+    size() const
+    {
+        return data_offsets[1] - data_offsets[0];
+    }
+};
+
+
+/// A view of the safetensor header, which is parsed in place without copying it.
+///
+/// The parser reads the JSON-encoded header directly from the specified buffer (usually a
+/// memory-mapped file), and produces a flat array of tensor descriptors ordered by the data
+/// offset. Names of tensors are views into the buffer, only strings that contain JSON escape
+/// sequences are decoded into the memory owned by the view.
+///
+/// The header is validated while it's parsed: offsets of tensors must be within the data
+/// section and must not overlap, sizes of tensors must match their shapes, and names of
+/// tensors must be unique. When the header is corrupted, the parser throws
+/// `std::runtime_error`.
+///
+/// ```cpp
+/// auto file = std::make_shared<basic_memfile>("model.safetensors");
+/// file->declare_mapped();
+///
+/// auto header = safetensor_header_view(file->data(), file->size());
+/// for (const auto& tensor : header.tensors()) {
+///     std::cout << tensor.name << std::endl;
+/// }
+/// ```
+class safetensor_header_view {
+public:
+    using metadata_type = std::vector<std::pair<std::string_view, std::string_view>>;
+
+    /// The maximum size of the header, larger headers are considered corrupted.
+    static constexpr std::size_t max_header_size = 100 * 1024 * 1024;
+
+    /// The maximum number of tensor dimensions.
+    static constexpr std::size_t max_dimensions = 16;
+
+    /// Parse the header of the safetensor file.
+    ///
+    /// \param data A pointer to the beginning of the file, which starts with the size of
+    ///     the header.
+    /// \param size A size of the file.
+    safetensor_header_view(const char* data, std::size_t size);
+
+    /// Parse the JSON-encoded safetensor header.
+    ///
+    /// \param header A JSON-encoded header (without the size prefix).
+    /// \param data_size A size of the data section, which follows the header.
+    safetensor_header_view(std::string_view header, std::size_t data_size);
+
+    safetensor_header_view(safetensor_header_view&&) = default;
+    safetensor_header_view(const safetensor_header_view&) = delete;
+
+    /// Returns descriptors of tensors ordered by the data offset.
+    const std::vector<safetensor_descriptor>&
+    tensors() const
+    {
+        return _M_tensors;
+    }
+
+    /// Returns key-value pairs of the `__metadata__` section of the header.
+    const metadata_type&
+    metadata() const
+    {
+        return _M_metadata;
+    }
+
+    /// Returns an offset of the data section from the beginning of the file.
+    std::size_t
+    data_offset() const
+    {
+        return _M_data_offset;
+    }
+
+    /// Returns a size of the data section, which is referenced by tensor offsets.
+    std::size_t
+    data_size() const
+    {
+        return _M_data_size;
+    }
+
+private:
+    struct _Parser;
+
+    std::vector<safetensor_descriptor> _M_tensors;
+    std::vector<std::size_t> _M_shapes;
+    metadata_type _M_metadata;
+    std::deque<std::string> _M_strings;
+    std::size_t _M_data_offset;
+    std::size_t _M_data_size;
+
+    void
+    parse(std::string_view header);
+};
+
+
 class safetensor {
 public:
     using container_type = basic_container;
@@ -371,9 +498,9 @@ public:
     /// \param size a size of a new container in bytes.
     /// \param alloc a basic void allocator to use for typed allocation.
     container_ptr
-    allocate(const std::string& type_name, void* data, std::size_t size, Allocator& alloc)
+    allocate(std::string_view type_name, void* data, std::size_t size, Allocator& alloc)
     {
-        auto& [_, allocator] = _M_type_alloc[type_name];
+        auto& [_, allocator] = find_type(type_name);
         return allocator(data, size, alloc);
     }
 
@@ -383,9 +510,9 @@ public:
     /// \param size a size of a new container in bytes.
     /// \param alloc a basic void allocator to use for typed allocation.
     container_ptr
-    allocate(const std::string& type_name, std::size_t size, Allocator& alloc)
+    allocate(std::string_view type_name, std::size_t size, Allocator& alloc)
     {
-        auto& [allocator, _] = _M_type_alloc[type_name];
+        auto& [allocator, _] = find_type(type_name);
         return allocator(size, alloc);
     }
 
@@ -401,7 +528,19 @@ private:
     /// Store both function pointers within the same container for the ease of access.
     using container_alloc = std::pair<make_alloc, copy_alloc>;
 
-    std::unordered_map<std::string, container_alloc, _StringHash> _M_type_alloc;
+    std::unordered_map<std::string, container_alloc, _StringHash, std::equal_to<>> _M_type_alloc;
+
+    const container_alloc&
+    find_type(std::string_view type_name) const
+    {
+        auto it = _M_type_alloc.find(type_name);
+        if (it == _M_type_alloc.end()) {
+            throw std::invalid_argument(
+                std::format("safetensor_allocator: unsupported data type '{}'", type_name)
+            );
+        }
+        return it->second;
+    }
 
     template <typename T>
     void
@@ -530,6 +669,30 @@ concept safetensor_serializer = requires(Serializer s) {
 };
 
 
+/// Options of the concurrent safetensor writer, see \ref safetensor_document::save.
+struct safetensor_save_options {
+    /// A prefix of the metadata keys, that store hashes of tensors.
+    static constexpr std::string_view hash_prefix = "metalchat.rapidhash.";
+
+    /// Returns a metadata key of the hash of the tensor, see \ref hash_prefix.
+    ///
+    /// \param name A name of the tensor.
+    static std::string
+    hash_key(std::string_view name);
+
+    /// Alignment of the data section in bytes (e.g. 64 bytes or the size of the page).
+    std::size_t alignment = 64;
+
+    /// When true, a rapidhash of every tensor is computed, and stored in the metadata with
+    /// a key `metalchat.rapidhash.<name>` as a 16-digit hexadecimal number.
+    bool hash = false;
+
+    /// A size of the data written by a single task, large tensors are split into chunks,
+    /// so that they are written concurrently. Chunks are not used, when tensors are hashed.
+    std::size_t chunk_size = 16 << 20;
+};
+
+
 /// A document for writing and reading tensors in a `safetensor` format.
 class safetensor_document {
 public:
@@ -562,6 +725,12 @@ private:
     void
     insert(const safetensor_metadata& tensor, const safetensor_container& container);
 
+    void
+    insert(const safetensor_descriptor& tensor, const safetensor_container& container);
+
+    void
+    insert(const safetensor_header_view::metadata_type& metadata);
+
     void
     load(const safetensor& st, basic_tensor& tensor) const;
 
@@ -577,6 +746,15 @@ public:
     /// A \ref safetensor_document copy constructor.
     safetensor_document(const safetensor_document&) = default;
 
+    /// A \ref safetensor_document move constructor.
+    safetensor_document(safetensor_document&&) = default;
+
+    safetensor_document&
+    operator=(const safetensor_document&) = default;
+
+    safetensor_document&
+    operator=(safetensor_document&&) = default;
+
     /// Returns tensor offsets (relative to a safetensor metadata header) in bytes.
     std::vector<std::size_t>
     offsets() const;
@@ -640,6 +818,32 @@ public:
     static safetensor_document
     open(const std::filesystem::path& p, hardware_accelerator& accelerator);
 
+    /// Open a safetensor document lazily.
+    ///
+    /// This implementation maps only the header of the file. Every tensor is allocated into
+    /// \ref filebuf_memory_container, that refers a window of the file (see \ref basic_memfile).
+    /// Windows are grouped by layers, and each layer is mapped on the first access to any of
+    /// its tensors. When the size of the mapped layers exceeds the budget of the residency
+    /// manager, the least recently used layers are evicted, so that models that don't fit into
+    /// the memory could be run by streaming layers from the file.
+    ///
+    /// A layer of the tensor is the prefix of the tensor name up to the first numeric component
+    /// (e.g. `layers.0` for `layers.0.attention.wq.weight`), or the name without the last
+    /// component for tensors outside of numbered layers (e.g. `norm` for `norm.weight`).
+    ///
+    /// ```cpp
+    /// residency_manager residency(std::size_t(8) << 30);
+    /// auto document = safetensor_document::open("model.safetensors", residency);
+    ///
+    /// auto stats = residency.stats();
+    /// std::cout << stats.hits << " " << stats.misses << " " << stats.evictions << std::endl;
+    /// ```
+    ///
+    /// \param p A path in the filesystem to a file in a safetensor format.
+    /// \param residency A residency manager used to map and evict layers.
+    static safetensor_document
+    open(const std::filesystem::path& p, residency_manager& residency);
+
     /// Open a safetensor document.
     ///
     /// This implementation reads safetensor data from the specified basic stream. So all reads
@@ -690,20 +894,45 @@ public:
     static safetensor_document
     open(const std::filesystem::path& p, Allocator& alloc, std::size_t max_size = -1)
     {
-        auto file = std::make_shared<basic_memfile>(p);
-        file->declare_mapped();
+        return open(p, memory_map_options{}, alloc, max_size);
+    }
 
-        spanbuf streambuf(file->data(), file->size());
-        std::istream safetensor_stream(&streambuf);
+    /// Open a safetensor document.
+    ///
+    /// This implementation is similar to
+    /// \ref safetensor_document::open(const std::filesystem::path&, Allocator&, std::size_t),
+    /// except that the file is memory-mapped with the specified options (e.g. backed by huge
+    /// pages and populated in advance). Options are hints, when they are not supported, the
+    /// file is mapped with the default options, see \ref basic_memfile::map_mode.
+    ///
+    /// \tparam Allocator A type of the allocator used to allocate tensor containers.
+    /// \param p A path in the filesystem to a file in a safetensor format.
+    /// \param options Options of the memory mapping of the file.
+    /// \param alloc An instance of the Allocator type.
+    /// \param max_size A maximum size of the buffer to allocate.
+    template <allocator_t<void> Allocator>
+    static safetensor_document
+    open(
+        const std::filesystem::path& p,
+        const memory_map_options& options,
+        Allocator& alloc,
+        std::size_t max_size = -1
+    )
+    {
+        auto file = std::make_shared<basic_memfile>(p);
+        file->declare_mapped(options);
 
-        auto header = parse_header(safetensor_stream);
+        // The header is parsed in place, names of tensors are views into the mapped file,
+        // which are copied only when tensors are inserted into the document.
+        auto header = safetensor_header_view(file->data(), file->size());
 
         std::vector<std::size_t> sizes;
-        for (const auto& m : header.tensors) {
-            sizes.push_back(m.size());
+        sizes.reserve(header.tensors().size());
+        for (const auto& tensor : header.tensors()) {
+            sizes.push_back(tensor.size());
         }
 
-        auto data_ptr = file->data() + safetensor_stream.tellg();
+        auto data_ptr = file->data() + header.data_offset();
 
         // Use an aliasing allocator to bind file pointer to container pointer,
         // so that file is closed (and evicted from mapped memory), only when
@@ -735,14 +964,15 @@ public:
         safetensor_document document;
         safetensor_allocator<allocator_type> allocator;
 
-        for (const auto& m : header.tensors) {
-            auto data = container_data_ptr + m.data_offsets[0];
+        for (const auto& tensor : header.tensors()) {
+            auto data = container_data_ptr + tensor.data_offsets[0];
+            auto size = tensor.size();
 
-            auto container_ptr = allocator.allocate(m.dtype, data, m.size(), container_alloc);
-            document.insert(m, std::move(container_ptr));
+            auto container_ptr = allocator.allocate(tensor.dtype, data, size, container_alloc);
+            document.insert(tensor, std::move(container_ptr));
         }
 
-        document._M_metadata = header.metadata;
+        document.insert(header.metadata());
         return document;
     }
 
@@ -758,6 +988,23 @@ public:
         return open(p, alloc, max_size);
     }
 
+    /// Open a safetensor document.
+    ///
+    /// This implementation is similar to
+    /// \ref safetensor_document::open(const std::filesystem::path&, const memory_map_options&,
+    /// Allocator&, std::size_t), except that allocator must be an r-value.
+    template <allocator_t<void> Allocator>
+    static safetensor_document
+    open(
+        const std::filesystem::path& p,
+        const memory_map_options& options,
+        Allocator&& alloc,
+        std::size_t max_size = -1
+    )
+    {
+        return open(p, options, alloc, max_size);
+    }
+
     /// Insert a safetensor into the safetensor document.
     void
     insert(const safetensor& st);
@@ -803,6 +1050,17 @@ public:
     void
     insert(const std::string& name, const std::string& source);
 
+    /// Move all tensors of the specified document to the end of the safetensor document.
+    ///
+    /// Offsets of the moved tensors are shifted by the size of this document, so that the
+    /// resulting document remains contiguous, containers are moved without copying the tensor
+    /// data. Metadata entries of the specified document are inserted, unless the document
+    /// already contains entries with the same keys.
+    ///
+    /// \param document A document to merge into this document.
+    void
+    merge(safetensor_document&& document);
+
     /// Insert all registered parameters of the specified layer into the safetensor document.
     ///
     /// This method recursively traverses layer and inserts parameters into the safetensor
@@ -852,6 +1110,25 @@ public:
         return doc;
     }
 
+    /// Rename tensors of the safetensor document with the compiled name mapping.
+    ///
+    /// Unlike the renaming with a list of regular expressions, every name is mapped with a
+    /// single walk over the trie of the mapping, so the mapping should be preferred for
+    /// checkpoints with many tensors. Containers are shared with the renamed document.
+    ///
+    /// ```cpp
+    /// static const name_mapping mapping = {
+    ///     {"model.layers.{n}.self_attn.q_proj", "layers.$1.attention.wq"},
+    ///     {"model.norm", "norm"},
+    /// };
+    ///
+    /// auto doc = document.rename(mapping);
+    /// ```
+    ///
+    /// \param mapping A mapping of tensor names.
+    safetensor_document
+    rename(const name_mapping& mapping) const;
+
     /// Load tensors from a safetensor document into the layer's registered parameters.
     ///
     /// The implementation is identical to the
@@ -964,11 +1241,305 @@ public:
     void
     save(const std::filesystem::path& p);
 
+    /// Save all registered tensors into the file at the specified location, tensors are
+    /// written concurrently from the threads of the pool.
+    ///
+    /// Offsets of all tensors are computed up front, the file is preallocated, and then
+    /// tensors are written with `pwrite` into their final locations. The header is padded
+    /// with spaces, so that the data section starts at the specified alignment. The format
+    /// does not allow gaps between tensors, therefore tensors are reordered: tensors with
+    /// sizes that are multiples of the alignment are written first, so all of them start at
+    /// aligned offsets, and they are followed by tensors with less aligned sizes.
+    ///
+    /// ```cpp
+    /// thread_pool pool(8);
+    ///
+    /// safetensor_save_options options;
+    /// options.alignment = memory_page_size();
+    /// options.hash = true;
+    ///
+    /// document.save("model.safetensors", pool, options);
+    /// ```
+    ///
+    /// \param p A path to the file to save tensors.
+    /// \param pool A thread pool used to write tensors.
+    /// \param options Options of the writer.
+    void
+    save(
+        const std::filesystem::path& p,
+        thread_pool& pool,
+        const safetensor_save_options& options = safetensor_save_options()
+    );
+
     /// Get a reference to the \ref safetensor_document metadata.
     ///
     /// \return a reference to the metadata container.
     metadata_container&
     get_metadata();
+
+    /// Get a constant reference to the \ref safetensor_document metadata.
+    const metadata_container&
+    get_metadata() const;
+
+    /// Compute a rapidhash of every tensor, tensors are hashed concurrently from the threads
+    /// of the pool.
+    ///
+    /// Hashes are computed over the data of tensors, so they are equal to hashes stored in the
+    /// metadata by \ref save with the \ref safetensor_save_options::hash option.
+    ///
+    /// \param pool A thread pool used to hash tensors.
+    /// \return Hashes of tensors in the order of the document tensors.
+    std::vector<std::uint64_t>
+    hash(thread_pool& pool) const;
+};
+
+
+/// Options of the \ref safetensor_warmup.
+struct safetensor_warmup_options {
+    /// Hint the kernel that tensors are read sequentially, so that the read-ahead is performed
+    /// aggressively. The hint is reverted, once the warmup is completed.
+    bool sequential = true;
+    /// Request an asynchronous read of tensors before they are touched.
+    bool willneed = true;
+    /// Request tensors to be backed by huge pages, where the platform supports it.
+    bool hugepage = false;
+    /// Touch pages of tensors from the threads of the pool, when the value is `false`, only
+    /// access hints are applied.
+    bool touch = true;
+    /// Name prefixes of tensors in the order of layer execution. Tensors are touched in the
+    /// order of the first matching prefix, tensors that don't match any prefix are touched
+    /// last. Tensors within the same prefix are ordered by their names, where numbers are
+    /// compared by their values (i.e. `layers.2` precedes `layers.10`).
+    std::vector<std::string> order = {};
+    /// A size of the memory touched by a single thread at once.
+    std::size_t chunk_size = 4 << 20;
+};
+
+
+/// A background warmup of tensors of the safetensor document.
+///
+/// The memory of documents opened from memory-mapped files is populated lazily, so the first
+/// forward pass of a model pays for the page faults of every weight. The warmup applies access
+/// hints to the memory of tensors and touches their pages from the threads of the pool in the
+/// order, in which layers are executed, so that loading of weights overlaps with the other work
+/// (e.g. construction of layers).
+///
+/// Copies of the warmup share the same state, the warmup is not cancelled, when the instance
+/// is destroyed. Tensor containers are held until all copies of the warmup are destroyed and
+/// all threads of the warmup are completed.
+///
+/// ```cpp
+/// thread_pool pool(2);
+///
+/// auto document = safetensor_document::open("model.safetensors", accelerator);
+/// auto warmup = safetensor_warmup(document, pool, {.order = {"tok_embeddings", "layers."}});
+///
+/// while (!warmup.done()) {
+///     std::cout << warmup.progress() << std::endl;
+/// }
+/// ```
+class safetensor_warmup {
+public:
+    /// Start the warmup of the document tensors.
+    ///
+    /// \param document A safetensor document to warm up.
+    /// \param pool A thread pool used to touch pages of tensors.
+    /// \param options Options of the warmup.
+    safetensor_warmup(
+        const safetensor_document& document,
+        thread_pool& pool,
+        const safetensor_warmup_options& options = {}
+    );
+
+    /// The \ref safetensor_warmup copy constructor.
+    safetensor_warmup(const safetensor_warmup&) = default;
+
+    /// Returns the total size of tensors in bytes.
+    std::size_t
+    size() const;
+
+    /// Returns names of tensors in the order, in which their pages are touched. Tensors that
+    /// share the container with a preceding tensor are not listed.
+    const std::vector<std::string>&
+    names() const;
+
+    /// Returns the number of bytes touched so far.
+    std::size_t
+    touched_size() const;
+
+    /// Returns the number of bytes of tensors that are resident in the physical memory.
+    ///
+    /// The value is queried from the kernel on every call, so it accounts for the pages read
+    /// ahead by the kernel, as well as pages evicted under the memory pressure.
+    std::size_t
+    resident_size() const;
+
+    /// Returns the fraction of touched bytes in range `[0, 1]`.
+    float
+    progress() const;
+
+    /// Checks whether all threads of the warmup are completed.
+    bool
+    done() const;
+
+    /// Block the calling thread until all threads of the warmup are completed.
+    void
+    wait() const;
+
+    /// Stop touching pages of tensors, chunks that are already being touched are completed.
+    void
+    cancel();
+
+private:
+    struct _State;
+    std::shared_ptr<_State> _M_state;
+};
+
+
+/// Options of the \ref safetensor_verification.
+struct safetensor_verification_options {
+    /// When true, the verification does not block the caller: tensors are hashed in the
+    /// background from the threads of the pool, and a tensor is hashed immediately, when it
+    /// is verified explicitly (see \ref safetensor_verification::verify) before that.
+    bool lazy = false;
+    /// A path to the sidecar cache of hashes. When the path is empty, the cache is stored
+    /// next to the document, and its name is the name of the document with the `.rapidhash`
+    /// extension appended.
+    std::filesystem::path cache_path = {};
+    /// Hashes of tensors from a trusted source, e.g. hashes computed by
+    /// \ref safetensor_document::hash, when the model was downloaded. These hashes take
+    /// precedence over hashes stored in the metadata of the document.
+    std::unordered_map<std::string, std::uint64_t> expected_hashes = {};
+};
+
+
+/// An integrity verification of tensors of the safetensor document.
+///
+/// Tensors are hashed with rapidhash, and hashes are compared to the expected hashes: hashes
+/// from the \ref safetensor_verification_options::expected_hashes, or hashes stored in the
+/// metadata of the document (see \ref safetensor_save_options::hash). Only documents written
+/// by this library store hashes in the metadata, so third-party documents are verified only
+/// against hashes from a trusted source (e.g. hashes recorded, when the model was downloaded).
+///
+/// Tensors without expected hashes are only hashed, they are not counted as verified, and
+/// are reported by \ref unverified. Once all tensors are hashed, their hashes are written
+/// into the sidecar cache along with the size, modification time and inode of the file.
+/// Later verifications of the same file restore hashes from the cache, and don't read tensors
+/// at all, unless the restored hashes don't match the expected hashes.
+///
+/// Copies of the verification share the same state. Tensors are ordered by their names, where
+/// numbers are compared by their values, so that in the lazy mode tensors are hashed roughly
+/// in the order of layer execution.
+///
+/// \note Tensors are mapped once on construction, and every tensor is acquired (see
+/// \ref basic_container::acquire) only while it is hashed, therefore tensors of documents
+/// opened with the \ref residency_manager are evicted during the verification.
+///
+/// ```cpp
+/// thread_pool pool(4);
+///
+/// auto document = safetensor_document::open("model.safetensors", accelerator);
+/// auto verification = safetensor_verification("model.safetensors", document, pool, {
+///     .lazy = true
+/// });
+///
+/// // Tensors of the first layer are verified before they are used.
+/// verification.verify("layers.0.attention.wq.weight");
+///
+/// // Throws, when any of the tensors is corrupted.
+/// verification.wait();
+/// ```
+class safetensor_verification {
+public:
+    /// An extension of the sidecar cache file.
+    static constexpr std::string_view cache_extension = ".rapidhash";
+
+    /// Start the verification of the document tensors.
+    ///
+    /// When the verification is not lazy, the constructor blocks until all tensors are
+    /// hashed, and throws `std::runtime_error`, when any of the tensors is corrupted.
+    ///
+    /// \param p A path to the file of the document.
+    /// \param document A safetensor document opened from the file.
+    /// \param pool A thread pool used to hash tensors.
+    /// \param options Options of the verification.
+    safetensor_verification(
+        const std::filesystem::path& p,
+        const safetensor_document& document,
+        thread_pool& pool,
+        const safetensor_verification_options& options = {}
+    );
+
+    /// The \ref safetensor_verification copy constructor.
+    safetensor_verification(const safetensor_verification&) = default;
+
+    /// Returns true, when hashes of tensors are restored from the sidecar cache.
+    bool
+    cached() const;
+
+    /// Returns the number of tensors in the document.
+    std::size_t
+    size() const;
+
+    /// Returns the number of tensors, which hashes match the expected hashes.
+    std::size_t
+    verified_size() const;
+
+    /// Verify the tensor, unless it is hashed already. When the tensor is being hashed by
+    /// another thread, the method blocks until the hashing is completed.
+    ///
+    /// The method throws `std::runtime_error`, when the tensor is corrupted.
+    ///
+    /// \param name A name of the tensor to verify.
+    /// \return True, when the hash of the tensor matches the expected hash, and false, when
+    /// the expected hash of the tensor is unknown.
+    bool
+    verify(const std::string& name);
+
+    /// Returns names of tensors, which hashes don't match the expected hashes.
+    std::vector<std::string>
+    corrupted() const;
+
+    /// Returns names of tensors without expected hashes, such tensors are never verified.
+    std::vector<std::string>
+    unverified() const;
+
+    /// Checks whether all tensors are hashed, or the verification is cancelled.
+    bool
+    done() const;
+
+    /// Block the calling thread until all tensors are hashed, or the verification is
+    /// cancelled. Throws `std::runtime_error`, when any of the tensors is corrupted.
+    void
+    wait() const;
+
+    /// Stop hashing tensors in the background, tensors that are already being hashed are
+    /// completed. The cache is not written for the cancelled verification.
+    void
+    cancel();
+
+private:
+    struct _State;
+    std::shared_ptr<_State> _M_state;
+};
+
+
+/// Timing of a single shard opened by the \ref sharded_safetensor_document.
+struct safetensor_shard_timing {
+    using duration = std::chrono::steady_clock::duration;
+
+    /// A path to the shard file.
+    std::filesystem::path path;
+    /// A position of the shard in the consolidated document.
+    std::size_t index;
+    /// A number of tensors in the shard.
+    std::size_t tensor_count;
+    /// A total size of tensors in the shard in bytes.
+    std::size_t size;
+    /// Time elapsed from the start of the opening until the shard was picked up by a thread.
+    duration wait_time;
+    /// Time spent on mapping the file, parsing the header and allocating tensors.
+    duration open_time;
 };
 
 
@@ -977,7 +1548,13 @@ public:
 /// Such documents are composed of two types of files: an index file, that points to the locations
 /// of the safetensors, and actual safetensor documents. This implementation reads the index file,
 /// and combines all safetensors into a single object.
+///
+/// Shards are merged into the consolidated document in the lexicographical order of their file
+/// names, so the resulting document does not depend on the order, in which shards are opened.
 struct sharded_safetensor_document {
+    /// A callback type, that receives timing of every opened shard.
+    using timing_callback = std::function<void(const safetensor_shard_timing&)>;
+
     /// Open a sharded safetensor document.
     ///
     /// See \ref safetensor_document::open(const std::filesystem::path&) for more details.
@@ -996,29 +1573,116 @@ struct sharded_safetensor_document {
     static safetensor_document
     open(const std::filesystem::path& p, hardware_accelerator& accelerator);
 
+    /// Open a sharded safetensor document using a hardware allocator, shards are opened
+    /// concurrently on the threads of the specified pool.
+    ///
+    /// \param p a path to the safetensor index file.
+    /// \param accelerator an instance of the hardware accelerator.
+    /// \param pool a thread pool used to open shards.
+    /// \param callback a callback that receives timing of every shard.
+    static safetensor_document
+    open(
+        const std::filesystem::path& p,
+        hardware_accelerator& accelerator,
+        thread_pool& pool,
+        timing_callback callback = nullptr
+    );
+
+    /// Open a sharded safetensor document lazily.
+    ///
+    /// See \ref safetensor_document::open(const std::filesystem::path&, residency_manager&)
+    /// for more details. Tensors of the same layer are grouped together, even when they are
+    /// distributed across multiple shards.
+    ///
+    /// \param p a path to the safetensor index file.
+    /// \param residency a residency manager used to map and evict layers.
+    static safetensor_document
+    open(const std::filesystem::path& p, residency_manager& residency);
+
     template <allocator_t<void> Allocator>
     static safetensor_document
     open(const std::filesystem::path& p, Allocator& alloc, std::size_t max_size = -1)
     {
-        std::ifstream index_file(p, std::ios::binary | std::ios::in);
-        auto index = safetensor_index::open(index_file);
-        auto index_path = p.parent_path();
+        auto [index_path, filenames] = shard_filenames(p);
 
         safetensor_document consolidated;
-        std::unordered_set<std::string> processed_documents;
+        for (std::size_t i = 0; i < filenames.size(); i++) {
+            auto allocator = alloc;
+            auto document_path = index_path / filenames[i];
+            consolidated.merge(safetensor_document::open(document_path, allocator, max_size));
+        }
+        return consolidated;
+    }
 
-        for (const auto& [_, filename] : index.weight_map) {
-            if (processed_documents.contains(filename)) {
-                continue;
-            }
+    template <allocator_t<void> Allocator>
+    static safetensor_document
+    open(const std::filesystem::path& p, Allocator&& alloc, std::size_t max_size = -1)
+    {
+        return open(p, alloc, max_size);
+    }
+
+    /// Open a sharded safetensor document, shards are opened concurrently on the threads of
+    /// the specified pool.
+    ///
+    /// Every shard is mapped, parsed and allocated independently using a copy of the specified
+    /// allocator, therefore the allocator must be safe to use from multiple threads. Opened
+    /// shards are merged into the consolidated document in a single pass once all of them are
+    /// opened, the callback is invoked in the calling thread in the order of shards.
+    ///
+    /// ```cpp
+    /// thread_pool pool(4);
+    ///
+    /// auto document = sharded_safetensor_document::open(
+    ///     "model.safetensors.index.json", alloc, pool, -1,
+    ///     [](const safetensor_shard_timing& timing) {
+    ///         std::cout << timing.path << ": " << timing.open_time << std::endl;
+    ///     }
+    /// );
+    /// ```
+    ///
+    /// \param p a path to the safetensor index file.
+    /// \param alloc an allocator used to allocate tensor containers.
+    /// \param pool a thread pool used to open shards.
+    /// \param max_size a maximum size of the buffer to allocate.
+    /// \param callback a callback that receives timing of every shard.
+    template <allocator_t<void> Allocator>
+    static safetensor_document
+    open(
+        const std::filesystem::path& p,
+        Allocator& alloc,
+        thread_pool& pool,
+        std::size_t max_size = -1,
+        timing_callback callback = nullptr
+    )
+    {
+        auto [index_path, filenames] = shard_filenames(p);
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<safetensor_document> documents(filenames.size());
+        std::vector<safetensor_shard_timing> timings(filenames.size());
+
+        pool.parallel_for(filenames.size(), [&](std::size_t i) {
+            auto& timing = timings[i];
+            auto shard_start = std::chrono::steady_clock::now();
+
+            timing.path = index_path / filenames[i];
+            timing.index = i;
+            timing.wait_time = shard_start - start;
 
-            processed_documents.insert(filename);
-            auto document_path = index_path / filename;
             auto allocator = alloc;
+            documents[i] = safetensor_document::open(timing.path, allocator, max_size);
+
+            auto sizes = documents[i].sizes();
+            timing.tensor_count = sizes.size();
+            timing.size = std::accumulate(sizes.begin(), sizes.end(), std::size_t(0));
+            timing.open_time = std::chrono::steady_clock::now() - shard_start;
+        });
 
-            auto document = safetensor_document::open(document_path, allocator, max_size);
-            for (auto it = document.begin(); it != document.end(); it++) {
-                consolidated.insert(*it);
+        safetensor_document consolidated;
+        for (std::size_t i = 0; i < documents.size(); i++) {
+            consolidated.merge(std::move(documents[i]));
+            if (callback) {
+                callback(timings[i]);
             }
         }
         return consolidated;
@@ -1026,9 +1690,223 @@ struct sharded_safetensor_document {
 
     template <allocator_t<void> Allocator>
     static safetensor_document
-    open(const std::filesystem::path& p, Allocator&& alloc, std::size_t max_size = -1)
+    open(
+        const std::filesystem::path& p,
+        Allocator&& alloc,
+        thread_pool& pool,
+        std::size_t max_size = -1,
+        timing_callback callback = nullptr
+    )
     {
-        return open(p, alloc, max_size);
+        return open(p, alloc, pool, max_size, std::move(callback));
+    }
+
+private:
+    friend struct compiled_safetensor;
+
+    /// Read the index file and return a directory of the index along with the sorted list
+    /// of unique shard file names.
+    static std::pair<std::filesystem::path, std::vector<std::string>>
+    shard_filenames(const std::filesystem::path& p);
+};
+
+
+/// A safetensor document with model weights in the layout of the MetalChat layers.
+///
+/// Layer serializers adapt weights distributed in third-party formats every time the model
+/// is loaded: tensors are renamed, attention heads are permuted, and tied weights are linked.
+/// The compiled document stores weights after the adaptation, so that later loads map the
+/// document directly and skip the adaptation. Tied weights are stored only once, and the
+/// links are kept in the document metadata (see \ref link).
+///
+/// The metadata of the compiled document also contains the version of the compiled document
+/// format, the identifier of the adaptation (e.g. `huggingface.llama3.1`), and the hash of the
+/// source documents, so that stale documents could be detected (see \ref is_current). The
+/// identifier of the adaptation is defined by the layer serializer, and it changes whenever
+/// the serializer adapts weights differently.
+///
+/// ```cpp
+/// auto layout = std::string_view("huggingface.llama3.1");
+/// auto compiled_path = compiled_safetensor::compiled_path("model.safetensors");
+/// if (compiled_safetensor::is_current(compiled_path, "model.safetensors", layout)) {
+///     auto document = safetensor_document::open(compiled_path, accelerator);
+///     compiled_safetensor::link(document);
+/// }
+/// ```
+struct compiled_safetensor {
+    /// A file extension of the compiled document.
+    static constexpr std::string_view default_extension = ".compiled.safetensors";
+
+    /// A version of the compiled document format (e.g. the encoding of links), documents of
+    /// other versions are considered stale.
+    static constexpr std::string_view version = "1";
+
+    /// Metadata keys of the compiled document.
+    static constexpr std::string_view version_key = "metalchat.compiled.version";
+    static constexpr std::string_view layout_key = "metalchat.compiled.layout";
+    static constexpr std::string_view source_key = "metalchat.compiled.source";
+    static constexpr std::string_view links_key = "metalchat.compiled.links";
+
+    /// Returns a path to the compiled document of the specified safetensor document (or an
+    /// index file of a sharded safetensor document).
+    static std::filesystem::path
+    compiled_path(const std::filesystem::path& p);
+
+    /// Returns a hash of sizes and modification times of the safetensor document. For sharded
+    /// documents, the hash includes the index file and all shards.
+    static std::string
+    source_hash(const std::filesystem::path& p);
+
+    /// Returns true when the compiled document exists, it is of the current version, and it
+    /// was compiled with the specified layout from the current version of the source document.
+    ///
+    /// \param compiled A path to the compiled document.
+    /// \param source A path to the source document.
+    /// \param layout An identifier of the adaptation of weights.
+    static bool
+    is_current(
+        const std::filesystem::path& compiled,
+        const std::filesystem::path& source,
+        std::string_view layout
+    );
+
+    /// Write all registered parameters of the layer into a compiled document.
+    ///
+    /// Parameters that share the same container are written only once. The file is written
+    /// into a temporary location first and then renamed, so that the concurrent readers never
+    /// observe a partially written document.
+    ///
+    /// \param p A path to the compiled document.
+    /// \param layer A layer with adapted parameters.
+    /// \param source A path to the source document the layer was loaded from.
+    /// \param layout An identifier of the adaptation of weights.
+    static void
+    save(
+        const std::filesystem::path& p,
+        const nn::basic_layer& layer,
+        const std::filesystem::path& source,
+        std::string_view layout
+    );
+
+    /// Restore links of tied weights stored in the metadata of the compiled document.
+    static void
+    link(safetensor_document& document);
+};
+
+
+/// A base of layer serializers of safetensor documents.
+///
+/// The base warms up the weights of documents loaded by the serializer (see \ref set_warmup),
+/// derived serializers start the warmup, once the names of tensors are adapted to the layout
+/// of the layer (see \ref start_warmup). The base also compiles the adapted weights into
+/// the \ref compiled_safetensor document, and loads the model from it.
+///
+/// \tparam Serializer A serializer derived from this class. The serializer implements
+///     `load(safetensor_document&)`, which adapts weights and loads the layer, and
+///     `make_layer()`, which creates a layer without weights. Serializers that compile
+///     models define `compiled_layout`, an identifier of the adaptation of weights, which
+///     must be changed whenever the adaptation changes (see \ref compiled_safetensor).
+template <typename Serializer> class basic_safetensor_serializer {
+public:
+    /// Creates a new instance of a serializer base.
+    ///
+    /// \param warmup_order Name prefixes of tensors in the order of layer execution of the
+    ///     model architecture (see \ref safetensor_warmup_options::order).
+    basic_safetensor_serializer(std::vector<std::string> warmup_order)
+    : _M_warmup_order(std::move(warmup_order))
+    {}
+
+    /// Warm up the model weights on the threads of the specified pool, so that page faults
+    /// of memory-mapped weights overlap with the construction of layers.
+    ///
+    /// Tensors are touched in the order of layer execution of the model architecture, unless
+    /// the order is specified in options.
+    ///
+    /// \param pool A thread pool used to touch pages of weights.
+    /// \param options Options of the warmup (see \ref safetensor_warmup).
+    void
+    set_warmup(thread_pool pool, safetensor_warmup_options options = {})
+    {
+        if (options.order.empty()) {
+            options.order = _M_warmup_order;
+        }
+        _M_warmup_pool = pool;
+        _M_warmup_options = std::move(options);
+    }
+
+    /// Returns the warmup started by the last load of the model, the warmup could be used to
+    /// report the progress of loading weights.
+    std::optional<safetensor_warmup>
+    warmup() const
+    {
+        return _M_warmup;
+    }
+
+    /// Compile the model into a document with weights in the layout of the layer.
+    ///
+    /// The model is loaded and adapted by the serializer, and then written into the compiled
+    /// document (see \ref compiled_safetensor), so that later loads could skip adaptation.
+    ///
+    /// \param document A safetensor document with the model weights.
+    /// \param p A path to the compiled document.
+    /// \param source A path to the source safetensor document.
+    void
+    compile(
+        safetensor_document& document,
+        const std::filesystem::path& p,
+        const std::filesystem::path& source
+    )
+    {
+        auto layer = derived().load(document);
+        compiled_safetensor::save(p, *layer, source, Serializer::compiled_layout);
+    }
+
+    /// Returns true, when the compiled document was compiled by this serializer from the
+    /// current version of the source document (see \ref compiled_safetensor::is_current).
+    ///
+    /// \param p A path to the compiled document.
+    /// \param source A path to the source safetensor document.
+    bool
+    is_compiled(const std::filesystem::path& p, const std::filesystem::path& source) const
+    {
+        return compiled_safetensor::is_current(p, source, Serializer::compiled_layout);
+    }
+
+    /// Load the model from the compiled document (see \ref compile) without adaptation.
+    auto
+    load_compiled(safetensor_document& document)
+    {
+        compiled_safetensor::link(document);
+        start_warmup(document);
+
+        auto layer = derived().make_layer();
+        document.load(layer);
+
+        return layer;
+    }
+
+protected:
+    /// Start the warmup of the document, when the warmup is enabled by \ref set_warmup.
+    ///
+    /// \param document A safetensor document with tensors named as parameters of the layer.
+    void
+    start_warmup(const safetensor_document& document)
+    {
+        if (_M_warmup_pool) {
+            _M_warmup.emplace(document, *_M_warmup_pool, _M_warmup_options);
+        }
+    }
+
+private:
+    std::vector<std::string> _M_warmup_order;
+    std::optional<thread_pool> _M_warmup_pool;
+    safetensor_warmup_options _M_warmup_options;
+    std::optional<safetensor_warmup> _M_warmup;
+
+    Serializer&
+    derived()
+    {
+        return static_cast<Serializer&>(*this);
     }
 };
 
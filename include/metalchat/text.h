@@ -6,7 +6,10 @@
 
 #include <metalchat/text/bpe.h>
 #include <metalchat/text/gpt.h>
+#include <metalchat/text/mapped_vocabulary.h>
+#include <metalchat/text/pretokenizer.h>
 #include <metalchat/text/regexp.h>
 #include <metalchat/text/sentence_piece.h>
+#include <metalchat/text/stream_decoder.h>
 #include <metalchat/text/tokenizer.h>
 #include <metalchat/text/unicode_tokenizer.h>
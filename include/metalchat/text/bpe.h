@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdlib>
 #include <filesystem>
 #include <format>
@@ -11,13 +12,16 @@
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
-#include <queue>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 
+#include <metalchat/text/encoding_cache.h>
+#include <metalchat/text/mapped_vocabulary.h>
 #include <metalchat/text/regexp.h>
 #include <metalchat/text/tokenizer.h>
 
@@ -33,6 +37,16 @@ std::string
 make_reserved_token(int32_t index);
 
 
+/// Specifies initial units of the string that are merged by the \ref byte_pair_encoder.
+enum class merge_unit {
+    /// Every byte (character) of the string is a separate unit.
+    byte,
+    /// Every UTF-8 encoded code point is a separate unit, this is used by the vocabularies
+    /// that do not include tokens for the individual bytes of multi-byte characters.
+    code_point,
+};
+
+
 /// A concept that requires an iterator to dereference a tuple comprised of three elements:
 /// (i) token string representation, (ii) token index, and (iii) type of the token.
 template <typename It, typename CharT, typename T = std::iterator_traits<It>::value_type>
@@ -85,12 +99,18 @@ public:
     using encoding_iterator = basic_output_iterator<index_type>;
     using decoding_iterator = basic_output_iterator<string_type>;
 
+    using cache_type = encoding_cache<CharT, index_type>;
+
 private:
-    std::unordered_map<string_type, index_type, _StringHash> _M_forward_mapping;
+    std::unordered_map<string_type, index_type, _StringHash, std::equal_to<>> _M_forward_mapping;
     std::unordered_map<index_type, string_type> _M_inverse_mapping;
     std::unordered_map<tokenkind, index_type> _M_control_mapping;
 
+    std::shared_ptr<mapped_vocabulary> _M_vocabulary;
     std::shared_ptr<RegularExpression> _M_re;
+    std::shared_ptr<cache_type> _M_cache;
+    string_type _M_token_regex;
+    merge_unit _M_merge_unit;
 
     /// This structure is used in the byte-pair merging algorithm.
     struct token_segment {
@@ -103,6 +123,36 @@ private:
         {}
     };
 
+    /// A scratch space of the byte-pair merging algorithm. The scratch space is kept per
+    /// thread and reused across calls, so that encoding of the pre-tokenized words does not
+    /// allocate memory once the buffers have grown to the size of the longest word.
+    struct token_scratch {
+        using pair_type = std::pair<index_type, std::size_t>;
+
+        std::vector<pair_type> ordering;
+        std::vector<token_segment> encoding;
+
+        /// Token identifiers of the pre-token that is inserted into the encoding cache.
+        std::vector<index_type> ids;
+
+        /// Token identifiers of the pre-token that is checked against the limit of tokens.
+        std::vector<index_type> prefix;
+
+        void
+        clear()
+        {
+            ordering.clear();
+            encoding.clear();
+        }
+    };
+
+    static token_scratch&
+    _M_scratch()
+    {
+        static thread_local token_scratch scratch;
+        return scratch;
+    }
+
     /// Encode the specified string by joining byte pairs.
     ///
     /// The algorithm works like following:
@@ -111,41 +161,56 @@ private:
     ///    priority to the highest. Where priority is an index in the token map.
     /// 3. Join to adjacent encodings, only when such encoding exists.
     /// 4. Then push encodings to the specified container of identifiers.
+    ///
+    /// Keys are looked up as views into the specified string, and the ordering is kept in
+    /// a binary heap over the thread-local scratch space, so the method does not allocate.
     template <std::output_iterator<index_type> OutputIt>
     void
-    _M_encode_unicode_pairs(const string_type& s, OutputIt& output) const
+    _M_encode_unicode_pairs(const std::basic_string_view<CharT>& s, OutputIt& output) const
     {
         std::size_t priority_limit = std::numeric_limits<index_type>::max();
 
-        using pair_type = std::pair<index_type, std::size_t>;
-        using container_type = std::vector<pair_type>;
+        using pair_type = typename token_scratch::pair_type;
+        using compare_type = std::greater<pair_type>;
 
-        std::priority_queue<pair_type, container_type, std::greater<pair_type>> ordering;
-        std::vector<token_segment> encoding;
+        auto& scratch = _M_scratch();
+        scratch.clear();
+
+        auto& ordering = scratch.ordering;
+        auto& encoding = scratch.encoding;
 
         // Get the priority from the map, when the key is not presented, return a
         // limit of the priority type.
-        auto get_priority = [&](const string_type& key) -> index_type {
-            if (auto it = _M_forward_mapping.find(key); it != _M_forward_mapping.end()) {
-                return it->second;
-            }
-            return priority_limit;
+        auto get_priority = [&](const std::basic_string_view<CharT>& key) -> index_type {
+            index_type id;
+            return _M_find(key, id) ? id : index_type(priority_limit);
         };
 
-        for (std::size_t i = 0; i < s.size() - 1; i++) {
-            auto key = s.substr(i, 1);
-            auto priority = get_priority(key);
+        // Encoding is indexed by the position of the unit in the string, positions within
+        // the multi-byte units are never merged and never pushed to the output.
+        for (std::size_t i = 0; i < s.size();) {
+            auto unit_size = _M_unit_size(s, i);
+            auto is_last = i + unit_size >= s.size();
+            auto priority = is_last ? priority_limit : get_priority(s.substr(i, unit_size));
 
-            ordering.emplace(priority, i);
-            encoding.emplace_back(priority, i + 1);
+            if (!is_last) {
+                ordering.emplace_back(priority, i);
+            }
+            encoding.emplace_back(priority, i + unit_size);
+
+            for (std::size_t j = 1; j < unit_size; j++) {
+                encoding.emplace_back(priority_limit, i + j + 1);
+            }
+            i += unit_size;
         }
 
-        encoding.emplace_back(priority_limit, s.size());
+        std::make_heap(ordering.begin(), ordering.end(), compare_type());
 
         while (!ordering.empty()) {
-            auto [priority, begin] = ordering.top();
+            std::pop_heap(ordering.begin(), ordering.end(), compare_type());
+            auto [priority, begin] = ordering.back();
             auto next = encoding[begin].end;
-            ordering.pop();
+            ordering.pop_back();
 
             if (encoding[begin].priority >= priority_limit || next >= encoding.size()) {
                 continue;
@@ -160,7 +225,8 @@ private:
             }
 
             // Merge elements, then push a merge into the queue for further processing.
-            ordering.emplace(merged_priority, begin);
+            ordering.emplace_back(merged_priority, begin);
+            std::push_heap(ordering.begin(), ordering.end(), compare_type());
 
             encoding[begin].priority = merged_priority;
             encoding[begin].end = end;
@@ -175,6 +241,152 @@ private:
         }
     }
 
+    /// Returns the size of the merge unit that starts at the specified position.
+    std::size_t
+    _M_unit_size(const std::basic_string_view<CharT>& s, std::size_t pos) const
+    {
+        if constexpr (std::same_as<CharT, char>) {
+            if (_M_merge_unit == merge_unit::code_point) {
+                auto byte = static_cast<unsigned char>(s[pos]);
+                std::size_t size = 1;
+                if ((byte & 0xe0) == 0xc0) {
+                    size = 2;
+                } else if ((byte & 0xf0) == 0xe0) {
+                    size = 3;
+                } else if ((byte & 0xf8) == 0xf0) {
+                    size = 4;
+                }
+                return std::min(size, s.size() - pos);
+            }
+        }
+        return 1;
+    }
+
+    /// Find an identifier of the specified token. Tokens inserted into the encoder take
+    /// precedence over the tokens of the compiled vocabulary.
+    bool
+    _M_find(const std::basic_string_view<CharT>& key, index_type& id) const
+    {
+        if (!_M_forward_mapping.empty()) {
+            if (auto it = _M_forward_mapping.find(key); it != _M_forward_mapping.end()) {
+                id = it->second;
+                return true;
+            }
+        }
+        if constexpr (std::same_as<CharT, char>) {
+            if (_M_vocabulary != nullptr) {
+                if (auto result = _M_vocabulary->find(key); result.has_value()) {
+                    id = result.value();
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /// Encode a single pre-token (a match of the regular expression).
+    template <std::output_iterator<index_type> OutputIt>
+    void
+    _M_encode_match(const std::basic_string_view<CharT>& key, OutputIt& output) const
+    {
+        if (_M_cache != nullptr) {
+            _M_encode_cached(key, output);
+        } else if (index_type id; _M_find(key, id)) {
+            *output = id;
+            ++output;
+        } else {
+            _M_encode_unicode_pairs(key, output);
+        }
+    }
+
+    template <typename InputIt, std::output_iterator<index_type> OutputIt>
+    void
+    _M_encode(InputIt first, InputIt last, OutputIt& output) const
+    {
+        for (auto match = first; match != last; ++match) {
+            _M_encode_match(*match, output);
+        }
+    }
+
+    /// Encode pre-tokens of the string until the limit of tokens is reached.
+    ///
+    /// The prefix is always trimmed on the boundary of a pre-token, so that encoding of the
+    /// trimmed string results in the same sequence of tokens.
+    template <typename InputIt, std::output_iterator<index_type> OutputIt>
+    prefix_encoding
+    _M_encode_prefix(
+        const std::basic_string_view<CharT>& s,
+        InputIt first,
+        InputIt last,
+        std::size_t max_tokens,
+        OutputIt& output
+    ) const
+    {
+        auto& ids = _M_scratch().prefix;
+        auto ids_output = std::back_inserter(ids);
+        prefix_encoding result;
+
+        for (auto match = first; match != last; ++match) {
+            const auto& key = (*match);
+
+            ids.clear();
+            _M_encode_match(key, ids_output);
+            if (result.count + ids.size() > max_tokens) {
+                result.complete = false;
+                return result;
+            }
+
+            for (const auto& id : ids) {
+                *output = id;
+                ++output;
+            }
+
+            // Iterators over the caller-owned buffer report positions of matches, otherwise
+            // the match is searched after the end of the previous match.
+            std::size_t position;
+            if constexpr (requires { match.position(); }) {
+                position = match.position();
+            } else {
+                position = s.find(key, result.size);
+            }
+
+            result.count += ids.size();
+            result.size = position + std::size(key);
+        }
+
+        result.size = s.size();
+        return result;
+    }
+
+    /// Encode the specified string using the encoding cache. The cache is consulted before
+    /// the vocabulary, so that repeated words are encoded with a single lookup. When the
+    /// encoding is not cached, the word is looked up in the vocabulary or encoded by merging
+    /// byte pairs, and then the encoding is inserted into the cache.
+    template <std::output_iterator<index_type> OutputIt>
+    void
+    _M_encode_cached(const std::basic_string_view<CharT>& s, OutputIt& output) const
+    {
+        if (_M_cache->find(s, output)) {
+            return;
+        }
+
+        auto& ids = _M_scratch().ids;
+        ids.clear();
+
+        auto ids_output = std::back_inserter(ids);
+        if (index_type id; _M_find(s, id)) {
+            ids.push_back(id);
+        } else {
+            _M_encode_unicode_pairs(s, ids_output);
+        }
+        _M_cache->insert(s, ids.begin(), ids.end());
+
+        for (const auto& id : ids) {
+            *output = id;
+            ++output;
+        }
+    }
+
 public:
     /// The \ref byte_pair_encoder copy constructor.
     byte_pair_encoder(const byte_pair_encoder&) = default;
@@ -184,9 +396,28 @@ public:
     : _M_forward_mapping(),
       _M_inverse_mapping(),
       _M_control_mapping(),
-      _M_re(std::make_shared<RegularExpression>(token_regex))
+      _M_vocabulary(nullptr),
+      _M_re(std::make_shared<RegularExpression>(token_regex)),
+      _M_cache(nullptr),
+      _M_token_regex(token_regex),
+      _M_merge_unit(merge_unit::byte)
     {}
 
+    /// Create an instance of a byte-pair encoder backed by the compiled vocabulary.
+    ///
+    /// The encoder does not copy tokens of the vocabulary, instead tokens are looked up
+    /// directly in the memory-mapped vocabulary. The regular expression used to split the
+    /// input string into tokens is stored in the vocabulary.
+    ///
+    /// \param vocabulary A compiled vocabulary.
+    byte_pair_encoder(std::shared_ptr<mapped_vocabulary> vocabulary)
+        requires std::same_as<CharT, char> &&
+                     std::constructible_from<RegularExpression, string_type>
+    : byte_pair_encoder(string_type(vocabulary->regex()))
+    {
+        _M_vocabulary = vocabulary;
+    }
+
     /// Create an instance of a byte-pair encoder using a base64-encoded token map.
     ///
     /// This constructor reads token map from the specified input stream line-by-line and
@@ -270,30 +501,190 @@ public:
         insert(value, key, kind);
     }
 
+    /// Set the cache of pre-token encodings.
+    ///
+    /// The cache is shared by all copies of the encoder, and could be shared among multiple
+    /// encoders using the same token map. Pass `nullptr` to disable the cache.
+    ///
+    /// \param cache A cache of pre-token encodings.
+    void
+    set_cache(std::shared_ptr<cache_type> cache)
+    {
+        _M_cache = cache;
+    }
+
+    /// Set the initial units of the string that are merged by the encoder.
+    ///
+    /// By default every byte of the string is a separate unit, which is suitable for the
+    /// byte-level vocabularies. For the vocabularies built over Unicode code points (like
+    /// SentencePiece vocabularies), merge units should be \ref merge_unit::code_point.
+    ///
+    /// \param unit A unit of the byte-pair merging.
+    void
+    set_merge_unit(merge_unit unit)
+    {
+        _M_merge_unit = unit;
+    }
+
+    /// Returns the cache of pre-token encodings, or `nullptr` when the cache is disabled.
+    std::shared_ptr<cache_type>
+    get_cache() const
+    {
+        return _M_cache;
+    }
+
     /// Returns the number of all available tokens in the encoder.
+    ///
+    /// When the encoder is backed by a compiled vocabulary, the result includes tokens of the
+    /// vocabulary, tokens inserted into the encoder that override tokens of the vocabulary
+    /// are counted once.
     std::size_t
     size() const
     {
+        if constexpr (std::same_as<CharT, char>) {
+            if (_M_vocabulary != nullptr) {
+                auto size = _M_vocabulary->size();
+                for (const auto& [token, id] : _M_forward_mapping) {
+                    if (!_M_vocabulary->find(token).has_value()) {
+                        size++;
+                    }
+                }
+                return size;
+            }
+        }
         return _M_forward_mapping.size();
     }
 
+    /// Returns the compiled vocabulary of the encoder, or `nullptr` when all tokens of the
+    /// encoder are kept in memory.
+    std::shared_ptr<mapped_vocabulary>
+    get_vocabulary() const
+    {
+        return _M_vocabulary;
+    }
+
+    /// Compile tokens of the encoder into a memory-mappable vocabulary.
+    ///
+    /// The compiled vocabulary could be opened with \ref mapped_vocabulary and then used to
+    /// create an encoder without parsing the tokenizer model.
+    ///
+    /// \param p A path to the output file.
+    /// \param stamp A stamp of the tokenizer model the encoder was loaded from.
+    void
+    compile(const std::filesystem::path& p, const mapped_vocabulary::source_stamp& stamp) const
+        requires std::same_as<CharT, char>
+    {
+        std::vector<std::pair<std::string_view, index_type>> forward;
+        std::vector<std::pair<index_type, std::string_view>> inverse;
+        std::vector<std::pair<tokenkind, index_type>> controls;
+
+        for (const auto& [token, id] : _M_forward_mapping) {
+            forward.emplace_back(token, id);
+        }
+        for (const auto& [id, token] : _M_inverse_mapping) {
+            inverse.emplace_back(id, token);
+        }
+        for (const auto& [kind, id] : _M_control_mapping) {
+            controls.emplace_back(kind, id);
+        }
+
+        if (_M_vocabulary != nullptr) {
+            _M_vocabulary->for_each([&](std::string_view token, index_type id) {
+                if (!_M_forward_mapping.contains(token)) {
+                    forward.emplace_back(token, id);
+                }
+                if (!_M_inverse_mapping.contains(id)) {
+                    inverse.emplace_back(id, token);
+                }
+            });
+            for (const auto& [kind, id] : _M_vocabulary->controls()) {
+                if (!_M_control_mapping.contains(kind)) {
+                    controls.emplace_back(kind, id);
+                }
+            }
+        }
+
+        mapped_vocabulary::write(p, forward, inverse, controls, _M_token_regex, stamp);
+    }
+
     /// Encode the provided string into tokens.
     ///
     /// This method iteratively splits the string into tokens and then appends a corresponding
     /// token index into end of the provided iterator `output`. When the token is not presented
     /// in the token dictionary, it is divided into byte-pairs, then index of the byte pair is
     /// appended to the end of the container.
+    ///
+    /// When the regular expression supports iteration over the caller-owned buffer, matches
+    /// are processed as views into the specified string without copying them.
     void
     encode(const string_type& s, encoding_iterator& output) const
     {
-        for (auto match = _M_re->begin(s); match != _M_re->end(); ++match) {
-            auto key = (*match);
-            if (auto it = _M_forward_mapping.find(key); it != _M_forward_mapping.end()) {
-                *output = it->second;
-                ++output;
-            } else {
-                _M_encode_unicode_pairs(key, output);
-            }
+        encode<encoding_iterator>(s, output);
+    }
+
+    /// Encode the provided string into tokens.
+    ///
+    /// This method is similar to \ref encode(const string_type&, encoding_iterator&) const,
+    /// but pushes tokens to the output iterator without virtual calls.
+    template <std::output_iterator<index_type> OutputIt>
+    void
+    encode(const string_type& s, OutputIt& output) const
+    {
+        if constexpr (view_regexp_t<RegularExpression, CharT>) {
+            auto view = std::basic_string_view<CharT>(s);
+            _M_encode(_M_re->view_begin(view), _M_re->view_end(), output);
+        } else {
+            _M_encode(_M_re->begin(s), _M_re->end(), output);
+        }
+    }
+
+    /// Returns the number of tokens of the encoded string.
+    ///
+    /// The method encodes the string like \ref encode(const string_type&, OutputIt&) const,
+    /// but only counts tokens, so the encoded sequence is never stored in memory.
+    std::size_t
+    count(const string_type& s) const
+    {
+        std::size_t result = 0;
+        counting_output_iterator<index_type> output(result);
+        encode(s, output);
+        return result;
+    }
+
+    /// Encode the longest prefix of the string, which fits into the specified number of
+    /// tokens.
+    ///
+    /// The encoding stops at the first pre-token (a match of the regular expression) that
+    /// does not fit into the limit, so the work is proportional to the size of the prefix
+    /// rather than to the size of the string. The prefix ends on the boundary of a pre-token,
+    /// therefore the number of encoded tokens could be less than the limit.
+    ///
+    /// \param s A string to encode.
+    /// \param max_tokens The maximum number of tokens pushed to the output iterator.
+    /// \param output An output iterator of tokens.
+    prefix_encoding
+    encode_prefix(const string_type& s, std::size_t max_tokens, encoding_iterator& output) const
+    {
+        return encode_prefix<encoding_iterator>(s, max_tokens, output);
+    }
+
+    /// Encode the longest prefix of the string, which fits into the specified number of
+    /// tokens.
+    ///
+    /// This method is similar to
+    /// \ref encode_prefix(const string_type&, std::size_t, encoding_iterator&) const, but
+    /// pushes tokens to the output iterator without virtual calls.
+    template <std::output_iterator<index_type> OutputIt>
+    prefix_encoding
+    encode_prefix(const string_type& s, std::size_t max_tokens, OutputIt& output) const
+    {
+        auto view = std::basic_string_view<CharT>(s);
+        if constexpr (view_regexp_t<RegularExpression, CharT>) {
+            return _M_encode_prefix(
+                view, _M_re->view_begin(view), _M_re->view_end(), max_tokens, output
+            );
+        } else {
+            return _M_encode_prefix(view, _M_re->begin(s), _M_re->end(), max_tokens, output);
         }
     }
 
@@ -310,6 +701,15 @@ public:
             ++output;
             return;
         }
+        if constexpr (std::same_as<CharT, char>) {
+            if (_M_vocabulary != nullptr) {
+                if (auto id = _M_vocabulary->find_control(kind); id.has_value()) {
+                    *output = id.value();
+                    ++output;
+                    return;
+                }
+            }
+        }
         throw std::invalid_argument(
             std::format("byte_pair_encoder: unknown control token '{}'", kind)
         );
@@ -332,12 +732,32 @@ public:
     /// query special tokens. In token is not found, method raises an exception.
     void
     decode(index_type id, decoding_iterator& output) const
+    {
+        decode<decoding_iterator>(id, output);
+    }
+
+    /// Decode a single position-encoded token to the string representation.
+    ///
+    /// This method is similar to \ref decode(index_type, decoding_iterator&) const, but
+    /// pushes the token to the output iterator without virtual calls.
+    template <std::output_iterator<string_type> OutputIt>
+    void
+    decode(index_type id, OutputIt& output) const
     {
         if (auto tok = _M_inverse_mapping.find(id); tok != _M_inverse_mapping.end()) {
             *output = tok->second;
             ++output;
             return;
         }
+        if constexpr (std::same_as<CharT, char>) {
+            if (_M_vocabulary != nullptr) {
+                if (auto tok = _M_vocabulary->decode(id); tok.has_value()) {
+                    *output = string_type(tok.value());
+                    ++output;
+                    return;
+                }
+            }
+        }
         throw std::runtime_error(std::format("byte_pair_encoder: unable to decode id '{}'", id));
     }
 };
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <metalchat/accelerator.h>
+
+
+namespace metalchat {
+namespace text {
+
+
+/// Statistics of the \ref encoding_cache.
+struct encoding_cache_stats {
+    /// The number of lookups that found a cached encoding.
+    std::size_t hits = 0;
+    /// The number of lookups that did not find a cached encoding.
+    std::size_t misses = 0;
+    /// The number of encodings evicted from the cache.
+    std::size_t evictions = 0;
+    /// The number of encodings stored in the cache.
+    std::size_t size = 0;
+    /// The estimated amount of memory (in bytes) used by the stored encodings.
+    std::size_t bytes = 0;
+};
+
+
+/// A bounded cache of pre-token encodings.
+///
+/// The cache maps a string of a pre-token to the sequence of token identifiers produced by
+/// the byte-pair merging, so that repeated words are encoded without merging. The cache is
+/// split into shards, each shard is protected by its own mutex, so the cache could be shared
+/// by encoders running concurrently. When the size of a shard exceeds its part of the memory
+/// budget, encodings are evicted using the CLOCK (second chance) algorithm.
+///
+/// ```cpp
+/// using namespace metalchat::text;
+///
+/// auto tokenizer = byte_pair_encoder<char>("tokenizer.model", regex);
+/// tokenizer.set_cache(std::make_shared<encoding_cache<char, int32_t>>(16 * 1024 * 1024));
+/// ```
+template <typename CharT, typename Index> class encoding_cache {
+public:
+    using char_type = CharT;
+    using index_type = Index;
+    using string_type = std::basic_string<CharT>;
+    using string_view_type = std::basic_string_view<CharT>;
+
+    /// An estimated per-entry memory overhead of the hash map node and the slot.
+    static constexpr std::size_t entry_overhead = 96;
+
+    /// Create a new encoding cache.
+    ///
+    /// \param max_bytes The memory budget of the cache in bytes.
+    /// \param shard_count The number of independently locked shards of the cache.
+    encoding_cache(std::size_t max_bytes, std::size_t shard_count = 16)
+    : _M_shards(std::max<std::size_t>(shard_count, 1)),
+      _M_shard_bytes(max_bytes / std::max<std::size_t>(shard_count, 1))
+    {}
+
+    /// Find an encoding of the pre-token and push token identifiers to the output iterator.
+    ///
+    /// Returns true when the encoding is found, otherwise output is left unchanged.
+    template <std::output_iterator<index_type> OutputIt>
+    bool
+    find(const string_view_type& key, OutputIt& output)
+    {
+        const auto lookup_key = hashed_key{key, _StringHash()(key)};
+        auto& shard = _M_get_shard(lookup_key);
+        std::scoped_lock lock(shard.mutex);
+
+        auto it = shard.mapping.find(lookup_key);
+        if (it == shard.mapping.end()) {
+            shard.misses++;
+            return false;
+        }
+
+        auto& slot = shard.slots[it->second];
+        slot.referenced = true;
+        shard.hits++;
+
+        for (const auto& id : slot.ids) {
+            *output = id;
+            ++output;
+        }
+        return true;
+    }
+
+    /// Insert an encoding of the pre-token into the cache.
+    ///
+    /// Encodings that are larger than the memory budget of a shard are not cached. When the
+    /// encoding of the pre-token is already cached, method does nothing.
+    template <std::forward_iterator ForwardIt>
+    void
+    insert(const string_view_type& key, ForwardIt first, ForwardIt last)
+    {
+        const auto ids_size = static_cast<std::size_t>(std::distance(first, last));
+        const auto bytes =
+            key.size() * sizeof(char_type) + ids_size * sizeof(index_type) + entry_overhead;
+
+        const auto lookup_key = hashed_key{key, _StringHash()(key)};
+        auto& shard = _M_get_shard(lookup_key);
+        if (bytes > _M_shard_bytes) {
+            return;
+        }
+
+        std::scoped_lock lock(shard.mutex);
+        if (shard.mapping.contains(lookup_key)) {
+            return;
+        }
+
+        while (shard.bytes + bytes > _M_shard_bytes) {
+            _M_evict(shard);
+        }
+
+        std::size_t slot_index = shard.slots.size();
+        if (!shard.vacant.empty()) {
+            slot_index = shard.vacant.back();
+            shard.vacant.pop_back();
+        } else {
+            shard.slots.emplace_back();
+        }
+
+        auto [it, _] = shard.mapping.emplace(string_type(key), slot_index);
+
+        // Slot reuses memory of the evicted encoding, when the slot is vacant.
+        auto& slot = shard.slots[slot_index];
+        slot.key = std::addressof(it->first);
+        slot.ids.assign(first, last);
+        slot.bytes = bytes;
+        slot.referenced = false;
+
+        shard.bytes += bytes;
+    }
+
+    /// Returns statistics of the cache accumulated over all shards.
+    encoding_cache_stats
+    stats() const
+    {
+        encoding_cache_stats result;
+        for (auto& shard : _M_shards) {
+            std::scoped_lock lock(shard.mutex);
+            result.hits += shard.hits;
+            result.misses += shard.misses;
+            result.evictions += shard.evictions;
+            result.size += shard.mapping.size();
+            result.bytes += shard.bytes;
+        }
+        return result;
+    }
+
+    /// Returns the memory budget of the cache in bytes.
+    std::size_t
+    max_bytes() const
+    {
+        return _M_shard_bytes * _M_shards.size();
+    }
+
+private:
+    /// A key of the lookup with the precomputed hash, the hash is computed once per lookup,
+    /// and used both to select a shard and to find the encoding within the shard.
+    struct hashed_key {
+        string_view_type key;
+        std::size_t hash;
+    };
+
+    struct key_hash {
+        using is_transparent = void;
+
+        std::size_t
+        operator()(const string_view_type& key) const noexcept
+        {
+            return _StringHash()(key);
+        }
+
+        std::size_t
+        operator()(const hashed_key& key) const noexcept
+        {
+            return key.hash;
+        }
+    };
+
+    struct key_equal {
+        using is_transparent = void;
+
+        bool
+        operator()(const string_view_type& a, const string_view_type& b) const noexcept
+        {
+            return a == b;
+        }
+
+        bool
+        operator()(const hashed_key& a, const string_view_type& b) const noexcept
+        {
+            return a.key == b;
+        }
+
+        bool
+        operator()(const string_view_type& a, const hashed_key& b) const noexcept
+        {
+            return a == b.key;
+        }
+    };
+
+    struct cache_slot {
+        const string_type* key = nullptr;
+        std::vector<index_type> ids;
+        std::size_t bytes = 0;
+        bool referenced = false;
+    };
+
+    struct alignas(64) cache_shard {
+        mutable std::mutex mutex;
+        std::unordered_map<string_type, std::size_t, key_hash, key_equal> mapping;
+        std::vector<cache_slot> slots;
+        std::vector<std::size_t> vacant;
+        std::size_t hand = 0;
+        std::size_t bytes = 0;
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+    };
+
+    std::vector<cache_shard> _M_shards;
+    std::size_t _M_shard_bytes;
+
+    cache_shard&
+    _M_get_shard(const hashed_key& key)
+    {
+        // Use high bits of the hash to select a shard, since the low bits are used to
+        // select a bucket of the hash map within the shard.
+        return _M_shards[(key.hash >> 32) % _M_shards.size()];
+    }
+
+    /// Evict a single encoding from the shard. Slots that were accessed since the last
+    /// pass of the clock hand are given a second chance.
+    void
+    _M_evict(cache_shard& shard)
+    {
+        for (;;) {
+            auto& slot = shard.slots[shard.hand];
+            auto slot_index = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+
+            if (slot.key == nullptr) {
+                continue;
+            }
+            if (slot.referenced) {
+                slot.referenced = false;
+                continue;
+            }
+
+            shard.mapping.erase(shard.mapping.find(*slot.key));
+            shard.vacant.push_back(slot_index);
+            shard.bytes -= slot.bytes;
+            shard.evictions++;
+
+            slot.key = nullptr;
+            slot.ids.clear();
+            slot.bytes = 0;
+            return;
+        }
+    }
+};
+
+
+} // namespace text
+} // namespace metalchat
@@ -5,8 +5,7 @@
 #pragma once
 
 #include <string>
-#include <unordered_map>
-#include <utility>
+#include <string_view>
 
 
 namespace metalchat {
@@ -25,6 +24,10 @@ namespace text {
 /// - Control characters and spaces are shifted to higher Unicode code points (>= 256).
 /// - Every byte (0-255) has a unique, reversible character representation.
 ///
+/// The codec is table-driven: bytes are mapped through 256-entry lookup tables, and runs of
+/// characters that are mapped to themselves are copied in blocks using SIMD instructions,
+/// when they are available on the target platform.
+///
 /// Example usage:
 /// ```cpp
 /// using namespace metalchat;
@@ -48,18 +51,17 @@ public:
     ///
     /// \param input The UTF-8 string to encode.
     std::string
-    encode(const std::string& input) const;
+    encode(std::string_view input) const;
 
     /// Decodes a byte-level BPE encoded string back to its original UTF-8 form by reversing
     /// the character-to-byte mapping.
     ///
+    /// Method throws `std::range_error`, when the input is not a valid UTF-8 string, or when
+    /// it contains characters outside of the Basic Multilingual Plane.
+    ///
     /// \param input The encoded string to decode.
     std::string
-    decode(const std::string& input) const;
-
-private:
-    std::unordered_map<char8_t, char16_t> _M_encoding;
-    std::unordered_map<char16_t, char8_t> _M_decoding;
+    decode(std::string_view input) const;
 };
 
 
@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <metalchat/container.h>
+#include <metalchat/text/tokenizer.h>
+
+
+namespace metalchat {
+namespace text {
+
+
+/// A vocabulary of a byte-pair encoder compiled into a binary file, which is accessed through
+/// a read-only memory mapping.
+///
+/// The compiled vocabulary contains a forward table (token string to token identifier) built
+/// as a perfect hash table, an inverse table (token identifier to token string) that refers to
+/// a single arena of token strings, a table of control tokens, and the regular expression used
+/// to split the input string into pre-tokens. Opening the vocabulary requires a single memory
+/// mapping and no memory allocations per token, which makes it suitable to eliminate parsing
+/// of the tokenizer model during the program startup.
+///
+/// The compiled vocabulary keeps a size and a modification time of the tokenizer model that
+/// was used to compile it, so that stale vocabularies could be detected (see \ref is_current).
+///
+/// ```cpp
+/// using namespace metalchat::text;
+///
+/// auto vocabulary = std::make_shared<mapped_vocabulary>("tokenizer.mtok");
+/// auto tokenizer = byte_pair_encoder<char>(vocabulary);
+/// ```
+class mapped_vocabulary {
+public:
+    using index_type = int32_t;
+
+    /// A file extension of the compiled vocabulary.
+    static constexpr std::string_view default_extension = ".mtok";
+
+    /// A size and a modification time of the source tokenizer model.
+    struct source_stamp {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+
+        /// Create a stamp of the specified file.
+        static source_stamp
+        from_file(const std::filesystem::path& p);
+
+        bool
+        operator==(const source_stamp&) const = default;
+    };
+
+    /// Open the compiled vocabulary from the specified file.
+    ///
+    /// The constructor validates the structure of the file, and throws `std::runtime_error`
+    /// when the file is not a compiled vocabulary, or when it is corrupted.
+    mapped_vocabulary(const std::filesystem::path& p);
+
+    /// Find an identifier of the specified token.
+    std::optional<index_type>
+    find(std::string_view token) const
+    {
+        auto h = _M_hash(token, _M_seed);
+        auto d = _M_displacements[h.bucket % _M_bucket_count];
+        const auto& slot = _M_forward[_M_position(h, d, _M_slot_count)];
+
+        if (slot.id < 0 || token != std::string_view(_M_arena + slot.offset, slot.size)) {
+            return std::nullopt;
+        }
+        return slot.id;
+    }
+
+    /// Find a string representation of the token with the specified identifier.
+    std::optional<std::string_view>
+    decode(index_type id) const
+    {
+        if (id < 0 || static_cast<uint64_t>(id) >= _M_inverse_count) {
+            return std::nullopt;
+        }
+        const auto& slot = _M_inverse[id];
+        if (slot.size == missing_size) {
+            return std::nullopt;
+        }
+        return std::string_view(_M_arena + slot.offset, slot.size);
+    }
+
+    /// Find an identifier of the specified control token.
+    std::optional<index_type>
+    find_control(tokenkind kind) const;
+
+    /// Returns the regular expression used to split strings into pre-tokens.
+    std::string_view
+    regex() const;
+
+    /// Returns the number of tokens in the forward table.
+    std::size_t
+    size() const;
+
+    /// Returns the stamp of the source tokenizer model.
+    source_stamp
+    stamp() const;
+
+    /// Invoke the specified function for each token of the inverse table, the function
+    /// receives a token string and a token identifier.
+    template <typename Function>
+    void
+    for_each(Function&& f) const
+    {
+        for (uint64_t id = 0; id < _M_inverse_count; id++) {
+            if (auto token = decode(static_cast<index_type>(id)); token.has_value()) {
+                f(token.value(), static_cast<index_type>(id));
+            }
+        }
+    }
+
+    /// Returns all control tokens as pairs of token kind and token identifier.
+    std::vector<std::pair<tokenkind, index_type>>
+    controls() const;
+
+    /// Returns a path to the compiled vocabulary of the specified tokenizer model.
+    static std::filesystem::path
+    compiled_path(const std::filesystem::path& p);
+
+    /// Returns true when the compiled vocabulary exists, and it was compiled from the
+    /// current version of the specified tokenizer model.
+    static bool
+    is_current(const std::filesystem::path& compiled, const std::filesystem::path& source);
+
+    /// Write a compiled vocabulary into the specified file.
+    ///
+    /// The file is written into a temporary location first and then renamed, so that the
+    /// concurrent readers never observe a partially written vocabulary.
+    ///
+    /// \param p A path to the output file.
+    /// \param forward Pairs of a token string and a token identifier of the forward table.
+    /// \param inverse Pairs of a token identifier and a token string of the inverse table.
+    /// \param controls Pairs of a control token kind and a token identifier.
+    /// \param regex A regular expression used to split strings into pre-tokens.
+    /// \param stamp A stamp of the source tokenizer model.
+    static void
+    write(
+        const std::filesystem::path& p,
+        std::span<const std::pair<std::string_view, index_type>> forward,
+        std::span<const std::pair<index_type, std::string_view>> inverse,
+        std::span<const std::pair<tokenkind, index_type>> controls,
+        std::string_view regex,
+        const source_stamp& stamp
+    );
+
+private:
+    struct _Header;
+
+    struct forward_slot {
+        uint32_t offset;
+        uint32_t size;
+        index_type id;
+    };
+
+    struct inverse_slot {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct control_slot {
+        tokenkind kind;
+        index_type id;
+    };
+
+    /// A size of the inverse slot that indicates a missing token identifier.
+    static constexpr uint32_t missing_size = UINT32_MAX;
+
+    struct hash_value {
+        uint64_t bucket;
+        uint64_t position;
+        uint64_t step;
+    };
+
+    std::shared_ptr<basic_memfile> _M_file;
+    const _Header* _M_header;
+    const uint32_t* _M_displacements;
+    const forward_slot* _M_forward;
+    const inverse_slot* _M_inverse;
+    const control_slot* _M_controls;
+    const char* _M_arena;
+
+    uint64_t _M_seed;
+    uint64_t _M_bucket_count;
+    uint64_t _M_slot_count;
+    uint64_t _M_inverse_count;
+
+    static hash_value
+    _M_hash(std::string_view token, uint64_t seed);
+
+    /// Returns a position of the token in the forward table. A displacement of the bucket
+    /// selects a probe in the sequence of positions of the token. The number of slots is a
+    /// prime number, so the sequence visits every slot of the table.
+    static uint64_t
+    _M_position(const hash_value& h, uint32_t displacement, uint64_t slot_count)
+    {
+        auto step = 1 + h.step % (slot_count - 1);
+        return (h.position % slot_count + displacement * step) % slot_count;
+    }
+};
+
+
+} // namespace text
+} // namespace metalchat
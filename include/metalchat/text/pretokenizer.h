@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+
+namespace metalchat {
+namespace text {
+
+
+class llama3_pretokenizer_iterator;
+
+
+/// A pre-tokenizer that splits the input string exactly like the Llama 3 split expression
+/// (see \ref llama3_pretokenizer::pattern), but without a regular expression engine.
+///
+/// The pattern is implemented as a hand-written state machine over a table of character
+/// classes. The expression is compiled by \ref regexp without UTF support, so every byte of
+/// the input is matched as a code point U+0000-U+00FF, and the table contains Unicode general
+/// categories (letter, number) of these code points. Runs of ASCII letters are classified
+/// with SIMD instructions, when they are available on the target platform.
+///
+/// The pre-tokenizer could be used as a regular expression of the \ref byte_pair_encoder:
+/// ```cpp
+/// using namespace metalchat::text;
+///
+/// byte_pair_encoder<char, llama3_pretokenizer> tokenizer(llama3_pretokenizer::pattern);
+/// ```
+///
+/// Also \ref regexp uses this pre-tokenizer instead of PCRE2, when it is constructed from
+/// the same pattern.
+class llama3_pretokenizer {
+public:
+    using iterator = llama3_pretokenizer_iterator;
+
+    // clang-format off
+    static constexpr std::string_view pattern =
+        (R"((?i:'s|'t|'re|'ve|'m|'ll|'d)|)"
+         R"([^\r\n\p{L}\p{N}]?\p{L}+|)"
+         R"(\p{N}{1,3}|)"
+         R"( ?[^\s\p{L}\p{N}]+[\r\n]*|)"
+         R"(\s*[\r\n]+|)"
+         R"(\s+(?!\S)|)"
+         R"(\s+)");
+    // clang-format on
+
+    /// Create a new pre-tokenizer. Constructor accepts only the \ref pattern, and throws
+    /// `std::invalid_argument` for any other regular expression.
+    ///
+    /// \param regex A regular expression implemented by the pre-tokenizer.
+    llama3_pretokenizer(const std::string& regex);
+
+    llama3_pretokenizer();
+
+    iterator
+    view_begin(std::string_view) const;
+
+    iterator
+    view_end() const;
+
+    /// Returns true when the specified expression is implemented by the pre-tokenizer.
+    static bool
+    is_compatible(std::string_view regex);
+
+    /// Returns the length of the match that starts at the specified offset of the string.
+    ///
+    /// The split pattern covers every byte of the input, therefore the returned length is
+    /// always non-zero, when the offset is less than the size of the string.
+    static std::size_t
+    match(std::string_view s, std::size_t offset);
+};
+
+
+/// Pre-tokenizer iterator over a caller-owned buffer, see \ref llama3_pretokenizer.
+class llama3_pretokenizer_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using reference = const value_type&;
+    using pointer = const value_type*;
+    using difference_type = std::ptrdiff_t;
+
+    llama3_pretokenizer_iterator()
+    : _M_subject(),
+      _M_offset(0),
+      _M_length(0)
+    {}
+
+    llama3_pretokenizer_iterator(std::string_view input)
+    : _M_subject(input),
+      _M_offset(0),
+      _M_length(llama3_pretokenizer::match(input, 0))
+    {}
+
+    llama3_pretokenizer_iterator&
+    operator++()
+    {
+        _M_offset += _M_length;
+        _M_length = llama3_pretokenizer::match(_M_subject, _M_offset);
+        return *this;
+    }
+
+    value_type
+    operator*() const
+    {
+        return _M_subject.substr(_M_offset, _M_length);
+    }
+
+    bool
+    operator!=(const llama3_pretokenizer_iterator& rhs) const
+    {
+        return (_M_length == 0) != (rhs._M_length == 0);
+    }
+
+    /// Returns a position of the current match within the iterated buffer.
+    std::size_t
+    position() const
+    {
+        return _M_offset;
+    }
+
+private:
+    std::string_view _M_subject;
+    std::size_t _M_offset;
+    std::size_t _M_length;
+};
+
+
+} // namespace text
+} // namespace metalchat
@@ -5,11 +5,13 @@
 #pragma once
 
 #include <codecvt>
+#include <concepts>
 #include <format>
 #include <iterator>
 #include <locale>
 #include <memory>
 #include <string>
+#include <string_view>
 
 
 namespace metalchat {
@@ -17,24 +19,107 @@ namespace text {
 
 
 class regexp_iterator;
+class regexp_view_iterator;
 
 
+/// A Perl-compatible regular expression.
+///
+/// The expression is compiled with a just-in-time compiler, when it is available on the
+/// target platform, otherwise matching falls back to the PCRE2 interpreter. Matching uses
+/// a per-thread JIT stack and a per-thread match data block, so iteration over matches
+/// does not allocate memory.
 class regexp {
 public:
     regexp(const std::string& regex);
     regexp(const char* regex);
 
+    /// Returns an iterator over matches of the specified string. The iterator keeps a copy
+    /// of the input string, therefore it could be used with temporary strings.
     regexp_iterator
     begin(const std::string&) const;
 
     regexp_iterator
     end() const;
 
+    /// Returns an iterator over matches of the caller-owned buffer. The iterator does not
+    /// copy the input, so the buffer must outlive the iterator and all returned matches.
+    regexp_view_iterator
+    view_begin(std::string_view) const;
+
+    regexp_view_iterator
+    view_end() const;
+
+    /// Returns true, when the expression is compiled with a just-in-time compiler.
+    bool
+    is_jit() const;
+
 private:
     struct _RegularExpression;
     std::shared_ptr<_RegularExpression> _M_impl;
 
     friend class regexp_iterator;
+    friend class regexp_view_iterator;
+};
+
+
+/// A concept that requires a regular expression to iterate over matches of a caller-owned
+/// buffer without copying it (see \ref regexp::view_begin).
+template <typename RegularExpression, typename CharT>
+concept view_regexp_t = requires(const RegularExpression& re, std::basic_string_view<CharT> s) {
+    { *re.view_begin(s) } -> std::convertible_to<std::basic_string_view<CharT>>;
+    { re.view_begin(s) != re.view_end() } -> std::convertible_to<bool>;
+};
+
+
+/// Regular expression iterator over a caller-owned buffer.
+///
+/// The iterator yields matches as views into the iterated buffer. Empty matches are
+/// skipped, so every returned view is non-empty.
+class regexp_view_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using reference = const value_type&;
+    using pointer = const value_type*;
+    using difference_type = std::ptrdiff_t;
+
+    /// Initialize the end-of-match-group iterator.
+    regexp_view_iterator();
+
+    /// Initialize the iterator and find the first match within the specified buffer.
+    regexp_view_iterator(const regexp& regex, std::string_view input);
+
+    /// Advance the iterator to the next regular expression match.
+    regexp_view_iterator&
+    operator++();
+
+    /// Return the current match of the regular expression.
+    ///
+    /// The method throws `std::runtime_error` when it is called on a terminated iterator.
+    value_type
+    operator*() const;
+
+    /// Compares two regular expression iterators.
+    ///
+    /// Similar to \ref regexp_iterator, the implementation only compares the ends of
+    /// iterators.
+    bool
+    operator!=(const regexp_view_iterator&) const;
+
+    /// Returns a position of the current match within the iterated buffer.
+    std::size_t
+    position() const;
+
+private:
+    std::shared_ptr<regexp::_RegularExpression> _M_re;
+    std::string_view _M_subject;
+    std::string_view _M_match;
+    std::size_t _M_offset;
+    bool _M_end;
+
+    /// Advance the iterator to the next match group.
+    void
+    next();
 };
 
 
@@ -4,7 +4,7 @@
 
 #pragma once
 
-#include <algorithm>
+#include <string_view>
 
 #include <metalchat/text/bpe.h>
 
@@ -13,10 +13,17 @@ namespace metalchat {
 namespace text {
 
 
-/// A tokenizer that applies byte-pair tokenizer directly on unicode text.
+/// A tokenizer that applies byte-pair tokenizer to the SentencePiece vocabulary.
+///
+/// SentencePiece vocabularies represent white spaces with a special symbol `▁` (U+2581), and
+/// consist of tokens built over Unicode code points. The tokenizer works directly on UTF-8
+/// encoded strings: the white space symbol is substituted with a regular white space once,
+/// when tokens are inserted into the vocabulary, so that neither encoded strings nor decoded
+/// tokens are copied to apply the substitution, and byte pairs are merged starting from the
+/// whole UTF-8 encoded code points (see \ref merge_unit::code_point).
 class sentence_piece {
 public:
-    using char_type = char32_t;
+    using char_type = char;
     using Tokenizer = byte_pair_encoder<char_type>;
 
     using string_type = Tokenizer::string_type;
@@ -30,26 +37,33 @@ public:
 
     /// The \ref sentence_piece default constructor.
     sentence_piece()
-    : _M_bpe(UR"(.*)")
-    {}
+    : _M_bpe(R"(.*)")
+    {
+        _M_bpe.set_merge_unit(merge_unit::code_point);
+    }
 
     template <input_token_iterator_t<char_type> InputIt>
     sentence_piece(InputIt first, InputIt last)
-    : _M_bpe(first, last, UR"(.*)")
-    {}
+    : sentence_piece()
+    {
+        for (auto it = first; it != last; ++it) {
+            auto [value, key, kind] = *it;
+            insert(value, key, kind);
+        }
+    }
 
     /// \copydoc byte_pair_encoder::insert
     void
     insert(const string_type& value, index_type key, tokenkind kind = token::regular)
     {
-        _M_bpe.insert(value, key, kind);
+        _M_bpe.insert(_M_substitute_whitespace(value), key, kind);
     }
 
     /// \copydoc byte_pair_encoder::insert_back
     void
     insert_back(const string_type& value, tokenkind kind = token::regular)
     {
-        _M_bpe.insert_back(value, kind);
+        _M_bpe.insert_back(_M_substitute_whitespace(value), kind);
     }
 
     /// \copydoc byte_pair_encoder::size
@@ -61,14 +75,47 @@ public:
 
     /// Encode the provided string into tokens.
     ///
-    /// The method replaces all white space characters with a special unicode symbols, and
-    /// then encodes the whole sequence using byte-pair encoding.
+    /// White spaces of the string are matched against the white space symbols of the
+    /// vocabulary, the whole sequence is then encoded using byte-pair encoding.
     void
     encode(const string_type& s, encoding_iterator& output) const
     {
-        auto input = s;
-        std::replace(input.begin(), input.end(), whitespace_forward, whitespace_inverse);
-        _M_bpe.encode(input, output);
+        _M_bpe.encode(s, output);
+    }
+
+    /// Encode the provided string into tokens.
+    ///
+    /// This method is similar to \ref encode(const string_type&, encoding_iterator&) const,
+    /// but pushes tokens to the output iterator without virtual calls.
+    template <std::output_iterator<index_type> OutputIt>
+    void
+    encode(const string_type& s, OutputIt& output) const
+    {
+        _M_bpe.encode(s, output);
+    }
+
+    /// \copydoc byte_pair_encoder::count
+    std::size_t
+    count(const string_type& s) const
+    {
+        return _M_bpe.count(s);
+    }
+
+    /// Encode the longest prefix of the string, which fits into the specified number of
+    /// tokens (see \ref byte_pair_encoder::encode_prefix).
+    prefix_encoding
+    encode_prefix(const string_type& s, std::size_t max_tokens, encoding_iterator& output) const
+    {
+        return _M_bpe.encode_prefix(s, max_tokens, output);
+    }
+
+    /// Encode the longest prefix of the string, which fits into the specified number of
+    /// tokens, without virtual calls of the output iterator.
+    template <std::output_iterator<index_type> OutputIt>
+    prefix_encoding
+    encode_prefix(const string_type& s, std::size_t max_tokens, OutputIt& output) const
+    {
+        return _M_bpe.encode_prefix(s, max_tokens, output);
     }
 
     /// \copydoc byte_pair_encoder::encode(tokenkind, OutputIt) const
@@ -80,29 +127,47 @@ public:
 
     /// Decode a single position-encoded token to the string representation.
     ///
-    /// Method replaces all whitespace-replacement unicode code points with a unicode code
-    /// point of the regular white space.
+    /// White space symbols of the vocabulary are decoded as regular white spaces.
     void
     decode(index_type id, decoding_iterator& output) const
     {
-        using iterator = string_type*;
-        using iterator_wrapper = output_iterator_wrapper<string_type, iterator>;
-
-        string_type s;
-        string_type* s_ptr = &s;
-        iterator_wrapper output_it(s_ptr);
+        _M_bpe.decode(id, output);
+    }
 
-        _M_bpe.decode(id, output_it);
-        std::replace(s.begin(), s.end(), whitespace_inverse, whitespace_forward);
-        *output = s;
-        ++output;
+    /// Decode a single position-encoded token to the string representation.
+    ///
+    /// This method is similar to \ref decode(index_type, decoding_iterator&) const, but
+    /// pushes the token to the output iterator without virtual calls.
+    template <std::output_iterator<string_type> OutputIt>
+    void
+    decode(index_type id, OutputIt& output) const
+    {
+        _M_bpe.decode(id, output);
     }
 
 private:
-    static constexpr char_type whitespace_forward = U' ';
-    static constexpr char_type whitespace_inverse = U'▁';
+    static constexpr std::string_view whitespace_forward = " ";
+    static constexpr std::string_view whitespace_inverse = "▁";
 
     Tokenizer _M_bpe;
+
+    static string_type
+    _M_substitute_whitespace(const string_type& value)
+    {
+        string_type result;
+        result.reserve(value.size());
+
+        std::string_view input(value);
+        for (auto pos = input.find(whitespace_inverse); pos != input.npos;
+             pos = input.find(whitespace_inverse)) {
+            result.append(input.substr(0, pos));
+            result.append(whitespace_forward);
+            input.remove_prefix(pos + whitespace_inverse.size());
+        }
+
+        result.append(input);
+        return result;
+    }
 };
 
 
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <cstddef>
+#include <format>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+namespace metalchat {
+namespace text {
+
+
+class utf8_stream_decoder_iterator;
+
+
+/// A decoder of the token stream that assembles token strings into chunks of a valid UTF-8
+/// text.
+///
+/// Byte-level tokens could split a multi-byte UTF-8 character, so that a single token does
+/// not always decode into a printable string. The decoder appends token bytes into a buffer
+/// and returns chunks of the buffer that end on the boundary of a character, the incomplete
+/// character at the end of the buffer is held back until the remaining bytes arrive. Bytes
+/// that could not be a part of a valid character are passed through as is, so the stream
+/// never stalls on the malformed input.
+///
+/// Returned chunks are views into the decoder buffer, which are valid until the next call
+/// of a non-const method. The buffer is reused, so decoding does not allocate memory once
+/// the buffer has grown to the size of the longest chunk.
+///
+/// ```cpp
+/// using namespace metalchat::text;
+///
+/// utf8_stream_decoder decoder;
+/// auto output = decoder.begin();
+///
+/// for (auto id : ids) {
+///     TokenizerTraits::decode(tokenizer, id, output);
+///     std::cout << decoder.take();
+/// }
+/// std::cout << decoder.flush();
+/// ```
+class utf8_stream_decoder {
+public:
+    using iterator = utf8_stream_decoder_iterator;
+    using size_type = std::size_t;
+
+    /// Create a new decoder.
+    ///
+    /// \param capacity An initial capacity of the decoder buffer.
+    utf8_stream_decoder(size_type capacity = 256) { _M_buffer.reserve(capacity); }
+
+    /// Append bytes of the token to the end of the pending text.
+    void
+    append(std::string_view bytes)
+    {
+        _M_compact();
+        _M_buffer.append(bytes);
+    }
+
+    /// Returns an output iterator that appends decoded token strings to the decoder.
+    iterator
+    begin();
+
+    /// Returns the pending text, which includes the incomplete character at the end.
+    std::string_view
+    pending() const
+    {
+        return std::string_view(_M_buffer).substr(_M_taken);
+    }
+
+    /// Take the longest prefix of the pending text that does not end in the middle of a
+    /// character. The result is empty, when the pending text is a part of a character.
+    std::string_view
+    take()
+    {
+        auto text = pending();
+        auto size = _M_complete_size(text);
+
+        _M_taken += size;
+        return text.substr(0, size);
+    }
+
+    /// Take the whole pending text including the incomplete character at the end. The method
+    /// is expected to be called at the end of the token stream.
+    std::string_view
+    flush()
+    {
+        auto text = pending();
+        _M_taken = _M_buffer.size();
+        return text;
+    }
+
+    /// Remove the specified number of bytes from the end of the pending text.
+    ///
+    /// Rollback is used to trim stop sequences from the generated text before it is taken
+    /// from the decoder. The method does not release memory of the buffer.
+    ///
+    /// \param count The number of bytes to remove.
+    void
+    rollback(size_type count)
+    {
+        if (count > _M_buffer.size() - _M_taken) {
+            throw std::invalid_argument(std::format(
+                "utf8_stream_decoder: rollback of {} bytes exceeds {} pending bytes", count,
+                _M_buffer.size() - _M_taken
+            ));
+        }
+        _M_buffer.resize(_M_buffer.size() - count);
+    }
+
+    /// Remove all pending bytes from the decoder.
+    void
+    clear()
+    {
+        _M_buffer.clear();
+        _M_taken = 0;
+    }
+
+private:
+    std::string _M_buffer;
+    size_type _M_taken = 0;
+
+    /// Remove taken bytes from the beginning of the buffer. The buffer is compacted lazily,
+    /// so that the views returned from \ref take remain valid until the next modification.
+    void
+    _M_compact()
+    {
+        if (_M_taken > 0) {
+            _M_buffer.erase(0, _M_taken);
+            _M_taken = 0;
+        }
+    }
+
+    /// Returns the size of the longest prefix of the text, which does not end with an
+    /// incomplete character.
+    static size_type
+    _M_complete_size(std::string_view text)
+    {
+        const auto size = text.size();
+
+        // A character is at most 4 bytes long, so only the last 3 bytes could belong to an
+        // incomplete character. Scan backward until the leading byte of a character.
+        for (size_type i = size; i > 0 && size - i < 3; i--) {
+            auto byte = static_cast<unsigned char>(text[i - 1]);
+            if ((byte & 0xc0) == 0x80) {
+                continue;
+            }
+
+            size_type length = 1;
+            if ((byte & 0xe0) == 0xc0) {
+                length = 2;
+            } else if ((byte & 0xf0) == 0xe0) {
+                length = 3;
+            } else if ((byte & 0xf8) == 0xf0) {
+                length = 4;
+            }
+            return (i - 1) + length > size ? i - 1 : size;
+        }
+        return size;
+    }
+};
+
+
+/// An output iterator that appends token strings to the \ref utf8_stream_decoder.
+class utf8_stream_decoder_iterator {
+public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using pointer = void;
+    using reference = void;
+    using difference_type = std::ptrdiff_t;
+
+    utf8_stream_decoder_iterator()
+    : _M_decoder(nullptr)
+    {}
+
+    utf8_stream_decoder_iterator(utf8_stream_decoder& decoder)
+    : _M_decoder(std::addressof(decoder))
+    {}
+
+    utf8_stream_decoder_iterator&
+    operator=(std::string_view bytes)
+    {
+        _M_decoder->append(bytes);
+        return *this;
+    }
+
+    utf8_stream_decoder_iterator&
+    operator=(const std::string& bytes)
+    {
+        _M_decoder->append(bytes);
+        return *this;
+    }
+
+    utf8_stream_decoder_iterator&
+    operator*()
+    {
+        return *this;
+    }
+
+    utf8_stream_decoder_iterator&
+    operator++()
+    {
+        return *this;
+    }
+
+    utf8_stream_decoder_iterator
+    operator++(int)
+    {
+        return *this;
+    }
+
+private:
+    utf8_stream_decoder* _M_decoder;
+};
+
+
+inline utf8_stream_decoder::iterator
+utf8_stream_decoder::begin()
+{
+    return iterator(*this);
+}
+
+
+} // namespace text
+} // namespace metalchat
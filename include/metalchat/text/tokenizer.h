@@ -4,13 +4,16 @@
 
 #pragma once
 
+#include <algorithm>
 #include <iterator>
+#include <ranges>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include <metalchat/container.h>
 #include <metalchat/tensor.h>
+#include <metalchat/thread_pool.h>
 
 
 namespace metalchat {
@@ -125,6 +128,66 @@ public:
 };
 
 
+/// An output iterator that discards tokens and only counts them.
+///
+/// The iterator is used to compute the number of tokens of the encoded string without
+/// storing the tokens in a container.
+template <typename T> struct counting_output_iterator {
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using pointer = void;
+    using reference = void;
+    using difference_type = std::ptrdiff_t;
+
+    counting_output_iterator(std::size_t& count)
+    : _M_count(std::addressof(count))
+    {}
+
+    counting_output_iterator&
+    operator++()
+    {
+        return *this;
+    }
+
+    counting_output_iterator
+    operator++(int)
+    {
+        return *this;
+    }
+
+    counting_output_iterator&
+    operator*()
+    {
+        return *this;
+    }
+
+    counting_output_iterator&
+    operator=(const T&)
+    {
+        ++(*_M_count);
+        return *this;
+    }
+
+private:
+    std::size_t* _M_count;
+};
+
+
+/// A result of the encoding of a string prefix, which fits into the limit of tokens.
+///
+/// The string prefix is encoded by \ref basic_tokenizer::encode_prefix, and the `size`
+/// member indicates the position in the string, where the encoding stopped, so the string
+/// could be trimmed to `s.substr(0, size)` without encoding it once again.
+struct prefix_encoding {
+    /// The number of tokens pushed to the output iterator.
+    std::size_t count = 0;
+    /// The size of the encoded prefix of the string, in characters of the string.
+    std::size_t size = 0;
+    /// True when the whole string fits into the limit of tokens.
+    bool complete = true;
+};
+
+
 template <typename Index, typename CharT> struct basic_tokenizer {
     using index_type = Index;
     using string_type = std::basic_string<CharT>;
@@ -140,6 +203,16 @@ template <typename Index, typename CharT> struct basic_tokenizer {
     virtual void
     decode(index_type id, decoding_iterator& output) const = 0;
 
+    /// Returns the number of tokens of the encoded string without storing the tokens.
+    virtual std::size_t
+    count(const string_type& s) const = 0;
+
+    /// Encode the longest prefix of the string, which fits into the specified number of
+    /// tokens. The encoding stops as soon as the limit is reached.
+    virtual prefix_encoding
+    encode_prefix(const string_type& s, std::size_t max_tokens, encoding_iterator& output)
+        const = 0;
+
     /// The \ref basic_tokenizer default destructor.
     virtual ~basic_tokenizer() = default;
 };
@@ -149,6 +222,27 @@ template <typename I, typename T>
 concept forward_iterator = std::forward_iterator<I> && std::same_as<std::iter_value_t<I>, T>;
 
 
+/// A batch of token sequences of different lengths.
+///
+/// Tokens of all sequences are stored in a single flat tensor `ids`, and the sequence `i`
+/// occupies positions `[offsets[i], offsets[i + 1])` of this tensor, so the size of the
+/// `offsets` tensor is larger by one than the number of sequences in the batch.
+template <typename Index> struct ragged_tokens {
+    using index_type = Index;
+    using offset_type = int64_t;
+
+    tensor<index_type, 1, vector_memory_container<index_type>> ids;
+    tensor<offset_type, 1, vector_memory_container<offset_type>> offsets;
+
+    /// Returns the number of sequences in the batch.
+    std::size_t
+    size() const
+    {
+        return offsets.size(0) - 1;
+    }
+};
+
+
 template <typename Tokenizer> struct tokenizer_traits {
     using index_type = Tokenizer::index_type;
     using string_type = Tokenizer::string_type;
@@ -156,13 +250,21 @@ template <typename Tokenizer> struct tokenizer_traits {
     using encoding_iterator = Tokenizer::encoding_iterator;
     using decoding_iterator = Tokenizer::decoding_iterator;
 
+    /// Encode the string and push tokens to the specified output iterator.
+    ///
+    /// When tokenizer accepts the output iterator directly, tokens are pushed without
+    /// calling virtual methods of the \ref basic_output_iterator.
     template <std::output_iterator<index_type> OutputIt>
     static void
     encode(const Tokenizer& t, const string_type& s, OutputIt& output)
     {
-        using iterator_wrapper = output_iterator_wrapper<index_type, OutputIt>;
-        iterator_wrapper output_it(output);
-        t.encode(s, output_it);
+        if constexpr (requires { t.encode(s, output); }) {
+            t.encode(s, output);
+        } else {
+            using iterator_wrapper = output_iterator_wrapper<index_type, OutputIt>;
+            iterator_wrapper output_it(output);
+            t.encode(s, output_it);
+        }
     }
 
     template <std::output_iterator<index_type> OutputIt>
@@ -204,6 +306,79 @@ template <typename Tokenizer> struct tokenizer_traits {
         return tensor({container_size}, container_ptr);
     }
 
+    /// Returns the number of tokens of the encoded string.
+    ///
+    /// Tokens are counted as they are produced by the tokenizer, so the method does not
+    /// allocate memory for the encoded sequence.
+    static std::size_t
+    count(const Tokenizer& t, const string_type& s)
+    {
+        if constexpr (requires { t.count(s); }) {
+            return t.count(s);
+        } else {
+            std::size_t result = 0;
+            counting_output_iterator<index_type> output(result);
+            encode(t, s, output);
+            return result;
+        }
+    }
+
+    /// Encode the longest prefix of the string, which fits into the specified number of
+    /// tokens, and push tokens to the output iterator.
+    ///
+    /// When the tokenizer does not implement prefix encoding, the whole string is encoded
+    /// and the size of the prefix is computed from the lengths of decoded tokens.
+    ///
+    /// ```cpp
+    /// std::vector<int32_t> ids;
+    /// auto output = std::back_inserter(ids);
+    ///
+    /// auto prefix = TokenizerTraits::encode_prefix(tokenizer, document, 512, output);
+    /// if (!prefix.complete) {
+    ///     std::cout << "trimmed to: " << document.substr(0, prefix.size) << std::endl;
+    /// }
+    /// ```
+    ///
+    /// \param t A tokenizer used to encode the string.
+    /// \param s A string to encode.
+    /// \param max_tokens The maximum number of tokens pushed to the output iterator.
+    /// \param output An output iterator of tokens.
+    template <std::output_iterator<index_type> OutputIt>
+    static prefix_encoding
+    encode_prefix(
+        const Tokenizer& t, const string_type& s, std::size_t max_tokens, OutputIt& output
+    )
+    {
+        constexpr bool has_virtual_prefix = requires(encoding_iterator& it) {
+            t.encode_prefix(s, max_tokens, it);
+        };
+
+        if constexpr (requires { t.encode_prefix(s, max_tokens, output); }) {
+            return t.encode_prefix(s, max_tokens, output);
+        } else if constexpr (has_virtual_prefix) {
+            using iterator_wrapper = output_iterator_wrapper<index_type, OutputIt>;
+            iterator_wrapper output_it(output);
+            return t.encode_prefix(s, max_tokens, output_it);
+        } else {
+            std::vector<index_type> ids;
+            auto ids_output = std::back_inserter(ids);
+            encode(t, s, ids_output);
+
+            prefix_encoding result{.count = std::min(ids.size(), max_tokens)};
+            result.complete = result.count == ids.size();
+
+            for (std::size_t i = 0; i < result.count; i++) {
+                result.size += decode(t, ids[i]).size();
+                *output = ids[i];
+                ++output;
+            }
+            if (result.complete) {
+                result.size = s.size();
+            }
+            return result;
+        }
+    }
+
     /// Iteratively decode a sequence of position-encoded tokens.
     ///
     /// The result of decoding is sequentially appended to the specified container. If one
@@ -213,11 +388,17 @@ template <typename Tokenizer> struct tokenizer_traits {
     static void
     decode(const Tokenizer& t, ForwardIt first, ForwardIt last, OutputIt& output)
     {
-        using iterator_wrapper = output_iterator_wrapper<string_type, OutputIt>;
-        iterator_wrapper output_it(output);
-
-        for (auto id = first; id != last; ++id) {
-            t.decode(*id, output_it);
+        if constexpr (requires(index_type id) { t.decode(id, output); }) {
+            for (auto id = first; id != last; ++id) {
+                t.decode(*id, output);
+            }
+        } else {
+            using iterator_wrapper = output_iterator_wrapper<string_type, OutputIt>;
+            iterator_wrapper output_it(output);
+
+            for (auto id = first; id != last; ++id) {
+                t.decode(*id, output_it);
+            }
         }
     }
 
@@ -247,6 +428,125 @@ template <typename Tokenizer> struct tokenizer_traits {
     {
         return decode(t, &id, &id + 1);
     }
+
+    /// Encode a batch of strings using the specified thread pool.
+    ///
+    /// Strings are split into contiguous chunks, which are encoded in parallel, then the
+    /// results are concatenated in the order of the input strings, so the result does not
+    /// depend on the number of threads in the pool.
+    ///
+    /// ```cpp
+    /// std::vector<std::string> documents = {"This is a test sentence.", "Hello, world!"};
+    /// auto batch = TokenizerTraits::encode_batch(tokenizer, documents, pool);
+    ///
+    /// // Tokens of the second document.
+    /// auto first = batch.offsets[1], last = batch.offsets[2];
+    /// ```
+    ///
+    /// \param t A tokenizer used to encode strings.
+    /// \param strings A range of strings to encode.
+    /// \param pool A thread pool used to encode strings.
+    template <std::ranges::random_access_range Range>
+    requires std::convertible_to<std::ranges::range_reference_t<Range>, const string_type&>
+    static ragged_tokens<index_type>
+    encode_batch(const Tokenizer& t, const Range& strings, thread_pool& pool)
+    {
+        using offset_type = ragged_tokens<index_type>::offset_type;
+        using ids_container = vector_memory_container<index_type>;
+        using offsets_container = vector_memory_container<offset_type>;
+
+        struct chunk_type {
+            std::vector<index_type> ids;
+            std::size_t first = 0;
+            std::size_t last = 0;
+        };
+
+        const std::size_t batch_size = std::ranges::size(strings);
+        auto chunks = std::vector<chunk_type>(_M_chunk_count(batch_size, pool));
+        auto offsets = std::vector<offset_type>(batch_size + 1, 0);
+
+        pool.parallel_for(chunks.size(), [&](std::size_t c) {
+            auto& chunk = chunks[c];
+            chunk.first = c * batch_size / chunks.size();
+            chunk.last = (c + 1) * batch_size / chunks.size();
+
+            auto output = std::back_inserter(chunk.ids);
+            for (auto i = chunk.first; i < chunk.last; i++) {
+                encode(t, strings[i], output);
+                offsets[i + 1] = chunk.ids.size();
+            }
+        });
+
+        // Convert chunk-local offsets to the global offsets, and copy tokens of all chunks
+        // into the resulting flat buffer.
+        std::vector<offset_type> bases(chunks.size() + 1, 0);
+        for (std::size_t c = 0; c < chunks.size(); c++) {
+            bases[c + 1] = bases[c] + chunks[c].ids.size();
+        }
+
+        auto ids = std::vector<index_type>(bases.back());
+        pool.parallel_for(chunks.size(), [&](std::size_t c) {
+            auto& chunk = chunks[c];
+            std::copy(chunk.ids.begin(), chunk.ids.end(), ids.begin() + bases[c]);
+            for (auto i = chunk.first; i < chunk.last; i++) {
+                offsets[i + 1] += bases[c];
+            }
+        });
+
+        auto ids_size = ids.size();
+        auto offsets_size = offsets.size();
+
+        return ragged_tokens<index_type>{
+            .ids = tensor({ids_size}, std::make_shared<ids_container>(std::move(ids))),
+            .offsets =
+                tensor({offsets_size}, std::make_shared<offsets_container>(std::move(offsets)))
+        };
+    }
+
+    /// Decode a batch of token sequences using the specified thread pool.
+    ///
+    /// The method returns decoded strings in the order of sequences in the batch.
+    ///
+    /// \param t A tokenizer used to decode token sequences.
+    /// \param batch A batch of token sequences (see \ref encode_batch).
+    /// \param pool A thread pool used to decode sequences.
+    static std::vector<string_type>
+    decode_batch(const Tokenizer& t, const ragged_tokens<index_type>& batch, thread_pool& pool)
+    {
+        const std::size_t batch_size = batch.size();
+        const std::size_t chunk_count = _M_chunk_count(batch_size, pool);
+
+        auto ids = batch.ids.data_ptr();
+        auto offsets = batch.offsets.data_ptr();
+        auto strings = std::vector<string_type>(batch_size);
+
+        pool.parallel_for(chunk_count, [&](std::size_t c) {
+            std::vector<string_type> pieces;
+
+            for (auto i = c * batch_size / chunk_count; i < (c + 1) * batch_size / chunk_count;
+                 i++) {
+                pieces.clear();
+                auto output = std::back_inserter(pieces);
+                decode(t, ids + offsets[i], ids + offsets[i + 1], output);
+
+                for (const auto& piece : pieces) {
+                    strings[i] += piece;
+                }
+            }
+        });
+
+        return strings;
+    }
+
+private:
+    /// Returns the number of chunks, the batch is split into. The number of chunks is larger
+    /// than the number of threads in order to balance the work of threads, when documents
+    /// in the batch have different lengths.
+    static std::size_t
+    _M_chunk_count(std::size_t batch_size, const thread_pool& pool)
+    {
+        return std::max<std::size_t>(std::min(batch_size, pool.size() * 4), 1);
+    }
 };
 
 
@@ -287,6 +587,18 @@ public:
         _M_tokenizer.decode(id, output);
     }
 
+    std::size_t
+    count(const string_type& s) const
+    {
+        return tokenizer_traits<Tokenizer>::count(_M_tokenizer, s);
+    }
+
+    prefix_encoding
+    encode_prefix(const string_type& s, std::size_t max_tokens, encoding_iterator& output) const
+    {
+        return tokenizer_traits<Tokenizer>::encode_prefix(_M_tokenizer, s, max_tokens, output);
+    }
+
 
 private:
     Tokenizer _M_tokenizer;
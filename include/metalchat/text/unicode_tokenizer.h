@@ -4,15 +4,22 @@
 
 #pragma once
 
-#include <codecvt>
+#include <cstdint>
 #include <iterator>
-#include <locale>
+#include <limits>
+#include <stdexcept>
+#include <string>
 
 
 namespace metalchat {
 namespace text {
 
 
+/// An adaptor of the tokenizer that works on strings of Unicode code points, which accepts
+/// and returns UTF-8 encoded strings.
+///
+/// Strings are converted between UTF-8 and code points on every call, tokenizers that work
+/// directly on UTF-8 strings (like \ref sentence_piece) should be preferred.
 template <typename Tokenizer> class unicode_tokenizer_adaptor : public Tokenizer {
 public:
     using char_type = char;
@@ -39,6 +46,28 @@ public:
         Tokenizer::encode(kind, output);
     }
 
+    std::size_t
+    count(const string_type& s) const
+    {
+        return Tokenizer::count(decode_bytes(s));
+    }
+
+    /// Encode the longest prefix of the string, which fits into the specified number of
+    /// tokens. The size of the prefix is reported in bytes of the UTF-8 encoded string.
+    prefix_encoding
+    encode_prefix(const string_type& s, std::size_t max_tokens, encoding_iterator& output) const
+    {
+        auto runes = decode_bytes(s);
+        auto result = Tokenizer::encode_prefix(runes, max_tokens, output);
+
+        if (!result.complete) {
+            result.size = encode_bytes(runes.substr(0, result.size)).size();
+        } else {
+            result.size = s.size();
+        }
+        return result;
+    }
+
     void
     decode(index_type id, decoding_iterator& output) const
     {
@@ -56,25 +85,94 @@ public:
     }
 
 private:
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
     using rune_type = Tokenizer::char_type;
-    using codecvt_type = std::codecvt_utf8<rune_type>;
-    using convert_type = std::wstring_convert<codecvt_type, rune_type>;
-#pragma clang diagnostic pop
+    using rune_string = std::basic_string<rune_type>;
 
     static string_type
-    encode_bytes(const std::basic_string<rune_type>& s)
+    encode_bytes(const rune_string& s)
     {
-        convert_type convert;
-        return convert.to_bytes(s);
+        string_type result;
+        result.reserve(s.size());
+
+        for (auto rune : s) {
+            auto code = static_cast<uint32_t>(rune);
+            if (code < 0x80) {
+                result.push_back(char(code));
+            } else if (code < 0x800) {
+                result.push_back(char(0xc0 | (code >> 6)));
+                result.push_back(char(0x80 | (code & 0x3f)));
+            } else if (code < 0x10000) {
+                result.push_back(char(0xe0 | (code >> 12)));
+                result.push_back(char(0x80 | ((code >> 6) & 0x3f)));
+                result.push_back(char(0x80 | (code & 0x3f)));
+            } else {
+                result.push_back(char(0xf0 | (code >> 18)));
+                result.push_back(char(0x80 | ((code >> 12) & 0x3f)));
+                result.push_back(char(0x80 | ((code >> 6) & 0x3f)));
+                result.push_back(char(0x80 | (code & 0x3f)));
+            }
+        }
+        return result;
     }
 
-    static std::basic_string<rune_type>
+    /// Decode the UTF-8 string into code points.
+    ///
+    /// Method throws `std::range_error`, when the string is not a well-formed UTF-8 string,
+    /// including overlong encodings and encoded surrogate code points (U+D800-U+DFFF).
+    static rune_string
     decode_bytes(const string_type& b)
     {
-        convert_type convert;
-        return convert.from_bytes(b);
+        // The minimum code point of the sequence of the given length, shorter encodings are
+        // overlong and would allow different byte sequences to encode the same string.
+        static constexpr uint32_t min_codes[] = {0, 0, 0x80, 0x800, 0x10000};
+
+        rune_string result;
+        result.reserve(b.size());
+
+        const auto data = reinterpret_cast<const unsigned char*>(b.data());
+        const auto size = b.size();
+
+        for (std::size_t i = 0; i < size;) {
+            const auto byte = data[i];
+
+            uint32_t code = byte;
+            std::size_t length = 1;
+            if ((byte & 0xe0) == 0xc0) {
+                code = byte & 0x1f;
+                length = 2;
+            } else if ((byte & 0xf0) == 0xe0) {
+                code = byte & 0x0f;
+                length = 3;
+            } else if ((byte & 0xf8) == 0xf0) {
+                code = byte & 0x07;
+                length = 4;
+            } else if (byte >= 0x80) {
+                throw std::range_error("unicode_tokenizer_adaptor: invalid UTF-8 sequence");
+            }
+
+            if (i + length > size) {
+                throw std::range_error("unicode_tokenizer_adaptor: incomplete UTF-8 sequence");
+            }
+            for (std::size_t j = 1; j < length; j++) {
+                if ((data[i + j] & 0xc0) != 0x80) {
+                    throw std::range_error("unicode_tokenizer_adaptor: invalid UTF-8 sequence");
+                }
+                code = (code << 6) | (data[i + j] & 0x3f);
+            }
+            if (code < min_codes[length]) {
+                throw std::range_error("unicode_tokenizer_adaptor: overlong UTF-8 sequence");
+            }
+            if (code >= 0xd800 && code <= 0xdfff) {
+                throw std::range_error("unicode_tokenizer_adaptor: surrogate code point");
+            }
+            if (code > 0x10ffff || code > std::numeric_limits<rune_type>::max()) {
+                throw std::range_error("unicode_tokenizer_adaptor: code point is out of range");
+            }
+
+            result.push_back(rune_type(code));
+            i += length;
+        }
+        return result;
     }
 };
 
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+
+namespace metalchat {
+
+
+/// A fixed-size pool of host threads that execute tasks in the order of submission.
+///
+/// The pool is used to parallelize host-side work, like tokenization of large batches of
+/// documents or reading of model weights. Copies of the pool share the same threads, threads
+/// are joined when the last copy of the pool is destroyed.
+///
+/// ```cpp
+/// thread_pool pool(4);
+///
+/// auto future = pool.push([] { return 42; });
+/// pool.parallel_for(100, [](std::size_t i) { std::cout << i << std::endl; });
+/// ```
+class thread_pool {
+public:
+    /// Create a new thread pool.
+    ///
+    /// \param thread_count A number of threads in the pool, when the value is zero, the
+    ///     pool is created with a single thread.
+    thread_pool(std::size_t thread_count = std::thread::hardware_concurrency());
+
+    /// The \ref thread_pool copy constructor.
+    thread_pool(const thread_pool&) = default;
+
+    /// Returns the number of threads in the pool.
+    std::size_t
+    size() const;
+
+    /// Submit a task for the asynchronous execution.
+    ///
+    /// Method returns a future that holds either a result of the task, or an exception
+    /// thrown by the task.
+    template <typename Function, typename Result = std::invoke_result_t<Function>>
+    std::future<Result>
+    push(Function&& f)
+    {
+        using task_type = std::packaged_task<Result()>;
+
+        auto task = std::make_shared<task_type>(std::forward<Function>(f));
+        auto future = task->get_future();
+
+        _M_push([task = std::move(task)]() { (*task)(); });
+        return future;
+    }
+
+    /// Invoke the specified function for every index in range `[0, count)` and wait until
+    /// all invocations complete.
+    ///
+    /// The calling thread participates in the execution, so the method could be safely
+    /// called from the tasks of the same pool. The order of invocations is not specified.
+    /// When one of invocations throws an exception, remaining indices are skipped, and the
+    /// first exception is re-thrown to the caller.
+    template <typename Function>
+    void
+    parallel_for(std::size_t count, Function&& f)
+    {
+        struct parallel_state {
+            std::atomic<std::size_t> next = 0;
+            std::atomic<std::size_t> done = 0;
+            std::atomic<bool> failed = false;
+            std::exception_ptr error = nullptr;
+            std::mutex mutex;
+            std::condition_variable cv;
+        };
+
+        auto state = std::make_shared<parallel_state>();
+
+        // Workers that start after all indices are claimed, return immediately without
+        // accessing the function, therefore it is safe to capture it by reference.
+        auto worker = [state, count, &f]() {
+            for (auto i = state->next++; i < count; i = state->next++) {
+                if (!state->failed) {
+                    try {
+                        f(i);
+                    } catch (...) {
+                        std::scoped_lock lock(state->mutex);
+                        if (!state->failed.exchange(true)) {
+                            state->error = std::current_exception();
+                        }
+                    }
+                }
+                if (++state->done == count) {
+                    std::scoped_lock lock(state->mutex);
+                    state->cv.notify_all();
+                }
+            }
+        };
+
+        auto worker_count = std::min(count, size() + 1);
+        for (std::size_t i = 1; i < worker_count; i++) {
+            _M_push(worker);
+        }
+        worker();
+
+        std::unique_lock lock(state->mutex);
+        state->cv.wait(lock, [&] { return state->done == count; });
+
+        if (state->error != nullptr) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+private:
+    struct _ThreadPool;
+    std::shared_ptr<_ThreadPool> _M_impl;
+
+    void
+    _M_push(std::function<void()>&& task);
+};
+
+
+} // namespace metalchat
@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <metalchat/allocator.h>
+
+
+namespace metalchat {
+
+
+/// A scope of the allocation tag of the calling thread.
+///
+/// Scopes are nested: the tag of allocations is a path of names of all active scopes of the
+/// thread joined with delimiters (e.g. `layers.0.attention`). Invocations of layers through
+/// \ref nn::indirect_layer open a scope with the name of the layer, so that allocations of the
+/// layer are attributed to it by \ref tracing_allocator_adapter.
+///
+/// The scope only links a pointer to the thread-local chain, names are joined only when the
+/// tag is requested, so that scopes are cheap, when allocations are not traced.
+///
+/// ```cpp
+/// const allocation_scope scope("decode");
+/// auto container_ptr = alloc.allocate(4096); // Tagged as "decode".
+/// ```
+class allocation_scope {
+public:
+    /// Open a new allocation scope.
+    ///
+    /// \param name A name of the scope, the name must outlive the scope. Scopes with empty
+    ///     names are skipped in the tag.
+    /// \param delimiter A delimiter used to join the name with the name of the parent scope.
+    allocation_scope(std::string_view name, char delimiter = '.') noexcept;
+
+    allocation_scope(const allocation_scope&) = delete;
+
+    /// Close the allocation scope.
+    ~allocation_scope();
+
+    /// Returns a tag of the calling thread, an empty string when no scope is active.
+    static std::string
+    current();
+
+private:
+    const allocation_scope* _M_parent;
+    std::string_view _M_name;
+    char _M_delimiter;
+};
+
+
+/// A type of the allocation event, see \ref allocation_event.
+enum class allocation_event_type {
+    /// A container was allocated.
+    allocate,
+    /// A container was released.
+    free,
+};
+
+
+/// An event recorded by the \ref allocation_trace.
+struct allocation_event {
+    /// A type of the event.
+    allocation_event_type type;
+    /// An identifier of the allocation, the release has the same identifier.
+    std::size_t id;
+    /// A size of the allocation in bytes.
+    std::size_t size;
+    /// A tag of the allocation (see \ref allocation_scope), releases are attributed to the tag
+    /// of the allocation.
+    std::string tag;
+    /// A time since the creation of the trace.
+    std::chrono::nanoseconds timestamp;
+};
+
+
+/// Statistics of allocations with the same tag, see \ref allocation_trace::tag_stats.
+struct allocation_tag_stats {
+    /// A number of allocations with the tag.
+    std::size_t allocations = 0;
+    /// A number of bytes of the tag, that are currently allocated.
+    std::size_t bytes_in_use = 0;
+    /// The maximum number of bytes of the tag allocated at the same time.
+    std::size_t peak_bytes = 0;
+    /// A number of bytes of the tag at the moment of the peak of all tags. Values of all tags
+    /// sum up to \ref allocation_trace::peak_bytes.
+    std::size_t bytes_at_peak = 0;
+};
+
+
+/// A trace of allocate and free events.
+///
+/// The trace accumulates events in memory, and keeps the usage of memory per tag, so that the
+/// contribution of every tag to the peak of memory usage could be inspected after the run.
+/// Copies of the trace share the same events.
+///
+/// When the trace is disabled, allocations are not recorded, and the only cost of tracing is
+/// a check of the atomic flag per allocation. Containers allocated while the trace was enabled
+/// are still recorded on release, so that the usage of memory remains consistent.
+class allocation_trace {
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    /// Create a new enabled trace.
+    allocation_trace();
+
+    /// Enable recording of allocations.
+    void
+    enable() noexcept;
+
+    /// Disable recording of allocations.
+    void
+    disable() noexcept;
+
+    /// Returns `true`, when allocations are recorded.
+    bool
+    enabled() const noexcept;
+
+    /// Record an allocation with the tag of the calling thread.
+    ///
+    /// \param size A size of the allocation in bytes.
+    /// \return An identifier of the allocation.
+    std::size_t
+    record_allocate(std::size_t size);
+
+    /// Record a release of the allocation.
+    ///
+    /// \param id An identifier of the allocation returned by \ref record_allocate.
+    void
+    record_free(std::size_t id);
+
+    /// Returns all recorded events in the order of recording.
+    std::vector<allocation_event>
+    events() const;
+
+    /// Returns statistics of allocations per tag.
+    std::unordered_map<std::string, allocation_tag_stats>
+    tag_stats() const;
+
+    /// Returns the number of bytes, that are currently allocated.
+    std::size_t
+    bytes_in_use() const;
+
+    /// Returns the maximum number of bytes allocated at the same time.
+    std::size_t
+    peak_bytes() const;
+
+    /// Write the trace as a JSON document.
+    ///
+    /// The document contains the timeline of events (`events`), the peak usage of memory
+    /// (`peak_bytes`), and statistics per tag (`tags`):
+    /// ```json
+    /// {
+    ///   "peak_bytes": 4096,
+    ///   "events": [
+    ///     {"type": "allocate", "id": 0, "size": 4096, "tag": "output", "timestamp_ns": 1200}
+    ///   ],
+    ///   "tags": {
+    ///     "output": {"allocations": 1, "bytes_in_use": 4096, "peak_bytes": 4096,
+    ///                "bytes_at_peak": 4096}
+    ///   }
+    /// }
+    /// ```
+    ///
+    /// \param os An output stream to write the document to.
+    void
+    write_json(std::ostream& os) const;
+
+    /// Remove all recorded events and reset statistics. Containers allocated before the
+    /// reset are not recorded on release.
+    void
+    clear();
+
+private:
+    struct _State;
+
+    std::shared_ptr<_State> _M_state;
+};
+
+
+/// This class records allocations of the underlying allocator into the \ref allocation_trace.
+///
+/// Every allocation is recorded with its size, the tag of the calling thread (the path of the
+/// active layer, see \ref allocation_scope) and the timestamp. The returned container records
+/// the release of the memory, once the last reference to the container is destroyed.
+///
+/// The adapter is a \ref hardware_allocator, when the underlying allocator is a hardware
+/// allocator, so it could be wrapped into \ref polymorphic_hardware_allocator and installed
+/// into the \ref hardware_accelerator.
+///
+/// Example:
+/// ```cpp
+/// auto alloc = tracing_allocator_adapter(random_memory_allocator<void>());
+///
+/// auto container_ptr = alloc.allocate(4096);
+/// alloc.trace().write_json(std::cout);
+/// ```
+template <allocator_t<void> Allocator> class tracing_allocator_adapter {
+public:
+    using value_type = Allocator::value_type;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+    using size_type = Allocator::size_type;
+    using container_type = Allocator::container_type;
+    using container_pointer = Allocator::container_pointer;
+
+    /// Constructs a new tracing allocator.
+    ///
+    /// \param alloc The underlying allocator.
+    /// \param trace A trace to record allocations to.
+    tracing_allocator_adapter(Allocator alloc, const allocation_trace& trace = {})
+    : _M_alloc(alloc),
+      _M_trace(trace)
+    {}
+
+    container_pointer
+    allocate(size_type size)
+    {
+        return traced(_M_alloc.allocate(size), size);
+    }
+
+    container_pointer
+    allocate(const_pointer ptr, size_type size)
+    {
+        return traced(_M_alloc.allocate(ptr, size), size);
+    }
+
+    /// Returns the trace of allocations.
+    allocation_trace&
+    trace()
+    {
+        return _M_trace;
+    }
+
+    /// Returns the trace of allocations.
+    const allocation_trace&
+    trace() const
+    {
+        return _M_trace;
+    }
+
+private:
+    Allocator _M_alloc;
+    allocation_trace _M_trace;
+
+    container_pointer
+    traced(container_pointer&& container_ptr, size_type size)
+    {
+        if (!_M_trace.enabled()) {
+            return container_ptr;
+        }
+
+        auto id = _M_trace.record_allocate(size);
+
+        // The returned container shares the allocated container, the deleter records the
+        // release, once the last reference to the container is destroyed.
+        auto data_ptr = container_ptr.get();
+        auto deleter = [trace = _M_trace, container_ptr = std::move(container_ptr),
+                        id](container_type*) mutable {
+            trace.record_free(id);
+            container_ptr.reset();
+        };
+
+        return container_pointer(data_ptr, std::move(deleter));
+    }
+};
+
+
+} // namespace metalchat
@@ -132,6 +132,32 @@ model_provider::insert(const manifest& m)
     auto& clone = it->second;
     clone(model_manifest, model_path);
 
+    // Compile the tokenizer, so that the model startup does not require parsing the
+    // tokenizer model. Tokenizer falls back to the original model, when compilation fails.
+    using transformer_type = huggingface::llama3;
+    auto tokenizer_path = model_path / transformer_type::tokenizer_location;
+    try {
+        transformer_type::tokenizer_loader loader;
+        loader.compile(tokenizer_path);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Warning: failed compiling tokenizer: " << e.what() << std::endl;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Warning: failed compiling tokenizer: " << e.what() << std::endl;
+    }
+
+    // Compile the transformer, so that the model startup does not require renaming and
+    // permutation of weights. Transformer falls back to the original weights, when
+    // compilation fails.
+    try {
+        filesystem_repository<transformer_type> repository(model_path);
+        transformer_container<transformer_type> transformers(model_path);
+        transformers.compile(model_manifest.model, repository.retrieve_options());
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Warning: failed compiling transformer: " << e.what() << std::endl;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Warning: failed compiling transformer: " << e.what() << std::endl;
+    }
+
     ManifestFile manifest_file(manifest_path, tomlformat::multiline);
     manifest_file.write(model_manifest);
 
@@ -180,7 +180,8 @@ public:
     using constructor_type = std::function<value_type(const options_type&)>;
 
     transformer_container(const std::filesystem::path& p)
-    : _M_values()
+    : _M_values(),
+      _M_compilers()
     {
         _M_values.insert_or_assign(partitioning::consolidated, [=](const options_type& options) {
             repository_type<safetensor_document> repository(p);
@@ -190,6 +191,31 @@ public:
             repository_type<sharded_safetensor_document> repository(p);
             return repository.retrieve_transformer("model.safetensors.index.json", options);
         });
+
+        _M_compilers.insert_or_assign(partitioning::consolidated, [=](const options_type& options) {
+            repository_type<safetensor_document> repository(p);
+            repository.compile_transformer("model.safetensors", options);
+        });
+        _M_compilers.insert_or_assign(partitioning::sharded, [=](const options_type& options) {
+            repository_type<sharded_safetensor_document> repository(p);
+            repository.compile_transformer("model.safetensors.index.json", options);
+        });
+    }
+
+    /// Compile the transformer, so that the model startup does not require adaptation
+    /// of weights.
+    void
+    compile(const model_section& model, const options_type& options) const
+    {
+        auto compiler = _M_compilers.find(model.partitioning);
+        if (compiler == _M_compilers.end()) {
+            throw std::runtime_error(
+                std::format("transformer: partitioning '{}' is not supported", model.partitioning)
+            );
+        }
+
+        auto& compile = compiler->second;
+        compile(options);
     }
 
     value_type
@@ -207,7 +233,10 @@ public:
     }
 
 private:
+    using compiler_type = std::function<void(const options_type&)>;
+
     std::unordered_map<std::string, constructor_type> _M_values;
+    std::unordered_map<std::string, compiler_type> _M_compilers;
 };
 
 
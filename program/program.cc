@@ -101,6 +101,8 @@ program::transform(const program_scope& scope, const std::string& prompt) const
     using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
 
     auto interp = metalchat::interpreter(transformer, tokenizer);
+    interp.set_context_limit(repo.retrieve_options().max_seq_len);
+
     // TODO: extract terminal tokens from the huggingface tokenizer configuration.
     interp.set_token_scanner(match_token_scanner(
         {TokenizerTraits::encode(tokenizer, text::token::end_text),
@@ -114,7 +116,6 @@ program::transform(const program_scope& scope, const std::string& prompt) const
     }
     interp.write(basic_message("user", prompt));
 
-    // TODO: ensure that encoded context does not exceed the model limit.
     std::ostream_iterator<std::string> content_iterator(std::cout << std::unitbuf);
     interp.read(content_iterator);
 }
@@ -2,9 +2,21 @@
 // SPDX-FileCopyrightText: 2025 Yakau Bubnou
 // SPDX-FileType: SOURCE
 
+#include <algorithm>
+#include <cstdint>
 #include <format>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 #include <metalchat/container.h>
 
@@ -12,6 +24,527 @@
 namespace metalchat {
 
 
+std::size_t
+memory_page_size() noexcept
+{
+    static const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+
+/// Extend the memory range to the page boundaries, returns a pointer to the first page
+/// and the size of the range rounded up to the page size.
+static std::pair<char*, std::size_t>
+_Page_aligned_range(const void* ptr, std::size_t size) noexcept
+{
+    const auto page_size = memory_page_size();
+    const auto address = reinterpret_cast<std::uintptr_t>(ptr);
+    const auto first = address & ~(page_size - 1);
+    const auto last = (address + size + page_size - 1) & ~(page_size - 1);
+
+    return std::make_pair(reinterpret_cast<char*>(first), last - first);
+}
+
+
+bool
+memory_advise(const void* ptr, std::size_t size, memory_advice advice) noexcept
+{
+    if (ptr == nullptr || size == 0) {
+        return false;
+    }
+
+    int flags = 0;
+    switch (advice) {
+    case memory_advice::normal:
+        flags = MADV_NORMAL;
+        break;
+    case memory_advice::sequential:
+        flags = MADV_SEQUENTIAL;
+        break;
+    case memory_advice::random:
+        flags = MADV_RANDOM;
+        break;
+    case memory_advice::willneed:
+        flags = MADV_WILLNEED;
+        break;
+    case memory_advice::hugepage:
+#if defined(MADV_HUGEPAGE)
+        flags = MADV_HUGEPAGE;
+        break;
+#else
+        return false;
+#endif
+    }
+
+    auto [first, length] = _Page_aligned_range(ptr, size);
+    return madvise(first, length, flags) == 0;
+}
+
+
+std::size_t
+memory_resident_size(const void* ptr, std::size_t size) noexcept
+{
+    if (ptr == nullptr || size == 0) {
+        return 0;
+    }
+
+    const auto page_size = memory_page_size();
+    auto [first, length] = _Page_aligned_range(ptr, size);
+
+    // Residency is queried in batches of pages to bound the size of the status vector.
+    constexpr std::size_t batch_pages = 4096;
+#if defined(__APPLE__)
+    std::vector<char> status(batch_pages);
+#else
+    std::vector<unsigned char> status(batch_pages);
+#endif
+
+    std::size_t resident_size = 0;
+    for (std::size_t offset = 0; offset < length; offset += batch_pages * page_size) {
+        auto batch_length = std::min(length - offset, batch_pages * page_size);
+        if (mincore(first + offset, batch_length, status.data()) != 0) {
+            return 0;
+        }
+
+        auto pages = batch_length / page_size;
+        for (std::size_t i = 0; i < pages; i++) {
+            resident_size += (status[i] & 1) ? page_size : 0;
+        }
+    }
+
+    return resident_size;
+}
+
+
+std::size_t
+memory_huge_page_size() noexcept
+{
+    static const std::size_t huge_page_size = []() -> std::size_t {
+        constexpr std::size_t default_size = 2 * 1024 * 1024;
+#if defined(__linux__)
+        std::FILE* meminfo = std::fopen("/proc/meminfo", "r");
+        if (meminfo == nullptr) {
+            return default_size;
+        }
+
+        std::size_t size_kb = 0;
+        char line[256];
+        while (std::fgets(line, sizeof(line), meminfo) != nullptr) {
+            if (std::sscanf(line, "Hugepagesize: %zu kB", &size_kb) == 1) {
+                break;
+            }
+        }
+
+        std::fclose(meminfo);
+        return size_kb > 0 ? size_kb * 1024 : default_size;
+#else
+        return default_size;
+#endif
+    }();
+
+    return huge_page_size;
+}
+
+
+numa_policy
+numa_policy::local()
+{
+    return numa_policy{.placement = numa_placement::local, .nodes = {}};
+}
+
+
+numa_policy
+numa_policy::bind(std::size_t node)
+{
+    return numa_policy{.placement = numa_placement::bind, .nodes = {node}};
+}
+
+
+numa_policy
+numa_policy::interleave(std::vector<std::size_t> nodes)
+{
+    return numa_policy{.placement = numa_placement::interleave, .nodes = std::move(nodes)};
+}
+
+
+#if defined(__linux__)
+
+// Constants of the memory policy from <linux/mempolicy.h>, declared here to avoid
+// the dependency on the libnuma headers.
+static constexpr int _Mpol_default = 0;
+static constexpr int _Mpol_preferred = 1;
+static constexpr int _Mpol_bind = 2;
+static constexpr int _Mpol_interleave = 3;
+static constexpr int _Mpol_local = 4;
+static constexpr unsigned _Mpol_mf_move = 1 << 1;
+
+
+/// Read the list of integers in the format of the sysfs (e.g. `0-3,8,10-11`).
+static std::vector<std::size_t>
+_Sysfs_list(const std::string& path)
+{
+    std::vector<std::size_t> values;
+
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return values;
+    }
+
+    std::size_t first = 0, last = 0;
+    int count = 0;
+    while ((count = std::fscanf(file, "%zu-%zu", &first, &last)) > 0) {
+        last = count == 2 ? last : first;
+        for (auto value = first; value <= last; value++) {
+            values.push_back(value);
+        }
+        if (std::fgetc(file) != ',') {
+            break;
+        }
+    }
+
+    std::fclose(file);
+    return values;
+}
+
+
+/// A mask of NUMA nodes in the format of the `mbind` and `set_mempolicy` system calls.
+struct _Node_mask {
+    static constexpr std::size_t word_bits = sizeof(unsigned long) * 8;
+
+    std::vector<unsigned long> words;
+
+    _Node_mask(std::size_t node_count)
+    : words((node_count + word_bits - 1) / word_bits, 0)
+    {}
+
+    void
+    set(std::size_t node)
+    {
+        words[node / word_bits] |= 1UL << (node % word_bits);
+    }
+
+    const unsigned long*
+    data() const
+    {
+        return words.empty() ? nullptr : words.data();
+    }
+
+    /// Kernel reads one bit less than specified, so the number of bits is increased.
+    unsigned long
+    max_node() const
+    {
+        return words.empty() ? 0 : words.size() * word_bits + 1;
+    }
+};
+
+
+/// Translate the policy into the mode and the mask of nodes, returns false, when the policy
+/// refers to non-existing nodes.
+static bool
+_Numa_policy_mode(const numa_policy& policy, int& mode, _Node_mask& mask)
+{
+    const auto node_count = numa_node_count();
+    for (auto node : policy.nodes) {
+        if (node >= node_count) {
+            return false;
+        }
+    }
+
+    switch (policy.placement) {
+    case numa_placement::first_touch:
+        mode = _Mpol_default;
+        return true;
+    case numa_placement::local:
+        mode = _Mpol_local;
+        return true;
+    case numa_placement::bind:
+        mode = _Mpol_bind;
+        break;
+    case numa_placement::interleave:
+        mode = _Mpol_interleave;
+        break;
+    }
+
+    mask = _Node_mask(node_count);
+    for (auto node : policy.nodes) {
+        mask.set(node);
+    }
+    if (policy.nodes.empty() && policy.placement == numa_placement::interleave) {
+        for (std::size_t node = 0; node < node_count; node++) {
+            mask.set(node);
+        }
+    }
+
+    return !policy.nodes.empty() || policy.placement == numa_placement::interleave;
+}
+
+#endif
+
+
+std::size_t
+numa_node_count() noexcept
+{
+#if defined(__linux__)
+    static const std::size_t node_count = []() -> std::size_t {
+        try {
+            auto nodes = _Sysfs_list("/sys/devices/system/node/possible");
+            return nodes.empty() ? 1 : *std::max_element(nodes.begin(), nodes.end()) + 1;
+        } catch (...) {
+            return 1;
+        }
+    }();
+
+    return node_count;
+#else
+    return 1;
+#endif
+}
+
+
+bool
+memory_bind(const void* ptr, std::size_t size, const numa_policy& policy) noexcept
+{
+    if (ptr == nullptr || size == 0) {
+        return false;
+    }
+
+#if defined(__linux__) && defined(SYS_mbind)
+    try {
+        int mode = _Mpol_default;
+        _Node_mask mask(0);
+        if (!_Numa_policy_mode(policy, mode, mask)) {
+            return false;
+        }
+
+        auto flags = mask.data() != nullptr ? _Mpol_mf_move : 0;
+        auto [first, length] = _Page_aligned_range(ptr, size);
+
+        return syscall(SYS_mbind, first, length, mode, mask.data(), mask.max_node(), flags) == 0;
+    } catch (...) {
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+
+std::vector<std::size_t>
+memory_numa_nodes(const void* ptr, std::size_t size)
+{
+    if (ptr == nullptr || size == 0) {
+        return std::vector<std::size_t>(numa_node_count(), 0);
+    }
+
+#if defined(__linux__) && defined(SYS_move_pages)
+    const auto page_size = memory_page_size();
+    auto [first, length] = _Page_aligned_range(ptr, size);
+
+    std::vector<std::size_t> node_sizes(numa_node_count(), 0);
+
+    // Placement is queried in batches of pages to bound the size of the status vector.
+    constexpr std::size_t batch_pages = 4096;
+    std::vector<void*> pages(batch_pages);
+    std::vector<int> status(batch_pages);
+
+    for (std::size_t offset = 0; offset < length; offset += batch_pages * page_size) {
+        auto count = std::min(length - offset, batch_pages * page_size) / page_size;
+        for (std::size_t i = 0; i < count; i++) {
+            pages[i] = first + offset + i * page_size;
+        }
+
+        // Without target nodes, the system call only reports nodes of the pages.
+        auto pages_ptr = pages.data();
+        auto status_ptr = status.data();
+        if (syscall(SYS_move_pages, 0, count, pages_ptr, nullptr, status_ptr, 0) != 0) {
+            return {};
+        }
+
+        // Negative status is an error code for pages, that are not allocated yet.
+        for (std::size_t i = 0; i < count; i++) {
+            if (status[i] >= 0 && std::size_t(status[i]) < node_sizes.size()) {
+                node_sizes[status[i]] += page_size;
+            }
+        }
+    }
+
+    return node_sizes;
+#else
+    return {memory_resident_size(ptr, size)};
+#endif
+}
+
+
+bool
+numa_set_thread_policy(const numa_policy& policy) noexcept
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    try {
+        int mode = _Mpol_default;
+        _Node_mask mask(0);
+        if (!_Numa_policy_mode(policy, mode, mask)) {
+            return false;
+        }
+
+        return syscall(SYS_set_mempolicy, mode, mask.data(), mask.max_node()) == 0;
+    } catch (...) {
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+
+bool
+numa_pin_thread(std::size_t node) noexcept
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    try {
+        if (node >= numa_node_count()) {
+            return false;
+        }
+
+        auto cpus = _Sysfs_list(std::format("/sys/devices/system/node/node{}/cpulist", node));
+        if (cpus.empty()) {
+            return false;
+        }
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (auto cpu : cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &cpu_set);
+            }
+        }
+
+        if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+            return false;
+        }
+
+        // Preferred policy falls back to other nodes instead of failing allocations,
+        // when the memory of the node is exhausted.
+        _Node_mask mask(numa_node_count());
+        mask.set(node);
+        return syscall(SYS_set_mempolicy, _Mpol_preferred, mask.data(), mask.max_node()) == 0;
+    } catch (...) {
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+
+/// Map the memory with the specified options, falling back to the default pages, when the
+/// huge pages are not available. Returns the pointer to the mapping (or `MAP_FAILED`) and
+/// the size of the mapping, which is rounded up to the huge page size for `MAP_HUGETLB`.
+static std::pair<void*, std::size_t>
+_Memory_map(
+    std::size_t size,
+    int prot,
+    int flags,
+    int fd,
+    off_t offset,
+    const memory_map_options& options,
+    memory_map_mode& mode
+) noexcept
+{
+    mode = memory_map_mode{};
+    const bool numa = options.numa.placement != numa_placement::first_touch;
+
+    int populate = 0;
+#if defined(MAP_POPULATE)
+    populate = options.populate ? MAP_POPULATE : 0;
+#endif
+
+    // Pages populated before the advice or the NUMA policy are allocated with the default
+    // size on the node of the calling thread, so such mappings are populated after.
+#if defined(MADV_POPULATE_READ) && defined(MADV_POPULATE_WRITE)
+    const bool populate_after = (options.hugepage || numa) && populate != 0;
+#else
+    const bool populate_after = false;
+#endif
+    const int map_populate = populate_after ? 0 : populate;
+
+    void* map = MAP_FAILED;
+    std::size_t map_size = size;
+
+#if defined(MAP_HUGETLB)
+    if (options.hugepage) {
+        const auto huge_page_size = memory_huge_page_size();
+        const auto huge_size = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+
+        map = mmap(nullptr, huge_size, prot, flags | map_populate | MAP_HUGETLB, fd, offset);
+        if (map != MAP_FAILED) {
+            mode.pages = memory_page_kind::hugetlb;
+            map_size = huge_size;
+        }
+    }
+#endif
+
+    if (map == MAP_FAILED) {
+        map = mmap(nullptr, size, prot, flags | map_populate, fd, offset);
+        if (map == MAP_FAILED) {
+            return std::make_pair(map, 0);
+        }
+
+        if (options.hugepage && memory_advise(map, size, memory_advice::hugepage)) {
+            mode.pages = memory_page_kind::transparent_hugepage;
+        }
+    }
+
+    if (numa) {
+        mode.numa_bound = memory_bind(map, map_size, options.numa);
+    }
+
+    mode.populate_requested = populate != 0;
+#if defined(MADV_POPULATE_READ) && defined(MADV_POPULATE_WRITE)
+    if (populate_after) {
+        // Write faults dirty pages of the shared file mappings, so files are populated
+        // for reading, only anonymous memory is populated for writing.
+        auto advice = (fd == -1 && (prot & PROT_WRITE)) ? MADV_POPULATE_WRITE : MADV_POPULATE_READ;
+        mode.populate_requested = madvise(map, map_size, advice) == 0;
+    }
+#endif
+
+    return std::make_pair(map, map_size);
+}
+
+
+std::pair<std::shared_ptr<void>, memory_map_mode>
+memory_map(std::size_t size, const memory_map_options& options)
+{
+    if (size == 0) {
+        throw std::invalid_argument("memory_map: size of the memory must be positive");
+    }
+
+    const auto page_size = memory_page_size();
+    size = (size + page_size - 1) & ~(page_size - 1);
+
+    memory_map_mode mode;
+    auto prot = PROT_READ | PROT_WRITE;
+    auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    auto [map, map_size] = _Memory_map(size, prot, flags, -1, 0, options, mode);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error(std::format("memory_map: unable to map {} bytes", size));
+    }
+
+    auto deleter = [map_size](void* ptr) { munmap(ptr, map_size); };
+    return std::make_pair(std::shared_ptr<void>(map, deleter), mode);
+}
+
+
+static void
+_File_close(std::FILE* file)
+{
+    if (file != nullptr) {
+        std::fclose(file);
+    }
+}
+
+
 std::string
 filemode(std::ios::openmode mode)
 {
@@ -32,7 +565,7 @@ filemode(std::ios::openmode mode)
 basic_memfile::basic_memfile(const std::filesystem::path& p, std::ios::openmode mode)
 {
     auto fmode = filemode(mode);
-    _M_file = std::fopen(p.c_str(), fmode.c_str());
+    _M_file = std::shared_ptr<std::FILE>(std::fopen(p.c_str(), fmode.c_str()), _File_close);
     if (_M_file == nullptr) {
         throw std::invalid_argument(
             std::format("basic_memfile: unable to open file '{}'", p.string())
@@ -53,7 +586,7 @@ basic_memfile::basic_memfile(const std::filesystem::path& p)
 basic_memfile::basic_memfile(std::ios::openmode mode)
 {
     _M_mode = mode;
-    _M_file = std::tmpfile();
+    _M_file = std::shared_ptr<std::FILE>(std::tmpfile(), _File_close);
     if (_M_file == nullptr) {
         throw std::invalid_argument("basic_memfile: unable to create temporary file");
     }
@@ -65,6 +598,25 @@ basic_memfile::basic_memfile()
 {}
 
 
+basic_memfile::basic_memfile(const basic_memfile& file, std::size_t offset, std::size_t size)
+: _M_file(file._M_file),
+  _M_file_offset(file._M_file_offset + offset),
+  _M_file_size(size),
+  _M_file_p(size),
+  _M_mode(std::ios::in)
+{
+    if (_M_file == nullptr) {
+        throw std::invalid_argument("basic_memfile: unable to create a window of a closed file");
+    }
+    if (offset > file._M_file_size || size > file._M_file_size - offset) {
+        throw std::invalid_argument(std::format(
+            "basic_memfile: window [{}, {}) is out of the file bounds [0, {})", offset,
+            offset + size, file._M_file_size
+        ));
+    }
+}
+
+
 bool
 basic_memfile::is_mapped() const noexcept
 {
@@ -74,12 +626,19 @@ basic_memfile::is_mapped() const noexcept
 
 basic_memfile&
 basic_memfile::declare_mapped()
+{
+    return declare_mapped(memory_map_options{});
+}
+
+
+basic_memfile&
+basic_memfile::declare_mapped(const memory_map_options& options)
 {
     if (is_mapped()) {
         return *this;
     }
 
-    int fd = fileno(_M_file);
+    int fd = fileno(_M_file.get());
     if (fd == -1) {
         throw std::invalid_argument("basic_memfile: unable to get file descriptor for a file");
     }
@@ -92,11 +651,19 @@ basic_memfile::declare_mapped()
         flags = MAP_SHARED;
     }
 
-    _M_map = static_cast<char_type*>(mmap(nullptr, _M_file_size, prot, flags, fd, 0));
-    if (_M_map == MAP_FAILED) {
+    // Offset of the mapping must be a multiple of the page size, so windows of the file
+    // are mapped from the beginning of the page, and the pointer is shifted to the window.
+    auto [map_offset, map_size] = mapped_range();
+
+    auto offset = static_cast<off_t>(map_offset);
+    auto [map, size] = _Memory_map(map_size, prot, flags, fd, offset, options, _M_map_mode);
+    if (map == MAP_FAILED) {
         throw std::invalid_argument("basic_memfile: unable to memory-map safetensors a file");
     }
 
+    _M_map = static_cast<char_type*>(map) + (_M_file_offset - map_offset);
+    _M_map_size = size;
+
     return *this;
 }
 
@@ -105,18 +672,43 @@ basic_memfile&
 basic_memfile::undeclare_mapped()
 {
     if (is_mapped()) {
+        auto [map_offset, map_size] = mapped_range();
+        auto map = _M_map - (_M_file_offset - map_offset);
+
         if (writable()) {
-            msync(_M_map, _M_file_size, MS_SYNC);
+            msync(map, map_size, MS_SYNC);
         }
 
-        munmap(_M_map, _M_file_size);
+        // Mappings backed by huge pages are larger than the mapped range of the file.
+        munmap(map, _M_map_size);
         _M_map = nullptr;
+        _M_map_size = 0;
+        _M_map_mode = memory_map_mode{};
     }
 
     return *this;
 }
 
 
+bool
+basic_memfile::advise(memory_advice advice, std::size_t offset, std::size_t size) const noexcept
+{
+    if (!is_mapped() || offset >= _M_file_size) {
+        return false;
+    }
+
+    size = std::min(size, _M_file_size - offset);
+    return memory_advise(_M_map + offset, size, advice);
+}
+
+
+memory_map_mode
+basic_memfile::map_mode() const noexcept
+{
+    return _M_map_mode;
+}
+
+
 std::size_t
 basic_memfile::size() const noexcept
 {
@@ -156,7 +748,7 @@ basic_memfile&
 basic_memfile::read(char_type* d, std::size_t size)
 {
     if (!is_mapped()) {
-        auto read = std::fread(d, sizeof(char_type), size, _M_file);
+        auto read = std::fread(d, sizeof(char_type), size, _M_file.get());
         _M_file_g += read;
         _M_file_size += read;
         return *this;
@@ -182,6 +774,15 @@ basic_memfile::read(void* d, std::size_t size)
 }
 
 
+std::pair<std::size_t, std::size_t>
+basic_memfile::mapped_range() const noexcept
+{
+    const auto page_size = memory_page_size();
+    const auto map_offset = _M_file_offset & ~(page_size - 1);
+    return std::make_pair(map_offset, _M_file_size + (_M_file_offset - map_offset));
+}
+
+
 bool
 basic_memfile::writable() const
 {
@@ -196,7 +797,7 @@ basic_memfile::write(const char_type* s, std::size_t size)
         throw std::runtime_error("basic_memfile: file is not opened in a write mode");
     }
 
-    auto written = std::fwrite(s, sizeof(char_type), size, _M_file);
+    auto written = std::fwrite(s, sizeof(char_type), size, _M_file.get());
     _M_file_p += written;
     _M_file_size += written;
 
@@ -221,15 +822,212 @@ void
 basic_memfile::close()
 {
     undeclare_mapped();
+    _M_file.reset();
+}
+
+
+basic_memfile::~basic_memfile() { close(); }
 
-    if (_M_file != nullptr) {
-        std::fclose(_M_file);
-        _M_file = nullptr;
+
+struct residency_manager::_State {
+    struct group_type {
+        std::vector<std::weak_ptr<basic_memfile>> files;
+        std::size_t size = 0;
+        std::size_t acquired = 0;
+        std::size_t last_access = 0;
+        bool mapped = false;
+    };
+
+    std::mutex mutex;
+    std::size_t budget;
+    std::size_t access_count = 0;
+    std::vector<group_type> groups;
+    std::unordered_map<std::string, std::size_t> names;
+    residency_stats stats;
+
+    _State(std::size_t b)
+    : budget(b)
+    {}
+
+    group_type&
+    at(std::size_t group)
+    {
+        if (group >= groups.size()) {
+            throw std::out_of_range(
+                std::format("residency_manager: group {} does not exist", group)
+            );
+        }
+        return groups[group];
     }
+
+    void
+    map(group_type& g)
+    {
+        for (auto& file : g.files) {
+            if (auto file_ptr = file.lock(); file_ptr) {
+                file_ptr->declare_mapped();
+            }
+        }
+
+        g.mapped = true;
+        stats.resident_size += g.size;
+        stats.peak_size = std::max(stats.peak_size, stats.resident_size);
+    }
+
+    void
+    unmap(group_type& g)
+    {
+        for (auto& file : g.files) {
+            if (auto file_ptr = file.lock(); file_ptr) {
+                file_ptr->undeclare_mapped();
+            }
+        }
+
+        g.mapped = false;
+        stats.resident_size -= g.size;
+    }
+
+    void
+    access(std::size_t group, bool acquire)
+    {
+        auto& g = at(group);
+
+        // Accesses to the acquired group are not counted, since the group could not be
+        // evicted until it is released.
+        if (!g.mapped) {
+            map(g);
+            stats.misses++;
+        } else if (acquire || g.acquired == 0) {
+            stats.hits++;
+        }
+
+        g.last_access = ++access_count;
+        g.acquired += acquire ? 1 : 0;
+
+        // Callers of touch keep raw pointers to the data of other groups without acquiring
+        // them, so groups are evicted only on acquire, release and park.
+        if (acquire) {
+            evict(group);
+        }
+    }
+
+    /// Unmap least recently used groups, until the resident size is within the budget.
+    void
+    evict(std::size_t except)
+    {
+        while (stats.resident_size > budget) {
+            auto victim = groups.size();
+            auto last_access = std::numeric_limits<std::size_t>::max();
+
+            for (std::size_t i = 0; i < groups.size(); i++) {
+                const auto& g = groups[i];
+                if (i != except && g.mapped && g.acquired == 0 && g.last_access < last_access) {
+                    victim = i;
+                    last_access = g.last_access;
+                }
+            }
+
+            if (victim == groups.size()) {
+                break;
+            }
+
+            unmap(groups[victim]);
+            stats.evictions++;
+        }
+    }
+};
+
+
+residency_manager::residency_manager(std::size_t budget)
+: _M_state(std::make_shared<_State>(budget))
+{}
+
+
+std::size_t
+residency_manager::insert(const std::string& group, const std::shared_ptr<basic_memfile>& file)
+{
+    std::scoped_lock lock(_M_state->mutex);
+
+    auto [it, inserted] = _M_state->names.try_emplace(group, _M_state->groups.size());
+    if (inserted) {
+        _M_state->groups.emplace_back();
+    }
+
+    auto& g = _M_state->groups[it->second];
+    g.files.push_back(file);
+    g.size += file->size();
+
+    // Files inserted into the mapped group are mapped immediately, so that all files
+    // of the group are always either mapped or not.
+    if (g.mapped) {
+        file->declare_mapped();
+        _M_state->stats.resident_size += file->size();
+        _M_state->stats.peak_size =
+            std::max(_M_state->stats.peak_size, _M_state->stats.resident_size);
+    }
+
+    return it->second;
 }
 
 
-basic_memfile::~basic_memfile() { close(); }
+void
+residency_manager::acquire(std::size_t group)
+{
+    std::scoped_lock lock(_M_state->mutex);
+    _M_state->access(group, /*acquire=*/true);
+}
+
+
+void
+residency_manager::release(std::size_t group)
+{
+    std::scoped_lock lock(_M_state->mutex);
+
+    auto& g = _M_state->at(group);
+    if (g.acquired > 0) {
+        g.acquired--;
+    }
+
+    // The budget could be exceeded while all mapped groups were acquired, so evict groups
+    // as soon as they are released.
+    _M_state->evict(_M_state->groups.size());
+}
+
+
+void
+residency_manager::touch(std::size_t group)
+{
+    std::scoped_lock lock(_M_state->mutex);
+    _M_state->access(group, /*acquire=*/false);
+}
+
+
+void
+residency_manager::park()
+{
+    std::scoped_lock lock(_M_state->mutex);
+
+    for (auto& g : _M_state->groups) {
+        if (g.mapped && g.acquired == 0) {
+            _M_state->unmap(g);
+        }
+    }
+}
+
+
+std::size_t
+residency_manager::budget() const
+{
+    return _M_state->budget;
+}
+
+
+residency_stats
+residency_manager::stats() const
+{
+    std::scoped_lock lock(_M_state->mutex);
+    return _M_state->stats;
+}
 
 
 } // namespace metalchat
@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include <metalchat/gguf.h>
+
+
+namespace metalchat {
+
+
+static constexpr auto _Gguf_types = std::to_array<gguf_type>({
+    gguf_type{"F32", 0, 1, 4, "F32"},
+    gguf_type{"F16", 1, 1, 2, "U16"},
+    gguf_type{"Q4_0", 2, 32, 18, "U8"},
+    gguf_type{"Q4_1", 3, 32, 20, "U8"},
+    gguf_type{"Q5_0", 6, 32, 22, "U8"},
+    gguf_type{"Q5_1", 7, 32, 24, "U8"},
+    gguf_type{"Q8_0", 8, 32, 34, "U8"},
+    gguf_type{"Q8_1", 9, 32, 36, "U8"},
+    gguf_type{"Q2_K", 10, 256, 84, "U8"},
+    gguf_type{"Q3_K", 11, 256, 110, "U8"},
+    gguf_type{"Q4_K", 12, 256, 144, "U8"},
+    gguf_type{"Q5_K", 13, 256, 176, "U8"},
+    gguf_type{"Q6_K", 14, 256, 210, "U8"},
+    gguf_type{"Q8_K", 15, 256, 292, "U8"},
+    gguf_type{"IQ2_XXS", 16, 256, 66, "U8"},
+    gguf_type{"IQ2_XS", 17, 256, 74, "U8"},
+    gguf_type{"IQ3_XXS", 18, 256, 98, "U8"},
+    gguf_type{"IQ1_S", 19, 256, 50, "U8"},
+    gguf_type{"IQ4_NL", 20, 32, 18, "U8"},
+    gguf_type{"IQ3_S", 21, 256, 110, "U8"},
+    gguf_type{"IQ2_S", 22, 256, 82, "U8"},
+    gguf_type{"IQ4_XS", 23, 256, 136, "U8"},
+    gguf_type{"I8", 24, 1, 1, "I8"},
+    gguf_type{"I16", 25, 1, 2, "I16"},
+    gguf_type{"I32", 26, 1, 4, "I32"},
+    gguf_type{"I64", 27, 1, 8, "I64"},
+    gguf_type{"F64", 28, 1, 8, "F64"},
+    gguf_type{"IQ1_M", 29, 256, 56, "U8"},
+    gguf_type{"BF16", 30, 1, 2, "BF16"},
+    gguf_type{"TQ1_0", 34, 256, 54, "U8"},
+    gguf_type{"TQ2_0", 35, 256, 66, "U8"},
+});
+
+
+std::span<const gguf_type>
+gguf_header::types()
+{
+    return _Gguf_types;
+}
+
+
+const gguf_type&
+gguf_header::find_type(std::string_view name)
+{
+    auto it = std::ranges::find(_Gguf_types, name, &gguf_type::name);
+    if (it == _Gguf_types.end()) {
+        throw std::invalid_argument(std::format("gguf_header: unsupported data type '{}'", name));
+    }
+    return *it;
+}
+
+
+/// Types of values of the key-value pairs in the GGUF header.
+enum class _Gguf_value : std::uint32_t {
+    uint8 = 0,
+    int8 = 1,
+    uint16 = 2,
+    int16 = 3,
+    uint32 = 4,
+    int32 = 5,
+    float32 = 6,
+    boolean = 7,
+    string = 8,
+    array = 9,
+    uint64 = 10,
+    int64 = 11,
+    float64 = 12,
+};
+
+
+struct gguf_header::_Parser {
+    static constexpr std::size_t max_depth = 64;
+
+    gguf_header& header;
+    const char* data;
+    std::size_t size;
+    std::size_t pos = 0;
+
+    [[noreturn]] void
+    error(std::string_view message) const
+    {
+        throw std::runtime_error(std::format("gguf_header: {} at position {}", message, pos));
+    }
+
+    void
+    require(std::size_t n)
+    {
+        if (n > size - pos) {
+            error("unexpected end of file");
+        }
+    }
+
+    template <typename T>
+    T
+    read()
+    {
+        require(sizeof(T));
+
+        T value;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    std::string_view
+    read_string()
+    {
+        auto length = read<std::uint64_t>();
+        require(length);
+
+        auto value = std::string_view(data + pos, length);
+        pos += length;
+        return value;
+    }
+
+    /// Skip the value, nesting of arrays is limited, so that the parser never exhausts the
+    /// stack on a hostile input.
+    void
+    skip(_Gguf_value type, std::size_t depth = 0)
+    {
+        if (depth > max_depth) {
+            error("maximum nesting depth exceeded");
+        }
+
+        switch (type) {
+        case _Gguf_value::uint8:
+        case _Gguf_value::int8:
+        case _Gguf_value::boolean:
+            require(1);
+            pos += 1;
+            break;
+        case _Gguf_value::uint16:
+        case _Gguf_value::int16:
+            require(2);
+            pos += 2;
+            break;
+        case _Gguf_value::uint32:
+        case _Gguf_value::int32:
+        case _Gguf_value::float32:
+            require(4);
+            pos += 4;
+            break;
+        case _Gguf_value::uint64:
+        case _Gguf_value::int64:
+        case _Gguf_value::float64:
+            require(8);
+            pos += 8;
+            break;
+        case _Gguf_value::string:
+            read_string();
+            break;
+        case _Gguf_value::array: {
+            auto element_type = _Gguf_value(read<std::uint32_t>());
+            auto count = read<std::uint64_t>();
+            for (std::uint64_t i = 0; i < count; i++) {
+                skip(element_type, depth + 1);
+            }
+            break;
+        }
+        default:
+            error(std::format("unsupported value type {}", std::uint32_t(type)));
+        }
+    }
+
+    /// Read a scalar or a string value and convert it to a string. Returns an empty optional,
+    /// when the value is an array.
+    std::optional<std::string>
+    read_value(_Gguf_value type)
+    {
+        switch (type) {
+        case _Gguf_value::uint8:
+            return std::to_string(read<std::uint8_t>());
+        case _Gguf_value::int8:
+            return std::to_string(read<std::int8_t>());
+        case _Gguf_value::uint16:
+            return std::to_string(read<std::uint16_t>());
+        case _Gguf_value::int16:
+            return std::to_string(read<std::int16_t>());
+        case _Gguf_value::uint32:
+            return std::to_string(read<std::uint32_t>());
+        case _Gguf_value::int32:
+            return std::to_string(read<std::int32_t>());
+        case _Gguf_value::uint64:
+            return std::to_string(read<std::uint64_t>());
+        case _Gguf_value::int64:
+            return std::to_string(read<std::int64_t>());
+        case _Gguf_value::float32:
+            return std::format("{}", read<float>());
+        case _Gguf_value::float64:
+            return std::format("{}", read<double>());
+        case _Gguf_value::boolean:
+            return read<std::uint8_t>() != 0 ? "true" : "false";
+        case _Gguf_value::string:
+            return std::string(read_string());
+        default:
+            skip(type);
+            return std::nullopt;
+        }
+    }
+
+    void
+    parse_alignment(_Gguf_value type, const std::string& value)
+    {
+        if (type != _Gguf_value::uint32) {
+            error("alignment must be an unsigned 32-bit integer");
+        }
+
+        auto alignment = std::stoull(value);
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+            error(std::format("alignment {} is not a power of two", alignment));
+        }
+        header._M_alignment = alignment;
+    }
+
+    void
+    parse_tensor(std::unordered_set<std::string_view>& names)
+    {
+        auto name = read_string();
+        if (!names.insert(name).second) {
+            error(std::format("duplicate tensor '{}'", name));
+        }
+
+        auto dimensions = read<std::uint32_t>();
+        if (dimensions == 0 || dimensions > max_dimensions) {
+            error(std::format("tensor '{}' has {} dimensions", name, dimensions));
+        }
+
+        // GGUF stores dimensions starting from the innermost one.
+        std::vector<std::size_t> shape(dimensions);
+        std::size_t numel = 1;
+        for (std::uint32_t i = 0; i < dimensions; i++) {
+            auto dim = read<std::uint64_t>();
+            if (dim != 0 && numel > std::numeric_limits<std::uint64_t>::max() / dim) {
+                error(std::format("tensor '{}' has too many elements", name));
+            }
+            numel *= dim;
+            shape[dimensions - i - 1] = dim;
+        }
+
+        auto type_id = read<std::uint32_t>();
+        auto type_it = std::ranges::find(_Gguf_types, type_id, &gguf_type::id);
+        if (type_it == _Gguf_types.end()) {
+            error(std::format("tensor '{}' has unsupported type {}", name, type_id));
+        }
+
+        const gguf_type& type = *type_it;
+        if (shape.back() % type.block_size != 0) {
+            error(std::format(
+                "tensor '{}' row size {} is not a multiple of the block size {}", name,
+                shape.back(), type.block_size
+            ));
+        }
+
+        if (type.quantized()) {
+            shape.back() /= type.block_size;
+            shape.push_back(type.type_size);
+        }
+
+        // The size in bytes must be representable, otherwise it wraps around and passes
+        // the bounds checks of the data section with a shape larger than the container.
+        auto blocks = numel / type.block_size;
+        if (blocks > std::numeric_limits<std::size_t>::max() / type.type_size) {
+            error(std::format("tensor '{}' size in bytes overflows", name));
+        }
+
+        auto offset = read<std::uint64_t>();
+        auto size = blocks * type.type_size;
+
+        header._M_tensors.push_back(gguf_descriptor{
+            .name = std::string(name),
+            .type = &type,
+            .shape = std::move(shape),
+            .offset = offset,
+            .size = size
+        });
+    }
+
+    void
+    parse()
+    {
+        require(magic.size());
+        if (std::string_view(data, magic.size()) != magic) {
+            error("invalid magic number");
+        }
+        pos += magic.size();
+
+        header._M_version = read<std::uint32_t>();
+        if (header._M_version != 2 && header._M_version != 3) {
+            error(std::format("unsupported version {}", header._M_version));
+        }
+
+        auto tensor_count = read<std::uint64_t>();
+        auto metadata_count = read<std::uint64_t>();
+
+        for (std::uint64_t i = 0; i < metadata_count; i++) {
+            auto key = read_string();
+            auto type = _Gguf_value(read<std::uint32_t>());
+            auto value = read_value(type);
+
+            if (value.has_value()) {
+                if (key == "general.alignment") {
+                    parse_alignment(type, value.value());
+                }
+                header._M_metadata.emplace_back(std::string(key), std::move(value.value()));
+            }
+        }
+
+        // Every tensor descriptor takes at least a few bytes, so the count is validated
+        // against the size of the file before reserving memory.
+        if (tensor_count > size - pos) {
+            error(std::format("tensor count {} exceeds the size of the file", tensor_count));
+        }
+
+        std::unordered_set<std::string_view> names;
+        header._M_tensors.reserve(tensor_count);
+
+        for (std::uint64_t i = 0; i < tensor_count; i++) {
+            parse_tensor(names);
+        }
+
+        auto alignment = header._M_alignment;
+        auto data_offset = (pos + alignment - 1) / alignment * alignment;
+        if (data_offset > size) {
+            error("data section is beyond the end of the file");
+        }
+
+        header._M_data_offset = data_offset;
+        header._M_data_size = size - data_offset;
+    }
+};
+
+
+gguf_header::gguf_header(const char* data, std::size_t size)
+: _M_tensors(),
+  _M_metadata(),
+  _M_version(0),
+  _M_alignment(default_alignment),
+  _M_data_offset(0),
+  _M_data_size(0)
+{
+    _Parser parser{.header = *this, .data = data, .size = size};
+    parser.parse();
+
+    auto comparator = [](const gguf_descriptor& a, const gguf_descriptor& b) {
+        return a.offset < b.offset;
+    };
+    std::sort(_M_tensors.begin(), _M_tensors.end(), comparator);
+
+    // Tensors are allocated from the contiguous pages of the data section, so they must be
+    // aligned, must not overlap, and must be within the data section.
+    std::size_t data_end = 0;
+    for (const auto& tensor : _M_tensors) {
+        if (tensor.offset % _M_alignment != 0) {
+            throw std::runtime_error(std::format(
+                "gguf_header: tensor '{}' offset {} is not aligned to {}", tensor.name,
+                tensor.offset, _M_alignment
+            ));
+        }
+        if (tensor.offset < data_end) {
+            throw std::runtime_error(
+                std::format("gguf_header: tensor '{}' overlaps the previous tensor", tensor.name)
+            );
+        }
+        if (tensor.offset > _M_data_size || tensor.size > _M_data_size - tensor.offset) {
+            throw std::runtime_error(std::format(
+                "gguf_header: tensor '{}' is beyond the end of the data section", tensor.name
+            ));
+        }
+        data_end = tensor.offset + tensor.size;
+    }
+}
+
+
+safetensor_document
+gguf_document::open(const std::filesystem::path& p)
+{
+    auto alloc = random_memory_allocator<void>();
+    auto nocopy_alloc = nocopy_allocator(alloc);
+    return open(p, nocopy_alloc);
+}
+
+
+safetensor_document
+gguf_document::open(const std::filesystem::path& p, hardware_accelerator& accelerator)
+{
+    auto alloc = accelerator.get_allocator();
+    auto nocopy_alloc = nocopy_allocator(alloc, accelerator.get_metal_device());
+    auto resident_alloc = hardware_resident_allocator(nocopy_alloc, accelerator.get_metal_device());
+
+    return open(p, resident_alloc, accelerator.max_buffer_size());
+}
+
+
+} // namespace metalchat
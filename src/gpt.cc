@@ -3,11 +3,17 @@
 // SPDX-FileType: SOURCE
 
 #include <algorithm>
-#include <codecvt>
-#include <iostream>
-#include <locale>
-#include <queue>
-#include <sstream>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <metalchat/text/gpt.h>
 
@@ -16,89 +22,226 @@ namespace metalchat {
 namespace text {
 
 
-gpt2_codec::gpt2_codec()
-: _M_encoding(),
-  _M_decoding()
-{
-    using range_type = std::pair<std::size_t, std::size_t>;
+/// A code point of the byte-level character, which represents a byte in the GPT-2 encoding.
+static constexpr std::array<uint16_t, 256> _GPT2_encoding_table = [] {
+    std::array<uint16_t, 256> table = {};
+    uint16_t offset = 0;
 
-    std::queue<range_type> ranges({{0x21, 0x7e}, {0xa1, 0xac}, {0xae, 0xff}});
-    std::size_t offset = 0;
+    for (unsigned i = 0; i < 256; i++) {
+        // Printable characters are mapped to themselves, all other bytes are shifted
+        // to the code points starting from U+0100 in the order of their values.
+        bool printable = (i >= 0x21 && i <= 0x7e) || (i >= 0xa1 && i <= 0xac) || (i >= 0xae);
+        table[i] = printable ? uint16_t(i) : uint16_t(0x100 + offset++);
+    }
+    return table;
+}();
 
-    constexpr std::size_t cardinality = 1 << std::numeric_limits<char8_t>::digits;
 
-    for (std::size_t i = 0; i < cardinality; i++) {
-        auto& range = ranges.front();
+/// The largest code point of the byte-level characters.
+static constexpr std::size_t _GPT2_max_code_point = 0x143;
 
-        if (i >= range.first && i <= range.second) {
-            _M_encoding.insert_or_assign(char8_t(i), char16_t(i));
-            _M_decoding.insert_or_assign(char16_t(i), char8_t(i));
-        } else {
-            auto encoding = offset + cardinality;
-            offset++;
 
-            _M_encoding.insert_or_assign(char8_t(i), char16_t(encoding));
-            _M_decoding.insert_or_assign(char16_t(encoding), char8_t(i));
+/// A byte represented by the code point. Code points that are not used by the encoding are
+/// decoded into the lower byte of the code point, therefore all code points below U+0100
+/// are decoded into themselves.
+static constexpr std::array<uint8_t, _GPT2_max_code_point + 1> _GPT2_decoding_table = [] {
+    std::array<uint8_t, _GPT2_max_code_point + 1> table = {};
+    for (unsigned i = 0; i < table.size(); i++) {
+        table[i] = uint8_t(i);
+    }
+    for (unsigned i = 0; i < 256; i++) {
+        table[_GPT2_encoding_table[i]] = uint8_t(i);
+    }
+    return table;
+}();
+
+
+/// UTF-8 representation of the byte-level characters: the size of the sequence in the lower
+/// byte followed by up to two bytes of the sequence.
+static constexpr std::array<uint32_t, 256> _GPT2_utf8_table = [] {
+    std::array<uint32_t, 256> table = {};
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t code = _GPT2_encoding_table[i];
+        if (code < 0x80) {
+            table[i] = 1 | (code << 8);
+        } else {
+            uint32_t b0 = 0xc0 | (code >> 6);
+            uint32_t b1 = 0x80 | (code & 0x3f);
+            table[i] = 2 | (b0 << 8) | (b1 << 16);
         }
+    }
+    return table;
+}();
+
 
-        if (i == range.second) {
-            ranges.pop();
+/// Returns the number of leading bytes that are mapped to themselves by the encoding
+/// (printable ASCII characters), processed in blocks of 16 bytes.
+static inline std::size_t
+_GPT2_printable_prefix(const unsigned char* data, std::size_t size)
+{
+    std::size_t i = 0;
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t first = vdupq_n_u8(0x21);
+    const uint8x16_t count = vdupq_n_u8(0x7e - 0x21 + 1);
+
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t offset = vsubq_u8(vld1q_u8(data + i), first);
+        if (vminvq_u8(vcltq_u8(offset, count)) != 0xff) {
+            break;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i upper = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= size; i += 16) {
+        // Bytes above 0x7f are negative in the signed comparison, so they fail the first one.
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, lower), _mm_cmplt_epi8(v, upper));
+        if (_mm_movemask_epi8(printable) != 0xffff) {
+            break;
         }
     }
+#endif
+
+    return i;
 }
 
 
-std::string
-gpt2_codec::encode(const std::string& input) const
+/// Returns the number of leading ASCII bytes processed in blocks of 16 bytes.
+static inline std::size_t
+_GPT2_ascii_prefix(const unsigned char* data, std::size_t size)
 {
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-    std::wstring_convert<std::codecvt_utf8<char16_t>, char16_t> converter;
-#pragma clang diagnostic pop
-
-    std::basic_stringstream<char16_t> output;
+    std::size_t i = 0;
 
-    const auto bytes = reinterpret_cast<const char8_t*>(input.data());
-    const auto bytes_size = input.size() * sizeof(char);
-
-    for (std::size_t i = 0; i < bytes_size; i++) {
-        auto byte = bytes[i];
-        if (auto it = _M_encoding.find(byte); it != _M_encoding.end()) {
-            output.put(it->second);
-        } else {
-            output.put(char16_t(byte));
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 16 <= size; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(data + i)) >= 0x80) {
+            break;
+        }
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
         }
     }
+#endif
 
-    return converter.to_bytes(output.str());
+    return i;
 }
 
 
+gpt2_codec::gpt2_codec() {}
+
+
 std::string
-gpt2_codec::decode(const std::string& input) const
+gpt2_codec::encode(std::string_view input) const
 {
-    std::basic_stringstream<char> output;
+    const auto data = reinterpret_cast<const unsigned char*>(input.data());
+    const auto size = input.size();
+
+    // Every byte is encoded into at most two bytes, so the output is allocated only once.
+    std::string output(size * 2, '\0');
+    auto out = reinterpret_cast<unsigned char*>(output.data());
+    std::size_t pos = 0;
+
+    for (std::size_t i = 0; i < size;) {
+        auto prefix = _GPT2_printable_prefix(data + i, size - i);
+        if (prefix > 0) {
+            std::memcpy(out + pos, data + i, prefix);
+            pos += prefix;
+            i += prefix;
+        }
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-    std::wstring_convert<std::codecvt_utf8<char16_t>, char16_t> converter;
-#pragma clang diagnostic pop
+        // Encode bytes one by one until the next block of printable characters.
+        for (auto end = std::min(size, i + 16); i < end; i++) {
+            auto utf8 = _GPT2_utf8_table[data[i]];
+            out[pos] = uint8_t(utf8 >> 8);
+            out[pos + 1] = uint8_t(utf8 >> 16);
+            pos += utf8 & 0xff;
+        }
+    }
 
-    auto winput = converter.from_bytes(input);
+    output.resize(pos);
+    return output;
+}
 
-    const auto runes = winput.data();
-    const auto runes_size = winput.size();
 
-    for (std::size_t i = 0; i < runes_size; i++) {
-        auto rune = runes[i];
-        if (auto it = _M_decoding.find(rune); it != _M_decoding.end()) {
-            output.put(char(it->second));
-        } else {
-            output.put(char(rune));
+std::string
+gpt2_codec::decode(std::string_view input) const
+{
+    const auto data = reinterpret_cast<const unsigned char*>(input.data());
+    const auto size = input.size();
+
+    // Every character is decoded into a single byte, so the output is never larger than
+    // the input.
+    std::string output(size, '\0');
+    auto out = reinterpret_cast<unsigned char*>(output.data());
+    std::size_t pos = 0;
+
+    auto invalid_sequence = [&](std::size_t offset) {
+        return std::range_error(
+            std::format("gpt2_codec: invalid UTF-8 sequence at position {}", offset)
+        );
+    };
+
+    for (std::size_t i = 0; i < size;) {
+        auto prefix = _GPT2_ascii_prefix(data + i, size - i);
+        if (prefix > 0) {
+            std::memcpy(out + pos, data + i, prefix);
+            pos += prefix;
+            i += prefix;
+        }
+
+        for (auto end = std::min(size, i + 16); i < end;) {
+            const auto b0 = data[i];
+            if (b0 < 0x80) {
+                out[pos++] = b0;
+                i++;
+                continue;
+            }
+
+            // Byte-level characters are encoded with at most two bytes, longer sequences
+            // are decoded into the lower byte of the code point, as long as the code point
+            // fits into 16 bits.
+            uint32_t code = 0;
+            std::size_t length = 0;
+            if ((b0 & 0xe0) == 0xc0) {
+                code = b0 & 0x1f;
+                length = 2;
+            } else if ((b0 & 0xf0) == 0xe0) {
+                code = b0 & 0x0f;
+                length = 3;
+            } else {
+                throw invalid_sequence(i);
+            }
+
+            if (i + length > size) {
+                throw invalid_sequence(i);
+            }
+            for (std::size_t j = 1; j < length; j++) {
+                if ((data[i + j] & 0xc0) != 0x80) {
+                    throw invalid_sequence(i);
+                }
+                code = (code << 6) | (data[i + j] & 0x3f);
+            }
+
+            // Reject overlong encodings and surrogates.
+            if ((length == 2 && code < 0x80) || (length == 3 && code < 0x800) ||
+                (code >= 0xd800 && code <= 0xdfff)) {
+                throw invalid_sequence(i);
+            }
+
+            out[pos++] = code <= _GPT2_max_code_point ? _GPT2_decoding_table[code] : uint8_t(code);
+            i += length;
         }
     }
 
-    return output.str();
+    output.resize(pos);
+    return output;
 }
 
 
@@ -2,6 +2,9 @@
 // SPDX-FileCopyrightText: 2025 Yakau Bubnou
 // SPDX-FileType: SOURCE
 
+#include <format>
+#include <limits>
+
 #include <mstch/mstch.hpp>
 
 #include <metalchat/interpreter.h>
@@ -78,7 +81,11 @@ interpreter::interpreter(
   _M_command_scanner(std::make_shared<json_command_scanner>()),
   _M_commands(),
   _M_start_pos(0),
-  _M_buf()
+  _M_buf(),
+  _M_max_tokens(std::numeric_limits<std::size_t>::max()),
+  _M_overflow(context_overflow::reject),
+  _M_decoder(),
+  _M_chunk()
 {
     auto output = std::back_inserter(_M_buf);
     tokenizer_traits::encode(*_M_tokenizer, text::token::begin_text, output);
@@ -96,6 +103,14 @@ interpreter::set_token_scanner(std::shared_ptr<basic_token_scanner> scanner)
 }
 
 
+void
+interpreter::set_context_limit(std::size_t max_tokens, context_overflow overflow)
+{
+    _M_max_tokens = max_tokens;
+    _M_overflow = overflow;
+}
+
+
 void
 interpreter::declare_command(const std::string& declaration, command_type command)
 {
@@ -116,22 +131,45 @@ void
 interpreter::write_header(const std::string& role)
 {
     auto output = std::back_inserter(_M_buf);
-
-    tokenizer_traits::encode(*_M_tokenizer, text::token::begin_header, output);
-    tokenizer_traits::encode(*_M_tokenizer, role, output);
-    tokenizer_traits::encode(*_M_tokenizer, text::token::end_header, output);
-    tokenizer_traits::encode(*_M_tokenizer, "\n\n", output);
+    encode_header(role, output);
 }
 
 
 void
 interpreter::write(const basic_message& message)
 {
+    const auto buf_size = _M_buf.size();
     write_header(message.role());
 
     auto output = std::back_inserter(_M_buf);
     auto content = mustache::render(message.content(), _M_members->context());
-    tokenizer_traits::encode(*_M_tokenizer, content, output);
+
+    // Encode only the part of the content that fits into the context. Tokens of the message
+    // header are already in the context, the end of the turn and the header of the response
+    // (see read) are reserved, so that the context never exceeds the limit on flush.
+    std::size_t reserved_size = 1;
+    text::counting_output_iterator<index_type> reserved_output(reserved_size);
+    encode_header("assistant", reserved_output);
+
+    auto context_size = this->context_size() + reserved_size;
+    if (context_size > _M_max_tokens) {
+        _M_buf.resize(buf_size);
+        throw std::invalid_argument(std::format(
+            "interpreter: message header exceeds the context limit of {} tokens", _M_max_tokens
+        ));
+    }
+
+    auto max_tokens = _M_max_tokens - context_size;
+    auto prefix = tokenizer_traits::encode_prefix(*_M_tokenizer, content, max_tokens, output);
+
+    if (!prefix.complete && _M_overflow == context_overflow::reject) {
+        _M_buf.resize(buf_size);
+        throw std::invalid_argument(std::format(
+            "interpreter: message exceeds the context limit of {} tokens, only {} of {} bytes fit",
+            _M_max_tokens, prefix.size, content.size()
+        ));
+    }
+
     tokenizer_traits::encode(*_M_tokenizer, text::token::end_turn, output);
 }
 
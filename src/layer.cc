@@ -16,7 +16,8 @@ basic_layer::basic_layer(const hardware_accelerator& accelerator, char delimiter
   _M_params(),
   _M_polymorphic_pointers(),
   _M_accelerator(accelerator),
-  _M_delimiter(delimiter)
+  _M_delimiter(delimiter),
+  _M_name()
 {}
 
 
@@ -32,6 +33,13 @@ basic_layer::delimiter() const
 }
 
 
+const std::string&
+basic_layer::name() const
+{
+    return _M_name;
+}
+
+
 const hardware_accelerator&
 basic_layer::accelerator() const
 {
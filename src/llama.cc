@@ -111,6 +111,10 @@ llama3_tokenizer_loader::load(std::istream& is) const
 
     using loader_type = metalchat::reference::llama3_tokenizer_loader;
     loader_type::insert_control_tokens(tokenizer);
+
+    if (cache_size > 0) {
+        tokenizer.set_cache(std::make_shared<type::cache_type>(cache_size));
+    }
     return tokenizer;
 }
 
@@ -118,6 +122,20 @@ llama3_tokenizer_loader::load(std::istream& is) const
 llama3_tokenizer_loader::type
 llama3_tokenizer_loader::load(const std::filesystem::path& p) const
 {
+    auto compiled_path = text::mapped_vocabulary::compiled_path(p);
+    if (text::mapped_vocabulary::is_current(compiled_path, p)) {
+        // The corrupted vocabulary is not fatal, since the tokenizer could be still
+        // loaded from the original tokenizer model.
+        try {
+            type tokenizer(std::make_shared<text::mapped_vocabulary>(compiled_path));
+            if (cache_size > 0) {
+                tokenizer.set_cache(std::make_shared<type::cache_type>(cache_size));
+            }
+            return tokenizer;
+        } catch (const std::runtime_error&) {
+        }
+    }
+
     std::ifstream file(p, std::ios::binary | std::ios::in);
     if (!file.is_open()) {
         throw std::invalid_argument(
@@ -129,5 +147,21 @@ llama3_tokenizer_loader::load(const std::filesystem::path& p) const
 }
 
 
+void
+llama3_tokenizer_loader::compile(const std::filesystem::path& p) const
+{
+    std::ifstream file(p, std::ios::binary | std::ios::in);
+    if (!file.is_open()) {
+        throw std::invalid_argument(
+            std::format("llama3_tokenizer_loader: failed opening file '{}'", p.string())
+        );
+    }
+
+    auto stamp = text::mapped_vocabulary::source_stamp::from_file(p);
+    auto tokenizer = load(file);
+    tokenizer.compile(text::mapped_vocabulary::compiled_path(p), stamp);
+}
+
+
 } // namespace huggingface
 } // namespace metalchat
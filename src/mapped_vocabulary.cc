@@ -0,0 +1,496 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <rapidhash.h>
+
+#include <metalchat/text/mapped_vocabulary.h>
+
+
+namespace metalchat {
+namespace text {
+
+
+static constexpr char _MappedVocabulary_magic[8] = {'M', 'T', 'O', 'K', 'V', 'O', 'C', '\0'};
+static constexpr uint32_t _MappedVocabulary_version = 1;
+static constexpr uint32_t _MappedVocabulary_byte_order = 0x01020304;
+
+/// The number of seeds tried by the writer before giving up on building the perfect hash.
+static constexpr uint64_t _MappedVocabulary_max_seeds = 64;
+
+
+/// The header of the compiled vocabulary. All sections are referenced by the offset from the
+/// beginning of the file, and aligned to 8 bytes. Integers are stored in the native byte order,
+/// the byte order mark is used to reject vocabularies compiled on a different platform.
+struct mapped_vocabulary::_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t seed;
+    uint64_t source_size;
+    int64_t source_mtime;
+
+    uint64_t forward_count;
+    uint64_t bucket_count;
+    uint64_t slot_count;
+    uint64_t inverse_count;
+    uint64_t control_count;
+
+    uint64_t displacements_offset;
+    uint64_t forward_offset;
+    uint64_t inverse_offset;
+    uint64_t controls_offset;
+    uint64_t regex_offset;
+    uint64_t regex_size;
+    uint64_t arena_offset;
+    uint64_t arena_size;
+};
+
+
+static uint64_t
+_MappedVocabulary_align(uint64_t offset)
+{
+    return (offset + 7) & ~uint64_t(7);
+}
+
+
+static bool
+_MappedVocabulary_is_prime(uint64_t n)
+{
+    if (n < 2) {
+        return false;
+    }
+    for (uint64_t i = 2; i * i <= n; i++) {
+        if (n % i == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+mapped_vocabulary::source_stamp
+mapped_vocabulary::source_stamp::from_file(const std::filesystem::path& p)
+{
+    auto mtime = std::filesystem::last_write_time(p).time_since_epoch();
+    return source_stamp{
+        .size = static_cast<uint64_t>(std::filesystem::file_size(p)),
+        .mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime).count(),
+    };
+}
+
+
+mapped_vocabulary::hash_value
+mapped_vocabulary::_M_hash(std::string_view token, uint64_t seed)
+{
+    uint64_t h = rapidhash_withSeed(token.data(), token.size(), seed);
+
+    // Derive the second hash by mixing the first one, since the step of the probe sequence
+    // must be independent of the first probe position.
+    uint64_t g = (h ^ (h >> 31)) * 0x9e3779b97f4a7c15ULL;
+    return hash_value{.bucket = h >> 32, .position = h, .step = g ^ (g >> 29)};
+}
+
+
+mapped_vocabulary::mapped_vocabulary(const std::filesystem::path& p)
+: _M_file(std::make_shared<basic_memfile>(p))
+{
+    const auto file_size = _M_file->size();
+    if (file_size < sizeof(_Header)) {
+        throw std::runtime_error(
+            std::format("mapped_vocabulary: file '{}' is not a compiled vocabulary", p.string())
+        );
+    }
+
+    _M_file->declare_mapped();
+    const char* data = _M_file->data();
+    _M_header = reinterpret_cast<const _Header*>(data);
+
+    if (std::memcmp(_M_header->magic, _MappedVocabulary_magic, sizeof(_M_header->magic)) != 0 ||
+        _M_header->byte_order != _MappedVocabulary_byte_order) {
+        throw std::runtime_error(
+            std::format("mapped_vocabulary: file '{}' is not a compiled vocabulary", p.string())
+        );
+    }
+    if (_M_header->version != _MappedVocabulary_version) {
+        throw std::runtime_error(std::format(
+            "mapped_vocabulary: unsupported version {} of the file '{}'", _M_header->version,
+            p.string()
+        ));
+    }
+
+    auto corrupted = [&](std::string_view section) {
+        return std::runtime_error(
+            std::format("mapped_vocabulary: section '{}' of '{}' is corrupted", section, p.string())
+        );
+    };
+
+    // Ensure that the section resides within the file, the section counts are verified
+    // before multiplication, so that the size of a section does not overflow.
+    auto ensure_section = [&](std::string_view section, uint64_t offset, uint64_t count,
+                              std::size_t element_size) {
+        if (offset % 8 != 0 || offset > file_size || count > file_size / element_size ||
+            count * element_size > file_size - offset) {
+            throw corrupted(section);
+        }
+    };
+
+    const auto& h = *_M_header;
+    ensure_section("displacements", h.displacements_offset, h.bucket_count, sizeof(uint32_t));
+    ensure_section("forward", h.forward_offset, h.slot_count, sizeof(forward_slot));
+    ensure_section("inverse", h.inverse_offset, h.inverse_count, sizeof(inverse_slot));
+    ensure_section("controls", h.controls_offset, h.control_count, sizeof(control_slot));
+    ensure_section("arena", h.arena_offset, h.arena_size, sizeof(char));
+
+    if (h.bucket_count == 0 || h.slot_count < 2 || h.forward_count > h.slot_count) {
+        throw corrupted("forward");
+    }
+    if (h.regex_offset > h.arena_size || h.regex_size > h.arena_size - h.regex_offset) {
+        throw corrupted("regex");
+    }
+
+    _M_seed = h.seed;
+    _M_bucket_count = h.bucket_count;
+    _M_slot_count = h.slot_count;
+    _M_inverse_count = h.inverse_count;
+
+    _M_displacements = reinterpret_cast<const uint32_t*>(data + h.displacements_offset);
+    _M_forward = reinterpret_cast<const forward_slot*>(data + h.forward_offset);
+    _M_inverse = reinterpret_cast<const inverse_slot*>(data + h.inverse_offset);
+    _M_controls = reinterpret_cast<const control_slot*>(data + h.controls_offset);
+    _M_arena = data + h.arena_offset;
+
+    // Lookups do not check bounds of the arena, therefore all slots are verified once.
+    for (uint64_t i = 0; i < _M_slot_count; i++) {
+        const auto& slot = _M_forward[i];
+        if (slot.id >= 0 && uint64_t(slot.offset) + slot.size > h.arena_size) {
+            throw corrupted("forward");
+        }
+    }
+    for (uint64_t i = 0; i < _M_inverse_count; i++) {
+        const auto& slot = _M_inverse[i];
+        if (slot.size != missing_size && uint64_t(slot.offset) + slot.size > h.arena_size) {
+            throw corrupted("inverse");
+        }
+    }
+}
+
+
+std::optional<mapped_vocabulary::index_type>
+mapped_vocabulary::find_control(tokenkind kind) const
+{
+    for (uint64_t i = 0; i < _M_header->control_count; i++) {
+        if (_M_controls[i].kind == kind) {
+            return _M_controls[i].id;
+        }
+    }
+    return std::nullopt;
+}
+
+
+std::string_view
+mapped_vocabulary::regex() const
+{
+    return std::string_view(_M_arena + _M_header->regex_offset, _M_header->regex_size);
+}
+
+
+std::size_t
+mapped_vocabulary::size() const
+{
+    return _M_header->forward_count;
+}
+
+
+mapped_vocabulary::source_stamp
+mapped_vocabulary::stamp() const
+{
+    return source_stamp{.size = _M_header->source_size, .mtime = _M_header->source_mtime};
+}
+
+
+std::vector<std::pair<tokenkind, mapped_vocabulary::index_type>>
+mapped_vocabulary::controls() const
+{
+    std::vector<std::pair<tokenkind, index_type>> result;
+    for (uint64_t i = 0; i < _M_header->control_count; i++) {
+        result.emplace_back(_M_controls[i].kind, _M_controls[i].id);
+    }
+    return result;
+}
+
+
+std::filesystem::path
+mapped_vocabulary::compiled_path(const std::filesystem::path& p)
+{
+    auto compiled = p;
+    compiled.replace_extension(default_extension);
+    return compiled;
+}
+
+
+bool
+mapped_vocabulary::is_current(
+    const std::filesystem::path& compiled, const std::filesystem::path& source
+)
+{
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(compiled, error) ||
+        !std::filesystem::is_regular_file(source, error)) {
+        return false;
+    }
+
+    // Read only the header, there is no need to map the whole file.
+    _Header header;
+    std::ifstream file(compiled, std::ios::binary | std::ios::in);
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+
+    if (std::memcmp(header.magic, _MappedVocabulary_magic, sizeof(header.magic)) != 0 ||
+        header.byte_order != _MappedVocabulary_byte_order ||
+        header.version != _MappedVocabulary_version) {
+        return false;
+    }
+
+    auto stamp = source_stamp::from_file(source);
+    return stamp.size == header.source_size && stamp.mtime == header.source_mtime;
+}
+
+
+void
+mapped_vocabulary::write(
+    const std::filesystem::path& p,
+    std::span<const std::pair<std::string_view, index_type>> forward,
+    std::span<const std::pair<index_type, std::string_view>> inverse,
+    std::span<const std::pair<tokenkind, index_type>> controls,
+    std::string_view regex,
+    const source_stamp& stamp
+)
+{
+    // Every string is stored in the arena only once, even when it is referenced from both
+    // the forward and the inverse tables.
+    std::string arena(regex);
+    std::unordered_map<std::string_view, uint32_t> arena_offsets;
+
+    auto arena_insert = [&](std::string_view token) -> uint32_t {
+        if (auto it = arena_offsets.find(token); it != arena_offsets.end()) {
+            return it->second;
+        }
+        if (arena.size() + token.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::invalid_argument("mapped_vocabulary: token strings exceed 4GiB");
+        }
+        auto offset = static_cast<uint32_t>(arena.size());
+        arena.append(token);
+        arena_offsets.emplace(token, offset);
+        return offset;
+    };
+
+    std::vector<forward_slot> forward_entries;
+    for (const auto& [token, id] : forward) {
+        if (id < 0) {
+            throw std::invalid_argument(
+                std::format("mapped_vocabulary: invalid token identifier '{}'", id)
+            );
+        }
+        auto offset = arena_insert(token);
+        forward_entries.push_back(
+            forward_slot{.offset = offset, .size = uint32_t(token.size()), .id = id}
+        );
+    }
+
+    index_type max_id = -1;
+    for (const auto& [id, token] : inverse) {
+        if (id < 0) {
+            throw std::invalid_argument(
+                std::format("mapped_vocabulary: invalid token identifier '{}'", id)
+            );
+        }
+        max_id = std::max(max_id, id);
+    }
+
+    std::vector<inverse_slot> inverse_entries(
+        max_id + 1, inverse_slot{.offset = 0, .size = missing_size}
+    );
+    for (const auto& [id, token] : inverse) {
+        auto offset = arena_insert(token);
+        inverse_entries[id] = inverse_slot{.offset = offset, .size = uint32_t(token.size())};
+    }
+
+    auto key = [&](const forward_slot& slot) {
+        return std::string_view(arena.data() + slot.offset, slot.size);
+    };
+
+    // The perfect hash table is built using the "hash and displace" approach: tokens are
+    // split into buckets, then for every bucket (starting from the largest) the writer finds
+    // a displacement that places all tokens of the bucket into empty slots.
+    const uint64_t forward_count = forward_entries.size();
+    const uint64_t bucket_count = std::max<uint64_t>(forward_count / 4, 1);
+
+    uint64_t slot_count = std::max<uint64_t>(forward_count + forward_count / 8, 2);
+    while (!_MappedVocabulary_is_prime(slot_count)) {
+        slot_count++;
+    }
+
+    std::vector<uint32_t> displacements;
+    std::vector<forward_slot> slots;
+    uint64_t seed = 0;
+
+    for (; seed < _MappedVocabulary_max_seeds; seed++) {
+        std::vector<hash_value> hashes(forward_count);
+        std::vector<std::vector<uint64_t>> buckets(bucket_count);
+        for (uint64_t i = 0; i < forward_count; i++) {
+            hashes[i] = _M_hash(key(forward_entries[i]), seed);
+            buckets[hashes[i].bucket % bucket_count].push_back(i);
+        }
+
+        std::vector<uint64_t> bucket_order(bucket_count);
+        std::iota(bucket_order.begin(), bucket_order.end(), 0);
+        std::stable_sort(bucket_order.begin(), bucket_order.end(), [&](auto a, auto b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        displacements.assign(bucket_count, 0);
+        slots.assign(slot_count, forward_slot{.offset = 0, .size = 0, .id = -1});
+
+        std::vector<uint64_t> positions;
+        bool success = true;
+
+        for (auto b : bucket_order) {
+            const auto& bucket = buckets[b];
+            if (bucket.empty()) {
+                break;
+            }
+
+            bool placed = false;
+            for (uint64_t d = 0; d < slot_count && !placed; d++) {
+                positions.clear();
+                placed = true;
+
+                for (auto i : bucket) {
+                    auto pos = _M_position(hashes[i], uint32_t(d), slot_count);
+                    auto collision = std::ranges::find(positions, pos) != positions.end();
+
+                    if (slots[pos].id >= 0 || collision) {
+                        placed = false;
+                        break;
+                    }
+                    positions.push_back(pos);
+                }
+
+                if (placed) {
+                    displacements[b] = uint32_t(d);
+                    for (std::size_t j = 0; j < bucket.size(); j++) {
+                        slots[positions[j]] = forward_entries[bucket[j]];
+                    }
+                }
+            }
+
+            // Identical tokens could not be placed into distinct slots with any seed.
+            if (!placed) {
+                success = false;
+                break;
+            }
+        }
+
+        if (success) {
+            break;
+        }
+    }
+
+    if (seed == _MappedVocabulary_max_seeds) {
+        throw std::invalid_argument(
+            "mapped_vocabulary: unable to build a perfect hash table, tokens are not unique"
+        );
+    }
+
+    std::vector<control_slot> control_entries;
+    for (const auto& [kind, id] : controls) {
+        control_entries.push_back(control_slot{.kind = kind, .id = id});
+    }
+
+    _Header header = {};
+    std::memcpy(header.magic, _MappedVocabulary_magic, sizeof(header.magic));
+    header.version = _MappedVocabulary_version;
+    header.byte_order = _MappedVocabulary_byte_order;
+    header.seed = seed;
+    header.source_size = stamp.size;
+    header.source_mtime = stamp.mtime;
+    header.forward_count = forward_count;
+    header.bucket_count = bucket_count;
+    header.slot_count = slot_count;
+    header.inverse_count = inverse_entries.size();
+    header.control_count = control_entries.size();
+    header.regex_offset = 0;
+    header.regex_size = regex.size();
+    header.arena_size = arena.size();
+
+    uint64_t offset = _MappedVocabulary_align(sizeof(_Header));
+    auto allocate = [&](uint64_t size) {
+        auto section_offset = offset;
+        offset = _MappedVocabulary_align(offset + size);
+        return section_offset;
+    };
+
+    header.displacements_offset = allocate(displacements.size() * sizeof(uint32_t));
+    header.forward_offset = allocate(slots.size() * sizeof(forward_slot));
+    header.inverse_offset = allocate(inverse_entries.size() * sizeof(inverse_slot));
+    header.controls_offset = allocate(control_entries.size() * sizeof(control_slot));
+    header.arena_offset = allocate(arena.size());
+
+    auto temp_path = p;
+    temp_path += ".tmp";
+
+    std::ofstream file(temp_path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::invalid_argument(
+            std::format("mapped_vocabulary: failed opening file '{}'", temp_path.string())
+        );
+    }
+
+    auto write_section = [&](uint64_t section_offset, const void* data, std::size_t size) {
+        static constexpr char padding[8] = {};
+        auto position = static_cast<uint64_t>(file.tellp());
+        file.write(padding, section_offset - position);
+        file.write(static_cast<const char*>(data), size);
+    };
+
+    write_section(0, &header, sizeof(header));
+    write_section(
+        header.displacements_offset, displacements.data(), displacements.size() * sizeof(uint32_t)
+    );
+    write_section(header.forward_offset, slots.data(), slots.size() * sizeof(forward_slot));
+    write_section(
+        header.inverse_offset, inverse_entries.data(),
+        inverse_entries.size() * sizeof(inverse_slot)
+    );
+    write_section(
+        header.controls_offset, control_entries.data(),
+        control_entries.size() * sizeof(control_slot)
+    );
+    write_section(header.arena_offset, arena.data(), arena.size());
+    file.close();
+
+    if (!file) {
+        std::filesystem::remove(temp_path);
+        throw std::runtime_error(
+            std::format("mapped_vocabulary: failed writing file '{}'", temp_path.string())
+        );
+    }
+
+    std::filesystem::rename(temp_path, p);
+}
+
+
+} // namespace text
+} // namespace metalchat
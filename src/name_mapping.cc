@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <algorithm>
+#include <cctype>
+#include <format>
+#include <stdexcept>
+
+#include <metalchat/name_mapping.h>
+
+
+namespace metalchat {
+
+
+name_mapping::name_mapping()
+: _M_nodes(1),
+  _M_rules()
+{}
+
+
+name_mapping::name_mapping(
+    std::initializer_list<std::pair<std::string_view, std::string_view>> rules
+)
+: name_mapping()
+{
+    for (const auto& [pattern, replacement] : rules) {
+        insert(pattern, replacement);
+    }
+}
+
+
+std::size_t
+name_mapping::insert(std::string_view pattern, std::string_view replacement)
+{
+    return insert_rule(pattern, replacement);
+}
+
+
+std::size_t
+name_mapping::insert(std::string_view pattern)
+{
+    return insert_rule(pattern, std::nullopt);
+}
+
+
+std::uint32_t
+name_mapping::insert_child(std::uint32_t node, char c)
+{
+    auto& children = _M_nodes[node].children;
+    auto comp = [](const auto& child, char value) { return child.first < value; };
+
+    auto it = std::lower_bound(children.begin(), children.end(), c, comp);
+    if (it != children.end() && it->first == c) {
+        return it->second;
+    }
+
+    auto child = std::uint32_t(_M_nodes.size());
+    children.insert(it, std::make_pair(c, child));
+
+    // Insertion might reallocate nodes, so the reference to children is not used after.
+    _M_nodes.emplace_back();
+    return child;
+}
+
+
+std::size_t
+name_mapping::insert_rule(std::string_view pattern, std::optional<std::string_view> replacement)
+{
+    if (pattern.empty()) {
+        throw std::invalid_argument("name_mapping: pattern is empty");
+    }
+
+    std::uint32_t node = 0;
+    std::size_t captures = 0;
+
+    for (std::size_t pos = 0; pos < pattern.size();) {
+        if (pattern[pos] != '{') {
+            node = insert_child(node, pattern[pos++]);
+            continue;
+        }
+
+        auto placeholder = pattern.substr(pos, 3);
+        std::uint32_t _Node::* edge = nullptr;
+
+        if (placeholder == "{n}") {
+            edge = &_Node::digits;
+        } else if (placeholder == "{*}") {
+            edge = &_Node::component;
+        } else {
+            throw std::invalid_argument(std::format(
+                "name_mapping: invalid placeholder at position {} in pattern '{}'", pos, pattern
+            ));
+        }
+
+        if (_M_nodes[node].*edge == npos) {
+            auto child = std::uint32_t(_M_nodes.size());
+            _M_nodes.emplace_back();
+            _M_nodes[node].*edge = child;
+        }
+
+        node = _M_nodes[node].*edge;
+        captures++;
+        pos += placeholder.size();
+    }
+
+    if (_M_nodes[node].rule != npos) {
+        throw std::invalid_argument(std::format("name_mapping: duplicate pattern '{}'", pattern));
+    }
+
+    _Rule rule{.replacement = {}, .identity = !replacement.has_value()};
+    auto value = replacement.value_or("");
+
+    std::string literal;
+    for (std::size_t pos = 0; pos < value.size(); pos++) {
+        if (value[pos] != '$') {
+            literal.push_back(value[pos]);
+            continue;
+        }
+        if (pos + 1 < value.size() && value[pos + 1] == '$') {
+            literal.push_back('$');
+            pos++;
+            continue;
+        }
+
+        std::size_t capture = 0;
+        auto first = pos + 1;
+        while (pos + 1 < value.size() && std::isdigit(static_cast<unsigned char>(value[pos + 1]))) {
+            capture = capture * 10 + (value[++pos] - '0');
+        }
+
+        if (pos + 1 == first || capture == 0 || capture > captures) {
+            throw std::invalid_argument(std::format(
+                "name_mapping: invalid capture reference in replacement '{}' of pattern '{}'",
+                value, pattern
+            ));
+        }
+
+        if (!literal.empty()) {
+            rule.replacement.push_back(_Segment{.literal = std::move(literal), .capture = 0});
+            literal.clear();
+        }
+        rule.replacement.push_back(_Segment{.literal = {}, .capture = capture});
+    }
+
+    if (!literal.empty()) {
+        rule.replacement.push_back(_Segment{.literal = std::move(literal), .capture = 0});
+    }
+
+    _M_nodes[node].rule = std::uint32_t(_M_rules.size());
+    _M_rules.push_back(std::move(rule));
+    return _M_rules.size() - 1;
+}
+
+
+void
+name_mapping::match(
+    std::uint32_t node,
+    std::string_view name,
+    std::size_t pos,
+    std::vector<std::string_view>& captures,
+    std::optional<match_result>& result
+) const
+{
+    const auto& current = _M_nodes[node];
+
+    if (current.rule != npos && (pos == name.size() || name[pos] == '.')) {
+        if (!result.has_value() || pos > result->size) {
+            result = match_result{.index = current.rule, .size = pos, .captures = captures};
+        }
+    }
+
+    if (pos == name.size()) {
+        return;
+    }
+
+    auto comp = [](const auto& child, char value) { return child.first < value; };
+    auto it = std::lower_bound(current.children.begin(), current.children.end(), name[pos], comp);
+    if (it != current.children.end() && it->first == name[pos]) {
+        match(it->second, name, pos + 1, captures, result);
+    }
+
+    if (current.digits != npos) {
+        auto last = pos;
+        while (last < name.size() && std::isdigit(static_cast<unsigned char>(name[last]))) {
+            last++;
+        }
+        if (last > pos) {
+            captures.push_back(name.substr(pos, last - pos));
+            match(current.digits, name, last, captures, result);
+            captures.pop_back();
+        }
+    }
+
+    if (current.component != npos) {
+        auto last = std::min(name.find('.', pos), name.size());
+        if (last > pos) {
+            captures.push_back(name.substr(pos, last - pos));
+            match(current.component, name, last, captures, result);
+            captures.pop_back();
+        }
+    }
+}
+
+
+std::optional<name_mapping::match_result>
+name_mapping::match(std::string_view name) const
+{
+    std::optional<match_result> result;
+    std::vector<std::string_view> captures;
+
+    match(0, name, 0, captures, result);
+    return result;
+}
+
+
+std::string
+name_mapping::apply(std::string_view name) const
+{
+    auto result = match(name);
+    if (!result.has_value() || _M_rules[result->index].identity) {
+        return std::string(name);
+    }
+
+    std::string output;
+    for (const auto& segment : _M_rules[result->index].replacement) {
+        if (segment.capture > 0) {
+            output.append(result->captures[segment.capture - 1]);
+        } else {
+            output.append(segment.literal);
+        }
+    }
+
+    output.append(name.substr(result->size));
+    return output;
+}
+
+
+std::size_t
+name_mapping::size() const
+{
+    return _M_rules.size();
+}
+
+
+} // namespace metalchat
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <array>
+#include <cstdint>
+#include <format>
+#include <stdexcept>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <metalchat/text/pretokenizer.h>
+
+
+namespace metalchat {
+namespace text {
+
+
+static constexpr uint8_t _Pretokenizer_letter = 1 << 0;
+static constexpr uint8_t _Pretokenizer_number = 1 << 1;
+static constexpr uint8_t _Pretokenizer_space = 1 << 2;
+static constexpr uint8_t _Pretokenizer_newline = 1 << 3;
+
+
+/// Character classes of code points U+0000-U+00FF: Unicode general categories L* and N*,
+/// and the PCRE2 `\s` class, which matches only ASCII white spaces without UCP support.
+static constexpr std::array<uint8_t, 256> _Pretokenizer_class_table = [] {
+    std::array<uint8_t, 256> table = {};
+
+    auto set_range = [&](unsigned first, unsigned last, uint8_t cls) {
+        for (unsigned c = first; c <= last; c++) {
+            table[c] |= cls;
+        }
+    };
+
+    set_range('A', 'Z', _Pretokenizer_letter);
+    set_range('a', 'z', _Pretokenizer_letter);
+    set_range(0xaa, 0xaa, _Pretokenizer_letter);
+    set_range(0xb5, 0xb5, _Pretokenizer_letter);
+    set_range(0xba, 0xba, _Pretokenizer_letter);
+    set_range(0xc0, 0xd6, _Pretokenizer_letter);
+    set_range(0xd8, 0xf6, _Pretokenizer_letter);
+    set_range(0xf8, 0xff, _Pretokenizer_letter);
+
+    set_range('0', '9', _Pretokenizer_number);
+    set_range(0xb2, 0xb3, _Pretokenizer_number);
+    set_range(0xb9, 0xb9, _Pretokenizer_number);
+    set_range(0xbc, 0xbe, _Pretokenizer_number);
+
+    set_range('\t', '\r', _Pretokenizer_space);
+    set_range(' ', ' ', _Pretokenizer_space);
+    set_range('\n', '\n', _Pretokenizer_newline);
+    set_range('\r', '\r', _Pretokenizer_newline);
+
+    return table;
+}();
+
+
+static constexpr uint8_t _Pretokenizer_nonother =
+    _Pretokenizer_letter | _Pretokenizer_number | _Pretokenizer_space;
+
+
+static inline uint8_t
+_Pretokenizer_class(unsigned char c)
+{
+    return _Pretokenizer_class_table[c];
+}
+
+
+/// Returns the number of leading ASCII letters that are classified in blocks of 16 bytes.
+/// The remaining part of the run is expected to be classified using the class table.
+static inline std::size_t
+_Pretokenizer_ascii_letters(const unsigned char* data, std::size_t size)
+{
+    std::size_t i = 0;
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t mask = vdupq_n_u8(0x20);
+    const uint8x16_t first = vdupq_n_u8('a');
+    const uint8x16_t count = vdupq_n_u8(26);
+
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8(data + i);
+        uint8x16_t offset = vsubq_u8(vorrq_u8(v, mask), first);
+        if (vminvq_u8(vcltq_u8(offset, count)) != 0xff) {
+            break;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x20);
+    const __m128i first = _mm_set1_epi8('a');
+    const __m128i sign = _mm_set1_epi8(char(0x80));
+    const __m128i count = _mm_set1_epi8(char(26 ^ 0x80));
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i offset = _mm_sub_epi8(_mm_or_si128(v, mask), first);
+        // There is no unsigned comparison in SSE2, so flip the sign bit of both operands.
+        __m128i letter = _mm_cmplt_epi8(_mm_xor_si128(offset, sign), count);
+        if (_mm_movemask_epi8(letter) != 0xffff) {
+            break;
+        }
+    }
+#endif
+
+    return i;
+}
+
+
+/// Returns the end position of a run of characters of the specified class.
+static inline std::size_t
+_Pretokenizer_scan(const unsigned char* data, std::size_t pos, std::size_t size, uint8_t cls)
+{
+    while (pos < size && (_Pretokenizer_class(data[pos]) & cls)) {
+        pos++;
+    }
+    return pos;
+}
+
+
+static inline std::size_t
+_Pretokenizer_scan_letters(const unsigned char* data, std::size_t pos, std::size_t size)
+{
+    pos += _Pretokenizer_ascii_letters(data + pos, size - pos);
+    return _Pretokenizer_scan(data, pos, size, _Pretokenizer_letter);
+}
+
+
+static inline std::size_t
+_Pretokenizer_scan_other(const unsigned char* data, std::size_t pos, std::size_t size)
+{
+    while (pos < size && !(_Pretokenizer_class(data[pos]) & _Pretokenizer_nonother)) {
+        pos++;
+    }
+    return pos;
+}
+
+
+llama3_pretokenizer::llama3_pretokenizer() {}
+
+
+llama3_pretokenizer::llama3_pretokenizer(const std::string& regex)
+{
+    if (!is_compatible(regex)) {
+        throw std::invalid_argument(
+            std::format("llama3_pretokenizer: unsupported regular expression '{}'", regex)
+        );
+    }
+}
+
+
+llama3_pretokenizer::iterator
+llama3_pretokenizer::view_begin(std::string_view input) const
+{
+    return iterator(input);
+}
+
+
+llama3_pretokenizer::iterator
+llama3_pretokenizer::view_end() const
+{
+    return iterator();
+}
+
+
+bool
+llama3_pretokenizer::is_compatible(std::string_view regex)
+{
+    return regex == pattern;
+}
+
+
+std::size_t
+llama3_pretokenizer::match(std::string_view s, std::size_t offset)
+{
+    const auto size = s.size();
+    if (offset >= size) {
+        return 0;
+    }
+
+    const auto* data = reinterpret_cast<const unsigned char*>(s.data());
+    const auto c = data[offset];
+    const auto cls = _Pretokenizer_class(c);
+
+    // Alternatives of the pattern are tried in the same order as PCRE2 does, the first
+    // alternative that matches at the offset defines the length of the match.
+    //
+    // (?i:'s|'t|'re|'ve|'m|'ll|'d)
+    if (c == '\'' && offset + 1 < size) {
+        const auto c1 = data[offset + 1] | 0x20;
+        const auto c2 = offset + 2 < size ? data[offset + 2] | 0x20 : 0;
+
+        if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd') {
+            return 2;
+        }
+        if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') || (c1 == 'l' && c2 == 'l')) {
+            return 3;
+        }
+    }
+
+    // [^\r\n\p{L}\p{N}]?\p{L}+
+    if (cls & _Pretokenizer_letter) {
+        return _Pretokenizer_scan_letters(data, offset + 1, size) - offset;
+    }
+    if (!(cls & (_Pretokenizer_newline | _Pretokenizer_number)) && offset + 1 < size &&
+        (_Pretokenizer_class(data[offset + 1]) & _Pretokenizer_letter)) {
+        return _Pretokenizer_scan_letters(data, offset + 2, size) - offset;
+    }
+
+    // \p{N}{1,3}
+    if (cls & _Pretokenizer_number) {
+        std::size_t end = offset + 1;
+        while (end < size && end - offset < 3 &&
+               (_Pretokenizer_class(data[end]) & _Pretokenizer_number)) {
+            end++;
+        }
+        return end - offset;
+    }
+
+    //  ?[^\s\p{L}\p{N}]+[\r\n]*
+    std::size_t pos = offset;
+    if (c == ' ' && pos + 1 < size &&
+        !(_Pretokenizer_class(data[pos + 1]) & _Pretokenizer_nonother)) {
+        pos++;
+    }
+    if (!(_Pretokenizer_class(data[pos]) & _Pretokenizer_nonother)) {
+        pos = _Pretokenizer_scan_other(data, pos + 1, size);
+        pos = _Pretokenizer_scan(data, pos, size, _Pretokenizer_newline);
+        return pos - offset;
+    }
+
+    // At this point the character at the offset is a white space, since all other classes
+    // of characters are matched by the alternatives above.
+    const auto end = _Pretokenizer_scan(data, offset + 1, size, _Pretokenizer_space);
+
+    // \s*[\r\n]+, the greedy white space prefix backtracks to the last line break in the
+    // run of white spaces, which is the only line break matched by the second part.
+    for (auto last = end; last > offset; last--) {
+        if (_Pretokenizer_class(data[last - 1]) & _Pretokenizer_newline) {
+            return last - offset;
+        }
+    }
+
+    // \s+(?!\S), the run of white spaces is followed by a non-white space character, so
+    // the greedy match backtracks by one character. A single white space is matched by \s+.
+    if (end == size || end - offset == 1) {
+        return end - offset;
+    }
+    return end - offset - 1;
+}
+
+
+} // namespace text
+} // namespace metalchat
@@ -78,6 +78,10 @@ llama3_tokenizer_loader::load(std::istream& is, const std::string& token_regex)
 {
     type tokenizer(is, token_regex);
     insert_control_tokens(tokenizer);
+
+    if (cache_size > 0) {
+        tokenizer.set_cache(std::make_shared<type::cache_type>(cache_size));
+    }
     return tokenizer;
 }
 
@@ -7,6 +7,7 @@
 #include <cppcodec/base64_rfc4648.hpp>
 #include <pcre2.h>
 
+#include <metalchat/text/pretokenizer.h>
 #include <metalchat/text/regexp.h>
 
 
@@ -22,15 +23,106 @@ base64::decode(const std::string& s)
 
 
 static constexpr std::size_t _RegularExpression_error_bufsize = 256;
+static constexpr std::size_t _RegularExpression_jit_stack_start = 32 * 1024;
+static constexpr std::size_t _RegularExpression_jit_stack_max = 1024 * 1024;
+
+
+/// Matching state that is kept per thread and shared by all regular expressions, so that
+/// matching does not allocate a match data block and a JIT stack on every call.
+struct _RegularExpressionContext {
+    std::unique_ptr<pcre2_match_context, decltype(&pcre2_match_context_free)> context;
+    std::unique_ptr<pcre2_jit_stack, decltype(&pcre2_jit_stack_free)> stack;
+    std::unique_ptr<pcre2_match_data, decltype(&pcre2_match_data_free)> data;
+
+    _RegularExpressionContext()
+    : context(pcre2_match_context_create(nullptr), pcre2_match_context_free),
+      stack(
+          pcre2_jit_stack_create(
+              _RegularExpression_jit_stack_start, _RegularExpression_jit_stack_max, nullptr
+          ),
+          pcre2_jit_stack_free
+      ),
+      data(pcre2_match_data_create(1, nullptr), pcre2_match_data_free)
+    {
+        if (context == nullptr || data == nullptr) {
+            throw std::runtime_error("regexp: failed to create a match context");
+        }
+        // When the JIT stack cannot be created (JIT is not supported), PCRE2 uses a
+        // default stack of 32KiB, which is used only for JIT-compiled expressions.
+        if (stack != nullptr) {
+            pcre2_jit_stack_assign(context.get(), nullptr, stack.get());
+        }
+    }
+
+    static _RegularExpressionContext&
+    get()
+    {
+        static thread_local _RegularExpressionContext ctx;
+        return ctx;
+    }
+};
 
 
 struct regexp::_RegularExpression {
     std::shared_ptr<pcre2_code> ptr = nullptr;
+    bool jit = false;
+    bool native = false;
+
+    /// Find the first non-empty match within the subject starting from the specified
+    /// offset. Only the boundaries of the whole match are returned, since the match data
+    /// is shared among all expressions of the calling thread.
+    bool
+    match(std::string_view subject, std::size_t offset, std::string_view& result) const
+    {
+        if (native) {
+            auto length = llama3_pretokenizer::match(subject, offset);
+            result = subject.substr(offset, length);
+            return length > 0;
+        }
+
+        auto& ctx = _RegularExpressionContext::get();
+
+        const PCRE2_SPTR data = reinterpret_cast<PCRE2_SPTR>(subject.data());
+        const uint32_t options = PCRE2_NOTEMPTY;
+
+        int rc;
+        if (jit) {
+            rc = pcre2_jit_match(
+                ptr.get(), data, subject.size(), offset, options, ctx.data.get(),
+                ctx.context.get()
+            );
+        } else {
+            rc = pcre2_match(
+                ptr.get(), data, subject.size(), offset, options, ctx.data.get(),
+                ctx.context.get()
+            );
+        }
+
+        if (rc < 0) {
+            if (rc != PCRE2_ERROR_NOMATCH) {
+                throw std::runtime_error(std::format("regexp_iterator: matching error {}", rc));
+            }
+            return false;
+        }
+
+        // Return code 0 means that the match data is too small to keep all capture groups,
+        // but the first pair of the output vector is always set, which is enough here.
+        PCRE2_SIZE* slice = pcre2_get_ovector_pointer(ctx.data.get());
+        result = subject.substr(slice[0], slice[1] - slice[0]);
+        return true;
+    }
 };
 
 
 regexp::regexp(const std::string& regex)
 {
+    // The most frequently used split expression is implemented without PCRE2, the native
+    // implementation produces exactly the same matches.
+    if (llama3_pretokenizer::is_compatible(regex)) {
+        _M_impl = std::make_shared<_RegularExpression>(nullptr, false, true);
+        return;
+    }
+
     int error_code;
     PCRE2_SIZE error_offset;
 
@@ -47,7 +139,13 @@ regexp::regexp(const std::string& regex)
     }
 
     auto ptr = std::shared_ptr<pcre2_code>(re_ptr, pcre2_code_free);
-    _M_impl = std::make_shared<_RegularExpression>(ptr);
+
+    // JIT compilation fails with an error, when the library is built without JIT support,
+    // or the platform does not allow executable memory. In this case, the compiled pattern
+    // is still usable by the interpreter.
+    bool jit = pcre2_jit_compile(re_ptr, PCRE2_JIT_COMPLETE) == 0;
+
+    _M_impl = std::make_shared<_RegularExpression>(ptr, jit);
 }
 
 
@@ -70,36 +168,110 @@ regexp::end() const
 }
 
 
+regexp_view_iterator
+regexp::view_begin(std::string_view input) const
+{
+    return regexp_view_iterator(*this, input);
+}
+
+
+regexp_view_iterator
+regexp::view_end() const
+{
+    return regexp_view_iterator();
+}
+
+
+bool
+regexp::is_jit() const
+{
+    return _M_impl->jit;
+}
+
+
+regexp_view_iterator::regexp_view_iterator()
+: _M_re(nullptr),
+  _M_subject(),
+  _M_match(),
+  _M_offset(0),
+  _M_end(true)
+{}
+
+
+regexp_view_iterator::regexp_view_iterator(const regexp& regex, std::string_view input)
+: _M_re(regex._M_impl),
+  _M_subject(input),
+  _M_match(),
+  _M_offset(0),
+  _M_end(false)
+{
+    next();
+}
+
+
+regexp_view_iterator&
+regexp_view_iterator::operator++()
+{
+    if (!_M_end) {
+        next();
+    }
+    return *this;
+}
+
+
+regexp_view_iterator::value_type
+regexp_view_iterator::operator*() const
+{
+    if (_M_end) {
+        throw std::runtime_error(
+            std::format("regexp_iterator: terminated iterator cannot be accessed")
+        );
+    }
+    return _M_match;
+}
+
+
+bool
+regexp_view_iterator::operator!=(const regexp_view_iterator& rhs) const
+{
+    return _M_end != rhs._M_end;
+}
+
+
+std::size_t
+regexp_view_iterator::position() const
+{
+    return static_cast<std::size_t>(_M_match.data() - _M_subject.data());
+}
+
+
+void
+regexp_view_iterator::next()
+{
+    if (_M_offset >= _M_subject.size() || !_M_re->match(_M_subject, _M_offset, _M_match)) {
+        _M_end = true;
+        _M_match = std::string_view();
+        return;
+    }
+    _M_offset = position() + _M_match.size();
+}
+
+
 struct regexp_iterator::_RegularExpressionIterator {
     friend class regexp;
 
-    const std::shared_ptr<pcre2_code> _M_re = nullptr;
-    std::shared_ptr<pcre2_match_data> _M_data = nullptr;
     std::string _M_subject;
-    PCRE2_SIZE _M_offset = 0;
-    bool _M_end = false;
+    regexp_view_iterator _M_it;
 
     _RegularExpressionIterator()
-    : _M_re(nullptr),
-      _M_data(nullptr),
-      _M_subject(),
-      _M_offset(0),
-      _M_end(true)
+    : _M_subject(),
+      _M_it()
     {}
 
-    _RegularExpressionIterator(const regexp& regex, const std::string& input)
-    : _M_re(regex._M_impl->ptr),
-      _M_data(nullptr),
-      _M_subject(input),
-      _M_offset(0),
-      _M_end(false)
-    {
-        pcre2_code* code = regex._M_impl->ptr.get();
-        pcre2_match_data* match_data = pcre2_match_data_create_from_pattern(code, nullptr);
-
-        _M_data = std::shared_ptr<pcre2_match_data>(match_data, pcre2_match_data_free);
-        _M_end = pcre2_get_ovector_count(match_data) == 0;
-    }
+    _RegularExpressionIterator(const std::string& input)
+    : _M_subject(input),
+      _M_it()
+    {}
 };
 
 
@@ -109,18 +281,18 @@ regexp_iterator::regexp_iterator()
 
 
 regexp_iterator::regexp_iterator(const regexp& regex, const std::string& input)
-: _M_impl(std::make_shared<regexp_iterator::_RegularExpressionIterator>(regex, input))
+: _M_impl(std::make_shared<regexp_iterator::_RegularExpressionIterator>(input))
 {
-    next();
+    // Create a view iterator only after the subject is copied to the memory owned by
+    // the iterator, so that matches point to the copied subject.
+    _M_impl->_M_it = regexp_view_iterator(regex, _M_impl->_M_subject);
 }
 
 
 regexp_iterator&
 regexp_iterator::operator++()
 {
-    if (!_M_impl->_M_end) {
-        next();
-    }
+    next();
     return *this;
 }
 
@@ -135,48 +307,21 @@ regexp_iterator::operator*()
 bool
 regexp_iterator::operator!=(const regexp_iterator& rhs)
 {
-    return _M_impl->_M_end != rhs._M_impl->_M_end;
+    return _M_impl->_M_it != rhs._M_impl->_M_it;
 }
 
 
 regexp_iterator::value_type
 regexp_iterator::get()
 {
-    if (_M_impl->_M_end) {
-        throw std::runtime_error(
-            std::format("regexp_iterator: terminated iterator cannot be accessed")
-        );
-    }
-
-    pcre2_match_data* match_data = _M_impl->_M_data.get();
-
-    PCRE2_SIZE* slice = pcre2_get_ovector_pointer(match_data);
-    PCRE2_SIZE length = slice[1] - slice[0];
-
-    auto data = _M_impl->_M_subject.data() + _M_impl->_M_offset;
-    _M_impl->_M_offset = slice[1];
-    _M_impl->_M_end |= _M_impl->_M_subject.size() == _M_impl->_M_offset;
-
-    return value_type(reinterpret_cast<const char*>(data), length);
+    return value_type(*_M_impl->_M_it);
 }
 
 
 void
 regexp_iterator::next()
 {
-    pcre2_match_data* match_data = _M_impl->_M_data.get();
-    const PCRE2_SPTR subject = reinterpret_cast<PCRE2_SPTR>(_M_impl->_M_subject.data());
-    const PCRE2_SIZE subject_size = _M_impl->_M_subject.size();
-
-    auto rc = pcre2_match(
-        _M_impl->_M_re.get(), subject, subject_size, _M_impl->_M_offset, 0, match_data, NULL
-    );
-    if (rc < 0) {
-        _M_impl->_M_end = true;
-        if (rc != PCRE2_ERROR_NOMATCH) {
-            throw std::runtime_error(std::format("regexp_iterator: matching error {}", rc));
-        }
-    }
+    ++_M_impl->_M_it;
 }
 
 
@@ -2,7 +2,22 @@
 // SPDX-FileCopyrightText: 2025 Yakau Bubnou
 // SPDX-FileType: SOURCE
 
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
 #include <jsoncons/json.hpp>
+#include <rapidhash.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <metalchat/safetensor.h>
 
@@ -21,6 +36,548 @@ safetensor_index::open(std::istream& stream)
 }
 
 
+/// Returns the size of an element of the safetensor data type in bytes, or zero, when the
+/// data type is not defined by the safetensor specification.
+static std::size_t
+_Safetensor_element_size(std::string_view dtype)
+{
+    static constexpr std::pair<std::string_view, std::size_t> element_sizes[] = {
+        {"BOOL", 1}, {"U8", 1},  {"I8", 1},  {"F8_E5M2", 1}, {"F8_E4M3", 1},
+        {"I16", 2},  {"U16", 2}, {"F16", 2}, {"BF16", 2},    {"I32", 4},
+        {"U32", 4},  {"F32", 4}, {"I64", 8}, {"U64", 8},     {"F64", 8},
+    };
+
+    for (const auto& [name, size] : element_sizes) {
+        if (name == dtype) {
+            return size;
+        }
+    }
+    return 0;
+}
+
+
+/// A single-pass parser of the JSON-encoded safetensor header.
+///
+/// The parser supports only the subset of JSON that is required to read the header, values
+/// of unknown fields are skipped. Every read is checked against the end of the input, and
+/// the nesting of skipped values is limited, so the parser never reads outside of the header
+/// and never exhausts the stack on a hostile input.
+struct safetensor_header_view::_Parser {
+    static constexpr std::size_t max_depth = 64;
+
+    safetensor_header_view& view;
+    std::string_view input;
+    std::size_t pos = 0;
+
+    [[noreturn]] void
+    error(std::string_view message) const
+    {
+        throw std::runtime_error(
+            std::format("safetensor_header_view: {} at position {}", message, pos)
+        );
+    }
+
+    void
+    skip_whitespace()
+    {
+        while (pos < input.size() && (input[pos] == ' ' || input[pos] == '\t' ||
+                                      input[pos] == '\n' || input[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    char
+    peek()
+    {
+        skip_whitespace();
+        if (pos >= input.size()) {
+            error("unexpected end of header");
+        }
+        return input[pos];
+    }
+
+    void
+    expect(char c)
+    {
+        if (peek() != c) {
+            error(std::format("expected '{}'", c));
+        }
+        pos++;
+    }
+
+    bool
+    consume(char c)
+    {
+        if (peek() == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    unsigned
+    parse_hex()
+    {
+        if (pos + 4 > input.size()) {
+            error("incomplete unicode escape sequence");
+        }
+
+        unsigned code = 0;
+        for (std::size_t i = 0; i < 4; i++, pos++) {
+            char c = input[pos];
+            code <<= 4;
+            if (c >= '0' && c <= '9') {
+                code |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                code |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                code |= c - 'A' + 10;
+            } else {
+                error("invalid unicode escape sequence");
+            }
+        }
+        return code;
+    }
+
+    /// Decode the string with escape sequences into the memory owned by the header view.
+    std::string_view
+    unescape(std::string_view s)
+    {
+        auto& result = view._M_strings.emplace_back();
+        result.reserve(s.size());
+
+        // Position of the parser is moved to the beginning of the string, so that errors
+        // report a position of the invalid escape sequence.
+        const auto end = pos;
+        pos = end - s.size() - 1;
+
+        while (pos < end - 1) {
+            char c = input[pos++];
+            if (c != '\\') {
+                result.push_back(c);
+                continue;
+            }
+
+            switch (input[pos++]) {
+            case '"':
+                result.push_back('"');
+                break;
+            case '\\':
+                result.push_back('\\');
+                break;
+            case '/':
+                result.push_back('/');
+                break;
+            case 'b':
+                result.push_back('\b');
+                break;
+            case 'f':
+                result.push_back('\f');
+                break;
+            case 'n':
+                result.push_back('\n');
+                break;
+            case 'r':
+                result.push_back('\r');
+                break;
+            case 't':
+                result.push_back('\t');
+                break;
+            case 'u': {
+                unsigned code = parse_hex();
+                if (code >= 0xd800 && code <= 0xdbff) {
+                    if (pos + 2 > end || input[pos] != '\\' || input[pos + 1] != 'u') {
+                        error("unpaired surrogate in unicode escape sequence");
+                    }
+                    pos += 2;
+                    unsigned low = parse_hex();
+                    if (low < 0xdc00 || low > 0xdfff) {
+                        error("unpaired surrogate in unicode escape sequence");
+                    }
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                } else if (code >= 0xdc00 && code <= 0xdfff) {
+                    error("unpaired surrogate in unicode escape sequence");
+                }
+
+                if (code < 0x80) {
+                    result.push_back(char(code));
+                } else if (code < 0x800) {
+                    result.push_back(char(0xc0 | (code >> 6)));
+                    result.push_back(char(0x80 | (code & 0x3f)));
+                } else if (code < 0x10000) {
+                    result.push_back(char(0xe0 | (code >> 12)));
+                    result.push_back(char(0x80 | ((code >> 6) & 0x3f)));
+                    result.push_back(char(0x80 | (code & 0x3f)));
+                } else {
+                    result.push_back(char(0xf0 | (code >> 18)));
+                    result.push_back(char(0x80 | ((code >> 12) & 0x3f)));
+                    result.push_back(char(0x80 | ((code >> 6) & 0x3f)));
+                    result.push_back(char(0x80 | (code & 0x3f)));
+                }
+                break;
+            }
+            default:
+                pos--;
+                error("invalid escape sequence");
+            }
+        }
+
+        pos = end;
+        return result;
+    }
+
+    /// Parse the string. The result is a view into the input, unless the string contains
+    /// escape sequences.
+    std::string_view
+    parse_string()
+    {
+        expect('"');
+
+        const auto first = pos;
+        bool escaped = false;
+
+        while (true) {
+            if (pos >= input.size()) {
+                error("unterminated string");
+            }
+
+            auto c = static_cast<unsigned char>(input[pos]);
+            if (c == '"') {
+                break;
+            }
+            if (c < 0x20) {
+                error("control character in string");
+            }
+            if (c == '\\') {
+                escaped = true;
+                pos++;
+            }
+            pos++;
+        }
+
+        auto s = input.substr(first, pos - first);
+        pos++;
+
+        return escaped ? unescape(s) : s;
+    }
+
+    std::size_t
+    parse_integer()
+    {
+        constexpr auto max_value = std::numeric_limits<std::size_t>::max();
+
+        if (char c = peek(); c < '0' || c > '9') {
+            error("expected non-negative integer");
+        }
+
+        std::size_t value = 0;
+        while (pos < input.size() && input[pos] >= '0' && input[pos] <= '9') {
+            std::size_t digit = input[pos] - '0';
+            if (value > (max_value - digit) / 10) {
+                error("integer overflow");
+            }
+            value = value * 10 + digit;
+            pos++;
+        }
+
+        if (pos < input.size() && (input[pos] == '.' || input[pos] == 'e' || input[pos] == 'E')) {
+            error("expected non-negative integer");
+        }
+        return value;
+    }
+
+    void
+    skip_literal(std::string_view literal)
+    {
+        if (input.substr(pos, literal.size()) != literal) {
+            error("invalid literal");
+        }
+        pos += literal.size();
+    }
+
+    void
+    skip_value(std::size_t depth)
+    {
+        if (depth > max_depth) {
+            error("maximum nesting depth exceeded");
+        }
+
+        switch (peek()) {
+        case '{':
+            pos++;
+            if (!consume('}')) {
+                do {
+                    parse_string();
+                    expect(':');
+                    skip_value(depth + 1);
+                } while (consume(','));
+                expect('}');
+            }
+            break;
+        case '[':
+            pos++;
+            if (!consume(']')) {
+                do {
+                    skip_value(depth + 1);
+                } while (consume(','));
+                expect(']');
+            }
+            break;
+        case '"':
+            parse_string();
+            break;
+        case 't':
+            skip_literal("true");
+            break;
+        case 'f':
+            skip_literal("false");
+            break;
+        case 'n':
+            skip_literal("null");
+            break;
+        default:
+            if (pos < input.size() && input[pos] == '-') {
+                pos++;
+            }
+            if (pos >= input.size() || input[pos] < '0' || input[pos] > '9') {
+                error("unexpected character");
+            }
+            while (pos < input.size() && std::string_view("0123456789.eE+-").contains(input[pos])) {
+                pos++;
+            }
+        }
+    }
+
+    void
+    parse_metadata()
+    {
+        if (peek() == 'n') {
+            skip_literal("null");
+            return;
+        }
+
+        expect('{');
+        if (consume('}')) {
+            return;
+        }
+
+        do {
+            auto key = parse_string();
+            expect(':');
+            auto value = parse_string();
+            view._M_metadata.emplace_back(key, value);
+        } while (consume(','));
+        expect('}');
+    }
+
+    void
+    parse_tensor(std::string_view name, std::vector<std::size_t>& shape_offsets)
+    {
+        safetensor_descriptor tensor{.name = name};
+        bool has_dtype = false, has_shape = false, has_offsets = false;
+
+        const auto shape_offset = view._M_shapes.size();
+        std::size_t dimensions = 0;
+
+        expect('{');
+        do {
+            auto field = parse_string();
+            expect(':');
+
+            if (field == "dtype") {
+                tensor.dtype = parse_string();
+                has_dtype = true;
+            } else if (field == "shape" && !has_shape) {
+                expect('[');
+                if (!consume(']')) {
+                    do {
+                        if (dimensions++ == max_dimensions) {
+                            error(std::format("tensor '{}' has too many dimensions", name));
+                        }
+                        view._M_shapes.push_back(parse_integer());
+                    } while (consume(','));
+                    expect(']');
+                }
+                has_shape = true;
+            } else if (field == "data_offsets") {
+                expect('[');
+                tensor.data_offsets[0] = parse_integer();
+                expect(',');
+                tensor.data_offsets[1] = parse_integer();
+                expect(']');
+                has_offsets = true;
+            } else {
+                skip_value(1);
+            }
+        } while (consume(','));
+        expect('}');
+
+        if (!has_dtype || !has_shape || !has_offsets) {
+            error(std::format("tensor '{}' misses dtype, shape or data_offsets", name));
+        }
+
+        auto element_size = _Safetensor_element_size(tensor.dtype);
+        if (element_size == 0) {
+            error(std::format("tensor '{}' has unknown data type '{}'", name, tensor.dtype));
+        }
+
+        const auto [begin, end] = tensor.data_offsets;
+        if (begin > end || end > view._M_data_size) {
+            error(std::format("tensor '{}' has invalid data offsets [{}, {}]", name, begin, end));
+        }
+
+        std::size_t size = element_size;
+        for (std::size_t i = shape_offset; i < view._M_shapes.size(); i++) {
+            auto dim = view._M_shapes[i];
+            if (dim != 0 && size > std::numeric_limits<std::size_t>::max() / dim) {
+                error(std::format("tensor '{}' size overflows", name));
+            }
+            size *= dim;
+        }
+        if (size != end - begin) {
+            error(std::format(
+                "tensor '{}' size {} does not match the size of data offsets {}", name, size,
+                end - begin
+            ));
+        }
+
+        tensor.aligned = (view._M_data_offset + begin) % element_size == 0;
+        view._M_tensors.push_back(tensor);
+        shape_offsets.push_back(shape_offset);
+    }
+
+    void
+    parse()
+    {
+        std::vector<std::size_t> shape_offsets;
+
+        expect('{');
+        if (!consume('}')) {
+            do {
+                auto key = parse_string();
+                expect(':');
+
+                if (key == "__metadata__") {
+                    parse_metadata();
+                    continue;
+                }
+                parse_tensor(key, shape_offsets);
+            } while (consume(','));
+            expect('}');
+        }
+
+        skip_whitespace();
+        if (pos != input.size()) {
+            error("unexpected trailing characters");
+        }
+
+        // Shapes are stored in a single vector, which is reallocated while parsing, so views
+        // of shapes are created only when all tensors are parsed.
+        auto& tensors = view._M_tensors;
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            auto first = view._M_shapes.begin() + shape_offsets[i];
+            auto last = (i + 1 < tensors.size()) ? view._M_shapes.begin() + shape_offsets[i + 1]
+                                                 : view._M_shapes.end();
+            tensors[i].shape = std::span<const std::size_t>(first, last);
+        }
+    }
+};
+
+
+safetensor_header_view::safetensor_header_view(const char* data, std::size_t size)
+: _M_tensors(),
+  _M_shapes(),
+  _M_metadata(),
+  _M_strings(),
+  _M_data_offset(0),
+  _M_data_size(0)
+{
+    uint64_t header_size = 0;
+    if (size < sizeof(header_size)) {
+        throw std::runtime_error(std::format(
+            "safetensor_header_view: header size is corrupted, read {} != {}", size,
+            sizeof(header_size)
+        ));
+    }
+
+    std::memcpy(&header_size, data, sizeof(header_size));
+    if (header_size > max_header_size || header_size > size - sizeof(header_size)) {
+        throw std::runtime_error(std::format(
+            "safetensor_header_view: header size {} exceeds the size of the file {}",
+            header_size, size
+        ));
+    }
+
+    _M_data_offset = sizeof(header_size) + header_size;
+    _M_data_size = size - _M_data_offset;
+    parse(std::string_view(data + sizeof(header_size), header_size));
+
+    // The data section of the file must be completely covered by tensors.
+    auto data_end = _M_tensors.empty() ? 0 : _M_tensors.back().data_offsets[1];
+    if (data_end != _M_data_size) {
+        throw std::runtime_error(std::format(
+            "safetensor_header_view: tensors cover {} of {} bytes of the data section", data_end,
+            _M_data_size
+        ));
+    }
+}
+
+
+safetensor_header_view::safetensor_header_view(std::string_view header, std::size_t data_size)
+: _M_tensors(),
+  _M_shapes(),
+  _M_metadata(),
+  _M_strings(),
+  _M_data_offset(sizeof(uint64_t) + header.size()),
+  _M_data_size(data_size)
+{
+    parse(header);
+}
+
+
+void
+safetensor_header_view::parse(std::string_view header)
+{
+    _Parser parser{.view = *this, .input = header};
+    parser.parse();
+
+    // Order tensors to ensure that the file is accessed sequentially, tensors must be
+    // stored contiguously without gaps and overlaps, since tensors are allocated from the
+    // contiguous pages of the file.
+    auto comparator = [](const safetensor_descriptor& a, const safetensor_descriptor& b) {
+        return a.data_offsets < b.data_offsets;
+    };
+    std::sort(_M_tensors.begin(), _M_tensors.end(), comparator);
+
+    // Names of tensors must be unique. Duplicates are found by sorting hashes of names,
+    // which is notably faster than a hash set for headers with thousands of tensors.
+    std::vector<std::pair<std::size_t, std::string_view>> names;
+    names.reserve(_M_tensors.size());
+    for (const auto& tensor : _M_tensors) {
+        names.emplace_back(std::hash<std::string_view>{}(tensor.name), tensor.name);
+    }
+
+    std::sort(names.begin(), names.end());
+    auto duplicate = std::adjacent_find(names.begin(), names.end());
+    if (duplicate != names.end()) {
+        throw std::runtime_error(
+            std::format("safetensor_header_view: duplicate tensor '{}'", duplicate->second)
+        );
+    }
+
+    std::size_t offset = 0;
+    for (const auto& tensor : _M_tensors) {
+        if (tensor.data_offsets[0] != offset) {
+            throw std::runtime_error(std::format(
+                "safetensor_header_view: tensor '{}' starts at {}, expected offset {}",
+                tensor.name, tensor.data_offsets[0], offset
+            ));
+        }
+        offset = tensor.data_offsets[1];
+    }
+}
+
+
 safetensor_document::safetensor_document()
 : _M_tensors(),
   _M_containers(),
@@ -93,41 +650,40 @@ safetensor_document::parse_header(std::istream& is)
             sizeof(header_size)
         ));
     }
+    if (header_size > safetensor_header_view::max_header_size) {
+        throw std::runtime_error(
+            std::format("safetensor_document: header size {} is too large", header_size)
+        );
+    }
 
-    char header_bytes[header_size];
-    is.read((char*)&header_bytes, sizeof(header_bytes));
-    if (is.gcount() != sizeof(header_bytes)) {
+    std::string header_bytes(header_size, '\0');
+    is.read(header_bytes.data(), header_bytes.size());
+    if (std::size_t(is.gcount()) != header_bytes.size()) {
         throw std::runtime_error(std::format(
             "safetensor_document: header is corrupted, read {} != {}", is.gcount(),
-            sizeof(header_bytes)
+            header_bytes.size()
         ));
     }
 
-    std::string_view header_json(header_bytes, sizeof(header_bytes));
-    safetensor_header header;
-
-    using value_type = std::variant<safetensor_metadata, metadata_container>;
-    using header_type = std::unordered_map<std::string, value_type>;
+    // The size of the stream is unknown, tensors that are out of the stream bounds are
+    // detected when the tensor data is read.
+    auto data_size = std::numeric_limits<std::size_t>::max();
+    auto header_view = safetensor_header_view(header_bytes, data_size);
 
-    auto header_data = jsoncons::decode_json<header_type>(header_json);
-    for (auto [name, value] : header_data) {
-        // Shame on designers of safetensor specification, garbage like this should
-        // not be presented on the same level as tensor structures.
-        if (name == "__metadata__") {
-            header.metadata = std::get<metadata_container>(value);
-            continue;
-        }
-
-        auto meta = std::get<safetensor_metadata>(value);
-        meta.name = name;
-        header.tensors.push_back(meta);
+    safetensor_header header;
+    header.tensors.reserve(header_view.tensors().size());
+
+    for (const auto& tensor : header_view.tensors()) {
+        header.tensors.push_back(safetensor_metadata{
+            .name = std::string(tensor.name),
+            .dtype = std::string(tensor.dtype),
+            .shape = {tensor.shape.begin(), tensor.shape.end()},
+            .data_offsets = {tensor.data_offsets.begin(), tensor.data_offsets.end()}
+        });
+    }
+    for (const auto& [key, value] : header_view.metadata()) {
+        header.metadata.insert_or_assign(std::string(key), std::string(value));
     }
-
-    // Order metadata entries to ensure that we access file sequentially.
-    auto comparator = [](const safetensor_metadata& a, const safetensor_metadata& b) {
-        return a.data_offsets[0] < b.data_offsets[0];
-    };
-    std::sort(header.tensors.begin(), header.tensors.end(), comparator);
 
     return header;
 }
@@ -153,6 +709,104 @@ safetensor_document::open(const std::filesystem::path& p, hardware_accelerator&
 }
 
 
+/// Returns a name of the residency group of the tensor: the prefix of the name up to the
+/// first numeric component, or the name without the last component.
+static std::string
+_Residency_group(std::string_view name)
+{
+    auto is_digit = [](unsigned char c) { return std::isdigit(c); };
+
+    for (std::size_t first = 0; first < name.size();) {
+        auto last = std::min(name.find('.', first), name.size());
+        auto component = name.substr(first, last - first);
+
+        if (!component.empty() && std::ranges::all_of(component, is_digit)) {
+            return std::string(name.substr(0, last));
+        }
+        first = last + 1;
+    }
+
+    return std::string(name.substr(0, name.rfind('.')));
+}
+
+
+/// Rebinds a void file-buffered container to the container of the safetensor data type.
+template <std::size_t... TypeIndices>
+static std::shared_ptr<basic_container>
+_Rebind_filebuf(
+    std::string_view type_name,
+    const std::shared_ptr<filebuf_memory_container<void>>& container_ptr,
+    std::index_sequence<TypeIndices...>
+)
+{
+    using safetensor_types = decltype(safetensor_typeinfo::default_types);
+
+    std::shared_ptr<basic_container> result;
+    auto rebind = [&]<std::size_t TypeIndex>() {
+        using safetensor_type = std::tuple_element_t<TypeIndex, safetensor_types>;
+        using value_type = safetensor_type::value_type;
+        using rebind_type = container_rebind<value_type, filebuf_memory_container<void>>;
+
+        if (std::get<TypeIndex>(safetensor_typeinfo::default_types).name == type_name) {
+            result = rebind_type::rebind(container_ptr);
+        }
+    };
+
+    (rebind.template operator()<TypeIndices>(), ...);
+
+    if (result == nullptr) {
+        throw std::invalid_argument(
+            std::format("safetensor_document::open: unsupported data type '{}'", type_name)
+        );
+    }
+    return result;
+}
+
+
+safetensor_document
+safetensor_document::open(const std::filesystem::path& p, residency_manager& residency)
+{
+    using safetensor_types = decltype(safetensor_typeinfo::default_types);
+    constexpr auto default_types_size = std::tuple_size_v<safetensor_types>;
+
+    auto file = std::make_shared<basic_memfile>(p);
+
+    uint64_t header_size = 0;
+    {
+        basic_memfile prefix(*file, 0, std::min(file->size(), sizeof(header_size)));
+        prefix.declare_mapped();
+        std::memcpy(&header_size, prefix.data(), prefix.size());
+    }
+
+    // Map only the header of the file. The parser validates the size of the header against
+    // the size of the file, and never reads beyond the header, so the window is clipped to
+    // the maximum size of the header.
+    header_size = std::min<uint64_t>(header_size, safetensor_header_view::max_header_size + 1);
+    auto header_window = std::min(file->size(), sizeof(header_size) + header_size);
+    auto header_file = basic_memfile(*file, 0, header_window);
+    header_file.declare_mapped();
+
+    auto header = safetensor_header_view(header_file.data(), file->size());
+    auto types = std::make_index_sequence<default_types_size>{};
+
+    safetensor_document document;
+    for (const auto& tensor : header.tensors()) {
+        auto offset = header.data_offset() + tensor.data_offsets[0];
+        auto size = tensor.size();
+
+        auto storage = std::make_shared<basic_memfile>(*file, offset, size);
+        auto group = residency.insert(_Residency_group(tensor.name), storage);
+
+        using container_type = filebuf_memory_container<void>;
+        auto container_ptr = std::make_shared<container_type>(storage, size, 0, residency, group);
+        document.insert(tensor, _Rebind_filebuf(tensor.dtype, container_ptr, types));
+    }
+
+    document.insert(header.metadata());
+    return document;
+}
+
+
 void
 safetensor_document::insert(
     const safetensor_metadata& tensor, const safetensor_container& container
@@ -176,6 +830,31 @@ safetensor_document::container_offset() const
 }
 
 
+void
+safetensor_document::insert(
+    const safetensor_descriptor& tensor, const safetensor_container& container
+)
+{
+    safetensor_metadata tensordata{
+        .name = std::string(tensor.name),
+        .dtype = std::string(tensor.dtype),
+        .shape = {tensor.shape.begin(), tensor.shape.end()},
+        .data_offsets = {tensor.data_offsets.begin(), tensor.data_offsets.end()}
+    };
+
+    insert(tensordata, container);
+}
+
+
+void
+safetensor_document::insert(const safetensor_header_view::metadata_type& metadata)
+{
+    for (const auto& [key, value] : metadata) {
+        _M_metadata.insert_or_assign(std::string(key), std::string(value));
+    }
+}
+
+
 void
 safetensor_document::insert(const safetensor& st)
 {
@@ -226,6 +905,48 @@ safetensor_document::insert(const std::string& name, const std::string& source)
 }
 
 
+void
+safetensor_document::merge(safetensor_document&& document)
+{
+    auto offset = container_offset();
+    auto size = _M_tensors.size();
+
+    _M_tensors.reserve(size + document._M_tensors.size());
+    _M_containers.reserve(size + document._M_containers.size());
+    _M_names.reserve(size + document._M_tensors.size());
+
+    for (std::size_t i = 0; i < document._M_tensors.size(); i++) {
+        auto& tensor = document._M_tensors[i];
+        tensor.data_offsets[0] += offset;
+        tensor.data_offsets[1] += offset;
+
+        _M_names.insert_or_assign(tensor.name, size + i);
+        _M_tensors.push_back(std::move(tensor));
+        _M_containers.push_back(std::move(document._M_containers[i]));
+    }
+
+    _M_metadata.merge(document._M_metadata);
+    document = safetensor_document();
+}
+
+
+safetensor_document
+safetensor_document::rename(const name_mapping& mapping) const
+{
+    safetensor_document doc;
+    doc._M_tensors.reserve(_M_tensors.size());
+    doc._M_containers.reserve(_M_containers.size());
+    doc._M_names.reserve(_M_tensors.size());
+
+    for (std::size_t i = 0; i < _M_tensors.size(); i++) {
+        auto tensor = _M_tensors[i];
+        tensor.name = mapping.apply(tensor.name);
+        doc.insert(tensor, _M_containers[i]);
+    }
+    return doc;
+}
+
+
 void
 safetensor_document::insert(const nn::basic_layer& layer)
 {
@@ -319,31 +1040,1135 @@ safetensor_document::save(const std::filesystem::path& p)
 }
 
 
-safetensor_document::metadata_container&
-safetensor_document::get_metadata()
+/// Keeps the container acquired within the scope, see \ref basic_container::acquire.
+struct _Container_acquire {
+    const basic_container& container;
+
+    _Container_acquire(const basic_container& c)
+    : container(c)
+    {
+        container.acquire();
+    }
+
+    ~_Container_acquire() { container.release(); }
+};
+
+
+/// Containers map the data on the first access, which is not thread-safe for file-buffered
+/// containers, so every container is accessed once in the calling thread. Containers are
+/// released right away, and acquired again by the tasks that access the data, since the
+/// residency manager keeps only a limited number of containers mapped.
+static void
+_Map_container(const basic_container& container)
 {
-    return _M_metadata;
+    _Container_acquire acquire(container);
+    container.data_ptr();
 }
 
 
-safetensor_document
-sharded_safetensor_document::open(const std::filesystem::path& p)
+/// A file descriptor of the file opened for writing, the file is closed on destruction.
+struct _Safetensor_file {
+    int fd;
+
+    _Safetensor_file(const std::filesystem::path& p)
+    : fd(::open(p.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))
+    {
+        if (fd == -1) {
+            throw std::runtime_error(std::format(
+                "safetensor_document::save: unable to open file '{}': {}", p.string(),
+                std::strerror(errno)
+            ));
+        }
+    }
+
+    ~_Safetensor_file() { ::close(fd); }
+
+    void
+    allocate(std::size_t size)
+    {
+        int error = 0;
+#if defined(__linux__)
+        error = posix_fallocate(fd, 0, static_cast<off_t>(size));
+        // File systems that don't support preallocation are extended without it.
+        if (error == EINVAL || error == EOPNOTSUPP) {
+            error = ftruncate(fd, static_cast<off_t>(size)) == 0 ? 0 : errno;
+        }
+#else
+        error = ftruncate(fd, static_cast<off_t>(size)) == 0 ? 0 : errno;
+#endif
+        if (error != 0) {
+            throw std::runtime_error(std::format(
+                "safetensor_document::save: unable to allocate {} bytes: {}", size,
+                std::strerror(error)
+            ));
+        }
+    }
+
+    void
+    write(const char* data, std::size_t size, std::size_t offset)
+    {
+        while (size > 0) {
+            auto written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+            if (written == -1 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                throw std::runtime_error(std::format(
+                    "safetensor_document::save: failed to write {} bytes at offset {}: {}", size,
+                    offset, std::strerror(errno)
+                ));
+            }
+
+            data += written;
+            size -= written;
+            offset += written;
+        }
+    }
+};
+
+
+std::string
+safetensor_save_options::hash_key(std::string_view name)
 {
-    auto alloc = random_memory_allocator<void>();
-    auto nocopy_alloc = nocopy_allocator(alloc);
-    return open(p, nocopy_alloc);
+    return std::format("{}{}", hash_prefix, name);
 }
 
 
-safetensor_document
-sharded_safetensor_document::open(const std::filesystem::path& p, hardware_accelerator& accelerator)
+void
+safetensor_document::save(
+    const std::filesystem::path& p, thread_pool& pool, const safetensor_save_options& options
+)
 {
-    auto alloc = accelerator.get_allocator();
+    using value_type = std::variant<safetensor_metadata, metadata_container>;
+    using header_type = std::unordered_map<std::string, value_type>;
 
-    nocopy_allocator nocopy_alloc(alloc, accelerator.get_metal_device());
-    hardware_resident_allocator resident_alloc(nocopy_alloc, accelerator.get_metal_device());
+    const auto alignment = options.alignment;
+    if (alignment == 0 || options.chunk_size == 0) {
+        throw std::invalid_argument(
+            "safetensor_document::save: alignment and chunk size must be positive"
+        );
+    }
 
-    return open(p, resident_alloc, accelerator.max_buffer_size());
+    // Padding between tensors is not allowed by the format, therefore tensors are ordered
+    // by the largest power of two (up to the alignment) their sizes are multiples of. This
+    // way, every tensor starts at an offset that is a multiple of that power of two, e.g.
+    // tensors with sizes that are multiples of the alignment are always aligned.
+    auto granularity = [&](std::size_t i) {
+        auto size = _M_tensors[i].size();
+        return size == 0 ? alignment : std::min(size & (~size + 1), alignment);
+    };
+
+    std::vector<std::size_t> order(_M_tensors.size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return granularity(a) > granularity(b);
+    });
+
+    std::vector<safetensor_metadata> tensors;
+    tensors.reserve(order.size());
+
+    std::size_t data_size = 0;
+    for (auto i : order) {
+        auto& tensor = tensors.emplace_back(_M_tensors[i]);
+        auto size = tensor.size();
+
+        tensor.data_offsets = {data_size, data_size + size};
+        data_size += size;
+    }
+
+    // Hashes have a fixed width, so the header is encoded with placeholders first to
+    // compute the offset of the data section, before the data is hashed.
+    auto metadata = _M_metadata;
+    auto encode_header = [&]() {
+        header_type header({{"__metadata__", metadata}});
+        for (const auto& tensor : tensors) {
+            header.insert_or_assign(tensor.name, tensor);
+        }
+
+        std::string header_json;
+        jsoncons::encode_json(header, header_json);
+        return header_json;
+    };
+
+    std::vector<std::uint64_t> hashes(tensors.size());
+    if (options.hash) {
+        for (const auto& tensor : tensors) {
+            auto hash_key = safetensor_save_options::hash_key(tensor.name);
+            metadata.insert_or_assign(hash_key, std::string(16, '0'));
+        }
+    }
+
+    uint64_t header_size = encode_header().size();
+    auto data_offset = sizeof(header_size) + header_size;
+    data_offset = (data_offset + alignment - 1) / alignment * alignment;
+    header_size = data_offset - sizeof(header_size);
+
+    _Safetensor_file file(p);
+    file.allocate(data_offset + data_size);
+
+    // Hashes are computed over the whole tensors, so tensors are written by a single task,
+    // otherwise large tensors are split into chunks.
+    struct chunk_type {
+        std::size_t tensor;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::vector<chunk_type> chunks;
+    for (std::size_t i = 0; i < tensors.size(); i++) {
+        auto size = tensors[i].size();
+        auto chunk_size = options.hash ? std::max<std::size_t>(size, 1) : options.chunk_size;
+
+        for (std::size_t offset = 0; offset < size; offset += chunk_size) {
+            chunks.push_back({i, offset, std::min(chunk_size, size - offset)});
+        }
+    }
+
+    // The data pointer is valid only while the container is acquired, so every task
+    // retrieves the pointer after acquiring the container.
+    for (const auto& container : _M_containers) {
+        _Map_container(*container);
+    }
+
+    pool.parallel_for(chunks.size(), [&](std::size_t i) {
+        const auto& chunk = chunks[i];
+        const auto& container = *_M_containers[order[chunk.tensor]];
+        const auto& tensor = tensors[chunk.tensor];
+
+        _Container_acquire acquire(container);
+        const auto data = static_cast<const char*>(container.data_ptr()) + chunk.offset;
+
+        if (options.hash) {
+            hashes[chunk.tensor] = rapidhash(data, chunk.size);
+        }
+        file.write(data, chunk.size, data_offset + tensor.data_offsets[0] + chunk.offset);
+    });
+
+    if (options.hash) {
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            // Tensors without data are not written, but the hash is still defined.
+            if (tensors[i].size() == 0) {
+                hashes[i] = rapidhash("", 0);
+            }
+            auto hash_key = safetensor_save_options::hash_key(tensors[i].name);
+            metadata.insert_or_assign(hash_key, std::format("{:016x}", hashes[i]));
+        }
+    }
+
+    auto header_json = encode_header();
+    if (header_json.size() > header_size) {
+        throw std::logic_error("safetensor_document::save: header exceeds the reserved size");
+    }
+
+    header_json.resize(header_size, ' ');
+    file.write(reinterpret_cast<const char*>(&header_size), sizeof(header_size), 0);
+    file.write(header_json.data(), header_json.size(), sizeof(header_size));
+}
+
+
+safetensor_document::metadata_container&
+safetensor_document::get_metadata()
+{
+    return _M_metadata;
+}
+
+
+const safetensor_document::metadata_container&
+safetensor_document::get_metadata() const
+{
+    return _M_metadata;
+}
+
+
+std::vector<std::uint64_t>
+safetensor_document::hash(thread_pool& pool) const
+{
+    for (const auto& container : _M_containers) {
+        _Map_container(*container);
+    }
+
+    std::vector<std::uint64_t> hashes(_M_tensors.size());
+    pool.parallel_for(_M_tensors.size(), [&](std::size_t i) {
+        _Container_acquire acquire(*_M_containers[i]);
+
+        auto size = _M_tensors[i].size();
+        auto data = _M_containers[i]->data_ptr();
+        hashes[i] = size == 0 ? rapidhash("", 0) : rapidhash(data, size);
+    });
+
+    return hashes;
+}
+
+
+/// Compare names, so that sequences of digits are compared by their numeric values.
+static bool
+_Natural_less(std::string_view a, std::string_view b)
+{
+    std::size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (std::isdigit((unsigned char)a[i]) && std::isdigit((unsigned char)b[j])) {
+            auto a_end = a.find_first_not_of("0123456789", i);
+            auto b_end = b.find_first_not_of("0123456789", j);
+            a_end = a_end == a.npos ? a.size() : a_end;
+            b_end = b_end == b.npos ? b.size() : b_end;
+
+            auto a_number = a.substr(i, a_end - i);
+            auto b_number = b.substr(j, b_end - j);
+            a_number.remove_prefix(std::min(a_number.find_first_not_of('0'), a_number.size()));
+            b_number.remove_prefix(std::min(b_number.find_first_not_of('0'), b_number.size()));
+
+            if (a_number.size() != b_number.size()) {
+                return a_number.size() < b_number.size();
+            }
+            if (a_number != b_number) {
+                return a_number < b_number;
+            }
+
+            i = a_end;
+            j = b_end;
+        } else {
+            if (a[i] != b[j]) {
+                return a[i] < b[j];
+            }
+            i++;
+            j++;
+        }
+    }
+    return (a.size() - i) < (b.size() - j);
+}
+
+
+struct safetensor_warmup::_State {
+    struct range {
+        const char* data;
+        std::size_t size;
+    };
+
+    std::vector<std::shared_ptr<basic_container>> containers;
+    std::vector<std::string> names;
+    std::vector<range> tensors;
+    std::vector<range> chunks;
+    std::size_t size = 0;
+    bool sequential = false;
+
+    std::atomic<std::size_t> next = 0;
+    std::atomic<std::size_t> touched = 0;
+    std::atomic<bool> cancelled = false;
+
+    std::size_t running = 0;
+    mutable std::mutex mutex;
+    mutable std::condition_variable cv;
+
+    void
+    touch()
+    {
+        const auto page_size = memory_page_size();
+
+        for (auto i = next++; i < chunks.size() && !cancelled; i = next++) {
+            const volatile char* data = chunks[i].data;
+            const auto size = chunks[i].size;
+
+            // Read a single byte from every page, this is enough to fault the page in.
+            char checksum = 0;
+            for (std::size_t offset = 0; offset < size; offset += page_size) {
+                checksum ^= data[offset];
+            }
+            checksum ^= data[size - 1];
+            touched += size;
+
+            volatile char sink = checksum;
+            static_cast<void>(sink);
+        }
+
+        std::scoped_lock lock(mutex);
+        if (--running == 0) {
+            finish();
+            cv.notify_all();
+        }
+    }
+
+    void
+    finish()
+    {
+        // Sequential access hint results in an early eviction of accessed pages on some
+        // platforms, model weights are accessed repeatedly, so revert the hint.
+        if (sequential) {
+            for (const auto& tensor : tensors) {
+                memory_advise(tensor.data, tensor.size, memory_advice::normal);
+            }
+        }
+    }
+};
+
+
+safetensor_warmup::safetensor_warmup(
+    const safetensor_document& document, thread_pool& pool, const safetensor_warmup_options& options
+)
+: _M_state(std::make_shared<_State>())
+{
+    if (options.chunk_size == 0) {
+        throw std::invalid_argument("safetensor_warmup: chunk size must be positive");
+    }
+
+    struct entry {
+        std::size_t rank;
+        std::string name;
+        std::shared_ptr<basic_container> container;
+    };
+
+    std::vector<entry> entries;
+    for (auto it = document.begin(); it != document.end(); ++it) {
+        auto tensor = *it;
+        auto name = tensor.name();
+
+        std::size_t rank = options.order.size();
+        for (std::size_t i = 0; i < options.order.size(); i++) {
+            if (name.starts_with(options.order[i])) {
+                rank = i;
+                break;
+            }
+        }
+        entries.push_back({rank, std::move(name), tensor.container_ptr()});
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) {
+        if (a.rank != b.rank) {
+            return a.rank < b.rank;
+        }
+        return _Natural_less(a.name, b.name);
+    });
+
+    auto& state = *_M_state;
+    std::unordered_set<const void*> visited;
+
+    for (auto& e : entries) {
+        auto data = static_cast<const char*>(e.container->data_ptr());
+        auto size = e.container->size();
+
+        // Tensors that share the same container (i.e. tied weights) are touched only once.
+        if (data == nullptr || size == 0 || !visited.insert(data).second) {
+            continue;
+        }
+
+        if (options.sequential) {
+            memory_advise(data, size, memory_advice::sequential);
+        }
+        if (options.hugepage) {
+            memory_advise(data, size, memory_advice::hugepage);
+        }
+        if (options.willneed) {
+            memory_advise(data, size, memory_advice::willneed);
+        }
+
+        state.tensors.push_back({data, size});
+        state.names.push_back(std::move(e.name));
+        state.containers.push_back(std::move(e.container));
+        state.size += size;
+
+        for (std::size_t offset = 0; offset < size; offset += options.chunk_size) {
+            state.chunks.push_back({data + offset, std::min(options.chunk_size, size - offset)});
+        }
+    }
+
+    state.sequential = options.sequential;
+    if (!options.touch) {
+        state.chunks.clear();
+    }
+
+    auto worker_count = std::min(pool.size(), state.chunks.size());
+    if (worker_count == 0) {
+        state.finish();
+        return;
+    }
+
+    state.running = worker_count;
+    for (std::size_t i = 0; i < worker_count; i++) {
+        pool.push([state_ptr = _M_state]() { state_ptr->touch(); });
+    }
+}
+
+
+std::size_t
+safetensor_warmup::size() const
+{
+    return _M_state->size;
+}
+
+
+const std::vector<std::string>&
+safetensor_warmup::names() const
+{
+    return _M_state->names;
+}
+
+
+std::size_t
+safetensor_warmup::touched_size() const
+{
+    return _M_state->touched;
+}
+
+
+std::size_t
+safetensor_warmup::resident_size() const
+{
+    std::size_t resident_size = 0;
+    for (const auto& tensor : _M_state->tensors) {
+        resident_size += memory_resident_size(tensor.data, tensor.size);
+    }
+    return std::min(resident_size, _M_state->size);
+}
+
+
+float
+safetensor_warmup::progress() const
+{
+    if (_M_state->size == 0) {
+        return 1.0f;
+    }
+    return float(touched_size()) / float(_M_state->size);
+}
+
+
+bool
+safetensor_warmup::done() const
+{
+    std::scoped_lock lock(_M_state->mutex);
+    return _M_state->running == 0;
+}
+
+
+void
+safetensor_warmup::wait() const
+{
+    std::unique_lock lock(_M_state->mutex);
+    _M_state->cv.wait(lock, [&] { return _M_state->running == 0; });
+}
+
+
+void
+safetensor_warmup::cancel()
+{
+    _M_state->cancelled = true;
+}
+
+
+struct safetensor_verification::_State {
+    static constexpr std::uint64_t cache_version = 1;
+
+    /// Hashing states of tensors.
+    enum status_type : int { pending, hashing, hashed };
+
+    struct tensor_type {
+        std::string name;
+        std::shared_ptr<basic_container> container;
+        std::size_t size;
+        std::optional<std::uint64_t> expected;
+        std::uint64_t hash = 0;
+    };
+
+    /// A size, modification time and inode of the file, the cache is valid only for the
+    /// file with the same stamp.
+    struct stamp_type {
+        std::uint64_t size = 0;
+        std::uint64_t mtime = 0;
+        std::uint64_t inode = 0;
+
+        bool
+        operator==(const stamp_type&) const = default;
+    };
+
+    std::vector<tensor_type> tensors;
+    std::unordered_map<std::string, std::size_t> names;
+    std::unique_ptr<std::atomic<int>[]> status;
+
+    std::filesystem::path cache_path;
+    stamp_type stamp;
+    bool cached = false;
+
+    std::atomic<std::size_t> next = 0;
+    std::atomic<std::size_t> hashed_size = 0;
+    std::atomic<std::size_t> verified_size = 0;
+    std::atomic<bool> cancelled = false;
+
+    std::size_t running = 0;
+    std::vector<std::string> corrupted;
+    mutable std::mutex mutex;
+    mutable std::condition_variable cv;
+
+    static stamp_type
+    make_stamp(const std::filesystem::path& p)
+    {
+        struct stat st;
+        if (::stat(p.c_str(), &st) != 0) {
+            throw std::invalid_argument(
+                std::format("safetensor_verification: unable to stat file '{}'", p.string())
+            );
+        }
+
+        auto mtime = std::filesystem::last_write_time(p).time_since_epoch();
+        return stamp_type{
+            .size = static_cast<std::uint64_t>(st.st_size),
+            .mtime = static_cast<std::uint64_t>(mtime.count()),
+            .inode = static_cast<std::uint64_t>(st.st_ino),
+        };
+    }
+
+    /// Restore hashes from the cache, returns false when the cache does not exist, or it
+    /// was written for another version of the file.
+    bool
+    read_cache()
+    {
+        std::ifstream cache_file(cache_path);
+        if (!cache_file.is_open()) {
+            return false;
+        }
+
+        std::vector<std::uint64_t> hashes(tensors.size());
+        try {
+            auto cache = jsoncons::json::parse(cache_file);
+            auto cache_stamp = stamp_type{
+                .size = cache.at("size").as<std::uint64_t>(),
+                .mtime = cache.at("mtime").as<std::uint64_t>(),
+                .inode = cache.at("inode").as<std::uint64_t>(),
+            };
+
+            if (cache.at("version").as<std::uint64_t>() != cache_version || cache_stamp != stamp) {
+                return false;
+            }
+
+            const auto& cache_hashes = cache.at("hashes");
+            for (std::size_t i = 0; i < tensors.size(); i++) {
+                auto hash = cache_hashes.at(tensors[i].name).as<std::string>();
+                hashes[i] = std::stoull(hash, nullptr, 16);
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+
+        // Expected hashes could change after the cache was written, the cache is not used
+        // in that case, so that mismatching tensors are hashed and reported as corrupted.
+        std::size_t verified_count = 0;
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            if (tensors[i].expected) {
+                if (*tensors[i].expected != hashes[i]) {
+                    return false;
+                }
+                verified_count++;
+            }
+        }
+
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            tensors[i].hash = hashes[i];
+            status[i] = hashed;
+        }
+        hashed_size = tensors.size();
+        verified_size = verified_count;
+        return true;
+    }
+
+    /// Write hashes of all tensors into the cache. The cache is only an optimization, so
+    /// failures to write it (e.g. read-only file systems) are ignored.
+    void
+    write_cache() const
+    {
+        jsoncons::json hashes;
+        for (const auto& tensor : tensors) {
+            hashes.insert_or_assign(tensor.name, std::format("{:016x}", tensor.hash));
+        }
+
+        jsoncons::json cache;
+        cache.insert_or_assign("version", cache_version);
+        cache.insert_or_assign("size", stamp.size);
+        cache.insert_or_assign("mtime", stamp.mtime);
+        cache.insert_or_assign("inode", stamp.inode);
+        cache.insert_or_assign("hashes", std::move(hashes));
+
+        auto temp_path = cache_path;
+        temp_path += ".tmp";
+
+        std::error_code error;
+        {
+            std::ofstream cache_file(temp_path, std::ios::trunc);
+            if (!cache_file.is_open()) {
+                return;
+            }
+            cache_file << cache;
+            if (!cache_file.good()) {
+                cache_file.close();
+                std::filesystem::remove(temp_path, error);
+                return;
+            }
+        }
+        std::filesystem::rename(temp_path, cache_path, error);
+    }
+
+    /// Hash the tensor, returns false when the tensor is already hashed by another thread.
+    bool
+    hash(std::size_t i)
+    {
+        int expected_status = pending;
+        if (!status[i].compare_exchange_strong(expected_status, hashing)) {
+            return false;
+        }
+
+        auto& tensor = tensors[i];
+        {
+            _Container_acquire acquire(*tensor.container);
+            auto data = tensor.container->data_ptr();
+            tensor.hash = rapidhash(tensor.size == 0 ? "" : data, tensor.size);
+        }
+
+        bool complete = false;
+        {
+            std::scoped_lock lock(mutex);
+            if (tensor.expected && *tensor.expected != tensor.hash) {
+                corrupted.push_back(tensor.name);
+            } else if (tensor.expected) {
+                ++verified_size;
+            }
+
+            status[i] = hashed;
+            complete = ++hashed_size == tensors.size() && corrupted.empty();
+        }
+
+        if (complete) {
+            write_cache();
+        }
+
+        cv.notify_all();
+        return true;
+    }
+
+    void
+    work()
+    {
+        for (auto i = next++; i < tensors.size() && !cancelled; i = next++) {
+            hash(i);
+        }
+
+        std::scoped_lock lock(mutex);
+        --running;
+        cv.notify_all();
+    }
+
+    bool
+    is_done() const
+    {
+        return hashed_size == tensors.size() || (cancelled && running == 0);
+    }
+
+    void
+    throw_corrupted() const
+    {
+        if (!corrupted.empty()) {
+            throw std::runtime_error(std::format(
+                "safetensor_verification: {} tensor(s) are corrupted, including '{}'",
+                corrupted.size(), corrupted.front()
+            ));
+        }
+    }
+};
+
+
+safetensor_verification::safetensor_verification(
+    const std::filesystem::path& p,
+    const safetensor_document& document,
+    thread_pool& pool,
+    const safetensor_verification_options& options
+)
+: _M_state(std::make_shared<_State>())
+{
+    auto& state = *_M_state;
+    const auto& metadata = document.get_metadata();
+
+    auto sizes = document.sizes();
+    auto size = sizes.begin();
+
+    for (auto it = document.begin(); it != document.end(); ++it, ++size) {
+        auto tensor = *it;
+        auto container = tensor.container_ptr();
+        auto name = tensor.name();
+
+        std::optional<std::uint64_t> expected;
+        auto hash_key = safetensor_save_options::hash_key(name);
+        const auto& expected_hashes = options.expected_hashes;
+        if (auto hash = expected_hashes.find(name); hash != expected_hashes.end()) {
+            expected = hash->second;
+        } else if (auto hash = metadata.find(hash_key); hash != metadata.end()) {
+            expected = std::stoull(hash->second, nullptr, 16);
+        }
+
+        _Map_container(*container);
+        state.tensors.push_back({name, std::move(container), *size, expected});
+    }
+
+    std::stable_sort(state.tensors.begin(), state.tensors.end(), [](auto& a, auto& b) {
+        return _Natural_less(a.name, b.name);
+    });
+
+    state.status = std::make_unique<std::atomic<int>[]>(state.tensors.size());
+    for (std::size_t i = 0; i < state.tensors.size(); i++) {
+        state.names.insert_or_assign(state.tensors[i].name, i);
+        state.status[i] = _State::pending;
+    }
+
+    state.cache_path = options.cache_path;
+    if (state.cache_path.empty()) {
+        state.cache_path = p;
+        state.cache_path += cache_extension;
+    }
+
+    state.stamp = _State::make_stamp(p);
+    state.cached = state.read_cache();
+    if (state.cached) {
+        return;
+    }
+
+    if (!options.lazy) {
+        pool.parallel_for(state.tensors.size(), [&](std::size_t i) { state.hash(i); });
+        state.throw_corrupted();
+        return;
+    }
+
+    auto worker_count = std::min(pool.size(), state.tensors.size());
+    state.running = worker_count;
+
+    for (std::size_t i = 0; i < worker_count; i++) {
+        pool.push([state_ptr = _M_state]() { state_ptr->work(); });
+    }
+}
+
+
+bool
+safetensor_verification::cached() const
+{
+    return _M_state->cached;
+}
+
+
+std::size_t
+safetensor_verification::size() const
+{
+    return _M_state->tensors.size();
+}
+
+
+std::size_t
+safetensor_verification::verified_size() const
+{
+    return _M_state->verified_size;
+}
+
+
+bool
+safetensor_verification::verify(const std::string& name)
+{
+    auto& state = *_M_state;
+
+    auto it = state.names.find(name);
+    if (it == state.names.end()) {
+        throw std::invalid_argument(
+            std::format("safetensor_verification: tensor '{}' does not exist", name)
+        );
+    }
+
+    auto i = it->second;
+    if (!state.hash(i)) {
+        std::unique_lock lock(state.mutex);
+        state.cv.wait(lock, [&] { return state.status[i] == _State::hashed; });
+    }
+
+    const auto& tensor = state.tensors[i];
+    if (tensor.expected && *tensor.expected != tensor.hash) {
+        throw std::runtime_error(std::format(
+            "safetensor_verification: tensor '{}' is corrupted, hash {:016x} != {:016x}", name,
+            tensor.hash, *tensor.expected
+        ));
+    }
+    return tensor.expected.has_value();
+}
+
+
+std::vector<std::string>
+safetensor_verification::corrupted() const
+{
+    std::scoped_lock lock(_M_state->mutex);
+    return _M_state->corrupted;
+}
+
+
+std::vector<std::string>
+safetensor_verification::unverified() const
+{
+    std::vector<std::string> names;
+    for (const auto& tensor : _M_state->tensors) {
+        if (!tensor.expected) {
+            names.push_back(tensor.name);
+        }
+    }
+    return names;
+}
+
+
+bool
+safetensor_verification::done() const
+{
+    std::scoped_lock lock(_M_state->mutex);
+    return _M_state->is_done();
+}
+
+
+void
+safetensor_verification::wait() const
+{
+    std::unique_lock lock(_M_state->mutex);
+    _M_state->cv.wait(lock, [&] { return _M_state->is_done(); });
+    _M_state->throw_corrupted();
+}
+
+
+void
+safetensor_verification::cancel()
+{
+    _M_state->cancelled = true;
+}
+
+
+safetensor_document
+sharded_safetensor_document::open(const std::filesystem::path& p)
+{
+    auto alloc = random_memory_allocator<void>();
+    auto nocopy_alloc = nocopy_allocator(alloc);
+    return open(p, nocopy_alloc);
+}
+
+
+safetensor_document
+sharded_safetensor_document::open(const std::filesystem::path& p, hardware_accelerator& accelerator)
+{
+    auto alloc = accelerator.get_allocator();
+
+    nocopy_allocator nocopy_alloc(alloc, accelerator.get_metal_device());
+    hardware_resident_allocator resident_alloc(nocopy_alloc, accelerator.get_metal_device());
+
+    return open(p, resident_alloc, accelerator.max_buffer_size());
+}
+
+
+safetensor_document
+sharded_safetensor_document::open(
+    const std::filesystem::path& p,
+    hardware_accelerator& accelerator,
+    thread_pool& pool,
+    timing_callback callback
+)
+{
+    auto alloc = accelerator.get_allocator();
+
+    nocopy_allocator nocopy_alloc(alloc, accelerator.get_metal_device());
+    hardware_resident_allocator resident_alloc(nocopy_alloc, accelerator.get_metal_device());
+
+    auto max_size = accelerator.max_buffer_size();
+    return open(p, resident_alloc, pool, max_size, std::move(callback));
+}
+
+
+safetensor_document
+sharded_safetensor_document::open(const std::filesystem::path& p, residency_manager& residency)
+{
+    auto [index_path, filenames] = shard_filenames(p);
+
+    safetensor_document consolidated;
+    for (const auto& filename : filenames) {
+        consolidated.merge(safetensor_document::open(index_path / filename, residency));
+    }
+    return consolidated;
+}
+
+
+std::pair<std::filesystem::path, std::vector<std::string>>
+sharded_safetensor_document::shard_filenames(const std::filesystem::path& p)
+{
+    std::ifstream index_file(p, std::ios::binary | std::ios::in);
+    auto index = safetensor_index::open(index_file);
+
+    std::vector<std::string> filenames;
+    filenames.reserve(index.weight_map.size());
+    for (const auto& [_, filename] : index.weight_map) {
+        filenames.push_back(filename);
+    }
+
+    // Iteration order of the weight map is unspecified, sort file names so that shards
+    // are always merged in the same order.
+    std::sort(filenames.begin(), filenames.end());
+    filenames.erase(std::unique(filenames.begin(), filenames.end()), filenames.end());
+
+    return std::make_pair(p.parent_path(), std::move(filenames));
+}
+
+
+std::filesystem::path
+compiled_safetensor::compiled_path(const std::filesystem::path& p)
+{
+    // Both "model.safetensors" and "model.safetensors.index.json" are compiled into the
+    // "model.compiled.safetensors" document. Only known suffixes are removed, so that names
+    // with dots (i.e. "model.v2.safetensors") produce distinct documents.
+    static constexpr std::string_view suffixes[] = {".safetensors.index.json", ".safetensors"};
+
+    auto stem = p.filename().string();
+    for (auto suffix : suffixes) {
+        if (stem.ends_with(suffix)) {
+            stem.resize(stem.size() - suffix.size());
+            break;
+        }
+    }
+    return p.parent_path() / (stem + std::string(default_extension));
+}
+
+
+std::string
+compiled_safetensor::source_hash(const std::filesystem::path& p)
+{
+    std::vector<std::filesystem::path> paths = {p};
+    if (p.extension() == ".json") {
+        auto [index_path, filenames] = sharded_safetensor_document::shard_filenames(p);
+        for (const auto& filename : filenames) {
+            paths.push_back(index_path / filename);
+        }
+    }
+
+    std::string stamps;
+    for (const auto& path : paths) {
+        auto mtime = std::filesystem::last_write_time(path).time_since_epoch();
+        auto mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime).count();
+        auto size = std::filesystem::file_size(path);
+        stamps += std::format("{}:{}:{};", path.filename().string(), size, mtime_ns);
+    }
+
+    return std::format("{:016x}", rapidhash(stamps.data(), stamps.size()));
+}
+
+
+bool
+compiled_safetensor::is_current(
+    const std::filesystem::path& compiled,
+    const std::filesystem::path& source,
+    std::string_view layout
+)
+{
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(compiled, error) ||
+        !std::filesystem::is_regular_file(source, error)) {
+        return false;
+    }
+
+    // Read only the header, there is no need to map the whole document.
+    std::ifstream file(compiled, std::ios::binary | std::ios::in);
+    uint64_t header_size = 0;
+    if (!file.read(reinterpret_cast<char*>(&header_size), sizeof(header_size)) ||
+        header_size > safetensor_header_view::max_header_size) {
+        return false;
+    }
+
+    std::string header(header_size, '\0');
+    if (!file.read(header.data(), header_size)) {
+        return false;
+    }
+
+    std::string_view compiled_version, compiled_layout, compiled_source;
+    try {
+        safetensor_header_view view(header, std::numeric_limits<std::size_t>::max());
+        for (const auto& [key, value] : view.metadata()) {
+            if (key == version_key) {
+                compiled_version = value;
+            } else if (key == layout_key) {
+                compiled_layout = value;
+            } else if (key == source_key) {
+                compiled_source = value;
+            }
+        }
+
+        return compiled_version == version && compiled_layout == layout &&
+               compiled_source == source_hash(source);
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+
+void
+compiled_safetensor::save(
+    const std::filesystem::path& p,
+    const nn::basic_layer& layer,
+    const std::filesystem::path& source,
+    std::string_view layout
+)
+{
+    safetensor_document document;
+    std::unordered_map<const basic_container*, std::string> names;
+    std::string links;
+
+    auto insert_fn = [&](nn::named_parameter parameter) {
+        auto container = parameter.ptr->container_ptr().get();
+        auto [it, inserted] = names.try_emplace(container, parameter.path);
+        if (inserted) {
+            document.insert(parameter.path, *parameter.ptr);
+        } else {
+            links += std::format("{}{}={}", links.empty() ? "" : ",", parameter.path, it->second);
+        }
+    };
+    layer.apply(insert_fn, /*recurse=*/true);
+
+    auto& metadata = document.get_metadata();
+    metadata.insert_or_assign(std::string(version_key), std::string(version));
+    metadata.insert_or_assign(std::string(layout_key), std::string(layout));
+    metadata.insert_or_assign(std::string(source_key), source_hash(source));
+    metadata.insert_or_assign(std::string(links_key), links);
+
+    auto temp_path = p;
+    temp_path += ".tmp";
+
+    // Compiled documents are mapped directly, align the data section to the page.
+    thread_pool pool;
+    safetensor_save_options options;
+    options.alignment = memory_page_size();
+
+    try {
+        document.save(temp_path, pool, options);
+    } catch (...) {
+        std::filesystem::remove(temp_path);
+        throw;
+    }
+    std::filesystem::rename(temp_path, p);
+}
+
+
+void
+compiled_safetensor::link(safetensor_document& document)
+{
+    const auto& metadata = document.get_metadata();
+    auto it = metadata.find(std::string(links_key));
+    if (it == metadata.end()) {
+        return;
+    }
+
+    std::string_view links = it->second;
+    while (!links.empty()) {
+        auto link = links.substr(0, links.find(','));
+        links.remove_prefix(std::min(link.size() + 1, links.size()));
+
+        auto separator = link.find('=');
+        if (separator == link.npos) {
+            throw std::runtime_error(
+                std::format("compiled_safetensor: invalid link '{}' in the metadata", link)
+            );
+        }
+
+        auto name = std::string(link.substr(0, separator));
+        auto source = std::string(link.substr(separator + 1));
+        document.insert(name, source);
+    }
 }
 
 
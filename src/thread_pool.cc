@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <deque>
+#include <vector>
+
+#include <metalchat/thread_pool.h>
+
+
+namespace metalchat {
+
+
+struct thread_pool::_ThreadPool {
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopped = false;
+
+    _ThreadPool(std::size_t thread_count)
+    {
+        threads.reserve(thread_count);
+        for (std::size_t i = 0; i < thread_count; i++) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    ~_ThreadPool()
+    {
+        {
+            std::scoped_lock lock(mutex);
+            stopped = true;
+        }
+        cv.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void
+    push(std::function<void()>&& task)
+    {
+        {
+            std::scoped_lock lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    void
+    run()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [this] { return stopped || !tasks.empty(); });
+
+                // Complete all pending tasks before stopping the thread, since callers
+                // might wait for their results.
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+
+thread_pool::thread_pool(std::size_t thread_count)
+: _M_impl(std::make_shared<_ThreadPool>(std::max<std::size_t>(thread_count, 1)))
+{}
+
+
+std::size_t
+thread_pool::size() const
+{
+    return _M_impl->threads.size();
+}
+
+
+void
+thread_pool::_M_push(std::function<void()>&& task)
+{
+    _M_impl->push(std::move(task));
+}
+
+
+} // namespace metalchat
@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include <jsoncons/json.hpp>
+
+#include <metalchat/tracing.h>
+
+
+namespace metalchat {
+
+
+static thread_local const allocation_scope* _Current_allocation_scope = nullptr;
+
+
+allocation_scope::allocation_scope(std::string_view name, char delimiter) noexcept
+: _M_parent(_Current_allocation_scope),
+  _M_name(name),
+  _M_delimiter(delimiter)
+{
+    _Current_allocation_scope = this;
+}
+
+
+allocation_scope::~allocation_scope()
+{
+    _Current_allocation_scope = _M_parent;
+}
+
+
+std::string
+allocation_scope::current()
+{
+    std::vector<const allocation_scope*> scopes;
+    for (auto scope = _Current_allocation_scope; scope != nullptr; scope = scope->_M_parent) {
+        if (!scope->_M_name.empty()) {
+            scopes.push_back(scope);
+        }
+    }
+
+    std::string tag;
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        if (!tag.empty()) {
+            tag.push_back((*it)->_M_delimiter);
+        }
+        tag.append((*it)->_M_name);
+    }
+
+    return tag;
+}
+
+
+struct allocation_trace::_State {
+    struct event {
+        allocation_event_type type;
+        std::size_t id;
+        std::size_t size;
+        std::size_t tag;
+        std::chrono::nanoseconds timestamp;
+    };
+
+    struct allocation {
+        std::size_t size;
+        std::size_t tag;
+    };
+
+    std::atomic<bool> enabled = true;
+    clock_type::time_point start = clock_type::now();
+
+    std::mutex mutex;
+    std::size_t next_id = 0;
+    std::size_t bytes_in_use = 0;
+    std::size_t peak_bytes = 0;
+
+    // Tags are interned, so that events and statistics refer to tags by the index.
+    std::vector<std::string> tags;
+    std::unordered_map<std::string, std::size_t> tag_indices;
+    std::vector<allocation_tag_stats> tag_stats;
+
+    std::vector<event> events;
+    std::unordered_map<std::size_t, allocation> allocations;
+
+    std::size_t
+    intern(std::string&& tag)
+    {
+        if (auto it = tag_indices.find(tag); it != tag_indices.end()) {
+            return it->second;
+        }
+
+        auto index = tags.size();
+        tag_indices.emplace(tag, index);
+        tags.push_back(std::move(tag));
+        tag_stats.emplace_back();
+        return index;
+    }
+
+    std::chrono::nanoseconds
+    elapsed() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start);
+    }
+};
+
+
+allocation_trace::allocation_trace()
+: _M_state(std::make_shared<_State>())
+{}
+
+
+void
+allocation_trace::enable() noexcept
+{
+    _M_state->enabled.store(true, std::memory_order_relaxed);
+}
+
+
+void
+allocation_trace::disable() noexcept
+{
+    _M_state->enabled.store(false, std::memory_order_relaxed);
+}
+
+
+bool
+allocation_trace::enabled() const noexcept
+{
+    return _M_state->enabled.load(std::memory_order_relaxed);
+}
+
+
+std::size_t
+allocation_trace::record_allocate(std::size_t size)
+{
+    // The tag is built before the lock, since it depends only on the calling thread.
+    auto tag = allocation_scope::current();
+    auto timestamp = _M_state->elapsed();
+
+    const std::scoped_lock lock(_M_state->mutex);
+    auto& state = *_M_state;
+
+    auto id = state.next_id++;
+    auto tag_index = state.intern(std::move(tag));
+
+    state.events.push_back({allocation_event_type::allocate, id, size, tag_index, timestamp});
+    state.allocations.emplace(id, _State::allocation{size, tag_index});
+
+    auto& stats = state.tag_stats[tag_index];
+    stats.allocations++;
+    stats.bytes_in_use += size;
+    stats.peak_bytes = std::max(stats.peak_bytes, stats.bytes_in_use);
+
+    state.bytes_in_use += size;
+    if (state.bytes_in_use > state.peak_bytes) {
+        state.peak_bytes = state.bytes_in_use;
+        for (auto& tag_stats : state.tag_stats) {
+            tag_stats.bytes_at_peak = tag_stats.bytes_in_use;
+        }
+    }
+
+    return id;
+}
+
+
+void
+allocation_trace::record_free(std::size_t id)
+{
+    auto timestamp = _M_state->elapsed();
+
+    const std::scoped_lock lock(_M_state->mutex);
+    auto& state = *_M_state;
+
+    // Allocations recorded before the trace was cleared are not known.
+    auto it = state.allocations.find(id);
+    if (it == state.allocations.end()) {
+        return;
+    }
+
+    auto [size, tag_index] = it->second;
+    state.allocations.erase(it);
+
+    state.events.push_back({allocation_event_type::free, id, size, tag_index, timestamp});
+    state.tag_stats[tag_index].bytes_in_use -= size;
+    state.bytes_in_use -= size;
+}
+
+
+std::vector<allocation_event>
+allocation_trace::events() const
+{
+    const std::scoped_lock lock(_M_state->mutex);
+    auto& state = *_M_state;
+
+    std::vector<allocation_event> events;
+    events.reserve(state.events.size());
+
+    for (const auto& e : state.events) {
+        events.push_back(allocation_event{
+            .type = e.type,
+            .id = e.id,
+            .size = e.size,
+            .tag = state.tags[e.tag],
+            .timestamp = e.timestamp,
+        });
+    }
+
+    return events;
+}
+
+
+std::unordered_map<std::string, allocation_tag_stats>
+allocation_trace::tag_stats() const
+{
+    const std::scoped_lock lock(_M_state->mutex);
+    auto& state = *_M_state;
+
+    std::unordered_map<std::string, allocation_tag_stats> tag_stats;
+    for (std::size_t i = 0; i < state.tags.size(); i++) {
+        tag_stats.insert_or_assign(state.tags[i], state.tag_stats[i]);
+    }
+
+    return tag_stats;
+}
+
+
+std::size_t
+allocation_trace::bytes_in_use() const
+{
+    const std::scoped_lock lock(_M_state->mutex);
+    return _M_state->bytes_in_use;
+}
+
+
+std::size_t
+allocation_trace::peak_bytes() const
+{
+    const std::scoped_lock lock(_M_state->mutex);
+    return _M_state->peak_bytes;
+}
+
+
+void
+allocation_trace::write_json(std::ostream& os) const
+{
+    const std::scoped_lock lock(_M_state->mutex);
+    auto& state = *_M_state;
+
+    jsoncons::json events(jsoncons::json_array_arg);
+    events.reserve(state.events.size());
+
+    for (const auto& e : state.events) {
+        jsoncons::json event;
+        event.insert_or_assign("type", e.type == allocation_event_type::free ? "free" : "allocate");
+        event.insert_or_assign("id", e.id);
+        event.insert_or_assign("size", e.size);
+        event.insert_or_assign("tag", state.tags[e.tag]);
+        event.insert_or_assign("timestamp_ns", e.timestamp.count());
+        events.push_back(std::move(event));
+    }
+
+    jsoncons::json tags;
+    for (std::size_t i = 0; i < state.tags.size(); i++) {
+        const auto& stats = state.tag_stats[i];
+
+        jsoncons::json tag;
+        tag.insert_or_assign("allocations", stats.allocations);
+        tag.insert_or_assign("bytes_in_use", stats.bytes_in_use);
+        tag.insert_or_assign("peak_bytes", stats.peak_bytes);
+        tag.insert_or_assign("bytes_at_peak", stats.bytes_at_peak);
+        tags.insert_or_assign(state.tags[i], std::move(tag));
+    }
+
+    jsoncons::json document;
+    document.insert_or_assign("peak_bytes", state.peak_bytes);
+    document.insert_or_assign("events", std::move(events));
+    document.insert_or_assign("tags", std::move(tags));
+
+    os << document;
+}
+
+
+void
+allocation_trace::clear()
+{
+    const std::scoped_lock lock(_M_state->mutex);
+    auto& state = *_M_state;
+
+    state.bytes_in_use = 0;
+    state.peak_bytes = 0;
+    state.tags.clear();
+    state.tag_indices.clear();
+    state.tag_stats.clear();
+    state.events.clear();
+    state.allocations.clear();
+}
+
+
+} // namespace metalchat
@@ -4,7 +4,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <filesystem>
+#include <random>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
 
 
 #ifndef __lib_metalchat_test_fixture_directory
@@ -17,3 +22,43 @@ test_fixture_path()
 {
     return std::filesystem::path(__lib_metalchat_test_fixture_directory);
 }
+
+
+/// A temporary directory, which is removed with all its contents on destruction.
+struct scoped_temp_directory {
+private:
+    std::filesystem::path _M_name;
+
+    static std::string
+    random_string(std::size_t n, std::size_t alphabet_size = 16)
+    {
+        std::random_device rd;
+        std::mt19937 generator(rd());
+        std::uniform_int_distribution<std::size_t> distribution(0, alphabet_size);
+
+        std::string result(n, '0');
+        std::generate_n(result.begin(), n, [&]() { return distribution(generator) + 'a'; });
+
+        return result;
+    }
+
+public:
+    scoped_temp_directory(std::string prefix)
+    : _M_name(std::filesystem::temp_directory_path() / prefix / random_string(16))
+    {
+        std::filesystem::create_directories(_M_name);
+    }
+
+    std::filesystem::path
+    path() const
+    {
+        return _M_name;
+    }
+
+    ~scoped_temp_directory()
+    {
+        if (_M_name != "" && _M_name != "/") {
+            REQUIRE(std::filesystem::remove_all(_M_name) > 0);
+        }
+    }
+};
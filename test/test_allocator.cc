@@ -64,4 +64,160 @@ TEST_CASE("Allocator offset", "[allocator]")
     for (std::size_t i = 0; i < 10; i++) {
         REQUIRE(container0->data()[i] == i);
     }
+
+    using container_type = random_memory_container<std::size_t>;
+    auto container1 = container_traits<container_type>::offset(container0, 4 * sizeof(std::size_t));
+    REQUIRE(container1->size() == 6 * sizeof(std::size_t));
+    REQUIRE(container1->data()[0] == 4);
+}
+
+
+TEST_CASE("Arena allocator", "[allocator]")
+{
+    auto alloc = arena_allocator_adapter(random_memory_allocator<void>(), 1024, 64);
+
+    auto container0 = alloc.allocate(300);
+    auto container1 = alloc.allocate(300);
+    auto container2 = alloc.allocate(300);
+
+    auto data0 = static_cast<std::uint8_t*>(container0->data());
+    REQUIRE(container1->data() == data0 + 320);
+    REQUIRE(container2->data() == data0 + 640);
+
+    // The region is exhausted, so the arena allocates an additional region.
+    auto container3 = alloc.allocate(200);
+    REQUIRE(container3->data() != nullptr);
+
+    auto stats = alloc.stats();
+    REQUIRE(stats.overflows == 1);
+    REQUIRE(stats.size == 1140);
+    REQUIRE(stats.peak_size == 1140);
+
+    // After the reset, the arena grows to fit all allocations of the step.
+    alloc.reset();
+    stats = alloc.stats();
+    REQUIRE(stats.capacity == 2048);
+    REQUIRE(stats.size == 0);
+    REQUIRE(stats.resets == 1);
+
+    auto container4 = alloc.allocate(1500);
+    auto data4 = container4->data();
+
+    alloc.reset();
+    auto container5 = alloc.allocate(16);
+    REQUIRE(container5->data() == data4);
+    REQUIRE(alloc.stats().overflows == 1);
+
+    // Copies of the arena share the same region.
+    auto float_alloc = rebind_allocator<float, decltype(alloc)>(alloc);
+    auto container6 = float_alloc.allocate(4);
+    REQUIRE(static_cast<void*>(container6->data()) == static_cast<std::uint8_t*>(data4) + 64);
+}
+
+
+TEST_CASE("Caching allocator", "[allocator]")
+{
+    using allocator_type = caching_allocator_adapter<random_memory_allocator<void>>;
+    REQUIRE(allocator_type::size_class(1) == 256);
+    REQUIRE(allocator_type::size_class(600) == 640);
+    REQUIRE(allocator_type::size_class(1024) == 1024);
+    REQUIRE(allocator_type::size_class(1025) == 1280);
+
+    auto alloc = allocator_type(random_memory_allocator<void>(), 2048);
+
+    void* data0 = nullptr;
+    {
+        auto container0 = alloc.allocate(1000);
+        data0 = container0->data();
+
+        auto stats = alloc.stats();
+        REQUIRE(stats.misses == 1);
+        REQUIRE(stats.bytes_in_use == 1024);
+        REQUIRE(stats.requested_bytes == 1000);
+        REQUIRE(stats.fragmentation() > 0.0);
+    }
+
+    // The released block is cached and reused by the allocation of the same class.
+    REQUIRE(alloc.stats().cached_bytes == 1024);
+    auto container1 = alloc.allocate(900);
+    REQUIRE(container1->data() == data0);
+
+    auto stats = alloc.stats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.hit_rate() == 0.5);
+    REQUIRE(stats.cached_bytes == 0);
+
+    // Blocks released above the limit are returned to the underlying allocator.
+    {
+        auto container2 = alloc.allocate(1500);
+        auto container3 = alloc.allocate(1500);
+    }
+
+    stats = alloc.stats();
+    REQUIRE(stats.cached_bytes == 1536);
+    REQUIRE(stats.evictions == 1);
+
+    alloc.trim();
+    REQUIRE(alloc.stats().cached_bytes == 0);
+}
+
+
+TEST_CASE("Mapped memory allocator", "[allocator]")
+{
+    auto options = memory_map_options{.hugepage = true, .populate = true};
+    auto alloc = mapped_memory_allocator(options);
+
+    const std::size_t size = 4 << 20;
+    auto container = alloc.allocate(size);
+    REQUIRE(container->size() == size);
+
+    auto data = static_cast<std::uint8_t*>(container->data());
+    data[0] = 1;
+    data[size - 1] = 2;
+    REQUIRE(data[size - 1] == 2);
+
+    // Huge pages might be unavailable, but the allocation is always accounted in some mode.
+    auto stats = alloc.stats();
+    REQUIRE(stats.normal_bytes + stats.hugetlb_bytes + stats.transparent_hugepage_bytes == size);
+    REQUIRE(stats.populate_requested_bytes <= size);
+
+    auto copy = mapped_memory_allocator();
+    auto container_copy = copy.allocate(data, size);
+    REQUIRE(static_cast<std::uint8_t*>(container_copy->data())[size - 1] == 2);
+    REQUIRE(copy.stats().normal_bytes == size);
+
+    // Only live allocations are accounted.
+    container_copy.reset();
+    REQUIRE(copy.stats().normal_bytes == 0);
+}
+
+
+TEST_CASE("Mapped memory allocator NUMA placement", "[allocator]")
+{
+    REQUIRE(numa_node_count() >= 1);
+
+    auto options = memory_map_options{.populate = true, .numa = numa_policy::bind(0)};
+    auto alloc = mapped_memory_allocator(options);
+
+    const std::size_t size = 1 << 20;
+    auto container = alloc.allocate(size);
+    std::memset(container->data(), 1, size);
+
+    // Placement is not supported on all platforms, but reported bytes never exceed the size.
+    auto stats = alloc.stats();
+    REQUIRE(stats.numa_bound_bytes <= size);
+    if (!stats.node_bytes.empty()) {
+        REQUIRE(stats.node_bytes.size() == numa_node_count());
+        REQUIRE(stats.node_bytes[0] <= size);
+    }
+
+    // Policies referring to non-existing nodes are rejected.
+    auto invalid_policy = numa_policy::bind(numa_node_count());
+    REQUIRE_FALSE(memory_bind(container->data(), size, invalid_policy));
+
+    container.reset();
+    stats = alloc.stats();
+    if (!stats.node_bytes.empty()) {
+        REQUIRE(stats.node_bytes[0] == 0);
+    }
 }
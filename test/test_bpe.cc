@@ -2,12 +2,19 @@
 // SPDX-FileCopyrightText: 2025 Yakau Bubnou
 // SPDX-FileType: SOURCE
 
+#include <chrono>
+#include <format>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_vector.hpp>
 
 #include <metalchat/reference.h>
 #include <metalchat/repository.h>
 #include <metalchat/text/gpt.h>
+#include <metalchat/text/sentence_piece.h>
+#include <metalchat/text/unicode_tokenizer.h>
+#include <metalchat/thread_pool.h>
 
 #include "metalchat/testing.h"
 
@@ -34,6 +41,26 @@ TEST_CASE("Test GPT-2 codec", "[gpt2]")
 }
 
 
+TEST_CASE("Test GPT-2 codec with all bytes", "[gpt2]")
+{
+    text::gpt2_codec codec;
+
+    std::string bytes;
+    for (int i = 0; i < 256; i++) {
+        bytes.push_back(char(i));
+    }
+
+    // Make the input long enough to exercise the block-wise copy of printable characters.
+    auto input = bytes + std::string(100, 'a') + bytes;
+    auto output = codec.encode(input);
+
+    REQUIRE(output.size() == 100 + 2 * (94 + 2 * 162));
+    REQUIRE(output.starts_with("ĀāĂ"));
+    REQUIRE(codec.decode(output) == input);
+    REQUIRE_THROWS_AS(codec.decode("\xc3"), std::range_error);
+}
+
+
 TEST_CASE("TEST GPT-2 to Reference", "[gpt2][integration]")
 {
     auto tokenizer = make_tokenizer();
@@ -119,3 +146,318 @@ TEST_CASE("Decode control token", "[bpe][integration]")
 
     REQUIRE(token == "<|end_of_text|>");
 }
+
+
+TEST_CASE("Encode with a custom vocabulary", "[bpe]")
+{
+    text::byte_pair_encoder<char> tokenizer("\\S+|\\s+");
+    tokenizer.insert("a", 0);
+    tokenizer.insert("b", 1);
+    tokenizer.insert("c", 2);
+    tokenizer.insert("ab", 3);
+    tokenizer.insert("abc", 4);
+    tokenizer.insert(" ", 5);
+
+    using Tokenizer = decltype(tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    auto ids = TokenizerTraits::encode(tokenizer, "abc abcab ab");
+    std::vector<int32_t> actual(ids.begin(), ids.end());
+    std::vector<int32_t> expect = {4, 5, 4, 3, 5, 3};
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+}
+
+
+TEST_CASE("Count and encode prefix", "[bpe]")
+{
+    text::byte_pair_encoder<char> tokenizer("\\S+|\\s+");
+    tokenizer.insert("a", 0);
+    tokenizer.insert("b", 1);
+    tokenizer.insert("c", 2);
+    tokenizer.insert("ab", 3);
+    tokenizer.insert("abc", 4);
+    tokenizer.insert(" ", 5);
+
+    using Tokenizer = decltype(tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    const std::string input = "abc abcab ab";
+    REQUIRE(TokenizerTraits::count(tokenizer, input) == 6);
+
+    std::vector<int32_t> actual;
+    auto output = std::back_inserter(actual);
+
+    // The prefix ends on the boundary of the pre-token "abcab", which is encoded into
+    // two tokens, so only the first two tokens fit into the limit.
+    auto prefix = TokenizerTraits::encode_prefix(tokenizer, input, 3, output);
+    REQUIRE(prefix.count == 2);
+    REQUIRE(prefix.size == 4);
+    REQUIRE_FALSE(prefix.complete);
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(std::vector<int32_t>{4, 5}));
+
+    actual.clear();
+    prefix = TokenizerTraits::encode_prefix(tokenizer, input, 6, output);
+    REQUIRE(prefix.count == 6);
+    REQUIRE(prefix.size == input.size());
+    REQUIRE(prefix.complete);
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(std::vector<int32_t>{4, 5, 4, 3, 5, 3}));
+
+    text::tokenizer_wrapper<Tokenizer> wrapper(tokenizer);
+    REQUIRE(wrapper.count(input) == 6);
+}
+
+
+TEST_CASE("Encode with a sentence piece vocabulary", "[bpe]")
+{
+    text::sentence_piece tokenizer;
+    tokenizer.insert("▁", 3);
+    tokenizer.insert("п", 4);
+    tokenizer.insert("р", 5);
+    tokenizer.insert("и", 6);
+    tokenizer.insert("в", 7);
+    tokenizer.insert("е", 8);
+    tokenizer.insert("т", 9);
+    tokenizer.insert("м", 10);
+    tokenizer.insert("пр", 11);
+    tokenizer.insert("ив", 12);
+    tokenizer.insert("ет", 13);
+    tokenizer.insert("ми", 14);
+    tokenizer.insert("мир", 15);
+    tokenizer.insert("▁привет", 16);
+
+    using Tokenizer = decltype(tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    auto ids = TokenizerTraits::encode(tokenizer, " привет мир");
+    std::vector<int32_t> actual(ids.begin(), ids.end());
+    std::vector<int32_t> expect = {3, 11, 12, 13, 3, 15};
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+
+    auto string = TokenizerTraits::decode(tokenizer, ids.data_ptr(), ids.data_ptr() + 6);
+    REQUIRE(string == " привет мир");
+    REQUIRE(TokenizerTraits::encode(tokenizer, " привет")[0] == 16);
+    REQUIRE(TokenizerTraits::decode(tokenizer, 16) == " привет");
+}
+
+
+/// A tokenizer that encodes every code point into a token with the value of the code point.
+struct code_point_tokenizer {
+    using index_type = int32_t;
+    using char_type = char32_t;
+    using string_type = std::u32string;
+
+    void
+    encode(const string_type& s, text::basic_output_iterator<index_type>& output) const
+    {
+        for (auto rune : s) {
+            *output = index_type(rune);
+            ++output;
+        }
+    }
+};
+
+
+TEST_CASE("Decode UTF-8 strings with the unicode adaptor", "[bpe]")
+{
+    text::unicode_tokenizer_adaptor<code_point_tokenizer> tokenizer;
+
+    auto encode = [&](const std::string& s) {
+        std::vector<int32_t> ids;
+        auto back = std::back_inserter(ids);
+        text::output_iterator_wrapper<int32_t, decltype(back)> output(back);
+
+        tokenizer.encode(s, output);
+        return ids;
+    };
+
+    std::vector<int32_t> expect = {0x61, 0xe9, 0x2581, 0xd7ff, 0xffff, 0x1f600};
+    auto actual = encode("a\xc3\xa9\xe2\x96\x81\xed\x9f\xbf\xef\xbf\xbf\xf0\x9f\x98\x80");
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+
+    // Overlong encodings of '/' (U+002F), and of U+07FF and U+FFFF.
+    REQUIRE_THROWS_AS(encode("\xc0\xaf"), std::range_error);
+    REQUIRE_THROWS_AS(encode("\xe0\x80\xaf"), std::range_error);
+    REQUIRE_THROWS_AS(encode("\xf0\x80\x80\xaf"), std::range_error);
+    REQUIRE_THROWS_AS(encode("\xe0\x9f\xbf"), std::range_error);
+    REQUIRE_THROWS_AS(encode("\xf0\x8f\xbf\xbf"), std::range_error);
+
+    // Surrogate code points U+D800 and U+DFFF.
+    REQUIRE_THROWS_AS(encode("\xed\xa0\x80"), std::range_error);
+    REQUIRE_THROWS_AS(encode("\xed\xbf\xbf"), std::range_error);
+
+    // Code points above U+10FFFF, truncated and malformed sequences.
+    REQUIRE_THROWS_AS(encode("\xf4\x90\x80\x80"), std::range_error);
+    REQUIRE_THROWS_AS(encode("\xe2\x96"), std::range_error);
+    REQUIRE_THROWS_AS(encode("\x80"), std::range_error);
+}
+
+
+TEST_CASE("Encode and decode batch", "[bpe]")
+{
+    text::byte_pair_encoder<char> tokenizer("\\S+|\\s+");
+    tokenizer.insert("a", 0);
+    tokenizer.insert("b", 1);
+    tokenizer.insert("ab", 2);
+    tokenizer.insert(" ", 3);
+
+    using Tokenizer = decltype(tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    std::vector<std::string> words = {"a", "b", "ab"};
+    std::vector<std::string> documents;
+    for (std::size_t i = 0; i < 1000; i++) {
+        std::string document;
+        for (std::size_t j = 0; j < i % 7; j++) {
+            document += words[(i + j) % words.size()] + " ";
+        }
+        documents.push_back(document);
+    }
+
+    thread_pool pool(4);
+    auto batch = TokenizerTraits::encode_batch(tokenizer, documents, pool);
+
+    REQUIRE(batch.size() == documents.size());
+    REQUIRE(batch.offsets.size(0) == documents.size() + 1);
+    REQUIRE(batch.offsets[0] == 0);
+    REQUIRE(std::size_t(batch.offsets[documents.size()]) == batch.ids.size(0));
+
+    for (std::size_t i = 0; i < documents.size(); i++) {
+        auto ids = TokenizerTraits::encode(tokenizer, documents[i]);
+        std::vector<int32_t> expect(ids.begin(), ids.end());
+        std::vector<int32_t> actual(
+            batch.ids.data_ptr() + batch.offsets[i], batch.ids.data_ptr() + batch.offsets[i + 1]
+        );
+        REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+    }
+
+    auto strings = TokenizerTraits::decode_batch(tokenizer, batch, pool);
+    REQUIRE_THAT(strings, Catch::Matchers::Equals(documents));
+}
+
+
+TEST_CASE("Encode with an encoding cache", "[bpe]")
+{
+    text::byte_pair_encoder<char> tokenizer("\\S+|\\s+");
+    tokenizer.insert("a", 0);
+    tokenizer.insert("b", 1);
+    tokenizer.insert("c", 2);
+    tokenizer.insert("ab", 3);
+    tokenizer.insert("abc", 4);
+    tokenizer.insert(" ", 5);
+
+    using Tokenizer = decltype(tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    auto cache = std::make_shared<Tokenizer::cache_type>(1024 * 1024);
+    tokenizer.set_cache(cache);
+
+    for (std::size_t i = 0; i < 3; i++) {
+        auto ids = TokenizerTraits::encode(tokenizer, "abc abcab ab abcab");
+        std::vector<int32_t> actual(ids.begin(), ids.end());
+        std::vector<int32_t> expect = {4, 5, 4, 3, 5, 3, 5, 4, 3};
+        REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+    }
+
+    // The cache is consulted before the vocabulary, so every distinct word misses once,
+    // including words from the vocabulary, and all repeated words hit the cache.
+    auto stats = cache->stats();
+    REQUIRE(stats.misses == 4);
+    REQUIRE(stats.hits == 17);
+    REQUIRE(stats.size == 4);
+}
+
+
+TEST_CASE("Encoding cache eviction", "[bpe]")
+{
+    using Cache = text::encoding_cache<char, int32_t>;
+    Cache cache(Cache::entry_overhead * 16, 1);
+
+    for (int32_t i = 0; i < 100; i++) {
+        std::vector<int32_t> ids = {i, i + 1, i + 2};
+        auto key = std::to_string(i);
+        cache.insert(key, ids.begin(), ids.end());
+
+        std::vector<int32_t> actual;
+        auto output = std::back_inserter(actual);
+        REQUIRE(cache.find(key, output));
+        REQUIRE_THAT(actual, Catch::Matchers::Equals(ids));
+    }
+
+    auto stats = cache.stats();
+    REQUIRE(stats.bytes <= cache.max_bytes());
+    REQUIRE(stats.size < 16);
+    REQUIRE(stats.evictions == 100 - stats.size);
+    REQUIRE(stats.hits == 100);
+
+    std::vector<int32_t> actual;
+    auto output = std::back_inserter(actual);
+    REQUIRE_FALSE(cache.find("0", output));
+    REQUIRE(actual.empty());
+}
+
+
+TEST_CASE("Encode throughput", "[!benchmark][bpe]")
+{
+    auto tokenizer = make_tokenizer();
+    using Tokenizer = decltype(tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    std::string document;
+    while (document.size() < (std::size_t(1) << 20)) {
+        document += "And his name is John Cena. This is debatable topic, isn't it? ";
+        document += "Tokenization of the unbelievably incomprehensible 12345 numbers.\n";
+    }
+
+    BENCHMARK("encode 1MiB document")
+    {
+        return TokenizerTraits::encode(tokenizer, document);
+    };
+
+    auto uncached_tokenizer = tokenizer;
+    uncached_tokenizer.set_cache(nullptr);
+
+    BENCHMARK("encode 1MiB document without cache")
+    {
+        return TokenizerTraits::encode(uncached_tokenizer, document);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto ids = TokenizerTraits::encode(tokenizer, document);
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    auto throughput = double(document.size()) / double(1 << 20) / duration.count();
+    WARN(std::format(
+        "encode: {} bytes, {} tokens, {:.2f} MB/s", document.size(), ids.size(0), throughput
+    ));
+}
+
+
+TEST_CASE("GPT-2 codec throughput", "[!benchmark][gpt2]")
+{
+    text::gpt2_codec codec;
+
+    std::string document;
+    while (document.size() < (std::size_t(4) << 20)) {
+        document += "And his name is John Cena. This is debatable topic, isn't it? ";
+        document += "\t\x80 استاندارد\n";
+    }
+
+    auto encoding = codec.encode(document);
+
+    BENCHMARK("encode 4MiB document")
+    {
+        return codec.encode(document);
+    };
+
+    BENCHMARK("decode 4MiB document")
+    {
+        return codec.decode(encoding);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = codec.encode(document);
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    auto throughput = double(document.size()) / double(1 << 20) / duration.count();
+    WARN(std::format("gpt2 encode: {} bytes, {:.2f} MB/s", document.size(), throughput));
+}
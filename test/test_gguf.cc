@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <fstream>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_string.hpp>
+#include <catch2/matchers/catch_matchers_vector.hpp>
+
+#include <metalchat/gguf.h>
+#include <metalchat/tensor.h>
+
+#include "metalchat/testing.h"
+
+using namespace metalchat;
+
+
+struct gguf_tensor_record {
+    std::string name;
+    std::vector<std::uint64_t> dims;
+    std::uint32_t type;
+    std::uint64_t offset;
+};
+
+
+std::string
+make_gguf_bytes(const std::vector<gguf_tensor_record>& tensors, std::size_t data_size)
+{
+    std::string bytes;
+    auto write = [&](auto value) {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+
+    bytes.append("GGUF");
+    write(std::uint32_t(3));
+    write(std::uint64_t(tensors.size()));
+    write(std::uint64_t(0));
+
+    for (const auto& tensor : tensors) {
+        write(std::uint64_t(tensor.name.size()));
+        bytes.append(tensor.name);
+        write(std::uint32_t(tensor.dims.size()));
+        for (auto dim : tensor.dims) {
+            write(dim);
+        }
+        write(tensor.type);
+        write(tensor.offset);
+    }
+
+    bytes.resize((bytes.size() + 31) / 32 * 32, '\0');
+    bytes.append(data_size, '\x01');
+    return bytes;
+}
+
+
+TEST_CASE("Open GGUF document", "[gguf]")
+{
+    scoped_temp_directory tmpdir("gguf");
+    auto model_path = tmpdir.path() / "model.gguf";
+
+    std::string buffer;
+    auto write = [&](auto value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    auto write_string = [&](std::string_view value) {
+        write(std::uint64_t(value.size()));
+        buffer.append(value);
+    };
+
+    buffer.append("GGUF");
+    write(std::uint32_t(3));
+    write(std::uint64_t(2)); // Number of tensors.
+    write(std::uint64_t(3)); // Number of key-value pairs.
+
+    write_string("general.architecture");
+    write(std::uint32_t(8));
+    write_string("llama");
+
+    write_string("general.alignment");
+    write(std::uint32_t(4));
+    write(std::uint32_t(32));
+
+    write_string("tokenizer.ggml.scores");
+    write(std::uint32_t(9));
+    write(std::uint32_t(6));
+    write(std::uint64_t(2));
+    write(float(0.5));
+    write(float(1.5));
+
+    // The first tensor is a 2x64 matrix of Q8_0 blocks (34 bytes per 32 elements).
+    write_string("layers.0.weight");
+    write(std::uint32_t(2));
+    write(std::uint64_t(64));
+    write(std::uint64_t(2));
+    write(std::uint32_t(8));
+    write(std::uint64_t(0));
+
+    write_string("norm.weight");
+    write(std::uint32_t(1));
+    write(std::uint64_t(3));
+    write(std::uint32_t(0));
+    write(std::uint64_t(160));
+
+    buffer.resize((buffer.size() + 31) / 32 * 32, '\0');
+    for (std::size_t i = 0; i < 136; i++) {
+        buffer.push_back(char(i));
+    }
+    buffer.resize(buffer.size() + 24, '\0');
+
+    float norm[3] = {1.0, 2.0, 3.0};
+    buffer.append(reinterpret_cast<const char*>(norm), sizeof(norm));
+
+    std::ofstream(model_path, std::ios::binary).write(buffer.data(), buffer.size());
+
+    auto doc = gguf_document::open(model_path);
+    REQUIRE(std::distance(doc.begin(), doc.end()) == 2);
+
+    auto& metadata = doc.get_metadata();
+    REQUIRE(metadata.at("general.architecture") == "llama");
+    REQUIRE(metadata.at("general.alignment") == "32");
+    REQUIRE_FALSE(metadata.contains("tokenizer.ggml.scores"));
+
+    auto weight_it = doc.begin();
+    REQUIRE((*weight_it).name() == "layers.0.weight");
+    REQUIRE((*weight_it).dtype() == "Q8_0");
+    REQUIRE_THAT((*weight_it).sizes(), Catch::Matchers::Equals(std::vector<std::size_t>{2, 2, 34}));
+
+    const auto& type = gguf_header::find_type((*weight_it).dtype());
+    REQUIRE(type.block_size == 32);
+    REQUIRE(type.type_size == 34);
+
+    // Quantized blocks are loaded as raw bytes, without copying them.
+    tensor<std::uint8_t, 3> weight;
+    doc.load("layers.0.weight", weight);
+    REQUIRE(weight.numel() == 136);
+    REQUIRE(weight[1, 1, 33] == 135);
+
+    tensor<float, 1> norm_weight;
+    doc.load("norm.weight", norm_weight);
+    REQUIRE(norm_weight.size(0) == 3);
+    REQUIRE(norm_weight[2] == 3.0);
+}
+
+
+TEST_CASE("Parse corrupted GGUF header", "[gguf]")
+{
+    constexpr std::uint32_t f32 = 0, q8_0 = 8, f64 = 28;
+
+    auto bytes = make_gguf_bytes({{"a", {8}, f32, 0}, {"b", {4}, f32, 32}}, 48);
+    auto header = gguf_header(bytes.data(), bytes.size());
+    REQUIRE(header.tensors().size() == 2);
+    REQUIRE(header.tensors()[1].size == 16);
+
+    // Every truncation of the file cuts either a record, or the data of the tensor.
+    for (std::size_t size = 0; size < bytes.size(); size++) {
+        REQUIRE_THROWS_AS(gguf_header(bytes.data(), size), std::runtime_error);
+    }
+
+    const std::vector<std::pair<std::vector<gguf_tensor_record>, std::size_t>> headers = {
+        // Tensors overlap.
+        {{{"a", {16}, f32, 0}, {"b", {8}, f32, 32}}, 96},
+        {{{"a", {8}, f32, 0}, {"b", {8}, f32, 0}}, 64},
+        // Tensor is not aligned.
+        {{{"a", {4}, f32, 4}}, 64},
+        // Size of the tensor in bytes overflows.
+        {{{"a", {1ULL << 31, 1ULL << 31}, f64, 0}}, 64},
+        {{{"a", {1ULL << 63}, q8_0, 0}}, 64},
+        // Number of elements overflows.
+        {{{"a", {1ULL << 32, 1ULL << 32}, f32, 0}}, 64},
+        // Row is not a multiple of the block.
+        {{{"a", {33}, q8_0, 0}}, 64},
+        // Duplicate names.
+        {{{"a", {8}, f32, 0}, {"a", {8}, f32, 32}}, 64},
+    };
+
+    for (const auto& [tensors, data_size] : headers) {
+        auto bytes = make_gguf_bytes(tensors, data_size);
+        REQUIRE_THROWS_AS(gguf_header(bytes.data(), bytes.size()), std::runtime_error);
+    }
+}
+
+
+TEST_CASE("Parse deeply nested GGUF arrays", "[gguf]")
+{
+    auto make_bytes = [](std::size_t depth) {
+        std::string bytes;
+        auto write = [&](auto value) {
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+        bytes.append("GGUF");
+        write(std::uint32_t(3));
+        write(std::uint64_t(1)); // Number of tensors.
+        write(std::uint64_t(1)); // Number of key-value pairs.
+
+        std::string_view key = "tokenizer.ggml.nested";
+        write(std::uint64_t(key.size()));
+        bytes.append(key);
+
+        // Every array contains a single array, the innermost array is an empty array of bytes.
+        write(std::uint32_t(9));
+        for (std::size_t i = 0; i < depth; i++) {
+            write(std::uint32_t(9));
+            write(std::uint64_t(1));
+        }
+        write(std::uint32_t(0));
+        write(std::uint64_t(0));
+
+        std::string_view name = "a";
+        write(std::uint64_t(name.size()));
+        bytes.append(name);
+        write(std::uint32_t(1));
+        write(std::uint64_t(8));
+        write(std::uint32_t(0));
+        write(std::uint64_t(0));
+
+        bytes.resize((bytes.size() + 31) / 32 * 32, '\0');
+        bytes.append(32, '\x01');
+        return bytes;
+    };
+
+    auto bytes = make_bytes(16);
+    auto header = gguf_header(bytes.data(), bytes.size());
+    REQUIRE(header.tensors().size() == 1);
+
+    // Nesting is limited, so that hostile files don't exhaust the stack.
+    bytes = make_bytes(100000);
+    REQUIRE_THROWS_WITH(
+        gguf_header(bytes.data(), bytes.size()),
+        Catch::Matchers::ContainsSubstring("maximum nesting depth exceeded")
+    );
+}
@@ -109,3 +109,43 @@ TEST_CASE("Test filebuf interpreter", "[llama][integration]")
 
     std::cout << interp.read_text() << std::endl;
 }
+
+
+TEST_CASE("Write messages exceeding the context limit", "[llama][integration]")
+{
+    auto repo_path = test_fixture_path() / "meta-llama/Llama-3.2-1B-Instruct/original";
+
+    auto repository = filesystem_repository<reference::llama3>(repo_path);
+    auto options = nn::default_llama3_1b_options();
+    auto tokenizer = repository.retrieve_tokenizer("tokenizer.model");
+    auto transformer = repository.retrieve_transformer("model.safetensors", options);
+
+    std::string content;
+    for (std::size_t i = 0; i < 100; i++) {
+        content += "This is a test sentence. ";
+    }
+
+    auto interp = interpreter(transformer, tokenizer);
+    interp.set_context_limit(64);
+    interp.write(basic_message("system", "You are a helpful assistant."));
+
+    auto context_size = interp.context_size();
+    REQUIRE(context_size < 64);
+    REQUIRE_THROWS_AS(interp.write(basic_message("user", content)), std::invalid_argument);
+    REQUIRE(interp.context_size() == context_size);
+
+    interp.set_context_limit(64, context_overflow::truncate);
+    interp.write(basic_message("user", content));
+
+    // The message is truncated up to the limit, the header of the response is reserved: a
+    // begin and end header tokens, a role and a new line.
+    REQUIRE(interp.context_size() > 64 - 10);
+    REQUIRE(interp.context_size() + 4 <= 64);
+
+    interp.set_token_scanner(testing::make_token_scanner());
+    REQUIRE_NOTHROW(interp.read_text());
+    REQUIRE(interp.context_size() <= 64);
+
+    // A message without room for its header is rejected regardless of the policy.
+    REQUIRE_THROWS_AS(interp.write(basic_message("user", content)), std::invalid_argument);
+}
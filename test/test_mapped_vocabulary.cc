@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <fstream>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_vector.hpp>
+
+#include <metalchat/reference.h>
+#include <metalchat/repository.h>
+#include <metalchat/text/bpe.h>
+#include <metalchat/text/mapped_vocabulary.h>
+
+#include "metalchat/testing.h"
+
+
+using namespace metalchat;
+
+
+TEST_CASE("Compile and open vocabulary", "[bpe]")
+{
+    scoped_temp_directory tmpdir("mapped_vocabulary");
+    auto tokenizer_path = tmpdir.path() / "tokenizer.json";
+    std::ofstream(tokenizer_path) << "{}";
+
+    text::byte_pair_encoder<char> tokenizer("\\S+|\\s+");
+    tokenizer.insert("a", 0);
+    tokenizer.insert("b", 1);
+    tokenizer.insert("c", 2);
+    tokenizer.insert("ab", 3);
+    tokenizer.insert("abc", 4);
+    tokenizer.insert(" ", 5);
+    tokenizer.insert("<|end_of_text|>", 7, text::token::end_text);
+
+    auto stamp = text::mapped_vocabulary::source_stamp::from_file(tokenizer_path);
+    auto compiled_path = text::mapped_vocabulary::compiled_path(tokenizer_path);
+    tokenizer.compile(compiled_path, stamp);
+
+    REQUIRE(compiled_path.extension() == text::mapped_vocabulary::default_extension);
+    REQUIRE(text::mapped_vocabulary::is_current(compiled_path, tokenizer_path));
+
+    auto vocabulary = std::make_shared<text::mapped_vocabulary>(compiled_path);
+    REQUIRE(vocabulary->size() == 7);
+    REQUIRE(vocabulary->regex() == "\\S+|\\s+");
+    REQUIRE(vocabulary->stamp() == stamp);
+    REQUIRE(vocabulary->find("abc") == 4);
+    REQUIRE(vocabulary->find("ba") == std::nullopt);
+    REQUIRE(vocabulary->decode(3) == "ab");
+    REQUIRE(vocabulary->decode(6) == std::nullopt);
+    REQUIRE(vocabulary->find_control(text::token::end_text) == 7);
+
+    text::byte_pair_encoder<char> mapped_tokenizer(vocabulary);
+
+    using Tokenizer = decltype(mapped_tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    auto ids = TokenizerTraits::encode(mapped_tokenizer, "abc abcab ab");
+    std::vector<int32_t> actual(ids.begin(), ids.end());
+    std::vector<int32_t> expect = {4, 5, 4, 3, 5, 3};
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+
+    auto string = TokenizerTraits::decode(mapped_tokenizer, ids.data_ptr(), ids.data_ptr() + 6);
+    REQUIRE(string == "abc abcab ab");
+    REQUIRE(TokenizerTraits::encode(mapped_tokenizer, text::token::end_text) == 7);
+
+    // Tokens that override tokens of the vocabulary are counted once.
+    REQUIRE(mapped_tokenizer.size() == 7);
+    mapped_tokenizer.insert("abc", 4);
+    REQUIRE(mapped_tokenizer.size() == 7);
+    mapped_tokenizer.insert("cab", 8);
+    REQUIRE(mapped_tokenizer.size() == 8);
+
+    // Modification of the tokenizer model makes the compiled vocabulary stale.
+    std::ofstream(tokenizer_path) << "{\"model\": {}}";
+    REQUIRE_FALSE(text::mapped_vocabulary::is_current(compiled_path, tokenizer_path));
+}
+
+
+TEST_CASE("Open corrupted vocabulary", "[bpe]")
+{
+    scoped_temp_directory tmpdir("mapped_vocabulary");
+    auto compiled_path = tmpdir.path() / "tokenizer.mtok";
+    std::ofstream(compiled_path) << "not a compiled vocabulary";
+
+    REQUIRE_THROWS_AS(text::mapped_vocabulary(compiled_path), std::runtime_error);
+}
+
+
+TEST_CASE("Encode with a compiled reference vocabulary", "[bpe][integration]")
+{
+    auto repo_path = test_fixture_path() / "meta-llama/Llama-3.2-1B-Instruct/original";
+    auto repository = filesystem_repository<reference::llama3>(repo_path);
+    auto tokenizer = repository.retrieve_tokenizer("tokenizer.model");
+
+    scoped_temp_directory tmpdir("mapped_vocabulary");
+    auto compiled_path = tmpdir.path() / "tokenizer.mtok";
+    tokenizer.compile(compiled_path, {});
+
+    auto vocabulary = std::make_shared<text::mapped_vocabulary>(compiled_path);
+    text::byte_pair_encoder<char> mapped_tokenizer(vocabulary);
+    REQUIRE(mapped_tokenizer.size() == tokenizer.size());
+
+    using Tokenizer = decltype(tokenizer);
+    using TokenizerTraits = text::tokenizer_traits<Tokenizer>;
+
+    const std::string input = "This is a test sentence, and numbers 12345.";
+    auto expect_ids = TokenizerTraits::encode(tokenizer, input);
+    auto actual_ids = TokenizerTraits::encode(mapped_tokenizer, input);
+
+    std::vector<int32_t> expect(expect_ids.begin(), expect_ids.end());
+    std::vector<int32_t> actual(actual_ids.begin(), actual_ids.end());
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+
+    auto first = actual_ids.data_ptr();
+    auto last = actual_ids.data_ptr() + actual_ids.size(0);
+    REQUIRE(TokenizerTraits::decode(mapped_tokenizer, first, last) == input);
+    REQUIRE(
+        TokenizerTraits::encode(mapped_tokenizer, text::token::end_turn) ==
+        TokenizerTraits::encode(tokenizer, text::token::end_turn)
+    );
+}
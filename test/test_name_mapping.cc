@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <metalchat/name_mapping.h>
+#include <metalchat/safetensor.h>
+#include <metalchat/tensor.h>
+
+
+using namespace metalchat;
+
+
+TEST_CASE("Name mapping apply", "[name_mapping]")
+{
+    name_mapping mapping = {
+        {"model.layers.{n}.mlp.gate_proj", "layers.$1.feed_forward.w1"},
+        {"model.layers.{n}.self_attn.q_proj", "layers.$1.attention.wq"},
+        {"model.norm", "norm"},
+        {"model.{*}.experts.{n}", "$1.moe.$2"},
+    };
+    REQUIRE(mapping.size() == 4);
+
+    auto name = mapping.apply("model.layers.3.mlp.gate_proj.weight");
+    REQUIRE(name == "layers.3.feed_forward.w1.weight");
+    REQUIRE(mapping.apply("model.layers.12.self_attn.q_proj") == "layers.12.attention.wq");
+    REQUIRE(mapping.apply("model.norm.weight") == "norm.weight");
+    REQUIRE(mapping.apply("model.block.experts.7.w1") == "block.moe.7.w1");
+
+    // Patterns match only at component boundaries, unmatched names are kept.
+    REQUIRE(mapping.apply("model.normalize.weight") == "model.normalize.weight");
+    REQUIRE(mapping.apply("model.layers.x.mlp.gate_proj") == "model.layers.x.mlp.gate_proj");
+    REQUIRE(mapping.apply("output.weight") == "output.weight");
+}
+
+
+TEST_CASE("Name mapping match", "[name_mapping]")
+{
+    name_mapping mapping;
+    auto wk = mapping.insert("layers.{n}.attention.wk.weight");
+    auto wq = mapping.insert("layers.{n}.attention.wq.weight");
+
+    auto match = mapping.match("layers.10.attention.wq.weight");
+    REQUIRE(match.has_value());
+    REQUIRE(match->index == wq);
+    REQUIRE(match->captures.size() == 1);
+    REQUIRE(match->captures[0] == "10");
+
+    REQUIRE(mapping.match("layers.1.attention.wk.weight")->index == wk);
+    REQUIRE_FALSE(mapping.match("layers.1.attention.wv.weight").has_value());
+
+    // Patterns without replacement keep names unchanged.
+    REQUIRE(mapping.apply("layers.1.attention.wk.weight") == "layers.1.attention.wk.weight");
+}
+
+
+TEST_CASE("Name mapping invalid patterns", "[name_mapping]")
+{
+    name_mapping mapping;
+    mapping.insert("layers.{n}", "blocks.$1");
+
+    REQUIRE_THROWS_AS(mapping.insert("layers.{n}", "layers.$1"), std::invalid_argument);
+    REQUIRE_THROWS_AS(mapping.insert("layers.{x}", "layers"), std::invalid_argument);
+    REQUIRE_THROWS_AS(mapping.insert("norm.{n}", "norm.$2"), std::invalid_argument);
+    REQUIRE_THROWS_AS(mapping.insert("", "norm"), std::invalid_argument);
+}
+
+
+TEST_CASE("Rename safetensor document with name mapping", "[name_mapping]")
+{
+    safetensor_document document;
+    document.insert("model.layers.0.mlp.up_proj.weight", rand<float>({4, 8}));
+    document.insert("model.layers.1.mlp.up_proj.weight", rand<float>({4, 8}));
+    document.insert("model.embed_tokens.weight", rand<float>({16, 4}));
+
+    name_mapping mapping = {
+        {"model.layers.{n}.mlp.up_proj", "layers.$1.feed_forward.w3"},
+        {"model.embed_tokens", "tok_embeddings"},
+    };
+
+    auto doc = document.rename(mapping);
+
+    std::vector<std::string> names;
+    for (auto it = doc.begin(); it != doc.end(); ++it) {
+        names.push_back((*it).name());
+    }
+
+    REQUIRE(names.size() == 3);
+    REQUIRE(names[0] == "layers.0.feed_forward.w3.weight");
+    REQUIRE(names[1] == "layers.1.feed_forward.w3.weight");
+    REQUIRE(names[2] == "tok_embeddings.weight");
+
+    tensor<float, 2> weight;
+    doc.load("tok_embeddings.weight", weight);
+    REQUIRE(weight.size(0) == 16);
+}
@@ -5,7 +5,9 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 
+#include <numeric>
 #include <sstream>
+#include <vector>
 
 #include <metalchat/reference.h>
 
@@ -43,3 +45,81 @@ TEST_CASE("Test llama3 options serializer", "[reference]")
     REQUIRE_THAT(options.rope_theta, WithinRel(500000.0, 0.01));
     REQUIRE_THAT(options.norm_eps, WithinRel(1e-5, 0.01));
 }
+
+
+TEST_CASE("Permute attention rows", "[reference]")
+{
+    const std::size_t n_heads = 4;
+    const std::size_t attention_heads = 33;
+    const std::size_t rows = n_heads * attention_heads * 2;
+    const std::size_t cols = 5;
+
+    std::vector<std::int32_t> input(rows * cols);
+    std::iota(input.begin(), input.end(), 0);
+
+    std::vector<std::int32_t> output(rows * cols, -1);
+    thread_pool pool(3);
+
+    auto row_size = cols * sizeof(std::int32_t);
+    nn::permute_attention_rows(input.data(), output.data(), rows, row_size, n_heads, pool);
+
+    // Rows of the input are viewed as [n_heads, attention_heads, 2] and transposed
+    // to [n_heads, 2, attention_heads].
+    for (std::size_t i = 0; i < n_heads; i++) {
+        for (std::size_t j = 0; j < attention_heads; j++) {
+            for (std::size_t k = 0; k < 2; k++) {
+                auto input_row = (i * attention_heads + j) * 2 + k;
+                auto output_row = (i * 2 + k) * attention_heads + j;
+
+                for (std::size_t c = 0; c < cols; c++) {
+                    REQUIRE(output[output_row * cols + c] == input[input_row * cols + c]);
+                }
+            }
+        }
+    }
+
+    REQUIRE_THROWS_AS(
+        nn::permute_attention_rows(input.data(), output.data(), rows, row_size, 5, pool),
+        std::invalid_argument
+    );
+}
+
+
+TEST_CASE("Permute attention rows of large heads", "[reference]")
+{
+    // Rows are large, so that rows of every head are copied in several blocks, and the
+    // last block of every head is incomplete.
+    const std::size_t n_heads = 3;
+    const std::size_t head_dim = 10;
+    const std::size_t rows = n_heads * head_dim;
+    const std::size_t cols = 16 * 1024;
+
+    std::vector<std::int32_t> input(rows * cols);
+    std::iota(input.begin(), input.end(), 0);
+
+    std::vector<std::int32_t> output(rows * cols, -1);
+    thread_pool pool(4);
+
+    auto row_size = cols * sizeof(std::int32_t);
+    nn::permute_attention_rows(input.data(), output.data(), rows, row_size, n_heads, pool);
+
+    // The baseline reshapes the input to [n_heads, head_dim / 2, 2, cols], transposes
+    // the two middle dimensions, and copies elements in the order of the transposed view.
+    const std::size_t shape[4] = {n_heads, 2, head_dim / 2, cols};
+    const std::size_t strides[4] = {head_dim * cols, cols, 2 * cols, 1};
+
+    std::vector<std::int32_t> expect;
+    expect.reserve(rows * cols);
+    for (std::size_t i0 = 0; i0 < shape[0]; i0++) {
+        for (std::size_t i1 = 0; i1 < shape[1]; i1++) {
+            for (std::size_t i2 = 0; i2 < shape[2]; i2++) {
+                for (std::size_t i3 = 0; i3 < shape[3]; i3++) {
+                    auto offset = i0 * strides[0] + i1 * strides[1] + i2 * strides[2] + i3;
+                    expect.push_back(input[offset]);
+                }
+            }
+        }
+    }
+
+    REQUIRE(output == expect);
+}
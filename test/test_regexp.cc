@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_vector.hpp>
+
+#include <metalchat/reference.h>
+#include <metalchat/text/pretokenizer.h>
+#include <metalchat/text/regexp.h>
+
+
+using namespace metalchat;
+
+
+TEST_CASE("Regexp iterate over matches", "[regexp]")
+{
+    text::regexp re(std::string(reference::llama3_tokenizer_loader::default_regex));
+
+    std::vector<std::string> actual;
+    for (auto it = re.begin("This is a test sentence."); it != re.end(); ++it) {
+        actual.push_back(*it);
+    }
+
+    std::vector<std::string> expect = {"This", " is", " a", " test", " sentence", "."};
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+}
+
+
+TEST_CASE("Regexp iterate over views", "[regexp]")
+{
+    text::regexp re(std::string(reference::llama3_tokenizer_loader::default_regex));
+    std::string input = "I'm 12345 words\n\n  long";
+
+    std::vector<std::string_view> actual;
+    std::vector<std::size_t> positions;
+    for (auto it = re.view_begin(input); it != re.view_end(); ++it) {
+        auto match = *it;
+        REQUIRE(match.data() >= input.data());
+        REQUIRE(match.data() + match.size() <= input.data() + input.size());
+
+        actual.push_back(match);
+        positions.push_back(it.position());
+    }
+
+    std::vector<std::string_view> expect = {
+        "I", "'m", " ", "123", "45", " words", "\n\n", " ", " long",
+    };
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+
+    std::vector<std::size_t> expect_positions = {0, 1, 3, 4, 7, 9, 15, 17, 18};
+    REQUIRE_THAT(positions, Catch::Matchers::Equals(expect_positions));
+}
+
+
+TEST_CASE("Regexp skip empty matches", "[regexp]")
+{
+    text::regexp re("a*");
+    std::string input = "baab";
+
+    std::vector<std::string_view> actual;
+    for (auto it = re.view_begin(input); it != re.view_end(); ++it) {
+        actual.push_back(*it);
+    }
+
+    std::vector<std::string_view> expect = {"aa"};
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+}
+
+
+TEST_CASE("Regexp interleaved iterators", "[regexp]")
+{
+    text::regexp re0("\\d+");
+    text::regexp re1("[a-z]+");
+    std::string input = "ab12cd34";
+
+    auto it0 = re0.view_begin(input);
+    auto it1 = re1.view_begin(input);
+
+    REQUIRE(*it0 == "12");
+    REQUIRE(*it1 == "ab");
+    ++it1;
+    REQUIRE(*it0 == "12");
+    REQUIRE(*it1 == "cd");
+    ++it0;
+    REQUIRE(*it0 == "34");
+    ++it0;
+    REQUIRE_FALSE(it0 != re0.view_end());
+}
+
+
+TEST_CASE("Regexp invalid expression", "[regexp]")
+{
+    REQUIRE_THROWS_AS(text::regexp("(abc"), std::invalid_argument);
+}
+
+
+template <typename RegularExpression>
+std::vector<std::string_view>
+split(const RegularExpression& re, std::string_view input)
+{
+    std::vector<std::string_view> output;
+    for (auto it = re.view_begin(input); it != re.view_end(); ++it) {
+        output.push_back(*it);
+    }
+    return output;
+}
+
+
+TEST_CASE("Pre-tokenizer matches the split expression", "[regexp]")
+{
+    // Wrap the pattern into a non-capturing group, so that regexp does not replace
+    // the expression with the pre-tokenizer.
+    auto pattern = std::string(text::llama3_pretokenizer::pattern);
+    text::regexp re("(?:" + pattern + ")");
+    text::llama3_pretokenizer pretokenizer(pattern);
+
+    std::string alphabet = "aAzZ09 '\t\n\r\v.,!?sStTlLeEdDmMrRvV";
+    alphabet += "\x85\xa0\xaa\xb2\xc3\xd7\xe9\xff";
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<std::size_t> choice(0, alphabet.size() - 1);
+    std::uniform_int_distribution<std::size_t> length(1, 48);
+
+    for (std::size_t i = 0; i < 10000; i++) {
+        std::string input(length(generator), ' ');
+        for (auto& c : input) {
+            c = alphabet[choice(generator)];
+        }
+
+        REQUIRE_THAT(split(pretokenizer, input), Catch::Matchers::Equals(split(re, input)));
+    }
+}
+
+
+TEST_CASE("Pre-tokenizer split string", "[regexp]")
+{
+    text::llama3_pretokenizer pretokenizer;
+    auto actual = split(pretokenizer, "Don't stop\r\n\r\n   123456 words");
+    std::vector<std::string_view> expect = {
+        "Don", "'t", " stop", "\r\n\r\n", "  ", " ", "123", "456", " words",
+    };
+    REQUIRE_THAT(actual, Catch::Matchers::Equals(expect));
+
+    REQUIRE_THROWS_AS(text::llama3_pretokenizer("\\s+"), std::invalid_argument);
+}
+
+
+TEST_CASE("Pre-tokenizer benchmark", "[!benchmark][regexp]")
+{
+    auto pattern = std::string(text::llama3_pretokenizer::pattern);
+    text::regexp re("(?:" + pattern + ")");
+    text::llama3_pretokenizer pretokenizer;
+
+    std::string document;
+    while (document.size() < (std::size_t(1) << 20)) {
+        document += "And his name is John Cena. This is debatable topic, isn't it? ";
+        document += "Tokenization of the unbelievably incomprehensible 12345 numbers.\n";
+    }
+
+    BENCHMARK("regexp split 1MiB document")
+    {
+        return split(re, document).size();
+    };
+
+    BENCHMARK("pre-tokenizer split 1MiB document")
+    {
+        return split(pretokenizer, document).size();
+    };
+}
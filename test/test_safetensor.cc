@@ -5,6 +5,7 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_vector.hpp>
 #include <jsoncons/json.hpp>
+#include <rapidhash.h>
 
 #include <metalchat/accelerator.h>
 #include <metalchat/functional.h>
@@ -20,43 +21,16 @@ using namespace metalchat;
 JSONCONS_ALL_MEMBER_TRAITS(safetensor_index, metadata, weight_map);
 
 
-struct scoped_temp_directory {
-private:
-    std::filesystem::path _M_name;
-
-    static std::string
-    random_string(std::size_t n, std::size_t alphabet_size = 16)
-    {
-        std::random_device rd;
-        std::mt19937 generator(rd());
-        std::uniform_int_distribution<std::size_t> distribution(0, alphabet_size);
-
-        std::string result(n, '0');
-        std::generate_n(result.begin(), n, [&]() { return distribution(generator) + 'a'; });
-
-        return result;
-    }
-
-public:
-    scoped_temp_directory(std::string prefix)
-    : _M_name(std::filesystem::temp_directory_path() / prefix / random_string(16))
-    {
-        std::filesystem::create_directories(_M_name);
-    }
-
-    std::filesystem::path
-    path() const
-    {
-        return _M_name;
-    }
+std::string
+make_safetensor_bytes(const std::string& header, std::size_t data_size)
+{
+    uint64_t header_size = header.size();
 
-    ~scoped_temp_directory()
-    {
-        if (_M_name != "" && _M_name != "/") {
-            REQUIRE(std::filesystem::remove_all(_M_name) > 0);
-        }
-    }
-};
+    std::string bytes(reinterpret_cast<const char*>(&header_size), sizeof(header_size));
+    bytes += header;
+    bytes += std::string(data_size, '\x01');
+    return bytes;
+}
 
 
 TEST_CASE("Test model load", "[safetensor][integration]")
@@ -196,3 +170,662 @@ TEST_CASE("Test sharded document", "[safetensor]")
 
     REQUIRE(size == 2);
 }
+
+
+TEST_CASE("Parse safetensor header in place", "[safetensor]")
+{
+    auto header = R"({
+        "__metadata__": {"format": "pt"},
+        "layers.1.weight": {"dtype": "F32", "shape": [2, 3], "data_offsets": [4, 28]},
+        "layers.0.weight": {"dtype": "U8", "shape": [4], "data_offsets": [0, 4]},
+        "layers.0.bias": {"dtype": "BF16", "shape": [], "data_offsets": [28, 30], "x": [{}]}
+    }  )";
+    auto bytes = make_safetensor_bytes(header, 30);
+    auto view = safetensor_header_view(bytes.data(), bytes.size());
+
+    REQUIRE(view.data_offset() == 8 + std::string_view(header).size());
+    REQUIRE(view.data_size() == 30);
+    REQUIRE(view.tensors().size() == 3);
+
+    const auto& tensors = view.tensors();
+    REQUIRE(tensors[0].name == "layers.0.weight");
+    REQUIRE(tensors[1].name == "layers.1.weight");
+    REQUIRE(tensors[2].name == "layers.0.bias");
+    REQUIRE(tensors[1].dtype == "F32");
+    REQUIRE(tensors[1].size() == 24);
+
+    std::vector<std::size_t> shape(tensors[1].shape.begin(), tensors[1].shape.end());
+    REQUIRE(shape == std::vector<std::size_t>{2, 3});
+    REQUIRE(tensors[2].shape.empty());
+
+    // Names without escape sequences are views into the parsed buffer.
+    REQUIRE(tensors[1].name.data() >= bytes.data());
+    REQUIRE(tensors[1].name.data() < bytes.data() + bytes.size());
+
+    REQUIRE(view.metadata().size() == 1);
+    REQUIRE(view.metadata()[0].first == "format");
+    REQUIRE(view.metadata()[0].second == "pt");
+}
+
+
+TEST_CASE("Parse corrupted safetensor header", "[safetensor]")
+{
+    auto tensor = [](std::string offsets, std::string shape = "[1]", std::string dtype = "U8") {
+        return std::format(
+            R"({{"dtype": "{}", "shape": {}, "data_offsets": {}}})", dtype, shape, offsets
+        );
+    };
+
+    const std::vector<std::pair<std::string, std::size_t>> headers = {
+        {"", 0},
+        {"{", 0},
+        {"[]", 0},
+        {R"({"a": 1})", 0},
+        {R"({"a": {"dtype": "U8"}})", 1},
+        {R"({"a": )" + tensor("[0, 1]") + "} trailing", 1},
+        {R"({"a": )" + tensor("[0, 2]") + "}", 1},
+        {R"({"a": )" + tensor("[1, 0]") + "}", 1},
+        {R"({"a": )" + tensor("[0, 1]", "[2]") + "}", 1},
+        {R"({"a": )" + tensor("[0, 1]", "[1]", "Q4") + "}", 1},
+        {R"({"a": )" + tensor("[0, 1]", "[-1]") + "}", 1},
+        {R"({"a": )" + tensor("[0, 1]", "[99999999999999999999999]") + "}", 1},
+        {R"({"a": )" + tensor("[1, 2]") + "}", 2},
+        {R"({"a": )" + tensor("[0, 1]") + R"(, "a": )" + tensor("[1, 2]") + "}", 2},
+        {R"({"a": )" + tensor("[0, 1]") + R"(, "b": )" + tensor("[0, 1]") + "}", 1},
+        {R"({"a\x": )" + tensor("[0, 1]") + "}", 1},
+        {R"({"\ud800": )" + tensor("[0, 1]") + "}", 1},
+        {R"({"a": {"x": )" + std::string(1000, '[') + "}}", 1},
+    };
+
+    for (const auto& [header, data_size] : headers) {
+        auto bytes = make_safetensor_bytes(header, data_size);
+        REQUIRE_THROWS_AS(safetensor_header_view(bytes.data(), bytes.size()), std::runtime_error);
+    }
+
+    // Size of the header exceeds the size of the file.
+    auto bytes = make_safetensor_bytes("{}", 0);
+    bytes[4] = '\x01';
+    REQUIRE_THROWS_AS(safetensor_header_view(bytes.data(), bytes.size()), std::runtime_error);
+    REQUIRE_THROWS_AS(safetensor_header_view(bytes.data(), 4), std::runtime_error);
+}
+
+
+TEST_CASE("Open safetensor document with a parsed header", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+
+    auto header = std::format(
+        R"({{"__metadata__": {{"format": "pt"}}, "b": {{"dtype": "F32", "shape": [2], )"
+        R"("data_offsets": [4, 12]}}, "a": {{"dtype": "U8", "shape": [4], )"
+        R"("data_offsets": [0, 4]}}}})"
+    );
+    std::ofstream(model_path, std::ios::binary) << make_safetensor_bytes(header, 12);
+
+    auto doc = safetensor_document::open(model_path);
+    REQUIRE(doc.offsets() == std::vector<std::size_t>{0, 4});
+    REQUIRE(doc.sizes() == std::vector<std::size_t>{4, 8});
+    REQUIRE(doc.get_metadata().at("format") == "pt");
+
+    auto first = *doc.begin();
+    REQUIRE(first.name() == "a");
+    REQUIRE(first.dtype() == "U8");
+    REQUIRE(static_cast<uint8_t*>(first.container_ptr()->data_ptr())[0] == 1);
+}
+
+
+TEST_CASE("Open safetensor document with memory map options", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+
+    safetensor_document document;
+    document.insert("weight", rand<float>({64, 64}));
+    document.save(model_path);
+
+    auto options = memory_map_options{.hugepage = true, .populate = true};
+    auto doc = safetensor_document::open(model_path, options, random_memory_allocator<void>());
+
+    tensor<float, 2> weight;
+    doc.load("weight", weight);
+    REQUIRE(weight.size(0) == 64);
+
+    // Regular files are never backed by the reserved huge pages, the mapping falls back.
+    basic_memfile file(model_path);
+    file.declare_mapped(options);
+    REQUIRE(file.map_mode().pages != memory_page_kind::hugetlb);
+    REQUIRE(file.is_mapped());
+
+    file.undeclare_mapped();
+    REQUIRE(file.map_mode().pages == memory_page_kind::normal);
+    REQUIRE_FALSE(file.map_mode().populate_requested);
+}
+
+
+TEST_CASE("Open sharded document in parallel", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("sharded_safetensor");
+    auto index_path = tmpdir.path() / "tensors.safetensors.index.json";
+
+    safetensor_index index;
+    for (std::size_t i = 0; i < 6; i++) {
+        auto path = tmpdir.path() / std::format("tensors-{:04}-of-0006.safetensors", i + 1);
+
+        safetensor_document document;
+        document.insert(std::format("tensor{}.weight", i), rand<float>({i + 1, 3}));
+        document.insert(std::format("tensor{}.bias", i), rand<float>({3}));
+        document.save(path);
+
+        index.weight_map.insert_or_assign(std::format("tensor{}.weight", i), path.string());
+        index.weight_map.insert_or_assign(std::format("tensor{}.bias", i), path.string());
+    }
+
+    std::ofstream index_file(index_path);
+    jsoncons::encode_json<safetensor_index>(index, index_file);
+    index_file.close();
+
+    auto alloc = nocopy_allocator(random_memory_allocator<void>());
+    auto expect = sharded_safetensor_document::open(index_path, alloc);
+
+    thread_pool pool(3);
+    std::vector<safetensor_shard_timing> timings;
+    auto callback = [&](const safetensor_shard_timing& timing) { timings.push_back(timing); };
+    auto actual = sharded_safetensor_document::open(index_path, alloc, pool, -1, callback);
+
+    REQUIRE(std::distance(actual.begin(), actual.end()) == 12);
+    REQUIRE(actual.offsets() == expect.offsets());
+    REQUIRE(actual.sizes() == expect.sizes());
+
+    for (auto it = actual.begin(), exp = expect.begin(); it != actual.end(); ++it, ++exp) {
+        REQUIRE((*it).name() == (*exp).name());
+    }
+
+    REQUIRE(timings.size() == 6);
+    for (std::size_t i = 0; i < timings.size(); i++) {
+        REQUIRE(timings[i].index == i);
+        REQUIRE(timings[i].tensor_count == 2);
+        REQUIRE(timings[i].size == (i + 2) * 3 * sizeof(float));
+    }
+}
+
+
+TEST_CASE("Warm up safetensor document", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+
+    safetensor_document document;
+    document.insert("layers.10.weight", rand<float>({64, 1024}));
+    document.insert("layers.2.weight", rand<float>({64, 1024}));
+    document.insert("tok_embeddings.weight", rand<float>({128, 1024}));
+    document.save(model_path);
+
+    auto doc = safetensor_document::open(model_path);
+    auto sizes = doc.sizes();
+    auto size = std::accumulate(sizes.begin(), sizes.end(), std::size_t(0));
+
+    // Tensors sharing the same container are touched only once.
+    doc.insert("output.weight", "tok_embeddings.weight");
+
+    thread_pool pool(2);
+    safetensor_warmup_options options;
+    options.order = {"tok_embeddings", "layers."};
+    options.chunk_size = 4096;
+
+    auto warmup = safetensor_warmup(doc, pool, options);
+    warmup.wait();
+
+    REQUIRE(warmup.done());
+    REQUIRE(warmup.size() == size);
+    REQUIRE(warmup.touched_size() == size);
+    REQUIRE(warmup.progress() == 1.0f);
+    REQUIRE(warmup.resident_size() > 0);
+    REQUIRE(warmup.resident_size() <= size);
+
+    // Tensors are touched in the order of prefixes, and the tied output is touched only once.
+    std::vector<std::string> names = {
+        "tok_embeddings.weight", "layers.2.weight", "layers.10.weight"
+    };
+    REQUIRE_THAT(warmup.names(), Catch::Matchers::Equals(names));
+}
+
+
+TEST_CASE("Warm up weights loaded by a serializer", "[safetensor]")
+{
+    struct model : public nn::basic_layer {
+        model(hardware_accelerator& accelerator)
+        : nn::basic_layer(accelerator)
+        {
+            register_layer<linear_layer<float>>("input", rand<float>({10, 20}));
+            register_layer<linear_layer<float>>("norm", rand<float>({10, 20}));
+            register_layer<linear_layer<float>>("output", rand<float>({10, 20}));
+        }
+    };
+
+    struct serializer : public basic_safetensor_serializer<serializer> {
+        static constexpr std::string_view compiled_layout = "test.1";
+
+        hardware_accelerator accelerator;
+
+        serializer(hardware_accelerator& accelerator)
+        : basic_safetensor_serializer<serializer>({"output", "input"}),
+          accelerator(accelerator)
+        {}
+
+        nn::indirect_layer<model>
+        load(safetensor_document& document)
+        {
+            start_warmup(document);
+
+            auto layer = make_layer();
+            document.load(layer);
+            return layer;
+        }
+
+        nn::indirect_layer<model>
+        make_layer()
+        {
+            return nn::indirect_layer<model>(accelerator);
+        }
+    };
+
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+
+    hardware_accelerator accelerator;
+    nn::indirect_layer<model> model_out(accelerator);
+    safetensor_document::save(model_path, model_out);
+
+    auto document = safetensor_document::open(model_path);
+    serializer model_serializer(accelerator);
+
+    model_serializer.load(document);
+    REQUIRE_FALSE(model_serializer.warmup().has_value());
+
+    // Tensors are touched in the order of the architecture by default, a single thread
+    // touches tensors strictly in this order.
+    model_serializer.set_warmup(thread_pool(1));
+    model_serializer.load(document);
+
+    auto warmup = model_serializer.warmup();
+    REQUIRE(warmup.has_value());
+    warmup->wait();
+
+    std::vector<std::string> names = {"output.weight", "input.weight", "norm.weight"};
+    REQUIRE_THAT(warmup->names(), Catch::Matchers::Equals(names));
+    REQUIRE(warmup->touched_size() == warmup->size());
+
+    // The order specified in options takes precedence over the order of the architecture.
+    safetensor_warmup_options options;
+    options.order = {"norm"};
+    model_serializer.set_warmup(thread_pool(1), options);
+    model_serializer.load(document);
+
+    warmup = model_serializer.warmup();
+    warmup->wait();
+
+    names = {"norm.weight", "input.weight", "output.weight"};
+    REQUIRE_THAT(warmup->names(), Catch::Matchers::Equals(names));
+
+    // The model loaded from the compiled document is warmed up in the same order.
+    auto compiled_path = compiled_safetensor::compiled_path(model_path);
+    model_serializer.compile(document, compiled_path, model_path);
+    REQUIRE(model_serializer.is_compiled(compiled_path, model_path));
+    REQUIRE(compiled_safetensor::is_current(compiled_path, model_path, "test.1"));
+
+    auto compiled_document = safetensor_document::open(compiled_path);
+    auto model_in = model_serializer.load_compiled(compiled_document);
+    REQUIRE(model_in.parameter("norm.weight").container_ptr() != nullptr);
+
+    warmup = model_serializer.warmup();
+    warmup->wait();
+    REQUIRE_THAT(warmup->names(), Catch::Matchers::Equals(names));
+}
+
+
+TEST_CASE("Save safetensor document concurrently", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+
+    auto bias = rand<float>({3});
+    auto weight = rand<float>({64, 1024});
+    auto embedding = rand<float>({128, 64});
+
+    safetensor_document document;
+    document.insert("bias", bias);
+    document.insert("weight", weight);
+    document.insert("embedding", embedding);
+    document.get_metadata().insert_or_assign("format", "pt");
+
+    thread_pool pool(3);
+    safetensor_save_options options;
+    options.alignment = 4096;
+    options.hash = true;
+    options.chunk_size = 4096;
+
+    document.save(model_path, pool, options);
+
+    auto file = std::make_shared<basic_memfile>(model_path);
+    file->declare_mapped();
+
+    auto header = safetensor_header_view(file->data(), file->size());
+    REQUIRE(header.data_offset() % options.alignment == 0);
+
+    // Tensors with aligned sizes are written first, the bias is written last.
+    const auto& tensors = header.tensors();
+    REQUIRE(tensors.size() == 3);
+    REQUIRE(tensors[0].name == "weight");
+    REQUIRE(tensors[1].name == "embedding");
+    REQUIRE(tensors[2].name == "bias");
+
+    auto doc = safetensor_document::open(model_path);
+    auto& metadata = doc.get_metadata();
+    REQUIRE(metadata.at("format") == "pt");
+
+    auto check = [&](const std::string& name, tensor<float, 2>& expect) {
+        tensor<float, 2> actual;
+        doc.load(name, actual);
+
+        auto size = expect.numel() * sizeof(float);
+        REQUIRE(std::memcmp(actual.data_ptr(), expect.data_ptr(), size) == 0);
+
+        auto hash = std::format("{:016x}", rapidhash(expect.data_ptr(), size));
+        REQUIRE(metadata.at(safetensor_save_options::hash_key(name)) == hash);
+    };
+
+    check("weight", weight);
+    check("embedding", embedding);
+}
+
+
+TEST_CASE("Verify safetensor document", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+    auto cache_path = tmpdir.path() / "model.safetensors.rapidhash";
+
+    safetensor_document document;
+    document.insert("layers.0.weight", rand<float>({64, 1024}));
+    document.insert("layers.1.weight", rand<float>({64, 1024}));
+    document.insert("norm.weight", rand<float>({1024}));
+
+    thread_pool pool(2);
+    safetensor_save_options save_options;
+    save_options.hash = true;
+    document.save(model_path, pool, save_options);
+
+    auto doc = safetensor_document::open(model_path);
+    REQUIRE(doc.hash(pool).size() == 3);
+
+    auto verification = safetensor_verification(model_path, doc, pool);
+    REQUIRE_FALSE(verification.cached());
+    REQUIRE(verification.done());
+    REQUIRE(verification.verified_size() == 3);
+    REQUIRE(verification.unverified().empty());
+    REQUIRE(verification.verify("norm.weight"));
+    REQUIRE(std::filesystem::exists(cache_path));
+
+    // Hashes of the same file are restored from the cache.
+    auto cached_verification = safetensor_verification(model_path, doc, pool);
+    REQUIRE(cached_verification.cached());
+    REQUIRE(cached_verification.verified_size() == 3);
+
+    // Tensors of lazily opened documents are acquired only while they are hashed, so
+    // layers are evicted, when the budget is smaller than two layers.
+    auto layer_size = 64 * 1024 * sizeof(float);
+    residency_manager residency(layer_size + layer_size / 2);
+    auto lazy_doc = safetensor_document::open(model_path, residency);
+    REQUIRE(lazy_doc.hash(pool) == doc.hash(pool));
+
+    safetensor_verification_options lazy_options;
+    lazy_options.cache_path = tmpdir.path() / "lazy.rapidhash";
+
+    auto residency_verification = safetensor_verification(model_path, lazy_doc, pool, lazy_options);
+    REQUIRE(residency_verification.verified_size() == 3);
+    REQUIRE(residency.stats().evictions > 0);
+    REQUIRE(residency.stats().resident_size <= residency.budget());
+
+    // Corrupt the last byte of the file (the last byte of the last tensor).
+    std::filesystem::remove(cache_path);
+    {
+        std::fstream model_file(model_path, std::ios::in | std::ios::out | std::ios::binary);
+        model_file.seekp(-1, std::ios::end);
+        model_file.put('\xff');
+        model_file.seekp(-2, std::ios::end);
+        model_file.put('\x00');
+    }
+
+    auto corrupted_doc = safetensor_document::open(model_path);
+    REQUIRE_THROWS_AS(
+        safetensor_verification(model_path, corrupted_doc, pool), std::runtime_error
+    );
+    REQUIRE_FALSE(std::filesystem::exists(cache_path));
+
+    safetensor_verification_options options;
+    options.lazy = true;
+
+    auto lazy_verification = safetensor_verification(model_path, corrupted_doc, pool, options);
+    REQUIRE_THROWS_AS(lazy_verification.wait(), std::runtime_error);
+    REQUIRE(lazy_verification.done());
+    REQUIRE(lazy_verification.corrupted().size() == 1);
+
+    auto corrupted_name = lazy_verification.corrupted().front();
+    REQUIRE_THROWS_AS(lazy_verification.verify(corrupted_name), std::runtime_error);
+    REQUIRE_FALSE(std::filesystem::exists(cache_path));
+}
+
+
+TEST_CASE("Verify safetensor document without stored hashes", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+
+    safetensor_document document;
+    document.insert("layers.0.weight", rand<float>({64, 1024}));
+    document.insert("norm.weight", rand<float>({1024}));
+    document.save(model_path);
+
+    thread_pool pool(2);
+    auto doc = safetensor_document::open(model_path);
+
+    // Tensors without expected hashes are hashed, but they are never reported as verified.
+    safetensor_verification_options options;
+    options.cache_path = tmpdir.path() / "unverified.rapidhash";
+
+    auto verification = safetensor_verification(model_path, doc, pool, options);
+    REQUIRE(verification.done());
+    REQUIRE(verification.verified_size() == 0);
+    REQUIRE(verification.corrupted().empty());
+    REQUIRE_FALSE(verification.verify("norm.weight"));
+    REQUIRE_THAT(
+        verification.unverified(),
+        Catch::Matchers::UnorderedEquals(std::vector<std::string>{"layers.0.weight", "norm.weight"})
+    );
+
+    // Hashes recorded from a trusted source (e.g. when the model was downloaded) verify
+    // documents that don't store hashes in the metadata.
+    auto hashes = doc.hash(pool);
+    auto hash = hashes.begin();
+    for (auto it = doc.begin(); it != doc.end(); ++it, ++hash) {
+        options.expected_hashes.insert_or_assign((*it).name(), *hash);
+    }
+
+    auto trusted_verification = safetensor_verification(model_path, doc, pool, options);
+    REQUIRE(trusted_verification.cached());
+    REQUIRE(trusted_verification.verified_size() == 2);
+    REQUIRE(trusted_verification.unverified().empty());
+    REQUIRE(trusted_verification.verify("norm.weight"));
+
+    // Cached hashes that don't match the expected hashes are not trusted.
+    auto& norm_hash = options.expected_hashes.at("norm.weight");
+    norm_hash = ~norm_hash;
+    REQUIRE_THROWS_AS(safetensor_verification(model_path, doc, pool, options), std::runtime_error);
+}
+
+
+TEST_CASE("Open safetensor document lazily", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+
+    auto weight0 = rand<float>({64, 1024});
+    auto weight1 = rand<float>({64, 1024});
+    auto layer_size = weight0.numel() * sizeof(float);
+
+    safetensor_document document;
+    document.insert("layers.0.attention.weight", weight0);
+    document.insert("layers.1.attention.weight", weight1);
+    document.insert("norm.weight", rand<float>({1024}));
+    document.save(model_path);
+
+    residency_manager residency(layer_size + layer_size / 2);
+    auto doc = safetensor_document::open(model_path, residency);
+    REQUIRE(residency.stats().resident_size == 0);
+
+    using tensor_type = tensor<float, 2, filebuf_memory_container<float>>;
+    tensor_type layer0, layer1;
+    doc.load("layers.0.attention.weight", layer0);
+    doc.load("layers.1.attention.weight", layer1);
+
+    auto equal = [&](tensor_type& lazy, auto& expect) {
+        return std::memcmp(lazy.data_ptr(), expect.data_ptr(), layer_size) == 0;
+    };
+
+    // Layers don't fit into the budget together, but plain accesses never evict layers, so
+    // the pointer to the first layer remains valid while the second layer is read.
+    auto data0 = layer0.data_ptr();
+    REQUIRE(equal(layer1, weight1));
+    REQUIRE(std::memcmp(data0, weight0.data_ptr(), layer_size) == 0);
+    REQUIRE(equal(layer0, weight0));
+
+    auto stats = residency.stats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 2);
+    REQUIRE(stats.evictions == 0);
+    REQUIRE(stats.resident_size == 2 * layer_size);
+    REQUIRE(stats.peak_size == 2 * layer_size);
+
+    // Least recently used layers are evicted on acquire, acquired layers are not evicted.
+    layer0.container().unpark();
+    REQUIRE(residency.stats().evictions == 1);
+    REQUIRE(residency.stats().resident_size == layer_size);
+    REQUIRE(equal(layer0, weight0));
+    REQUIRE(equal(layer1, weight1));
+    layer0.container().park();
+
+    stats = residency.stats();
+    REQUIRE(stats.hits >= 2);
+    REQUIRE(stats.misses == 3);
+    REQUIRE(stats.evictions == 2);
+    REQUIRE(stats.resident_size == layer_size);
+
+    residency.park();
+    REQUIRE(residency.stats().resident_size == 0);
+
+    // Offset views share the residency manager, so the access maps the layer again.
+    using container_type = filebuf_memory_container<float>;
+    auto container_ptr = std::dynamic_pointer_cast<container_type>(layer1.container_ptr());
+    auto view = container_traits<container_type>::offset(container_ptr, sizeof(float));
+    REQUIRE(view->data()[0] == weight1.data_ptr()[1]);
+    REQUIRE(residency.stats().misses == 4);
+    REQUIRE(residency.stats().resident_size == layer_size);
+}
+
+
+TEST_CASE("Save lazily opened safetensor document", "[safetensor]")
+{
+    scoped_temp_directory tmpdir("safetensor");
+    auto model_path = tmpdir.path() / "model.safetensors";
+    auto saved_path = tmpdir.path() / "saved.safetensors";
+
+    std::vector<tensor<float, 2>> weights;
+    safetensor_document document;
+    for (std::size_t i = 0; i < 4; i++) {
+        weights.push_back(rand<float>({64, 1024}));
+        document.insert(std::format("layers.{}.attention.weight", i), weights.back());
+    }
+    document.save(model_path);
+
+    // The budget is smaller than two layers, so layers are evicted while the document is
+    // written, and every task keeps its layer acquired until the layer is written.
+    auto layer_size = weights[0].numel() * sizeof(float);
+    residency_manager residency(layer_size + layer_size / 2);
+    auto doc = safetensor_document::open(model_path, residency);
+
+    thread_pool pool(2);
+    safetensor_save_options options;
+    options.hash = true;
+    doc.save(saved_path, pool, options);
+
+    auto stats = residency.stats();
+    REQUIRE(stats.evictions > 0);
+    REQUIRE(stats.resident_size <= residency.budget());
+
+    auto saved = safetensor_document::open(saved_path);
+    for (std::size_t i = 0; i < weights.size(); i++) {
+        tensor<float, 2> actual;
+        saved.load(std::format("layers.{}.attention.weight", i), actual);
+        REQUIRE(std::memcmp(actual.data_ptr(), weights[i].data_ptr(), layer_size) == 0);
+    }
+}
+
+
+TEST_CASE("Compile safetensor document", "[safetensor]")
+{
+    struct model : public nn::basic_layer {
+        model(hardware_accelerator& accelerator)
+        : nn::basic_layer(accelerator)
+        {
+            auto weight = rand<float>({10, 20});
+
+            register_layer<linear_layer<float>>("input", weight);
+            register_layer<linear_layer<float>>("output", weight);
+        }
+    };
+
+    scoped_temp_directory tmpdir("safetensor");
+    auto source_path = tmpdir.path() / "model.safetensors";
+    auto compiled_path = compiled_safetensor::compiled_path(source_path);
+
+    REQUIRE(compiled_path.filename() == "model.compiled.safetensors");
+
+    auto index_path = std::filesystem::path("model.safetensors.index.json");
+    REQUIRE(compiled_safetensor::compiled_path(index_path) == compiled_path.filename());
+
+    // Only known suffixes are removed, so versioned names don't collide.
+    auto v2_path = compiled_safetensor::compiled_path("model.v2.safetensors");
+    auto v3_path = compiled_safetensor::compiled_path("model.v3.safetensors.index.json");
+    REQUIRE(v2_path == "model.v2.compiled.safetensors");
+    REQUIRE(v3_path == "model.v3.compiled.safetensors");
+    REQUIRE(compiled_safetensor::compiled_path("model.bin") == "model.bin.compiled.safetensors");
+
+    hardware_accelerator accelerator;
+    nn::indirect_layer<model> model_out(accelerator);
+    safetensor_document::save(source_path, model_out);
+
+    REQUIRE_FALSE(compiled_safetensor::is_current(compiled_path, source_path, "test.1"));
+    compiled_safetensor::save(compiled_path, *model_out, source_path, "test.1");
+    REQUIRE(compiled_safetensor::is_current(compiled_path, source_path, "test.1"));
+
+    // Documents compiled with another adaptation of weights are stale.
+    REQUIRE_FALSE(compiled_safetensor::is_current(compiled_path, source_path, "test.2"));
+
+    // Tied weights are stored only once, and restored from the metadata.
+    auto doc = safetensor_document::open(compiled_path);
+    REQUIRE(std::distance(doc.begin(), doc.end()) == 1);
+
+    compiled_safetensor::link(doc);
+    REQUIRE(std::distance(doc.begin(), doc.end()) == 2);
+
+    nn::indirect_layer<model> model_in(accelerator);
+    doc.load(model_in);
+
+    auto& input = model_in.parameter("input.weight");
+    auto& output = model_in.parameter("output.weight");
+    REQUIRE(input.container_ptr() == output.container_ptr());
+
+    // Modification of the source document makes the compiled document stale.
+    std::ofstream(source_path, std::ios::app) << "\n";
+    REQUIRE_FALSE(compiled_safetensor::is_current(compiled_path, source_path, "test.1"));
+}
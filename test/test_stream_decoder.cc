@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <metalchat/text/stream_decoder.h>
+
+
+using namespace metalchat;
+
+
+TEST_CASE("Stream ASCII tokens", "[stream_decoder]")
+{
+    text::utf8_stream_decoder decoder;
+    decoder.append("Hello");
+    REQUIRE(decoder.take() == "Hello");
+
+    decoder.append(", world");
+    REQUIRE(decoder.take() == ", world");
+    REQUIRE(decoder.take() == "");
+    REQUIRE(decoder.flush() == "");
+}
+
+
+TEST_CASE("Stream split multi-byte characters", "[stream_decoder]")
+{
+    // The llama emoji (U+1F999) is split between three byte-level tokens.
+    const std::string llama = "\xf0\x9f\xa6\x99";
+
+    text::utf8_stream_decoder decoder;
+    decoder.append("a");
+    decoder.append(llama.substr(0, 1));
+    REQUIRE(decoder.take() == "a");
+
+    decoder.append(llama.substr(1, 2));
+    REQUIRE(decoder.take() == "");
+    REQUIRE(decoder.pending() == llama.substr(0, 3));
+
+    decoder.append(llama.substr(3) + "b\xc3");
+    REQUIRE(decoder.take() == llama + "b");
+
+    decoder.append("\xa9");
+    REQUIRE(decoder.take() == "\xc3\xa9");
+}
+
+
+TEST_CASE("Stream malformed bytes", "[stream_decoder]")
+{
+    text::utf8_stream_decoder decoder;
+
+    // Continuation bytes without a leading byte are passed through.
+    decoder.append("\x80\x80\x80\x80");
+    REQUIRE(decoder.take() == "\x80\x80\x80\x80");
+
+    // Leading byte that is followed by an ASCII character does not stall the stream.
+    decoder.append("\xe2z");
+    REQUIRE(decoder.take() == "\xe2z");
+
+    // Incomplete character at the end of the stream is returned on flush.
+    decoder.append("\xe2\x82");
+    REQUIRE(decoder.take() == "");
+    REQUIRE(decoder.flush() == "\xe2\x82");
+}
+
+
+TEST_CASE("Stream rollback", "[stream_decoder]")
+{
+    text::utf8_stream_decoder decoder;
+    auto output = decoder.begin();
+
+    *output = std::string("Hello");
+    ++output;
+    REQUIRE(decoder.take() == "Hello");
+
+    *output = std::string(" world<|eot|>");
+    ++output;
+
+    auto stop = std::string_view("<|eot|>");
+    REQUIRE(decoder.pending().ends_with(stop));
+
+    decoder.rollback(stop.size());
+    REQUIRE(decoder.take() == " world");
+    REQUIRE_THROWS_AS(decoder.rollback(1), std::invalid_argument);
+}
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <metalchat/thread_pool.h>
+
+
+using namespace metalchat;
+
+
+TEST_CASE("Thread pool push tasks", "[thread_pool]")
+{
+    thread_pool pool(4);
+    REQUIRE(pool.size() == 4);
+
+    std::vector<std::future<std::size_t>> futures;
+    for (std::size_t i = 0; i < 100; i++) {
+        futures.push_back(pool.push([i] { return i * i; }));
+    }
+
+    for (std::size_t i = 0; i < futures.size(); i++) {
+        REQUIRE(futures[i].get() == i * i);
+    }
+
+    auto future = pool.push([] { throw std::runtime_error("task failed"); });
+    REQUIRE_THROWS_AS(future.get(), std::runtime_error);
+}
+
+
+TEST_CASE("Thread pool parallel for", "[thread_pool]")
+{
+    thread_pool pool(4);
+    std::vector<std::size_t> output(10000, 0);
+
+    pool.parallel_for(output.size(), [&](std::size_t i) { output[i] = i + 1; });
+
+    for (std::size_t i = 0; i < output.size(); i++) {
+        REQUIRE(output[i] == i + 1);
+    }
+
+    REQUIRE_NOTHROW(pool.parallel_for(0, [](std::size_t) {}));
+}
+
+
+TEST_CASE("Thread pool nested parallel for", "[thread_pool]")
+{
+    thread_pool pool(2);
+    std::atomic<std::size_t> count = 0;
+
+    pool.parallel_for(16, [&](std::size_t) {
+        pool.parallel_for(100, [&](std::size_t) { count++; });
+    });
+
+    REQUIRE(count == 1600);
+}
+
+
+TEST_CASE("Thread pool parallel for exception", "[thread_pool]")
+{
+    thread_pool pool(4);
+
+    auto fn = [](std::size_t i) {
+        if (i == 7) {
+            throw std::invalid_argument("invalid index");
+        }
+    };
+
+    REQUIRE_THROWS_AS(pool.parallel_for(100, fn), std::invalid_argument);
+}
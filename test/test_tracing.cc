@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: 2026 Yakau Bubnou
+// SPDX-FileType: SOURCE
+
+#include <sstream>
+
+#include <catch2/catch_test_macros.hpp>
+#include <jsoncons/json.hpp>
+
+#include <metalchat/accelerator.h>
+#include <metalchat/allocator.h>
+#include <metalchat/nn.h>
+#include <metalchat/tracing.h>
+
+
+using namespace metalchat;
+
+
+using tracing_allocator = tracing_allocator_adapter<random_memory_allocator<void>>;
+
+
+/// A layer that allocates a single host buffer on invocation.
+struct buffer_layer : public nn::basic_layer {
+    tracing_allocator alloc;
+    std::size_t size;
+
+    buffer_layer(tracing_allocator alloc, std::size_t size, hardware_accelerator& accelerator)
+    : nn::basic_layer(accelerator),
+      alloc(alloc),
+      size(size)
+    {}
+
+    tracing_allocator::container_pointer
+    operator()()
+    {
+        return alloc.allocate(size);
+    }
+};
+
+
+/// A layer that keeps buffers of both upstream layers alive at the same time.
+struct block_layer : public nn::basic_layer {
+    nn::indirect_layer<buffer_layer> proj;
+    nn::indirect_layer<buffer_layer> norm;
+
+    block_layer(tracing_allocator alloc, hardware_accelerator& accelerator)
+    : nn::basic_layer(accelerator)
+    {
+        proj = register_layer<buffer_layer>("proj", alloc, 1024);
+        norm = register_layer<buffer_layer>("norm", alloc, 256);
+    }
+
+    std::size_t
+    operator()()
+    {
+        auto proj_ptr = proj();
+        auto norm_ptr = norm();
+        return proj_ptr->size() + norm_ptr->size();
+    }
+};
+
+
+struct model_layer : public nn::basic_layer {
+    tracing_allocator alloc;
+    nn::indirect_layer<block_layer> encoder;
+    nn::indirect_layer<block_layer> decoder;
+
+    model_layer(tracing_allocator alloc, hardware_accelerator& accelerator)
+    : nn::basic_layer(accelerator),
+      alloc(alloc)
+    {
+        encoder = register_layer<block_layer>("encoder", alloc);
+        decoder = register_layer<block_layer>("decoder", alloc);
+    }
+
+    void
+    operator()()
+    {
+        auto hidden_ptr = alloc.allocate(512);
+        encoder();
+        decoder();
+    }
+};
+
+
+struct stack_layer : public nn::basic_layer {
+    using BlockArray = nn::layer_array<block_layer>;
+
+    nn::indirect_layer<BlockArray> layers;
+
+    stack_layer(tracing_allocator alloc, hardware_accelerator& accelerator)
+    : nn::basic_layer(accelerator)
+    {
+        layers = register_layer<BlockArray>("layers");
+        layers->emplace_back(alloc, accelerator);
+        layers->emplace_back(alloc, accelerator);
+    }
+
+    void
+    operator()()
+    {
+        for (std::size_t i = 0; i < layers->size(); i++) {
+            layers(i);
+        }
+    }
+};
+
+
+TEST_CASE("Allocation scope", "[tracing]")
+{
+    REQUIRE(allocation_scope::current() == "");
+
+    const allocation_scope scope0("model");
+    {
+        const allocation_scope scope1("");
+        const allocation_scope scope2("layers");
+        const allocation_scope scope3("0", '/');
+        REQUIRE(allocation_scope::current() == "model.layers/0");
+    }
+
+    REQUIRE(allocation_scope::current() == "model");
+}
+
+
+TEST_CASE("Trace allocations of layers", "[tracing]")
+{
+    hardware_accelerator accelerator;
+    auto alloc = tracing_allocator(random_memory_allocator<void>());
+    auto model = nn::indirect_layer<model_layer>(alloc, accelerator);
+
+    {
+        const allocation_scope scope("model");
+        model();
+    }
+
+    auto& trace = alloc.trace();
+    REQUIRE(trace.peak_bytes() == 512 + 1024 + 256);
+    REQUIRE(trace.bytes_in_use() == 0);
+    REQUIRE(trace.events().size() == 10);
+
+    auto tag_stats = trace.tag_stats();
+    REQUIRE(tag_stats.size() == 5);
+    REQUIRE(tag_stats.at("model").bytes_at_peak == 512);
+    REQUIRE(tag_stats.at("model.encoder.proj").bytes_at_peak == 1024);
+    REQUIRE(tag_stats.at("model.encoder.norm").bytes_at_peak == 256);
+    REQUIRE(tag_stats.at("model.decoder.proj").bytes_at_peak == 0);
+    REQUIRE(tag_stats.at("model.decoder.proj").peak_bytes == 1024);
+    REQUIRE(tag_stats.at("model.decoder.norm").allocations == 1);
+
+    auto events = trace.events();
+    REQUIRE(events[0].type == allocation_event_type::allocate);
+    REQUIRE(events[0].tag == "model");
+    REQUIRE(events[1].tag == "model.encoder.proj");
+    REQUIRE(events.back().type == allocation_event_type::free);
+    REQUIRE(events.back().tag == "model");
+    REQUIRE(events.back().timestamp >= events.front().timestamp);
+
+    std::stringstream timeline;
+    trace.write_json(timeline);
+
+    auto document = jsoncons::json::parse(timeline.str());
+    REQUIRE(document["peak_bytes"].as<std::size_t>() == 1792);
+    REQUIRE(document["events"].size() == 10);
+    REQUIRE(document["events"][1]["tag"].as<std::string>() == "model.encoder.proj");
+    REQUIRE(document["tags"]["model.encoder.norm"]["peak_bytes"].as<std::size_t>() == 256);
+
+    // Allocations are not recorded, when the trace is disabled.
+    trace.disable();
+    model();
+    REQUIRE(trace.events().size() == 10);
+
+    trace.enable();
+    trace.clear();
+    model();
+    REQUIRE(trace.peak_bytes() == 1792);
+    REQUIRE(trace.tag_stats().at("encoder.proj").peak_bytes == 1024);
+}
+
+
+TEST_CASE("Trace allocations of layer arrays", "[tracing]")
+{
+    hardware_accelerator accelerator;
+    auto alloc = tracing_allocator(random_memory_allocator<void>());
+    auto model = nn::indirect_layer<stack_layer>(alloc, accelerator);
+
+    model();
+
+    auto& trace = alloc.trace();
+    REQUIRE(trace.peak_bytes() == 1024 + 256);
+    REQUIRE(trace.events().size() == 8);
+
+    auto tag_stats = trace.tag_stats();
+    REQUIRE(tag_stats.size() == 4);
+    REQUIRE(tag_stats.at("layers.0.proj").peak_bytes == 1024);
+    REQUIRE(tag_stats.at("layers.0.norm").peak_bytes == 256);
+    REQUIRE(tag_stats.at("layers.1.proj").allocations == 1);
+    REQUIRE(tag_stats.at("layers.1.norm").allocations == 1);
+
+    auto events = trace.events();
+    REQUIRE(events[0].tag == "layers.0.proj");
+    REQUIRE(events[4].tag == "layers.1.proj");
+}